@@ -0,0 +1,518 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// headless throughput benchmark: runs a rom for a fixed number of frames as fast as the host allows
+// and reports emulation throughput along with the distribution of host time spent per frame
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../emu/nsgbe.h"
+
+#define DEFAULT_FRAMES        3600 // one emulated minute
+#define DEFAULT_WARMUP_FRAMES 120
+
+#define CPU_CLOCK_HZ 4194304.0
+
+// nsgbe-bench <rom> [--frames <n>] [--warmup <n>] [--movie <movie> | --script <script>] [--json <file>]
+//                   [--hotspots <file>] [--collapsed <file>] [--trace <file>] [--hashes <file>] [--check-hashes <file>]
+//
+// a script holds one input change per line: the frame it applies from (counting from the first warm-up frame)
+// and the buttons held from then on, '+'-separated, or '-' for none, e.g. "300 START" or "420 A+RIGHT";
+// lines starting with '#' are ignored. changes have to be listed in ascending frame order
+//
+// --hotspots and --collapsed profile the guest code over the measured frames (see nsgbe_hotspots_write()),
+// with the labels of the rom's .sym file next to it, if there is one. --trace writes a timeline of the measured
+// frames (see nsgbe_trace_start())
+//
+// --hashes writes a line of hashes of the frame, ram and cpu registers for every frame, warm-up included (see
+// nsgbe_frame_hash_enable()); --check-hashes compares every frame against such a file, written by another build, and
+// reports the first frame where they differ. a fifo lets two builds run in lockstep:
+// $ mkfifo h && nsgbe-bench-a rom --hashes h & nsgbe-bench-b rom --check-hashes h
+struct SCRIPT_ENTRY {
+    uint32_t frame;
+    union BUTTON_STATE buttons;
+};
+
+struct SCRIPT {
+    struct SCRIPT_ENTRY *entries;
+    uint32_t count;
+    uint32_t next;
+};
+
+struct HASH_LOG {
+    FILE *output;
+    FILE *reference;
+    _Bool reference_ended;
+    _Bool diverged;
+    uint32_t matched;
+    struct NSGBE_FRAME_HASH expected; // at the first divergence
+    struct NSGBE_FRAME_HASH actual;
+};
+
+struct RESULTS {
+    uint32_t frames;
+    double seconds;
+    uint64_t instructions;
+    uint64_t clock_cycles;
+    double frame_p50_us;
+    double frame_p99_us;
+    double frame_max_us;
+};
+
+static _Bool parse_button(const char *name, size_t length, union BUTTON_STATE *state)
+{
+#define BUTTON(button) \
+    if (length == strlen(#button) && strncmp(name, #button, length) == 0) \
+    { \
+        state->button = 1; \
+        return 1; \
+    }
+
+    BUTTON(A)
+    BUTTON(B)
+    BUTTON(START)
+    BUTTON(SELECT)
+    BUTTON(UP)
+    BUTTON(DOWN)
+    BUTTON(LEFT)
+    BUTTON(RIGHT)
+
+#undef BUTTON
+
+    return 0;
+}
+
+static _Bool script_parse_line(char *line, struct SCRIPT_ENTRY *entry)
+{
+    char buttons[128];
+
+    if (sscanf(line, "%u %127s", &entry->frame, buttons) != 2)
+        return 0;
+
+    entry->buttons.b = 0;
+
+    if (strcmp(buttons, "-") == 0)
+        return 1;
+
+    for (char *name = buttons; *name; )
+    {
+        size_t length = strcspn(name, "+");
+
+        if (!parse_button(name, length, &entry->buttons))
+            return 0;
+
+        name += length + (name[length] == '+');
+    }
+
+    return 1;
+}
+
+static int script_load(struct SCRIPT *script, char *path)
+{
+    FILE *file = fopen(path, "r");
+
+    if (!file)
+    {
+        printf("Error trying to open file: %s\n", path);
+        return NSGBE_ERR;
+    }
+
+    char line[256];
+    uint32_t capacity = 0, line_number = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+
+        char *start = line + strspn(line, " \t");
+
+        if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0')
+            continue;
+
+        if (script->count == capacity)
+        {
+            capacity = (capacity ? capacity * 2 : 64);
+            script->entries = realloc(script->entries, capacity * sizeof(struct SCRIPT_ENTRY));
+
+            if (!script->entries)
+                break;
+        }
+
+        struct SCRIPT_ENTRY *entry = &script->entries[script->count];
+
+        if (!script_parse_line(start, entry) || (script->count > 0 && entry->frame < entry[-1].frame))
+        {
+            printf("Invalid script line %u: %s", line_number, line);
+            fclose(file);
+            return NSGBE_ERR;
+        }
+
+        script->count++;
+    }
+
+    fclose(file);
+
+    return (script->entries || script->count == 0 ? NSGBE_OK : NSGBE_ERR);
+}
+
+__always_inline static void script_apply(struct SCRIPT *script, uint32_t frame)
+{
+    while (script->next < script->count && script->entries[script->next].frame <= frame)
+        nsgbe_set_buttons(script->entries[script->next++].buttons);
+}
+
+__always_inline static uint64_t time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of sorted values
+static double percentile_us(uint64_t *sorted, uint32_t count, double p)
+{
+    uint32_t rank = (uint32_t)(p / 100.0 * count + 0.999999);
+
+    if (rank < 1)
+        rank = 1;
+
+    return sorted[rank - 1] / 1000.0;
+}
+
+static void print_results(struct RESULTS *r)
+{
+    printf("frames:           %u\n", r->frames);
+    printf("host time:        %.3f s\n", r->seconds);
+    printf("frames/s:         %.1f (%.2fx real time)\n", r->frames / r->seconds, r->clock_cycles / r->seconds / CPU_CLOCK_HZ);
+    printf("instructions/s:   %.0f\n", r->instructions / r->seconds);
+    printf("T-cycles/s:       %.0f\n", r->clock_cycles / r->seconds);
+    printf("frame time p50:   %.1f us\n", r->frame_p50_us);
+    printf("frame time p99:   %.1f us\n", r->frame_p99_us);
+    printf("frame time max:   %.1f us\n", r->frame_max_us);
+}
+
+static int write_json(char *path, char *rompath, struct RESULTS *r)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        printf("Error trying to open file: %s\n", path);
+        return NSGBE_ERR;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"rom\": \"");
+
+    // paths are the only strings in here that may need escaping
+    for (char *c = rompath; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+
+        fputc(*c, file);
+    }
+
+    fprintf(file, "\",\n");
+    fprintf(file, "  \"frames\": %u,\n", r->frames);
+    fprintf(file, "  \"seconds\": %.6f,\n", r->seconds);
+    fprintf(file, "  \"frames_per_second\": %.3f,\n", r->frames / r->seconds);
+    fprintf(file, "  \"speed\": %.4f,\n", r->clock_cycles / r->seconds / CPU_CLOCK_HZ);
+    fprintf(file, "  \"instructions\": %llu,\n", (unsigned long long)r->instructions);
+    fprintf(file, "  \"instructions_per_second\": %.0f,\n", r->instructions / r->seconds);
+    fprintf(file, "  \"t_cycles\": %llu,\n", (unsigned long long)r->clock_cycles);
+    fprintf(file, "  \"t_cycles_per_second\": %.0f,\n", r->clock_cycles / r->seconds);
+    fprintf(file, "  \"frame_time_us\": { \"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f }\n",
+            r->frame_p50_us, r->frame_p99_us, r->frame_max_us);
+    fprintf(file, "}\n");
+
+    return (fclose(file) == 0 ? NSGBE_OK : NSGBE_ERR);
+}
+
+static void hash_log_on_frame(const struct NSGBE_FRAME_HASH *hash, void *user)
+{
+    struct HASH_LOG *log = user;
+
+    if (log->output)
+        fprintf(log->output, "%u %llu %016llx %016llx %016llx\n", hash->frame, (unsigned long long)hash->cycle,
+            (unsigned long long)hash->frame_hash, (unsigned long long)hash->ram_hash, (unsigned long long)hash->cpu_hash);
+
+    if (!log->reference || log->reference_ended)
+        return;
+
+    struct NSGBE_FRAME_HASH expected;
+    unsigned long long cycle, frame_hash, ram_hash, cpu_hash;
+
+    // lines keep getting read after a divergence, so a writer on the other end of a fifo never blocks
+    if (fscanf(log->reference, "%u %llu %llx %llx %llx", &expected.frame, &cycle, &frame_hash, &ram_hash, &cpu_hash) != 5)
+    {
+        log->reference_ended = 1;
+        return;
+    }
+
+    if (log->diverged)
+        return;
+
+    expected.cycle = cycle;
+    expected.frame_hash = frame_hash;
+    expected.ram_hash = ram_hash;
+    expected.cpu_hash = cpu_hash;
+
+    if (expected.frame == hash->frame && expected.cycle == hash->cycle && expected.frame_hash == hash->frame_hash
+        && expected.ram_hash == hash->ram_hash && expected.cpu_hash == hash->cpu_hash)
+    {
+        log->matched++;
+        return;
+    }
+
+    log->diverged = 1;
+    log->expected = expected;
+    log->actual = *hash;
+}
+
+static void print_hash_divergence(struct HASH_LOG *log)
+{
+    struct NSGBE_FRAME_HASH *e = &log->expected, *a = &log->actual;
+
+    printf("Hashes diverged after %u matching frames, at frame %u (cycle %llu):", log->matched, a->frame,
+        (unsigned long long)a->cycle);
+
+    if (e->frame != a->frame || e->cycle != a->cycle)
+        printf(" timing (expected frame %u, cycle %llu)", e->frame, (unsigned long long)e->cycle);
+
+    if (e->frame_hash != a->frame_hash)
+        printf(" frame");
+
+    if (e->ram_hash != a->ram_hash)
+        printf(" ram");
+
+    if (e->cpu_hash != a->cpu_hash)
+        printf(" cpu");
+
+    printf("\n\n");
+}
+
+// rgbds names the symbol file after the rom, e.g. game.gb -> game.sym
+static void load_symbols(char *rompath)
+{
+    size_t length = strlen(rompath);
+    char *dot = strrchr(rompath, '.');
+    char *sympath = malloc(length + 5);
+
+    if (!sympath)
+        return;
+
+    size_t stem = (dot && !strchr(dot, '/') ? (size_t)(dot - rompath) : length);
+    memcpy(sympath, rompath, stem);
+    strcpy(sympath + stem, ".sym");
+
+    if (nsgbe_hotspots_load_symbols(sympath))
+        printf("Loaded symbols: %s\n\n", sympath);
+
+    free(sympath);
+}
+
+static void print_usage()
+{
+    printf("usage: nsgbe-bench <rom> [--frames <n>] [--warmup <n>] [--movie <movie> | --script <script>] [--json <file>]\n");
+    printf("                   [--hotspots <file>] [--collapsed <file>] [--trace <file>] [--hashes <file>] [--check-hashes <file>]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || (argc % 2) != 0)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    char *rompath = argv[1];
+    char *moviepath = NULL;
+    char *scriptpath = NULL;
+    char *jsonpath = NULL;
+    char *hotspotspath = NULL;
+    char *collapsedpath = NULL;
+    char *tracepath = NULL;
+    char *hashespath = NULL;
+    char *checkhashespath = NULL;
+    uint32_t frames = DEFAULT_FRAMES;
+    uint32_t warmup_frames = DEFAULT_WARMUP_FRAMES;
+
+    for (int i = 2; i < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--frames") == 0)
+            frames = strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--warmup") == 0)
+            warmup_frames = strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--movie") == 0)
+            moviepath = argv[i + 1];
+        else if (strcmp(argv[i], "--script") == 0)
+            scriptpath = argv[i + 1];
+        else if (strcmp(argv[i], "--json") == 0)
+            jsonpath = argv[i + 1];
+        else if (strcmp(argv[i], "--hotspots") == 0)
+            hotspotspath = argv[i + 1];
+        else if (strcmp(argv[i], "--collapsed") == 0)
+            collapsedpath = argv[i + 1];
+        else if (strcmp(argv[i], "--trace") == 0)
+            tracepath = argv[i + 1];
+        else if (strcmp(argv[i], "--hashes") == 0)
+            hashespath = argv[i + 1];
+        else if (strcmp(argv[i], "--check-hashes") == 0)
+            checkhashespath = argv[i + 1];
+        else
+        {
+            printf("Unknown option: %s\n", argv[i]);
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (frames == 0 || (moviepath && scriptpath))
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    struct SCRIPT script = { 0 };
+
+    if (scriptpath && !script_load(&script, scriptpath))
+        return EXIT_FAILURE;
+
+    if (!nsgbe_load_rom_file(rompath) || !system_reset())
+        return EXIT_FAILURE;
+
+    if (moviepath && !nsgbe_movie_play(moviepath))
+    {
+        printf("Failed to start movie: %s\n", moviepath);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t *frame_times = malloc(frames * sizeof(uint64_t));
+
+    if (!frame_times)
+        return EXIT_FAILURE;
+
+    struct HASH_LOG hash_log = { 0 };
+
+    if (hashespath && !(hash_log.output = fopen(hashespath, "w")))
+    {
+        printf("Error trying to open file: %s\n", hashespath);
+        return EXIT_FAILURE;
+    }
+
+    if (checkhashespath && !(hash_log.reference = fopen(checkhashespath, "r")))
+    {
+        printf("Error trying to open file: %s\n", checkhashespath);
+        return EXIT_FAILURE;
+    }
+
+    if (hashespath || checkhashespath)
+        nsgbe_frame_hash_enable(NSGBE_HASH_FRAME | NSGBE_HASH_RAM | NSGBE_HASH_CPU, hash_log_on_frame, &hash_log);
+
+    for (uint32_t i = 0; i < warmup_frames; i++)
+    {
+        script_apply(&script, i);
+        nsgbe_run_frame();
+    }
+
+    if ((hotspotspath || collapsedpath) && nsgbe_hotspots_enable())
+        load_symbols(rompath);
+
+    if (tracepath && !nsgbe_trace_start(tracepath))
+    {
+        printf("Failed to start trace: %s\n", tracepath);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t instructions_before = nsgbe_instruction_count();
+    uint64_t cycles_before = nsgbe_cycle_count();
+    uint64_t start = time_ns();
+    uint64_t last = start;
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        script_apply(&script, warmup_frames + i);
+        nsgbe_run_frame();
+
+        uint64_t now = time_ns();
+        frame_times[i] = now - last;
+        last = now;
+    }
+
+    if (tracepath)
+    {
+        uint64_t dropped = nsgbe_trace_dropped();
+        nsgbe_trace_stop();
+
+        if (dropped)
+            printf("Note: the trace dropped %llu events.\n\n", (unsigned long long)dropped);
+    }
+
+    struct RESULTS results;
+    results.frames = frames;
+    results.seconds = (last - start) / 1e9;
+    results.instructions = nsgbe_instruction_count() - instructions_before;
+    results.clock_cycles = nsgbe_cycle_count() - cycles_before;
+
+    qsort(frame_times, frames, sizeof(uint64_t), compare_u64);
+
+    results.frame_p50_us = percentile_us(frame_times, frames, 50.0);
+    results.frame_p99_us = percentile_us(frame_times, frames, 99.0);
+    results.frame_max_us = frame_times[frames - 1] / 1000.0;
+
+    if (moviepath && nsgbe_movie_finished())
+        printf("Note: the movie ended during the run, the frames after its end ran without new input.\n\n");
+
+    print_results(&results);
+
+    int result = EXIT_SUCCESS;
+
+    nsgbe_frame_hash_disable();
+
+    if (hash_log.output && fclose(hash_log.output) != 0)
+        result = EXIT_FAILURE;
+
+    if (hash_log.reference)
+    {
+        printf("\n");
+
+        if (hash_log.diverged)
+        {
+            print_hash_divergence(&hash_log);
+            result = EXIT_FAILURE;
+        }
+        else if (hash_log.reference_ended)
+            printf("Hashes matched for all %u frames the reference has.\n", hash_log.matched);
+        else
+            printf("Hashes matched for all %u frames.\n", hash_log.matched);
+
+        fclose(hash_log.reference);
+    }
+
+    if (jsonpath && !write_json(jsonpath, rompath, &results))
+        result = EXIT_FAILURE;
+
+    if (hotspotspath && !nsgbe_hotspots_write(hotspotspath, NSGBE_HOTSPOTS_FLAT))
+        result = EXIT_FAILURE;
+
+    if (collapsedpath && !nsgbe_hotspots_write(collapsedpath, NSGBE_HOTSPOTS_COLLAPSED))
+        result = EXIT_FAILURE;
+
+    free(frame_times);
+    free(script.entries);
+
+    return result;
+}
@@ -0,0 +1,501 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// microbenchmarks of the core's hot paths: every benchmark runs one operation in a tight loop against a
+// synthetic cartridge, is warmed up while calibrating its iteration count and then timed over several samples
+
+#include <string.h>
+#include <math.h>
+
+#include "../../emu/env.h"
+
+#define DEFAULT_SAMPLES   15
+#define TARGET_SAMPLE_NS  1000000 // iterations per sample are doubled until a sample takes at least this long
+
+#define LINES_PER_FRAME   GB_FRAMEBUFFER_HEIGHT
+#define CYCLES_PER_FRAME  70224
+
+// instructions are executed from work ram; their memory operands point further into it, away from the code
+#define CODE_ADDRESS      0xC000
+#define DATA_ADDRESS      0xC880
+#define STACK_ADDRESS     0xCFF0
+
+struct BENCH;
+typedef void (*bench_fn)(struct BENCH *bench, uint32_t iterations);
+
+struct BENCH {
+    const char *group;
+    char name[40];
+    bench_fn run;
+    uint32_t ops;           // operations per iteration, results are reported per operation
+    struct nsgbe_ctx *ctx;
+    uint16_t address;
+    byte data;
+    byte opcode;
+    _Bool cb;
+};
+
+struct BENCH_STATS {
+    double min;
+    double median;
+    double mean;
+    double stddev;
+};
+
+static volatile byte sink;
+static struct CPU_REGS regs_template;
+
+__always_inline static uint64_t time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// xorshift32, fixed seed so every run sees the same synthetic data
+static uint32_t random_state = 0x2545F491;
+
+static byte random_byte()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state & 0xFF;
+}
+
+/*-----------------------SETUP-----------------------*/
+
+// 32kB mbc3 cartridge with 32kB of ram that loops at its entry point
+static void build_rom(byte *rom, size_t size, byte gbc_flag)
+{
+    memset(rom, 0x00, size);
+
+    const byte entry[] = { 0x00, 0xC3, 0x50, 0x01 }; // nop; jp 0x0150
+    memcpy(rom + 0x100, entry, sizeof(entry));
+    memcpy(rom + 0x134, "MICROBENCH", 10);
+
+    rom[0x143] = gbc_flag;
+    rom[0x147] = 0x13; // mbc3 + ram + battery
+    rom[0x148] = 0x00; // 32kB
+    rom[0x149] = 0x03; // 4 banks of 8kB
+
+    rom[0x150] = 0x18; // jr -2
+    rom[0x151] = 0xFE;
+
+    byte checksum = 0;
+
+    for (uint16_t i = 0x134; i <= 0x14C; i++)
+        checksum = checksum - rom[i] - 1;
+
+    rom[0x14D] = checksum;
+}
+
+// random tiles, maps, attributes, sprites and palettes with background, window and sprites enabled
+static void fill_video_memory()
+{
+    for (uint16_t i = 0x8000; i < 0xA000; i++)
+        CTX(mem).raw[i] = random_byte();
+
+    for (uint16_t i = 0; i < 0x2000; i++)
+        CTX(cgb_extra_vram_bank)[i] = random_byte();
+
+    // 40 sprites, spread over the screen
+    for (uint16_t i = 0; i < 40; i++)
+    {
+        CTX(mem).raw[OAM + i * 4 + 0] = 16 + (random_byte() % GB_FRAMEBUFFER_HEIGHT);
+        CTX(mem).raw[OAM + i * 4 + 1] = 8 + (random_byte() % GB_FRAMEBUFFER_WIDTH);
+        CTX(mem).raw[OAM + i * 4 + 2] = random_byte();
+        CTX(mem).raw[OAM + i * 4 + 3] = random_byte();
+    }
+
+    CTX(mem).raw[0xFF40] = 0xE3; // lcd, window (map 0x9C00), sprites and background on
+    CTX(mem).raw[0xFF47] = 0xE4;
+    CTX(mem).raw[0xFF48] = 0xD2;
+    CTX(mem).raw[0xFF49] = 0x1E;
+    CTX(mem).raw[0xFF4A] = 0x00; // window from the top..
+    CTX(mem).raw[0xFF4B] = 87;   // ..covering the right half of the screen
+
+    if (CTX(gb_mode) == MODE_CGB)
+    {
+        mem_write(BCPS, 0x80); // auto increment from index 0
+        mem_write(OCPS, 0x80);
+
+        for (uint16_t i = 0; i < 64; i++)
+        {
+            mem_write(BCPD, random_byte());
+            mem_write(OCPD, random_byte());
+        }
+    }
+}
+
+// registers point into work ram, flags are as after the dmg boot rom (Z, H and C set)
+static void init_regs_template()
+{
+    regs_template.AF = 0x01B0;
+    regs_template.BC = DATA_ADDRESS;
+    regs_template.DE = DATA_ADDRESS + 0x100;
+    regs_template.HL = DATA_ADDRESS + 0x200;
+    regs_template.SP = STACK_ADDRESS;
+    regs_template.PC = CODE_ADDRESS;
+}
+
+static struct nsgbe_ctx *create_machine(byte gbc_flag)
+{
+    static byte rom[0x8000];
+
+    struct nsgbe_ctx *ctx = nsgbe_ctx_create();
+
+    if (!ctx)
+        return NULL;
+
+    nsgbe_ctx_bind(ctx);
+
+    build_rom(rom, sizeof(rom), gbc_flag);
+
+    if (!nsgbe_load_rom(rom, sizeof(rom)) || !system_reset())
+    {
+        nsgbe_ctx_bind(NULL);
+        nsgbe_ctx_destroy(ctx);
+        return NULL;
+    }
+
+    fill_video_memory();
+
+    nsgbe_ctx_bind(NULL);
+
+    return ctx;
+}
+
+/*---------------------BENCHMARKS--------------------*/
+
+static void bench_mem_read(struct BENCH *bench, uint32_t iterations)
+{
+    uint16_t address = bench->address;
+    byte sum = 0;
+
+    for (uint32_t i = 0; i < iterations; i++)
+        sum += mem_read(address);
+
+    sink = sum;
+}
+
+static void bench_mem_write(struct BENCH *bench, uint32_t iterations)
+{
+    uint16_t address = bench->address;
+    byte data = bench->data;
+
+    for (uint32_t i = 0; i < iterations; i++)
+        mem_write(address, data);
+}
+
+// fetch, decode and execute a single instruction from a fixed register state
+static void bench_instruction(struct BENCH *bench, uint32_t iterations)
+{
+    CTX(mem).raw[CODE_ADDRESS + 0] = (bench->cb ? 0xCB : bench->opcode);
+    CTX(mem).raw[CODE_ADDRESS + 1] = (bench->cb ? bench->opcode : DATA_ADDRESS & 0xFF);
+    CTX(mem).raw[CODE_ADDRESS + 2] = DATA_ADDRESS >> 8;
+
+    CTX(mem).map.interrupt_flag_reg.b = 0;
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        CTX(cpu_regs) = regs_template;
+        CTX(cpu_int_halt) = 0;
+        CTX(interrupt_master_enable) = 0;
+
+        cpu_step();
+    }
+}
+
+// the register reset in bench_instruction on its own, to put the per-opcode numbers into perspective
+static void bench_instruction_overhead(struct BENCH *bench, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        CTX(cpu_regs) = regs_template;
+        CTX(cpu_int_halt) = 0;
+        CTX(interrupt_master_enable) = 0;
+
+        __asm__ volatile("" ::: "memory");
+    }
+}
+
+// every visible line once; the ppu renders a line as it enters vram read mode at its 81st cycle
+static void bench_render_scanline(struct BENCH *bench, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        CTX(window_internal_line_counter) = 0;
+
+        for (byte line = 0; line < LINES_PER_FRAME; line++)
+        {
+            CTX(mem).raw[LY] = line;
+            CTX(ppu_clock_cycle_counter) = 80;
+
+            ppu_step();
+        }
+    }
+}
+
+static void bench_io_step(struct BENCH *bench, uint32_t iterations)
+{
+    io_exec_cycles(iterations);
+}
+
+static void bench_ppu_frame(struct BENCH *bench, uint32_t iterations)
+{
+    for (uint32_t i = 0; i < iterations; i++)
+        ppu_exec_cycles(CYCLES_PER_FRAME);
+}
+
+/*---------------------RUNNER------------------------*/
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t run_sample(struct BENCH *bench, uint32_t iterations)
+{
+    uint64_t start = time_ns();
+    bench->run(bench, iterations);
+
+    return time_ns() - start;
+}
+
+static struct BENCH_STATS run_bench(struct BENCH *bench, uint32_t samples)
+{
+    nsgbe_ctx_bind(bench->ctx);
+
+    // calibrating doubles as warm-up; one more sample at the final count settles caches and branch predictors
+    uint32_t iterations = 1;
+
+    while (run_sample(bench, iterations) < TARGET_SAMPLE_NS && iterations < (1u << 30))
+        iterations *= 2;
+
+    run_sample(bench, iterations);
+
+    double ns_per_op[samples];
+    double sum = 0.0;
+
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        ns_per_op[i] = (double)run_sample(bench, iterations) / ((double)iterations * bench->ops);
+        sum += ns_per_op[i];
+    }
+
+    nsgbe_ctx_bind(NULL);
+
+    qsort(ns_per_op, samples, sizeof(double), compare_double);
+
+    struct BENCH_STATS stats;
+    stats.min = ns_per_op[0];
+    stats.median = ns_per_op[samples / 2];
+    stats.mean = sum / samples;
+
+    double variance = 0.0;
+
+    for (uint32_t i = 0; i < samples; i++)
+        variance += (ns_per_op[i] - stats.mean) * (ns_per_op[i] - stats.mean);
+
+    stats.stddev = sqrt(variance / samples);
+
+    return stats;
+}
+
+/*-----------------------SUITE-----------------------*/
+
+struct MEM_REGION {
+    const char *name;
+    uint16_t read_address;
+    uint16_t write_address; // writes to the rom area go to the mbc instead
+    byte write_data;
+};
+
+static const struct MEM_REGION mem_regions[] = {
+    { "rom0/mbc-rom-bank",  0x0150, 0x2100, 0x01 },
+    { "romx/mbc-ram-bank",  0x4150, 0x4100, 0x00 },
+    { "vram",               0x8800, 0x8800, 0x5A },
+    { "cart-ram",           0xA100, 0xA100, 0x5A },
+    { "wram0",              0xC100, 0xC100, 0x5A },
+    { "wramx",              0xD100, 0xD100, 0x5A },
+    { "echo",               0xE100, 0xE100, 0x5A },
+    { "oam",                0xFE10, 0xFE10, 0x5A },
+    { "io-joypad",          0xFF00, 0xFF00, 0x20 },
+    { "io-lcd",             0xFF44, 0xFF47, 0xE4 },
+    { "hram",               0xFF90, 0xFF90, 0x5A },
+    { "ie",                 0xFFFF, 0xFFFF, 0x00 },
+};
+
+static struct BENCH *benches;
+static uint32_t bench_count, bench_capacity;
+
+static struct BENCH *add_bench(const char *group, bench_fn run, uint32_t ops, struct nsgbe_ctx *ctx, const char *name)
+{
+    if (bench_count == bench_capacity)
+    {
+        bench_capacity = (bench_capacity ? bench_capacity * 2 : 256);
+        benches = realloc(benches, bench_capacity * sizeof(struct BENCH));
+
+        if (!benches)
+        {
+            printf("Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct BENCH *bench = &benches[bench_count++];
+    memset(bench, 0, sizeof(struct BENCH));
+
+    bench->group = group;
+    bench->run = run;
+    bench->ops = ops;
+    bench->ctx = ctx;
+    snprintf(bench->name, sizeof(bench->name), "%s", name);
+
+    return bench;
+}
+
+static void add_opcode_benches(const char *group, _Bool cb, struct nsgbe_ctx *ctx)
+{
+    nsgbe_ctx_bind(ctx);
+
+    for (uint16_t opcode = 0; opcode <= 0xFF; opcode++)
+    {
+        if (!cb && opcode == 0xCB)
+            continue;
+
+        CTX(mem).raw[CODE_ADDRESS + 0] = (cb ? 0xCB : opcode);
+        CTX(mem).raw[CODE_ADDRESS + 1] = opcode;
+
+        const char *description = cpu_instruction_description(CODE_ADDRESS);
+
+        // illegal opcodes stop the cpu
+        if (strcmp(description, "ILLEGAL INSTRUCTION") == 0)
+            continue;
+
+        char name[40];
+        snprintf(name, sizeof(name), "%s%02X %s", (cb ? "CB " : ""), opcode, description);
+
+        struct BENCH *bench = add_bench(group, bench_instruction, 1, ctx, name);
+        bench->opcode = opcode;
+        bench->cb = cb;
+    }
+
+    nsgbe_ctx_bind(NULL);
+}
+
+static void build_suite(struct nsgbe_ctx *dmg, struct nsgbe_ctx *cgb)
+{
+    char name[40];
+
+    for (uint32_t i = 0; i < sizeof(mem_regions) / sizeof(mem_regions[0]); i++)
+    {
+        const struct MEM_REGION *region = &mem_regions[i];
+
+        snprintf(name, sizeof(name), "read %s", region->name);
+        add_bench("mem", bench_mem_read, 1, dmg, name)->address = region->read_address;
+
+        snprintf(name, sizeof(name), "write %s", region->name);
+        struct BENCH *bench = add_bench("mem", bench_mem_write, 1, dmg, name);
+        bench->address = region->write_address;
+        bench->data = region->write_data;
+    }
+
+    add_bench("cpu", bench_instruction_overhead, 1, dmg, "(register reset only)");
+    add_opcode_benches("cpu", 0, dmg);
+    add_opcode_benches("cb", 1, dmg);
+
+    add_bench("render", bench_render_scanline, LINES_PER_FRAME, dmg, "scanline dmg");
+    add_bench("render", bench_render_scanline, LINES_PER_FRAME, cgb, "scanline cgb");
+
+    add_bench("io", bench_io_step, 1, dmg, "io_step dmg");
+    add_bench("io", bench_io_step, 1, cgb, "io_step cgb");
+
+    add_bench("ppu", bench_ppu_frame, 1, dmg, "frame dmg");
+    add_bench("ppu", bench_ppu_frame, 1, cgb, "frame cgb");
+}
+
+static void print_usage()
+{
+    printf("usage: nsgbe-microbench [--filter <group>] [--samples <n>]\n");
+    printf("groups: mem, cpu, cb, render, io, ppu\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    uint32_t samples = DEFAULT_SAMPLES;
+
+    if ((argc % 2) != 1)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--filter") == 0)
+            filter = argv[i + 1];
+        else if (strcmp(argv[i], "--samples") == 0)
+            samples = strtoul(argv[i + 1], NULL, 10);
+        else
+        {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (samples == 0)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    init_regs_template();
+
+    struct nsgbe_ctx *dmg = create_machine(0x00);
+    struct nsgbe_ctx *cgb = create_machine(0xC0);
+
+    if (!dmg || !cgb)
+    {
+        printf("Failed to set up the synthetic machines.\n");
+        return EXIT_FAILURE;
+    }
+
+    build_suite(dmg, cgb);
+
+    printf("\n%-8s %-28s %12s %12s %12s %8s\n", "group", "benchmark", "median ns", "min ns", "mean ns", "stddev");
+
+    const char *last_group = NULL;
+
+    for (uint32_t i = 0; i < bench_count; i++)
+    {
+        struct BENCH *bench = &benches[i];
+
+        if (filter && strcmp(filter, bench->group) != 0)
+            continue;
+
+        if (last_group && strcmp(last_group, bench->group) != 0)
+            printf("\n");
+
+        last_group = bench->group;
+
+        struct BENCH_STATS stats = run_bench(bench, samples);
+
+        printf("%-8s %-28s %12.2f %12.2f %12.2f %7.1f%%\n", bench->group, bench->name, stats.median, stats.min, stats.mean,
+               (stats.mean > 0.0 ? stats.stddev / stats.mean * 100.0 : 0.0));
+        fflush(stdout);
+    }
+
+    nsgbe_ctx_destroy(dmg);
+    nsgbe_ctx_destroy(cgb);
+    free(benches);
+
+    return EXIT_SUCCESS;
+}
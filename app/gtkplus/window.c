@@ -2,39 +2,39 @@
 //
 // SPDX-License-Identifier: LGPL-2.0-only
 
-#include <sys/time.h>
 #include <gtk/gtk.h>
+#include <signal.h>
 #include "../../emu/nsgbe.h"
 
-#define WINDOW_TITLE_FORMATTER "[ nsGBE ] [ %d fps ]"
+#define WINDOW_TITLE_FORMATTER "[ nsGBE ] [ %d fps ] [ %d%% ]"
 
 #define SCREEN_SCALE 3
-
-#define KEY_SPACE 0x20 // speed up
-#define KEY_K     0x6B // A
-#define KEY_O     0x6F // B
-#define KEY_L     0x6C // start
-#define KEY_P     0x70 // select
-#define KEY_W     0x77 // up
-#define KEY_S     0x73 // down
-#define KEY_A     0x61 // left
-#define KEY_D     0x64 // right
+#define SCREEN_SCALER NSGBE_SCALE_NEAREST // or NSGBE_SCALE_EPX, NSGBE_SCALE_XBR
+
+#define KEY_SPACE     0x20 // speed up
+#define KEY_TAB       0xFF09 // uncapped speed
+#define KEY_BACKSPACE 0xFF08 // rewind
+#define KEY_K         0x6B // A
+#define KEY_O         0x6F // B
+#define KEY_L         0x6C // start
+#define KEY_P         0x70 // select
+#define KEY_W         0x77 // up
+#define KEY_S         0x73 // down
+#define KEY_A         0x61 // left
+#define KEY_D         0x64 // right
 
 uint32_t *framebuffer;
 
-char title_buffer[32];
-uint16_t last_framecounter = 0;
+char title_buffer[48];
 
 GtkWidget *window;
 GtkWidget *display;
 static cairo_surface_t *surface;
 
-union BUTTON_STATE button_states;
+extern volatile sig_atomic_t exit_requested;
 
 static void close_window()
 {
-    write_battery();
-
     if (surface)
         cairo_surface_destroy(surface);
 }
@@ -55,28 +55,13 @@ void vblank()
 {
     framebuffer = display_request_next_frame();
 
-    cairo_t *cr;
-
-    clear_surface();
+    cairo_surface_flush(surface);
 
-    cr = cairo_create(surface);
-
-    for (int y = 0; y < GB_FRAMEBUFFER_HEIGHT; y++)
-    {
-        for (int x = 0; x < GB_FRAMEBUFFER_WIDTH; x++)
-        {
-            uint32_t color = *(framebuffer + (y * GB_FRAMEBUFFER_WIDTH + x));
-            uint8_t color_b = (color >> 16) & 0xFF;
-            uint8_t color_g = (color >> 8) & 0xFF;
-            uint8_t color_r = color & 0xFF;
-
-            cairo_set_source_rgb(cr, (float)color_r / 255.f, (float)color_g / 255.f, (float)color_b / 255.f);
-            cairo_rectangle(cr, x * SCREEN_SCALE, y * SCREEN_SCALE, SCREEN_SCALE, SCREEN_SCALE);
-            cairo_fill(cr);
-        }
-    }
+    // cairo's RGB24 wants red where the framebuffer has blue
+    nsgbe_scale(framebuffer, (uint32_t *)cairo_image_surface_get_data(surface), cairo_image_surface_get_width(surface), \
+      cairo_image_surface_get_height(surface), cairo_image_surface_get_stride(surface), SCREEN_SCALER | NSGBE_SCALE_SWAP_RB);
 
-    cairo_destroy(cr);
+    cairo_surface_mark_dirty(surface);
 }
 
 static gboolean setup_draw_surface(GtkWidget *widget, GdkEventConfigure *event, gpointer data)
@@ -84,7 +69,8 @@ static gboolean setup_draw_surface(GtkWidget *widget, GdkEventConfigure *event,
     if (surface)
         cairo_surface_destroy(surface);
 
-    surface = gdk_window_create_similar_surface(gtk_widget_get_window(widget), CAIRO_CONTENT_COLOR, gtk_widget_get_allocated_width(widget), \
+    // the frame gets scaled to whatever size the display is
+    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, gtk_widget_get_allocated_width(widget), \
       gtk_widget_get_allocated_height(widget));
 
     clear_surface();
@@ -99,7 +85,10 @@ static gboolean redraw_display(GtkWidget *widget, cairo_t *cr, gpointer data)
     cairo_set_source_surface(cr, surface, 0, 0);
     cairo_paint(cr);
 
-    sprintf(title_buffer, WINDOW_TITLE_FORMATTER, last_framecounter);
+    struct NSGBE_STATS stats;
+    nsgbe_stats(&stats);
+
+    sprintf(title_buffer, WINDOW_TITLE_FORMATTER, (int)(stats.emulated_fps + .5f), (int)(stats.speed + .5f));
     gtk_window_set_title(GTK_WINDOW(window), title_buffer);
 
     return FALSE;
@@ -166,45 +155,55 @@ static void draw_hi()
 
 static gint handle_key_press(GtkWidget *widget, GdkEventKey *event, gpointer data)
 {
+    union BUTTON_STATE *buttons = nsgbe_ctx_button_states(nsgbe_ctx_bound());
+
     //if (event->length > 0)
         //printf("pressed (string) 0x%02X\n", event->keyval);
 
     switch (event->keyval)
     {
         case KEY_SPACE:
-            system_overclock = 1;
+            system_set_speed(4.f);
+            break;
+
+        case KEY_TAB:
+            system_set_speed(NSGBE_SPEED_UNCAPPED);
+            break;
+
+        case KEY_BACKSPACE:
+            system_set_rewinding(1);
             break;
 
         case KEY_K:
-            button_states.A = 1;
+            buttons->A = 1;
             break;
 
         case KEY_O:
-            button_states.B = 1;
+            buttons->B = 1;
             break;
 
         case KEY_L:
-            button_states.START = 1;
+            buttons->START = 1;
             break;
 
         case KEY_P:
-            button_states.SELECT = 1;
+            buttons->SELECT = 1;
             break;
 
         case KEY_W:
-            button_states.UP = 1;
+            buttons->UP = 1;
             break;
 
         case KEY_S:
-            button_states.DOWN = 1;
+            buttons->DOWN = 1;
             break;
 
         case KEY_A:
-            button_states.LEFT = 1;
+            buttons->LEFT = 1;
             break;
 
         case KEY_D:
-            button_states.RIGHT = 1;
+            buttons->RIGHT = 1;
             break;
 
         default:
@@ -214,45 +213,55 @@ static gint handle_key_press(GtkWidget *widget, GdkEventKey *event, gpointer dat
 
 static gint handle_key_release(GtkWidget *widget, GdkEventKey *event, gpointer data)
 {
+    union BUTTON_STATE *buttons = nsgbe_ctx_button_states(nsgbe_ctx_bound());
+
     //if (event->length > 0)
         //printf("released (string) 0x%02X\n", event->keyval);
 
     switch (event->keyval)
     {
         case KEY_SPACE:
-            system_overclock = 0;
+            system_set_speed(1.f);
+            break;
+
+        case KEY_TAB:
+            system_set_speed(1.f);
+            break;
+
+        case KEY_BACKSPACE:
+            system_set_rewinding(0);
             break;
 
         case KEY_K:
-            button_states.A = 0;
+            buttons->A = 0;
             break;
 
         case KEY_O:
-            button_states.B = 0;
+            buttons->B = 0;
             break;
 
         case KEY_L:
-            button_states.START = 0;
+            buttons->START = 0;
             break;
 
         case KEY_P:
-            button_states.SELECT = 0;
+            buttons->SELECT = 0;
             break;
 
         case KEY_W:
-            button_states.UP = 0;
+            buttons->UP = 0;
             break;
 
         case KEY_S:
-            button_states.DOWN = 0;
+            buttons->DOWN = 0;
             break;
 
         case KEY_A:
-            button_states.LEFT = 0;
+            buttons->LEFT = 0;
             break;
 
         case KEY_D:
-            button_states.RIGHT = 0;
+            buttons->RIGHT = 0;
             break;
 
         default:
@@ -260,6 +269,15 @@ static gint handle_key_release(GtkWidget *widget, GdkEventKey *event, gpointer d
     }
 }
 
+// a signal asked to quit, see catch_exit() in main.c
+static gboolean poll_exit_request(gpointer data)
+{
+    if (exit_requested)
+        gtk_window_close(GTK_WINDOW(window));
+
+    return G_SOURCE_CONTINUE;
+}
+
 static void activate(GtkApplication* app, gpointer user_data)
 {
     window = gtk_application_window_new(app);
@@ -282,32 +300,12 @@ static void activate(GtkApplication* app, gpointer user_data)
     gtk_container_add(GTK_CONTAINER(window), display);
 
     gtk_widget_show_all(window);
+
+    g_timeout_add(100, poll_exit_request, NULL);
 }
 
-long time_start;
-uint16_t framecounter = 0;
 void handle_vblank()
 {
-    struct timeval tv;
-    long time_now;
-
-    gettimeofday(&tv, NULL);
-    time_now = (1000000 * tv.tv_sec + tv.tv_usec);
-
-    if (time_start == 0)
-        time_start = time_now;
-
-    if (time_now - time_start > 1000000)
-    {
-        time_start = time_now;
-        last_framecounter = framecounter;
-        framecounter = 0;
-    }
-    else
-    {
-        framecounter++;
-    }
-
     if (display)
         gtk_widget_queue_draw(display);
 }
@@ -317,7 +315,7 @@ int gui_main(int argc, char **argv)
     GtkApplication *app;
     int status;
 
-    display_notify_vblank = &handle_vblank;
+    *nsgbe_ctx_display_notify_vblank(nsgbe_ctx_bound()) = &handle_vblank;
 
     app = gtk_application_new("com.noeliel.nsgbe", G_APPLICATION_FLAGS_NONE);
     g_signal_connect(app, "activate", G_CALLBACK(activate), NULL);
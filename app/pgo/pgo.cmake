@@ -0,0 +1,32 @@
+# SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+#
+# SPDX-License-Identifier: LGPL-2.0-only
+
+# profile-guided optimisation stages, driven by app/pgo/CMakeLists.txt.
+# GENERATE instruments the build, a training run then writes its profile to NSGBE_PGO_DIR, and USE rebuilds with it
+# (plus link-time optimisation). the core has to be built as the nsgbe_core library for the profile to match:
+# gcc names profile files after the object files they belong to, minus the build directory
+set(NSGBE_PGO "OFF" CACHE STRING "Profile-guided optimisation stage (OFF, GENERATE or USE)")
+set(NSGBE_PGO_DIR "${CMAKE_BINARY_DIR}/profile" CACHE PATH "Profile of the training run")
+
+if(NSGBE_PGO STREQUAL "GENERATE")
+  if(CMAKE_C_COMPILER_ID MATCHES "Clang")
+    set(NSGBE_PGO_FLAGS "-fprofile-generate=${NSGBE_PGO_DIR}")
+  else()
+    set(NSGBE_PGO_FLAGS "-fprofile-generate=${NSGBE_PGO_DIR} -fprofile-prefix-path=${CMAKE_BINARY_DIR}")
+  endif()
+
+  string(APPEND CMAKE_C_FLAGS " ${NSGBE_PGO_FLAGS}")
+  string(APPEND CMAKE_EXE_LINKER_FLAGS " ${NSGBE_PGO_FLAGS}")
+elseif(NSGBE_PGO STREQUAL "USE")
+  # code the training run never reached (the gui, mostly) stays optimised for speed
+  if(CMAKE_C_COMPILER_ID MATCHES "Clang")
+    string(APPEND CMAKE_C_FLAGS " -fprofile-use=${NSGBE_PGO_DIR}/default.profdata")
+  else()
+    string(APPEND CMAKE_C_FLAGS " -fprofile-use=${NSGBE_PGO_DIR} -fprofile-prefix-path=${CMAKE_BINARY_DIR} -fprofile-partial-training")
+  endif()
+
+  set(CMAKE_INTERPROCEDURAL_OPTIMIZATION ON)
+elseif(NOT NSGBE_PGO STREQUAL "OFF")
+  message(FATAL_ERROR "NSGBE_PGO has to be OFF, GENERATE or USE")
+endif()
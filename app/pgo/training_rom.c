@@ -0,0 +1,432 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// generates the rom the pgo training run plays (see CMakeLists.txt next to this file)
+
+// the program keeps the core's hot paths busy the way games do: background, window and 40 sprites on screen, vblank /
+// lcd stat / timer interrupts, oam dma every frame, alu and cb-prefixed instructions over work ram, calls and the
+// stack, reads through every rom bank, cart ram traffic and joypad polling, then halts until the next interrupt.
+// the cgb variant additionally sets up tile attributes, color palettes and runs a general purpose vram dma per frame
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ROM_BANKS 8 // 128 kB
+#define ROM_SIZE  (ROM_BANKS * 0x4000)
+
+#define DMA_ROUTINE_SIZE 10
+
+// jr conditions
+#define JR    0x18
+#define JR_NZ 0x20
+#define JR_Z  0x28
+#define JR_NC 0x30
+#define JR_C  0x38
+
+enum LABEL {
+    L_VBLANK,
+    L_STAT,
+    L_TIMER,
+    L_START,
+    L_COPY_DMA,
+    L_FILL_MAP,
+    L_FILL_ATTRS,
+    L_BG_PALETTES,
+    L_OBJ_PALETTES,
+    L_SPRITES,
+    L_MAIN,
+    L_ALU,
+    L_ALU_SKIP,
+    L_BITS,
+    L_BITS_SKIP,
+    L_WIDE,
+    L_BANKS,
+    L_BANK_SUM,
+    L_CART_RAM,
+    L_SUBROUTINE,
+    L_MOVE_SPRITES,
+    L_MEMCPY,
+    L_DMA_ROUTINE,
+    LABEL_COUNT
+};
+
+struct FIXUP {
+    uint32_t offset;
+    enum LABEL label;
+    _Bool relative;
+};
+
+static uint8_t rom[ROM_SIZE];
+static uint32_t here;
+static int32_t labels[LABEL_COUNT];
+static struct FIXUP fixups[256];
+static uint32_t fixup_count;
+
+static void emit(const uint8_t *bytes, size_t length)
+{
+    memcpy(rom + here, bytes, length);
+    here += length;
+}
+
+#define DB(...) emit((const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void label(enum LABEL l)
+{
+    labels[l] = here;
+}
+
+static void fixup(enum LABEL l, _Bool relative)
+{
+    fixups[fixup_count++] = (struct FIXUP) { .offset = here - (relative ? 1 : 2), .label = l, .relative = relative };
+}
+
+static void jr(uint8_t condition, enum LABEL l)
+{
+    DB(condition, 0x00);
+    fixup(l, 1);
+}
+
+// jp, call and ld rr, nn to a label
+static void absolute(uint8_t opcode, enum LABEL l)
+{
+    DB(opcode, 0x00, 0x00);
+    fixup(l, 0);
+}
+
+static int resolve()
+{
+    for (uint32_t i = 0; i < fixup_count; i++)
+    {
+        struct FIXUP *f = &fixups[i];
+        int32_t target = labels[f->label];
+
+        if (target < 0)
+        {
+            fprintf(stderr, "undefined label %d\n", f->label);
+            return 0;
+        }
+
+        if (f->relative)
+        {
+            int32_t distance = target - (int32_t)(f->offset + 1);
+
+            if (distance < -128 || distance > 127)
+            {
+                fprintf(stderr, "jr to label %d out of range\n", f->label);
+                return 0;
+            }
+
+            rom[f->offset] = (uint8_t)distance;
+        }
+        else
+        {
+            rom[f->offset] = target & 0xFF;
+            rom[f->offset + 1] = target >> 8;
+        }
+    }
+
+    return 1;
+}
+
+static void program(_Bool cgb)
+{
+    // interrupt vectors and entry point
+    here = 0x40;
+    absolute(0xC3, L_VBLANK);           // jp vblank
+    here = 0x48;
+    absolute(0xC3, L_STAT);             // jp stat
+    here = 0x50;
+    absolute(0xC3, L_TIMER);            // jp timer
+    here = 0x100;
+    DB(0x00);                           // nop
+    absolute(0xC3, L_START);            // jp start
+
+    here = 0x150;
+    label(L_START);
+    DB(0xF3);                           // di
+    DB(0x31, 0xFE, 0xFF);               // ld sp, $FFFE
+    DB(0xAF, 0xE0, 0x40);               // xor a ; ldh (LCDC), a            -- lcd off while setting up
+
+    // oam dma routine to hram
+    absolute(0x21, L_DMA_ROUTINE);      // ld hl, dma_routine
+    DB(0x0E, 0x80);                     // ld c, $80
+    DB(0x06, DMA_ROUTINE_SIZE);         // ld b, DMA_ROUTINE_SIZE
+    label(L_COPY_DMA);
+    DB(0x2A, 0xE2, 0x0C, 0x05);         // ld a, (hl+) ; ld (c), a ; inc c ; dec b
+    jr(JR_NZ, L_COPY_DMA);
+
+    // tile data: whatever the first 6 kB of rom hold
+    DB(0x21, 0x00, 0x80);               // ld hl, $8000
+    DB(0x11, 0x00, 0x00);               // ld de, $0000
+    DB(0x01, 0x00, 0x18);               // ld bc, $1800
+    absolute(0xCD, L_MEMCPY);           // call memcpy
+
+    // both tile maps: ascending tile indices
+    DB(0x21, 0x00, 0x98);               // ld hl, $9800
+    DB(0x01, 0x00, 0x08);               // ld bc, $0800
+    DB(0x1E, 0x00);                     // ld e, 0
+    label(L_FILL_MAP);
+    DB(0x7B, 0x22, 0x1C);               // ld a, e ; ld (hl+), a ; inc e
+    DB(0x0B, 0x78, 0xB1);               // dec bc ; ld a, b ; or c
+    jr(JR_NZ, L_FILL_MAP);
+
+    if (cgb)
+    {
+        // tile attributes in vram bank 1: every palette, flip and priority combination
+        DB(0x3E, 0x01, 0xE0, 0x4F);     // ld a, 1 ; ldh (VBK), a
+        DB(0x21, 0x00, 0x98);           // ld hl, $9800
+        DB(0x01, 0x00, 0x08);           // ld bc, $0800
+        DB(0x1E, 0x00);                 // ld e, 0
+        label(L_FILL_ATTRS);
+        DB(0x7B, 0xE6, 0xF7, 0x22);     // ld a, e ; and $F7 ; ld (hl+), a  -- tiles stay in bank 0
+        DB(0x1C, 0x0B, 0x78, 0xB1);     // inc e ; dec bc ; ld a, b ; or c
+        jr(JR_NZ, L_FILL_ATTRS);
+        DB(0xAF, 0xE0, 0x4F);           // xor a ; ldh (VBK), a
+
+        // color palettes from rom bytes
+        DB(0x21, 0x00, 0x01);           // ld hl, $0100
+        DB(0x3E, 0x80, 0xE0, 0x68);     // ld a, $80 ; ldh (BCPS), a        -- auto increment
+        DB(0x06, 0x40);                 // ld b, 64
+        label(L_BG_PALETTES);
+        DB(0x2A, 0xE0, 0x69, 0x05);     // ld a, (hl+) ; ldh (BCPD), a ; dec b
+        jr(JR_NZ, L_BG_PALETTES);
+        DB(0x3E, 0x80, 0xE0, 0x6A);     // ld a, $80 ; ldh (OCPS), a
+        DB(0x06, 0x40);                 // ld b, 64
+        label(L_OBJ_PALETTES);
+        DB(0x2A, 0xE0, 0x6B, 0x05);     // ld a, (hl+) ; ldh (OCPD), a ; dec b
+        jr(JR_NZ, L_OBJ_PALETTES);
+    }
+
+    DB(0x3E, 0xE4, 0xE0, 0x47);         // ld a, $E4 ; ldh (BGP), a
+    DB(0x3E, 0xD2, 0xE0, 0x48);         // ld a, $D2 ; ldh (OBP0), a
+    DB(0x3E, 0x1B, 0xE0, 0x49);         // ld a, $1B ; ldh (OBP1), a
+
+    // 40 sprites in the oam buffer at $C100: y = 16 + 3i, x = 8 + 4i, tile = i, attributes = swap(i)
+    DB(0x21, 0x00, 0xC1);               // ld hl, $C100
+    DB(0x06, 0x00);                     // ld b, 0
+    label(L_SPRITES);
+    DB(0x78, 0x87, 0x80, 0xC6, 16, 0x22); // ld a, b ; add a, a ; add a, b ; add a, 16 ; ld (hl+), a
+    DB(0x78, 0x87, 0x87, 0xC6, 8, 0x22);  // ld a, b ; add a, a ; add a, a ; add a, 8 ; ld (hl+), a
+    DB(0x78, 0x22);                     // ld a, b ; ld (hl+), a
+    DB(0x78, 0xCB, 0x37, 0x22);         // ld a, b ; swap a ; ld (hl+), a
+    DB(0x04, 0x78, 0xFE, 40);           // inc b ; ld a, b ; cp 40
+    jr(JR_NZ, L_SPRITES);
+
+    DB(0x3E, 80, 0xE0, 0x4A);           // ld a, 80 ; ldh (WY), a
+    DB(0x3E, 87, 0xE0, 0x4B);           // ld a, 87 ; ldh (WX), a
+    DB(0x3E, 0x05, 0xE0, 0x07);         // ld a, $05 ; ldh (TAC), a         -- 262144 Hz
+    DB(0x3E, 64, 0xE0, 0x45);           // ld a, 64 ; ldh (LYC), a
+    DB(0x3E, 0x40, 0xE0, 0x41);         // ld a, $40 ; ldh (STAT), a        -- lyc interrupt
+    DB(0x3E, 0x07, 0xE0, 0xFF);         // ld a, $07 ; ldh (IE), a          -- vblank, lcd stat, timer
+    DB(0xAF, 0xE0, 0x0F);               // xor a ; ldh (IF), a
+    DB(0x3E, 0x0A, 0xEA, 0x00, 0x00);   // ld a, $0A ; ld ($0000), a        -- cart ram on
+    DB(0x3E, 0xF3, 0xE0, 0x40);         // ld a, $F3 ; ldh (LCDC), a        -- lcd, window ($9C00), objects, bg
+    DB(0xFB);                           // ei
+
+    label(L_MAIN);
+
+    // alu over the work area at $C200
+    DB(0x21, 0x00, 0xC2);               // ld hl, $C200
+    DB(0x06, 0x00);                     // ld b, 0                          -- 256 iterations
+    DB(0x0E, 0x5A);                     // ld c, $5A
+    label(L_ALU);
+    DB(0x7E, 0x81, 0x88, 0xAD);         // ld a, (hl) ; add a, c ; adc a, b ; xor l
+    DB(0x07, 0x91, 0x9C, 0xB0);         // rlca ; sub c ; sbc a, h ; or b
+    DB(0xE6, 0x7F, 0xFE, 0x40);         // and $7F ; cp $40
+    jr(JR_C, L_ALU_SKIP);
+    DB(0xCB, 0x37, 0x27);               // swap a ; daa
+    label(L_ALU_SKIP);
+    DB(0x22, 0xCB, 0x19, 0x05);         // ld (hl+), a ; rr c ; dec b
+    jr(JR_NZ, L_ALU);
+
+    // bit operations on registers and memory
+    DB(0x21, 0x00, 0xC2);               // ld hl, $C200
+    DB(0x16, 0x96, 0x1E, 0x3C);         // ld d, $96 ; ld e, $3C
+    DB(0x06, 0x40);                     // ld b, 64
+    label(L_BITS);
+    DB(0xCB, 0x22, 0xCB, 0x2A);         // sla d ; sra d
+    DB(0xCB, 0x03, 0x1C, 0xCB, 0x0B);   // rlc e ; inc e ; rrc e
+    DB(0xCB, 0x7A);                     // bit 7, d
+    jr(JR_Z, L_BITS_SKIP);
+    DB(0xCB, 0x8B, 0xCB, 0xEB);         // res 1, e ; set 5, e
+    label(L_BITS_SKIP);
+    DB(0xCB, 0xD6, 0xCB, 0xBE);         // set 2, (hl) ; res 7, (hl)
+    DB(0xCB, 0x46, 0x17, 0x1F);         // bit 0, (hl) ; rla ; rra
+    DB(0x2F, 0x37, 0x3F, 0x23);         // cpl ; scf ; ccf ; inc hl
+    DB(0x05);                           // dec b
+    jr(JR_NZ, L_BITS);
+
+    // 16 bit arithmetic, the stack and calls
+    DB(0x21, 0x34, 0x12);               // ld hl, $1234
+    DB(0x11, 0x11, 0x01);               // ld de, $0111
+    DB(0x06, 0x20);                     // ld b, 32
+    label(L_WIDE);
+    DB(0x19, 0xE5, 0xD5);               // add hl, de ; push hl ; push de
+    DB(0xD1, 0xE1, 0x13, 0xC5);         // pop de ; pop hl ; inc de ; push bc
+    absolute(0xCD, L_SUBROUTINE);       // call subroutine
+    DB(0xC1, 0x05);                     // pop bc ; dec b
+    jr(JR_NZ, L_WIDE);
+    DB(0xF8, 0x02);                     // ld hl, sp + 2
+    DB(0x08, 0x10, 0xC3);               // ld ($C310), sp
+
+    // read through every switchable rom bank
+    DB(0x1E, 0x01);                     // ld e, 1
+    label(L_BANKS);
+    DB(0x7B, 0xEA, 0x00, 0x21);         // ld a, e ; ld ($2100), a
+    DB(0x21, 0x00, 0x40);               // ld hl, $4000
+    DB(0x06, 0x40, 0xAF);               // ld b, 64 ; xor a
+    label(L_BANK_SUM);
+    DB(0x86, 0x23, 0x05);               // add a, (hl) ; inc hl ; dec b
+    jr(JR_NZ, L_BANK_SUM);
+    DB(0xEA, 0x00, 0xC3);               // ld ($C300), a
+    DB(0x1C, 0x7B, 0xFE, ROM_BANKS);    // inc e ; ld a, e ; cp ROM_BANKS
+    jr(JR_NZ, L_BANKS);
+
+    // cart ram: bank (frame & 3), write 256 bytes and read them back
+    DB(0xFA, 0x00, 0xC0, 0xE6, 0x03);   // ld a, ($C000) ; and 3
+    DB(0xEA, 0x00, 0x40);               // ld ($4000), a
+    DB(0x21, 0x00, 0xA0);               // ld hl, $A000
+    DB(0x06, 0x00);                     // ld b, 0
+    label(L_CART_RAM);
+    DB(0x78, 0x77, 0x7E, 0x23, 0x05);   // ld a, b ; ld (hl), a ; ld a, (hl) ; inc hl ; dec b
+    jr(JR_NZ, L_CART_RAM);
+
+    // joypad, both halves
+    DB(0x3E, 0x20, 0xE0, 0x00);         // ld a, $20 ; ldh (P1), a
+    DB(0xF0, 0x00, 0xF0, 0x00);         // ldh a, (P1) ; ldh a, (P1)
+    DB(0x2F, 0xE6, 0x0F, 0x47);         // cpl ; and $0F ; ld b, a
+    DB(0x3E, 0x10, 0xE0, 0x00);         // ld a, $10 ; ldh (P1), a
+    DB(0xF0, 0x00, 0xF0, 0x00);         // ldh a, (P1) ; ldh a, (P1)
+    DB(0x2F, 0xE6, 0x0F, 0xCB, 0x37);   // cpl ; and $0F ; swap a
+    DB(0xB0, 0xEA, 0x01, 0xC0);         // or b ; ld ($C001), a
+    DB(0x3E, 0x30, 0xE0, 0x00);         // ld a, $30 ; ldh (P1), a
+
+    DB(0x76, 0x00);                     // halt ; nop
+    absolute(0xC3, L_MAIN);             // jp main
+
+    label(L_SUBROUTINE);
+    DB(0x7D, 0xE6, 0x01, 0xC8);         // ld a, l ; and 1 ; ret z
+    DB(0x7C, 0xAD, 0x6F, 0xC9);         // ld a, h ; xor l ; ld l, a ; ret
+
+    label(L_VBLANK);
+    DB(0xF5, 0xC5, 0xD5, 0xE5);         // push af ; push bc ; push de ; push hl
+    DB(0xCD, 0x80, 0xFF);               // call $FF80                       -- oam dma
+    DB(0x21, 0x00, 0xC0, 0x34, 0x7E);   // ld hl, $C000 ; inc (hl) ; ld a, (hl)
+    DB(0xE0, 0x43, 0x1F, 0xE0, 0x42);   // ldh (SCX), a ; rra ; ldh (SCY), a
+
+    // sprites drift to the right
+    DB(0x21, 0x01, 0xC1, 0x06, 40);     // ld hl, $C101 ; ld b, 40
+    label(L_MOVE_SPRITES);
+    DB(0x34, 0x23, 0x23, 0x23, 0x23);   // inc (hl) ; inc hl (x4)
+    DB(0x05);                           // dec b
+    jr(JR_NZ, L_MOVE_SPRITES);
+
+    // 8x16 objects every other 64 frames
+    DB(0xFA, 0x00, 0xC0, 0xE6, 0x40);   // ld a, ($C000) ; and $40
+    DB(0x0F, 0x0F, 0x0F, 0x0F);         // rrca (x4)
+    DB(0xF6, 0xF3, 0xE0, 0x40);         // or $F3 ; ldh (LCDC), a
+
+    if (cgb)
+    {
+        // the oam buffer into tile data by general purpose vram dma
+        DB(0x3E, 0xC1, 0xE0, 0x51);     // ld a, $C1 ; ldh (HDMA1), a
+        DB(0xAF, 0xE0, 0x52);           // xor a ; ldh (HDMA2), a
+        DB(0x3E, 0x08, 0xE0, 0x53);     // ld a, $08 ; ldh (HDMA3), a
+        DB(0xAF, 0xE0, 0x54);           // xor a ; ldh (HDMA4), a
+        DB(0x3E, 0x07, 0xE0, 0x55);     // ld a, $07 ; ldh (HDMA5), a       -- 8 blocks of 16 bytes
+    }
+
+    DB(0xE1, 0xD1, 0xC1, 0xF1, 0xD9);   // pop hl ; pop de ; pop bc ; pop af ; reti
+
+    // mid-frame scroll change
+    label(L_STAT);
+    DB(0xF5, 0xF0, 0x43, 0xEE, 0x55);   // push af ; ldh a, (SCX) ; xor $55
+    DB(0xE0, 0x43, 0xF1, 0xD9);         // ldh (SCX), a ; pop af ; reti
+
+    label(L_TIMER);
+    DB(0xF5, 0xF0, 0x90, 0x3C);         // push af ; ldh a, ($90) ; inc a
+    DB(0xE0, 0x90, 0xF1, 0xD9);         // ldh ($90), a ; pop af ; reti
+
+    // de -> hl, bc bytes
+    label(L_MEMCPY);
+    DB(0x1A, 0x22, 0x13, 0x0B);         // ld a, (de) ; ld (hl+), a ; inc de ; dec bc
+    DB(0x78, 0xB1);                     // ld a, b ; or c
+    jr(JR_NZ, L_MEMCPY);
+    DB(0xC9);                           // ret
+
+    label(L_DMA_ROUTINE);
+    DB(0x3E, 0xC1, 0xE0, 0x46);         // ld a, $C1 ; ldh (DMA), a
+    DB(0x3E, 0x28, 0x3D, 0x20, 0xFD);   // ld a, 40 ; dec a ; jr nz, -3
+    DB(0xC9);                           // ret
+}
+
+static void header(_Bool cgb)
+{
+    memcpy(rom + 0x134, "NSGBE PGO", 9);
+
+    rom[0x143] = (cgb ? 0x80 : 0x00);
+    rom[0x147] = (cgb ? 0x1B : 0x13);   // mbc5 / mbc3, + ram + battery
+    rom[0x148] = 0x02;                  // 8 banks
+    rom[0x149] = 0x03;                  // 4 ram banks
+
+    uint8_t checksum = 0;
+
+    for (uint32_t i = 0x134; i < 0x14D; i++)
+        checksum = checksum - rom[i] - 1;
+
+    rom[0x14D] = checksum;
+
+    uint16_t global_checksum = 0;
+
+    for (uint32_t i = 0; i < ROM_SIZE; i++)
+        if (i != 0x14E && i != 0x14F)
+            global_checksum += rom[i];
+
+    rom[0x14E] = global_checksum >> 8;
+    rom[0x14F] = global_checksum & 0xFF;
+}
+
+// nsgbe-pgo-rom <output> <dmg | cgb>
+int main(int argc, char **argv)
+{
+    if (argc != 3 || (strcmp(argv[2], "dmg") != 0 && strcmp(argv[2], "cgb") != 0))
+    {
+        printf("usage: nsgbe-pgo-rom <output> <dmg | cgb>\n");
+        return EXIT_FAILURE;
+    }
+
+    _Bool cgb = (strcmp(argv[2], "cgb") == 0);
+
+    // the switchable banks hold deterministic noise to read through
+    uint32_t seed = 0x12345678;
+
+    for (uint32_t i = 0x4000; i < ROM_SIZE; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        rom[i] = seed >> 16;
+    }
+
+    memset(labels, 0xFF, sizeof(labels));
+
+    program(cgb);
+
+    if (!resolve())
+        return EXIT_FAILURE;
+
+    header(cgb);
+
+    FILE *file = fopen(argv[1], "wb");
+
+    if (!file || fwrite(rom, ROM_SIZE, 1, file) != 1)
+    {
+        printf("Error trying to write file: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fclose(file);
+
+    return EXIT_SUCCESS;
+}
@@ -7,24 +7,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <unistd.h>
 
 #include "../../emu/nsgbe.h"
 
+#define REWIND_BUDGET_BYTES      (32 * 1024 * 1024) // memory set aside for the rewind history
+#define REWIND_FRAME_INTERVAL    2 // capture a state every other frame
+#define REWIND_KEYFRAME_INTERVAL 60
+
+#define RUNAHEAD_FRAMES 0 // frames to run ahead to hide the game's input lag (0 = off, 1-2 suit most games)
+
+#define AUTOSAVE_QUIET_MSEC   1000 // make sure battery ram is on disk once the game has left it alone this long
+#define AUTOSAVE_INTERVAL_SEC 30   // or this often while it keeps writing
+
 char *rompath = NULL;
 char *biospath = NULL;
 char *batterypath = NULL;
 
 extern int gui_main(int argc, char **argv);
 
-__always_inline static void free_ptr(void **ptr)
-{
-    if (*ptr)
-    {
-        free(*ptr);
-        *ptr = 0;
-    }
-}
-
 static long file_read(uint8_t **buffer, char *path)
 {
     FILE *fbuf = fopen(path, "rb");
@@ -67,44 +68,52 @@ static int file_write(char *path, uint8_t *buffer, size_t size)
     return num;
 }
 
-long load_rom(uint8_t **buffer)
-{
-    free_ptr((void **)&batterypath);
-
-    size_t path_length = strlen(rompath);
-
-    batterypath = malloc(path_length + 4 + 1);
-
-    memcpy(batterypath, rompath, path_length + 1);
-    strcat(batterypath, ".sav");
-
-    return file_read(buffer, rompath);
-}
-
-long load_bios(uint8_t **buffer)
+static long gui_load_bios(uint8_t **buffer)
 {
     return file_read(buffer, biospath);
 }
 
-long load_battery(uint8_t **buffer)
+static long gui_load_battery(uint8_t **buffer)
 {
     return file_read(buffer, batterypath);
 }
 
-int save_battery(uint8_t *buffer, size_t size)
+static int gui_save_battery(uint8_t *buffer, size_t size)
 {
     return file_write(batterypath, buffer, size);
 }
 
+// nsgbe <rom> [--record <movie> | --play <movie>]
+static int start_movie(char *option, char *path)
+{
+    if (strcmp(option, "--record") == 0)
+        return nsgbe_movie_record(path);
+
+    if (strcmp(option, "--play") == 0)
+        return nsgbe_movie_play(path);
+
+    printf("Unknown option: %s\n", option);
+
+    return NSGBE_ERR;
+}
+
+volatile sig_atomic_t exit_requested = 0; // looked at by the gui, see catch_exit()
+static volatile sig_atomic_t exit_at_once = 0;
+
+// battery ram that maps the save file (see nsgbe_battery_file()) is written back by the kernel however the process
+// ends. otherwise it has to be saved, which a signal handler can't do (no file i/o or heap), so the gui is asked to
+// quit and saves on its way out; a second signal doesn't wait for that
 static void catch_exit(int signal_num)
 {
-    write_battery();
-    exit(EXIT_SUCCESS);
+    if (exit_at_once || exit_requested)
+        _exit(EXIT_SUCCESS);
+
+    exit_requested = 1;
 }
 
 int main(int argc, char **argv)
 {
-    if (argc != 2)
+    if (argc != 2 && argc != 4)
         return EXIT_FAILURE;
 
     if (signal(SIGTERM, catch_exit) == SIG_ERR) {
@@ -124,9 +133,65 @@ int main(int argc, char **argv)
 
     rompath = argv[1];
 
+    size_t path_length = strlen(rompath);
+
+    batterypath = malloc(path_length + 4 + 1);
+
+    memcpy(batterypath, rompath, path_length + 1);
+    strcat(batterypath, ".sav");
+
+    // mapped rather than read in, see nsgbe_load_rom_file()
+    if (!nsgbe_load_rom_file(rompath))
+        return EXIT_FAILURE;
+
+    // the callbacks below are only used if the save file can't be mapped
+    nsgbe_battery_file(batterypath);
+
+    load_bios = &gui_load_bios;
+    load_battery = &gui_load_battery;
+    save_battery = &gui_save_battery;
+
     if (!system_reset())
         return EXIT_FAILURE;
 
+    exit_at_once = (nsgbe_battery_file_mapped() || nsgbe_battery_size() == 0);
+
+    if (!nsgbe_rewind_enable(REWIND_BUDGET_BYTES, REWIND_FRAME_INTERVAL, REWIND_KEYFRAME_INTERVAL))
+        printf("Failed to set up rewind.\n");
+
+    if (!nsgbe_autosave_enable(AUTOSAVE_QUIET_MSEC, AUTOSAVE_INTERVAL_SEC))
+        printf("Failed to set up autosave.\n");
+
+    system_set_runahead(RUNAHEAD_FRAMES);
+
+    // a timeline for diagnosing frame pacing, see nsgbe_trace_start()
+    char *tracepath = getenv("NSGBE_TRACE");
+
+    if (tracepath && !nsgbe_trace_start(tracepath))
+        printf("Failed to start trace: %s\n", tracepath);
+
+    // gameplay recording, see nsgbe_capture_start(): NSGBE_CAPTURE=<file> writes y4m (or, unless the name ends in
+    // .y4m, the lossless tile diff format), NSGBE_CAPTURE_PIPE=<command> feeds y4m to an encoder instead
+    char *capturepath = getenv("NSGBE_CAPTURE");
+    char *capturecommand = getenv("NSGBE_CAPTURE_PIPE");
+
+    if (capturecommand && !nsgbe_capture_start_pipe(capturecommand, NSGBE_CAPTURE_Y4M))
+        printf("Failed to start capture: %s\n", capturecommand);
+    else if (!capturecommand && capturepath)
+    {
+        size_t length = strlen(capturepath);
+        _Bool y4m = (length >= 4 && strcmp(capturepath + length - 4, ".y4m") == 0);
+
+        if (!nsgbe_capture_start(capturepath, (y4m ? NSGBE_CAPTURE_Y4M : NSGBE_CAPTURE_TILE_DIFF)))
+            printf("Failed to start capture: %s\n", capturepath);
+    }
+
+    if (argc == 4 && !start_movie(argv[2], argv[3]))
+    {
+        printf("Failed to start movie: %s\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
     gui_main(1, argv);
 
     return EXIT_SUCCESS;
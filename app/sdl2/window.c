@@ -2,116 +2,92 @@
 //
 // SPDX-License-Identifier: LGPL-2.0-only
 
-#include <sys/time.h>
 #include <SDL2/SDL.h>
+#include <signal.h>
 #include "../../emu/nsgbe.h"
 
-#define WINDOW_TITLE_FORMATTER "[ nsGBE ] [ %d fps ]"
+#define WINDOW_TITLE_FORMATTER "[ nsGBE ] [ %d fps ] [ %d%% ]"
 
 #define SCREEN_SCALE 3
+#define SCREEN_SCALER NSGBE_SCALE_NEAREST // or NSGBE_SCALE_EPX, NSGBE_SCALE_XBR
 
 uint32_t *framebuffer;
 
-char title_buffer[32];
-uint16_t last_framecounter = 0;
+char title_buffer[48];
 
 SDL_Window *window;
 SDL_Renderer *renderer;
+SDL_Texture *screen;
 
-union BUTTON_STATE button_states;
+extern volatile sig_atomic_t exit_requested;
 
 __always_inline void vblank()
 {
     framebuffer = display_request_next_frame();
 
-    SDL_RenderClear(renderer);
+    void *pixels;
+    int pitch;
 
-    for (int y = 0; y < GB_FRAMEBUFFER_HEIGHT; y++)
+    // the framebuffer's 0xAABBGGRR pixels are what sdl calls ABGR8888
+    if (SDL_LockTexture(screen, NULL, &pixels, &pitch) == 0)
     {
-        for (int x = 0; x < GB_FRAMEBUFFER_WIDTH; x++)
-        {
-            uint32_t color = *(framebuffer + (y * GB_FRAMEBUFFER_WIDTH + x));
-            uint8_t color_b = (color >> 16) & 0xFF;
-            uint8_t color_g = (color >> 8) & 0xFF;
-            uint8_t color_r = color & 0xFF;
-
-            SDL_Rect rect;
-            rect.x = x * SCREEN_SCALE;
-            rect.y = y * SCREEN_SCALE;
-            rect.w = SCREEN_SCALE;
-            rect.h = SCREEN_SCALE;
-
-            SDL_SetRenderDrawColor(renderer, color_r, color_g, color_b, 0xFF);
-            SDL_RenderFillRect(renderer, &rect);
-        }
+        nsgbe_scale(framebuffer, pixels, GB_FRAMEBUFFER_WIDTH * SCREEN_SCALE, GB_FRAMEBUFFER_HEIGHT * SCREEN_SCALE, pitch, SCREEN_SCALER);
+        SDL_UnlockTexture(screen);
     }
 
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, screen, NULL, NULL);
     SDL_RenderPresent(renderer);
 }
 
-long time_start;
-uint16_t framecounter = 0;
-void handle_vblank()
-{
-    struct timeval tv;
-    long time_now;
-
-    gettimeofday(&tv, NULL);
-    time_now = (1000000 * tv.tv_sec + tv.tv_usec);
-
-    if (time_start == 0)
-        time_start = time_now;
-
-    if (time_now - time_start > 1000000)
-    {
-        time_start = time_now;
-        last_framecounter = framecounter;
-        framecounter = 0;
-    }
-    else
-    {
-        framecounter++;
-    }
-}
-
 static void handleKeyDown(SDL_KeyboardEvent key)
 {
+    union BUTTON_STATE *buttons = nsgbe_ctx_button_states(nsgbe_ctx_bound());
+
     switch (key.keysym.scancode)
     {
         case SDL_SCANCODE_SPACE:
-            system_overclock = 1;
+            system_set_speed(4.f);
+            break;
+
+        case SDL_SCANCODE_TAB:
+            system_set_speed(NSGBE_SPEED_UNCAPPED);
+            break;
+
+        case SDL_SCANCODE_BACKSPACE:
+            system_set_rewinding(1);
             break;
 
         case SDL_SCANCODE_K:
-            button_states.A = 1;
+            buttons->A = 1;
             break;
 
         case SDL_SCANCODE_O:
-            button_states.B = 1;
+            buttons->B = 1;
             break;
 
         case SDL_SCANCODE_L:
-            button_states.START = 1;
+            buttons->START = 1;
             break;
 
         case SDL_SCANCODE_P:
-            button_states.SELECT = 1;
+            buttons->SELECT = 1;
             break;
 
         case SDL_SCANCODE_W:
-            button_states.UP = 1;
+            buttons->UP = 1;
             break;
 
         case SDL_SCANCODE_S:
-            button_states.DOWN = 1;
+            buttons->DOWN = 1;
             break;
 
         case SDL_SCANCODE_A:
-            button_states.LEFT = 1;
+            buttons->LEFT = 1;
             break;
 
         case SDL_SCANCODE_D:
-            button_states.RIGHT = 1;
+            buttons->RIGHT = 1;
             break;
 
 #ifdef __DEBUG
@@ -131,42 +107,52 @@ static void handleKeyDown(SDL_KeyboardEvent key)
 
 static void handleKeyUp(SDL_KeyboardEvent key)
 {
+    union BUTTON_STATE *buttons = nsgbe_ctx_button_states(nsgbe_ctx_bound());
+
     switch (key.keysym.scancode)
     {
         case SDL_SCANCODE_SPACE:
-            system_overclock = 0;
+            system_set_speed(1.f);
+            break;
+
+        case SDL_SCANCODE_TAB:
+            system_set_speed(1.f);
+            break;
+
+        case SDL_SCANCODE_BACKSPACE:
+            system_set_rewinding(0);
             break;
 
         case SDL_SCANCODE_K:
-            button_states.A = 0;
+            buttons->A = 0;
             break;
 
         case SDL_SCANCODE_O:
-            button_states.B = 0;
+            buttons->B = 0;
             break;
 
         case SDL_SCANCODE_L:
-            button_states.START = 0;
+            buttons->START = 0;
             break;
 
         case SDL_SCANCODE_P:
-            button_states.SELECT = 0;
+            buttons->SELECT = 0;
             break;
 
         case SDL_SCANCODE_W:
-            button_states.UP = 0;
+            buttons->UP = 0;
             break;
 
         case SDL_SCANCODE_S:
-            button_states.DOWN = 0;
+            buttons->DOWN = 0;
             break;
 
         case SDL_SCANCODE_A:
-            button_states.LEFT = 0;
+            buttons->LEFT = 0;
             break;
 
         case SDL_SCANCODE_D:
-            button_states.RIGHT = 0;
+            buttons->RIGHT = 0;
             break;
 
         default:
@@ -181,15 +167,15 @@ int gui_main(int argc, char **argv)
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS);
 
     SDL_CreateWindowAndRenderer(GB_FRAMEBUFFER_WIDTH * SCREEN_SCALE, GB_FRAMEBUFFER_HEIGHT * SCREEN_SCALE, 0, &window, &renderer);
+    screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING,
+        GB_FRAMEBUFFER_WIDTH * SCREEN_SCALE, GB_FRAMEBUFFER_HEIGHT * SCREEN_SCALE);
     SDL_RenderClear(renderer);
     SDL_RenderPresent(renderer);
     SDL_SetWindowTitle(window, "[ nsGBE ]");
 
-    SDL_CreateThread(&system_run_event_loop, "nsgbe_core", NULL);
+    SDL_Thread *core_thread = SDL_CreateThread(&system_run_event_loop, "nsgbe_core", NULL);
 
-    display_notify_vblank = &handle_vblank;
-
-    while (!quit)
+    while (!quit && !exit_requested)
     {
         SDL_Event e;
 
@@ -207,12 +193,24 @@ int gui_main(int argc, char **argv)
 
         vblank();
 
-        sprintf(title_buffer, WINDOW_TITLE_FORMATTER, last_framecounter);
+        struct NSGBE_STATS stats;
+        nsgbe_stats(&stats);
+
+        sprintf(title_buffer, WINDOW_TITLE_FORMATTER, (int)(stats.emulated_fps + .5f), (int)(stats.speed + .5f));
         SDL_SetWindowTitle(window, title_buffer);
     }
 
+    // what the core was feeding can only be finished once it has stopped
+    system_stop();
+    SDL_WaitThread(core_thread, NULL);
+
+    nsgbe_movie_stop();
+    nsgbe_trace_stop();
+    nsgbe_autosave_disable();
+    nsgbe_capture_stop();
     write_battery();
 
+    SDL_DestroyTexture(screen);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -0,0 +1,534 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// headless test rom runner: runs every rom below a directory on a pool of worker threads (one emulator instance each)
+// for a capped amount of emulated time and tells whether it passed, judging by
+// - serial output: blargg's "Passed" / "Failed", mooneye's fibonacci bytes (3 5 8 13 21 34) / six times 0x42
+// - register signatures: mooneye's b/c/d/e/h/l = 3/5/8/13/21/34 (pass) or all 0x42 (fail)
+// - memory signatures: blargg's result code at 0xA000 behind the de b0 61 marker
+// - a reference image: <rom without extension>.ppm (binary, 160x144), compared by framebuffer hash
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "../../emu/nsgbe.h"
+
+#define DEFAULT_SECONDS     120 // emulated seconds before a rom counts as timed out
+#define CHECK_INTERVAL      70224 // cycles between checks, one frame
+#define DETAIL_LENGTH       48
+#define SERIAL_TAIL_SIZE    0x1000 // how much of the serial output is looked at
+#define CPU_CLOCK_HZ        4194304
+
+enum TEST_STATUS { TEST_PASS, TEST_FAIL, TEST_TIMEOUT, TEST_ERROR };
+
+static const char *status_names[] = { "PASS", "FAIL", "TIMEOUT", "ERROR" };
+
+struct TEST {
+    char *path;
+    char *reference_path;
+    enum TEST_STATUS status;
+    const char *method;
+    double emulated_seconds;
+    double host_seconds;
+    char detail[DETAIL_LENGTH + 1];
+};
+
+static struct TEST *tests;
+static uint32_t test_count, test_capacity;
+static uint32_t next_test; // next test to be picked up by a worker
+static pthread_mutex_t next_test_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t seconds_cap = DEFAULT_SECONDS;
+static char *dump_dir = NULL;
+static size_t base_length; // length of the directory prefix of the test paths
+
+__always_inline static uint64_t time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*-----------------------DISCOVERY-----------------------*/
+
+static _Bool has_extension(const char *name, const char *extension)
+{
+    size_t length = strlen(name), extension_length = strlen(extension);
+
+    return (length > extension_length && strcasecmp(name + length - extension_length, extension) == 0);
+}
+
+static void add_test(char *path)
+{
+    if (test_count == test_capacity)
+    {
+        test_capacity = (test_capacity ? test_capacity * 2 : 64);
+        tests = realloc(tests, test_capacity * sizeof(struct TEST));
+
+        if (!tests)
+        {
+            fprintf(stderr, "Out of memory.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct TEST *test = &tests[test_count++];
+    memset(test, 0, sizeof(struct TEST));
+
+    test->path = path;
+
+    // foo.gb -> foo.ppm
+    size_t stem_length = strrchr(path, '.') - path;
+    test->reference_path = malloc(stem_length + 5);
+    memcpy(test->reference_path, path, stem_length);
+    strcpy(test->reference_path + stem_length, ".ppm");
+}
+
+static void find_tests(const char *dir_path)
+{
+    DIR *dir = opendir(dir_path);
+
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+
+    while ((entry = readdir(dir)))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char *path = malloc(strlen(dir_path) + strlen(entry->d_name) + 2);
+        sprintf(path, "%s/%s", dir_path, entry->d_name);
+
+        struct stat st;
+
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            find_tests(path);
+            free(path);
+        }
+        else if (has_extension(entry->d_name, ".gb") || has_extension(entry->d_name, ".gbc"))
+            add_test(path);
+        else
+            free(path);
+    }
+
+    closedir(dir);
+}
+
+static int compare_tests(const void *a, const void *b)
+{
+    return strcmp(((const struct TEST *)a)->path, ((const struct TEST *)b)->path);
+}
+
+/*-----------------------VERDICTS-----------------------*/
+
+static const uint8_t fibonacci[] = { 3, 5, 8, 13, 21, 34 };
+static const uint8_t mooneye_failure[] = { 0x42, 0x42, 0x42, 0x42, 0x42, 0x42 };
+
+// last line of text in buf, for the summary table
+static void copy_detail(char *detail, const uint8_t *buf, size_t length)
+{
+    while (length > 0 && (buf[length - 1] == '\n' || buf[length - 1] == ' '))
+        length--;
+
+    size_t start = length;
+
+    while (start > 0 && buf[start - 1] != '\n')
+        start--;
+
+    size_t n = 0;
+
+    for (size_t i = start; i < length && n < DETAIL_LENGTH; i++)
+        detail[n++] = (buf[i] >= 0x20 && buf[i] < 0x7F ? buf[i] : '?');
+
+    detail[n] = '\0';
+}
+
+static _Bool contains(const uint8_t *buf, size_t length, const char *needle)
+{
+    size_t needle_length = strlen(needle);
+
+    for (size_t i = 0; i + needle_length <= length; i++)
+        if (memcmp(buf + i, needle, needle_length) == 0)
+            return 1;
+
+    return 0;
+}
+
+static _Bool check_serial(struct TEST *test)
+{
+    static __thread uint8_t buf[SERIAL_TAIL_SIZE];
+    size_t length = nsgbe_serial_output(buf, sizeof(buf));
+
+    test->method = "serial";
+
+    // mooneye's bytes aren't text
+    if (length >= sizeof(fibonacci) && memcmp(buf + length - sizeof(fibonacci), fibonacci, sizeof(fibonacci)) == 0)
+    {
+        test->status = TEST_PASS;
+        return 1;
+    }
+
+    if (length >= sizeof(mooneye_failure) && memcmp(buf + length - sizeof(mooneye_failure), mooneye_failure, sizeof(mooneye_failure)) == 0)
+    {
+        test->status = TEST_FAIL;
+        return 1;
+    }
+
+    if (contains(buf, length, "Passed"))
+        test->status = TEST_PASS;
+    else if (contains(buf, length, "Failed"))
+        test->status = TEST_FAIL;
+    else
+    {
+        test->method = "-";
+        return 0;
+    }
+
+    copy_detail(test->detail, buf, length);
+
+    return 1;
+}
+
+static _Bool check_registers(struct TEST *test)
+{
+    struct NSGBE_CPU_STATE cpu;
+    nsgbe_cpu_state(&cpu);
+
+    const uint8_t regs[] = { cpu.bc >> 8, cpu.bc & 0xFF, cpu.de >> 8, cpu.de & 0xFF, cpu.hl >> 8, cpu.hl & 0xFF };
+
+    if (memcmp(regs, fibonacci, sizeof(regs)) == 0)
+        test->status = TEST_PASS;
+    else if (memcmp(regs, mooneye_failure, sizeof(regs)) == 0)
+        test->status = TEST_FAIL;
+    else
+        return 0;
+
+    test->method = "registers";
+
+    return 1;
+}
+
+static _Bool check_memory(struct TEST *test)
+{
+    const uint8_t *ram = nsgbe_cart_ram_bank(0);
+
+    if (!ram)
+        return 0;
+
+    // 0x80 means the test is still running
+    if (ram[1] != 0xDE || ram[2] != 0xB0 || ram[3] != 0x61 || ram[0] == 0x80)
+        return 0;
+
+    test->status = (ram[0] == 0x00 ? TEST_PASS : TEST_FAIL);
+    test->method = "memory";
+
+    size_t length = strnlen((const char *)ram + 4, 0x2000 - 4);
+    copy_detail(test->detail, ram + 4, length);
+
+    return 1;
+}
+
+// fnv-1a over the rgb values of a frame
+static uint64_t hash_rgb(const uint8_t *rgb, size_t length)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ rgb[i]) * 0x100000001B3ull;
+
+    return hash;
+}
+
+static void framebuffer_rgb(uint8_t *rgb)
+{
+    uint32_t *framebuffer = nsgbe_framebuffer();
+
+    for (uint32_t i = 0; i < GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT; i++)
+    {
+        rgb[i * 3 + 0] = framebuffer[i] & 0xFF;
+        rgb[i * 3 + 1] = (framebuffer[i] >> 8) & 0xFF;
+        rgb[i * 3 + 2] = (framebuffer[i] >> 16) & 0xFF;
+    }
+}
+
+// hash of a binary 160x144 ppm with 8-bit channels; returns 0 if there's no (usable) reference
+static _Bool load_reference_hash(const char *path, uint64_t *hash)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (!file)
+        return 0;
+
+    unsigned width, height, maxval;
+    uint8_t rgb[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT * 3];
+    _Bool loaded = 0;
+
+    if (fscanf(file, "P6 %u %u %u", &width, &height, &maxval) == 3 && fgetc(file) != EOF
+        && width == GB_FRAMEBUFFER_WIDTH && height == GB_FRAMEBUFFER_HEIGHT && maxval == 255
+        && fread(rgb, sizeof(rgb), 1, file) == 1)
+    {
+        *hash = hash_rgb(rgb, sizeof(rgb));
+        loaded = 1;
+    }
+
+    fclose(file);
+
+    return loaded;
+}
+
+static void dump_framebuffer(struct TEST *test)
+{
+    const char *name = test->path + base_length;
+
+    // flatten the path below the test directory into a file name
+    char *path = malloc(strlen(dump_dir) + strlen(name) + 6);
+    sprintf(path, "%s/", dump_dir);
+
+    char *out = path + strlen(path);
+
+    for (; *name; name++)
+        *out++ = (*name == '/' ? '_' : *name);
+
+    *out = '\0';
+    strcpy(strrchr(path, '.'), ".ppm");
+
+    uint8_t rgb[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT * 3];
+    framebuffer_rgb(rgb);
+
+    FILE *file = fopen(path, "wb");
+
+    if (file)
+    {
+        fprintf(file, "P6\n%d %d\n255\n", GB_FRAMEBUFFER_WIDTH, GB_FRAMEBUFFER_HEIGHT);
+        fwrite(rgb, sizeof(rgb), 1, file);
+        fclose(file);
+    }
+
+    free(path);
+}
+
+/*------------------------WORKERS------------------------*/
+
+static void run_test(struct TEST *test)
+{
+    test->status = TEST_ERROR;
+    test->method = "-";
+
+    // workers running the same rom share its mapping
+    if (!nsgbe_load_rom_file(test->path))
+    {
+        strcpy(test->detail, "failed to read rom");
+        return;
+    }
+
+    if (!system_reset())
+    {
+        strcpy(test->detail, "failed to load rom");
+        return;
+    }
+
+    uint64_t reference_hash;
+    _Bool has_reference = load_reference_hash(test->reference_path, &reference_hash);
+    uint8_t rgb[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT * 3];
+
+    uint64_t cycle_cap = (uint64_t)seconds_cap * CPU_CLOCK_HZ;
+    uint64_t start = time_ns();
+
+    test->status = TEST_TIMEOUT;
+
+    while (nsgbe_cycle_count() < cycle_cap)
+    {
+        nsgbe_run_cycles(CHECK_INTERVAL);
+
+        struct NSGBE_CPU_STATE cpu;
+        nsgbe_cpu_state(&cpu);
+
+        if (!cpu.alive)
+        {
+            test->status = TEST_FAIL;
+            test->method = "crash";
+            snprintf(test->detail, sizeof(test->detail), "cpu stopped at 0x%04X", cpu.pc);
+            break;
+        }
+
+        if (check_serial(test) || check_registers(test) || check_memory(test))
+            break;
+
+        // the first frame after power on hasn't been drawn completely
+        struct NSGBE_STATS stats;
+        nsgbe_stats(&stats);
+
+        if (has_reference && stats.frames_emulated > 1)
+        {
+            framebuffer_rgb(rgb);
+
+            if (hash_rgb(rgb, sizeof(rgb)) == reference_hash)
+            {
+                test->status = TEST_PASS;
+                test->method = "image";
+                break;
+            }
+        }
+    }
+
+    if (test->status == TEST_TIMEOUT && has_reference)
+    {
+        test->method = "image";
+        strcpy(test->detail, "framebuffer differs from reference");
+    }
+
+    test->host_seconds = (time_ns() - start) / 1e9;
+    test->emulated_seconds = (double)nsgbe_cycle_count() / CPU_CLOCK_HZ;
+
+    if (dump_dir)
+        dump_framebuffer(test);
+}
+
+static void *worker(void *arg)
+{
+    for (;;)
+    {
+        pthread_mutex_lock(&next_test_mutex);
+        uint32_t index = next_test++;
+        pthread_mutex_unlock(&next_test_mutex);
+
+        if (index >= test_count)
+            break;
+
+        // a fresh instance per rom, nothing carries over between tests
+        struct nsgbe_ctx *ctx = nsgbe_ctx_create();
+
+        if (!ctx)
+        {
+            tests[index].status = TEST_ERROR;
+            tests[index].method = "-";
+            strcpy(tests[index].detail, "out of memory");
+            continue;
+        }
+
+        nsgbe_ctx_bind(ctx);
+        run_test(&tests[index]);
+        nsgbe_ctx_bind(NULL);
+
+        nsgbe_ctx_destroy(ctx);
+    }
+
+    return NULL;
+}
+
+/*-------------------------MAIN--------------------------*/
+
+static void print_usage()
+{
+    fprintf(stderr, "usage: nsgbe-testrunner <directory> [--jobs <n>] [--seconds <n>] [--dump <directory>] [--verbose]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    uint32_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    _Bool verbose = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--verbose") == 0)
+            verbose = 1;
+        else if (i + 1 < argc && strcmp(argv[i], "--jobs") == 0)
+            jobs = strtoul(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--seconds") == 0)
+            seconds_cap = strtoul(argv[++i], NULL, 10);
+        else if (i + 1 < argc && strcmp(argv[i], "--dump") == 0)
+            dump_dir = argv[++i];
+        else
+        {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (jobs == 0 || seconds_cap == 0)
+    {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    find_tests(argv[1]);
+    base_length = strlen(argv[1]) + 1;
+
+    if (test_count == 0)
+    {
+        fprintf(stderr, "No test roms found in %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    qsort(tests, test_count, sizeof(struct TEST), compare_tests);
+
+    if (jobs > test_count)
+        jobs = test_count;
+
+    // the core reports on stdout; keep that out of the table unless asked for
+    FILE *report = fdopen(dup(STDOUT_FILENO), "w");
+
+    if (!report)
+        return EXIT_FAILURE;
+
+    if (!verbose)
+        freopen("/dev/null", "w", stdout);
+
+    uint64_t start = time_ns();
+
+    pthread_t threads[jobs];
+
+    for (uint32_t i = 0; i < jobs; i++)
+        pthread_create(&threads[i], NULL, worker, NULL);
+
+    for (uint32_t i = 0; i < jobs; i++)
+        pthread_join(threads[i], NULL);
+
+    double total_seconds = (time_ns() - start) / 1e9;
+
+    uint32_t counts[4] = { 0 };
+
+    fprintf(report, "%-7s  %-9s  %8s  %8s  %-40s  %s\n", "result", "method", "emu s", "host s", "rom", "detail");
+
+    for (uint32_t i = 0; i < test_count; i++)
+    {
+        struct TEST *test = &tests[i];
+
+        counts[test->status]++;
+
+        fprintf(report, "%-7s  %-9s  %8.1f  %8.2f  %-40s  %s\n", status_names[test->status], test->method,
+                test->emulated_seconds, test->host_seconds, test->path + base_length, test->detail);
+    }
+
+    fprintf(report, "\n%u passed, %u failed, %u timed out, %u errors (%u roms, %u jobs, %.1f s)\n",
+            counts[TEST_PASS], counts[TEST_FAIL], counts[TEST_TIMEOUT], counts[TEST_ERROR], test_count, jobs, total_seconds);
+
+    fclose(report);
+
+    for (uint32_t i = 0; i < test_count; i++)
+    {
+        free(tests[i].path);
+        free(tests[i].reference_path);
+    }
+
+    free(tests);
+
+    return (counts[TEST_PASS] == test_count ? EXIT_SUCCESS : EXIT_FAILURE);
+}
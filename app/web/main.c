@@ -17,6 +17,12 @@
 #define NSGBE_STORAGE_PREFIX "/nsGBE/"
 #define NSGBE_STORAGE_SUFFIX ".sav"
 
+#define REWIND_BUDGET_BYTES      (8 * 1024 * 1024) // memory set aside for the rewind history
+#define REWIND_FRAME_INTERVAL    2 // capture a state every other frame
+#define REWIND_KEYFRAME_INTERVAL 60
+
+#define RUNAHEAD_FRAMES 0 // frames to run ahead to hide the game's input lag (0 = off, 1-2 suit most games)
+
 int gui_main();
 
 char *rompath = NULL;
@@ -80,29 +86,22 @@ static int file_write(char *path, uint8_t *buffer, size_t size)
     return num;
 }
 
-long load_rom(uint8_t **buffer)
-{
-    rompath = "/rom.gb";
-
-    return file_read(buffer, rompath);
-}
-
-long load_bios(uint8_t **buffer)
+static long gui_load_bios(uint8_t **buffer)
 {
     return file_read(buffer, biospath);
 }
 
-long load_battery(uint8_t **buffer)
+static long gui_load_battery(uint8_t **buffer)
 {
     strcat(batterypath, NSGBE_STORAGE_PREFIX);
-    strncat(batterypath, rom_header->game_title, 15);
+    strncat(batterypath, nsgbe_ctx_rom_header(nsgbe_ctx_bound())->game_title, 15);
     batterypath[22] = 0;
     strcat(batterypath, NSGBE_STORAGE_SUFFIX);
 
     return file_read(buffer, batterypath);
 }
 
-int save_battery(uint8_t *buffer, size_t size)
+static int gui_save_battery(uint8_t *buffer, size_t size)
 {
     return file_write(batterypath, buffer, size);
 }
@@ -116,12 +115,21 @@ static void catch_exit(int signal_num)
 extern void sdl_renderloop();
 void system_prepare()
 {
+    rompath = "/rom.gb";
+
+    nsgbe_load_rom_file(rompath);
     system_reset();
+    nsgbe_rewind_enable(REWIND_BUDGET_BYTES, REWIND_FRAME_INTERVAL, REWIND_KEYFRAME_INTERVAL);
+    system_set_runahead(RUNAHEAD_FRAMES);
     emscripten_set_main_loop(sdl_renderloop, 0, 0);
 }
 
 int main(int argc, char **argv)
 {
+    load_bios = &gui_load_bios;
+    load_battery = &gui_load_battery;
+    save_battery = &gui_save_battery;
+
     EM_ASM_({
         FS.mkdir('/nsGBE');
         FS.mount(IDBFS, {}, '/nsGBE');
@@ -10,27 +10,21 @@
 #include <emscripten.h>
 #endif
 
-#define WINDOW_TITLE_FORMATTER "[ nsGBE ] [ %d fps ]"
+#define WINDOW_TITLE_FORMATTER "[ nsGBE ] [ %d fps ] [ %d%% ]"
 
 #define SCREEN_SCALE 3
 
-#define SYSTEM_OVERCLOCK_MULTIPLIER     4
-#define MACHINE_CLOCK_HZ                1048576 // original DMG
-#define EFFECTIVE_MACHINE_CLOCK_HZ      (MACHINE_CLOCK_HZ * (system_overclock ? SYSTEM_OVERCLOCK_MULTIPLIER : 1))
-#define CLOCK_TICKS_PER_SLEEP_CYCLE     1024
-#define SLEEP_CYCLE_HZ                  (EFFECTIVE_MACHINE_CLOCK_HZ / CLOCK_TICKS_PER_SLEEP_CYCLE)
+#define RENDERLOOP_HZ                   60
+#define UNCAPPED_RENDERLOOP_BUDGET_USEC 14000 // leave the browser some headroom to present at 60 Hz
 
 uint32_t *framebuffer;
 
-char title_buffer[32];
-uint16_t last_framecounter = 0;
+char title_buffer[48];
 
 SDL_Window *window;
 SDL_Renderer *renderer;
 SDL_Texture *buffer;
 
-union BUTTON_STATE button_states;
-
 void set_canvas_scale()
 {
     EM_ASM_({
@@ -65,71 +59,59 @@ void vblank()
     copy_to_canvas(framebuffer, GB_FRAMEBUFFER_WIDTH, GB_FRAMEBUFFER_HEIGHT);
 }
 
-long time_start;
-uint16_t framecounter = 0;
 void handle_vblank()
 {
-    struct timeval tv;
-    long time_now;
-
-    gettimeofday(&tv, NULL);
-    time_now = (1000000 * tv.tv_sec + tv.tv_usec);
-
-    if (time_start == 0)
-        time_start = time_now;
-
-    if (time_now - time_start > 1000000)
-    {
-        time_start = time_now;
-        last_framecounter = framecounter;
-        framecounter = 0;
-    }
-    else
-    {
-        framecounter++;
-    }
-
     vblank();
 }
 
 static void handleKeyDown(SDL_KeyboardEvent key)
 {
+    union BUTTON_STATE *buttons = nsgbe_ctx_button_states(nsgbe_ctx_bound());
+
     switch (key.keysym.scancode)
     {
         case SDL_SCANCODE_SPACE:
-            system_overclock = 1;
+            system_set_speed(4.f);
+            break;
+
+        case SDL_SCANCODE_TAB:
+            system_set_speed(NSGBE_SPEED_UNCAPPED);
+            break;
+
+        case SDL_SCANCODE_BACKSPACE:
+            system_set_rewinding(1);
             break;
 
         case SDL_SCANCODE_K:
-            button_states.A = 1;
+            buttons->A = 1;
             break;
 
         case SDL_SCANCODE_O:
-            button_states.B = 1;
+            buttons->B = 1;
             break;
 
         case SDL_SCANCODE_L:
-            button_states.START = 1;
+            buttons->START = 1;
             break;
 
         case SDL_SCANCODE_P:
-            button_states.SELECT = 1;
+            buttons->SELECT = 1;
             break;
 
         case SDL_SCANCODE_W:
-            button_states.UP = 1;
+            buttons->UP = 1;
             break;
 
         case SDL_SCANCODE_S:
-            button_states.DOWN = 1;
+            buttons->DOWN = 1;
             break;
 
         case SDL_SCANCODE_A:
-            button_states.LEFT = 1;
+            buttons->LEFT = 1;
             break;
 
         case SDL_SCANCODE_D:
-            button_states.RIGHT = 1;
+            buttons->RIGHT = 1;
             break;
 
         default:
@@ -139,42 +121,52 @@ static void handleKeyDown(SDL_KeyboardEvent key)
 
 static void handleKeyUp(SDL_KeyboardEvent key)
 {
+    union BUTTON_STATE *buttons = nsgbe_ctx_button_states(nsgbe_ctx_bound());
+
     switch (key.keysym.scancode)
     {
         case SDL_SCANCODE_SPACE:
-            system_overclock = 0;
+            system_set_speed(1.f);
+            break;
+
+        case SDL_SCANCODE_TAB:
+            system_set_speed(1.f);
+            break;
+
+        case SDL_SCANCODE_BACKSPACE:
+            system_set_rewinding(0);
             break;
 
         case SDL_SCANCODE_K:
-            button_states.A = 0;
+            buttons->A = 0;
             break;
 
         case SDL_SCANCODE_O:
-            button_states.B = 0;
+            buttons->B = 0;
             break;
 
         case SDL_SCANCODE_L:
-            button_states.START = 0;
+            buttons->START = 0;
             break;
 
         case SDL_SCANCODE_P:
-            button_states.SELECT = 0;
+            buttons->SELECT = 0;
             break;
 
         case SDL_SCANCODE_W:
-            button_states.UP = 0;
+            buttons->UP = 0;
             break;
 
         case SDL_SCANCODE_S:
-            button_states.DOWN = 0;
+            buttons->DOWN = 0;
             break;
 
         case SDL_SCANCODE_A:
-            button_states.LEFT = 0;
+            buttons->LEFT = 0;
             break;
 
         case SDL_SCANCODE_D:
-            button_states.RIGHT = 0;
+            buttons->RIGHT = 0;
             break;
 
         case SDL_SCANCODE_B:
@@ -186,6 +178,15 @@ static void handleKeyUp(SDL_KeyboardEvent key)
     }
 }
 
+__always_inline static long time_usec()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (1000000 * tv.tv_sec + tv.tv_usec);
+}
+
 void sdl_renderloop()
 {
     _Bool quit = 0;
@@ -194,7 +195,11 @@ void sdl_renderloop()
     if (!EM_ASM_INT({ return Module.fs_init_finished; }))
         return;
 
-    for (int i = 0; i < (SLEEP_CYCLE_HZ / 60); i++)
+    // when uncapped, there is no sleep cycle rate to aim for; run until the frame budget is spent instead
+    int sleep_cycles = (int)(clock_sleep_cycle_hz() / RENDERLOOP_HZ);
+    long time_limit = time_usec() + UNCAPPED_RENDERLOOP_BUDGET_USEC;
+
+    for (int i = 0; (sleep_cycles > 0 ? i < sleep_cycles : time_usec() < time_limit); i++)
     {
         clock_perform_sleep_cycle_ticks();
 
@@ -211,7 +216,10 @@ void sdl_renderloop()
         }
     }
 
-    sprintf(title_buffer, WINDOW_TITLE_FORMATTER, last_framecounter);
+    struct NSGBE_STATS stats;
+    nsgbe_stats(&stats);
+
+    sprintf(title_buffer, WINDOW_TITLE_FORMATTER, (int)(stats.emulated_fps + .5f), (int)(stats.speed + .5f));
     SDL_SetWindowTitle(window, title_buffer);
 }
 
@@ -222,7 +230,7 @@ int gui_main()
     window = SDL_CreateWindow("[ nsGBE ]", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, GB_FRAMEBUFFER_WIDTH * SCREEN_SCALE, \
       GB_FRAMEBUFFER_HEIGHT * SCREEN_SCALE, 0);
 
-    display_notify_vblank = &handle_vblank;
+    *nsgbe_ctx_display_notify_vblank(nsgbe_ctx_bound()) = &handle_vblank;
 
     set_canvas_scale();
 
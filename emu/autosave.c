@@ -0,0 +1,346 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// periodic battery saves in the background
+
+// mem_write() raises ext_ram_dirty on every write to cart ram; once per frame, the emulation thread looks at it and,
+// once the game has left cart ram alone for the quiet period (or changes have been piling up for the interval), hands a
+// save job to the writer thread. if battery ram maps the battery file, the job is an msync of the mapping. otherwise
+// the emulation thread copies the ram into whichever of two buffers the writer isn't busy with, and the writer puts it
+// in a temporary file, fsyncs it and renames it over the battery file. either way, the emulation thread never waits
+// on the disk
+
+#include "env.h"
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define AUTOSAVE_NONE -1
+#define AUTOSAVE_SYNC 2 // job: msync the mapping; 0 and 1 are buffer indices
+
+struct AUTOSAVE {
+    uint64_t quiet_nsec;
+    uint64_t interval_nsec;
+    uint64_t last_change_nsec;  // when a write to cart ram was last noticed
+    uint64_t first_change_nsec; // oldest change not handed to the writer yet, 0 if there's none
+    char *path;
+    char *temp_path;
+
+    // shared with the writer, under mutex
+    byte *buffers[2];
+    size_t capacities[2];
+    size_t sizes[2];
+    byte *sync_block;
+    size_t sync_size;
+    int32_t pending;            // job waiting for the writer
+    int32_t writing;            // job the writer is working on
+    _Bool stopping;
+    uint64_t failures;
+
+#ifndef EMSCRIPTEN
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+#ifndef EMSCRIPTEN
+
+/*-------------------WRITER THREAD------------------*/
+
+// readers of the battery file see either the previous or the new contents, never a partial write
+static _Bool autosave_write_file(struct AUTOSAVE *a, const byte *data, size_t size)
+{
+    int fd = open(a->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return 0;
+
+    size_t written = 0;
+
+    while (written < size)
+    {
+        ssize_t result = write(fd, data + written, size - written);
+
+        if (result < 0 && errno == EINTR)
+            continue;
+
+        if (result <= 0)
+            break;
+
+        written += result;
+    }
+
+    _Bool ok = (written == size && fsync(fd) == 0);
+
+    if (close(fd) != 0)
+        ok = 0;
+
+    if (ok && rename(a->temp_path, a->path) != 0)
+        ok = 0;
+
+    if (!ok)
+        unlink(a->temp_path);
+
+    return ok;
+}
+
+static void *autosave_writer_thread(void *arg)
+{
+    struct AUTOSAVE *a = arg;
+
+    pthread_mutex_lock(&a->mutex);
+
+    for (;;)
+    {
+        while (a->pending == AUTOSAVE_NONE && !a->stopping)
+            pthread_cond_wait(&a->cond, &a->mutex);
+
+        // jobs handed over before stopping still get done
+        if (a->pending == AUTOSAVE_NONE)
+            break;
+
+        int32_t job = a->pending;
+        byte *block = (job == AUTOSAVE_SYNC ? a->sync_block : a->buffers[job]);
+        size_t size = (job == AUTOSAVE_SYNC ? a->sync_size : a->sizes[job]);
+
+        a->pending = AUTOSAVE_NONE;
+        a->writing = job;
+
+        pthread_mutex_unlock(&a->mutex);
+
+        _Bool ok = (job == AUTOSAVE_SYNC ? msync(block, size, MS_SYNC) == 0 : autosave_write_file(a, block, size));
+
+        if (!ok)
+            printf("Failed to autosave battery file: %s\n", a->path);
+
+        pthread_mutex_lock(&a->mutex);
+
+        a->writing = AUTOSAVE_NONE;
+
+        if (!ok)
+            a->failures++;
+    }
+
+    pthread_mutex_unlock(&a->mutex);
+
+    return NULL;
+}
+
+/*-------------------EMULATION THREAD------------------*/
+
+// returns 0 if there was no memory for the copy
+static _Bool autosave_submit(struct AUTOSAVE *a)
+{
+    _Bool ok = 1;
+
+    pthread_mutex_lock(&a->mutex);
+
+    if (CTX(ext_ram_mapped_size))
+    {
+        a->sync_block = CTX(ext_ram);
+        a->sync_size = CTX(ext_ram_mapped_size);
+        a->pending = AUTOSAVE_SYNC;
+    }
+    else
+    {
+        // a copy the writer hasn't picked up yet is simply replaced
+        int32_t buffer = (a->pending == 0 || a->pending == 1 ? a->pending : (a->writing == 0 ? 1 : 0));
+        size_t size = (size_t)CTX(ext_ram_bank_count) * 0x2000;
+
+        if (a->capacities[buffer] < size)
+        {
+            byte *grown = realloc(a->buffers[buffer], size);
+
+            if (grown)
+            {
+                a->buffers[buffer] = grown;
+                a->capacities[buffer] = size;
+            }
+            else
+                ok = 0;
+        }
+
+        if (ok)
+        {
+            memcpy(a->buffers[buffer], CTX(ext_ram), size);
+            a->sizes[buffer] = size;
+            a->pending = buffer;
+        }
+    }
+
+    if (ok)
+        pthread_cond_signal(&a->cond);
+
+    pthread_mutex_unlock(&a->mutex);
+
+    return ok;
+}
+
+void autosave_on_frame()
+{
+    struct AUTOSAVE *a = CTX(autosave);
+
+    if (!CTX(battery_enabled) || !CTX(ext_ram))
+        return;
+
+    uint64_t now = host_nsec();
+
+    if (CTX(ext_ram_dirty))
+    {
+        CTX(ext_ram_dirty) = 0;
+
+        a->last_change_nsec = now;
+
+        if (!a->first_change_nsec)
+            a->first_change_nsec = now;
+    }
+
+    if (!a->first_change_nsec)
+        return;
+
+    _Bool quiet = (now - a->last_change_nsec >= a->quiet_nsec);
+    _Bool overdue = (a->interval_nsec && now - a->first_change_nsec >= a->interval_nsec);
+
+    if ((quiet || overdue) && autosave_submit(a))
+        a->first_change_nsec = 0;
+}
+
+void autosave_free(struct AUTOSAVE *a)
+{
+    if (!a)
+        return;
+
+    pthread_mutex_lock(&a->mutex);
+    a->stopping = 1;
+    pthread_cond_signal(&a->cond);
+    pthread_mutex_unlock(&a->mutex);
+
+    pthread_join(a->thread, NULL);
+
+    pthread_cond_destroy(&a->cond);
+    pthread_mutex_destroy(&a->mutex);
+
+    free(a->buffers[0]);
+    free(a->buffers[1]);
+    free(a->path);
+    free(a->temp_path);
+    free(a);
+}
+
+int nsgbe_autosave_enable(uint32_t quiet_msec, uint32_t interval_sec)
+{
+    nsgbe_autosave_disable();
+
+    if (!CTX(battery_path))
+        return NSGBE_ERR;
+
+    struct AUTOSAVE *a = calloc(1, sizeof(struct AUTOSAVE));
+
+    if (!a)
+        return NSGBE_ERR;
+
+    size_t path_length = strlen(CTX(battery_path));
+
+    a->path = strdup(CTX(battery_path));
+    a->temp_path = malloc(path_length + 4 + 1);
+
+    if (!a->path || !a->temp_path)
+    {
+        free(a->path);
+        free(a->temp_path);
+        free(a);
+        return NSGBE_ERR;
+    }
+
+    memcpy(a->temp_path, CTX(battery_path), path_length);
+    memcpy(a->temp_path + path_length, ".tmp", 4 + 1);
+
+    a->quiet_nsec = quiet_msec * 1000000ULL;
+    a->interval_nsec = interval_sec * 1000000000ULL;
+    a->pending = AUTOSAVE_NONE;
+    a->writing = AUTOSAVE_NONE;
+
+    pthread_mutex_init(&a->mutex, NULL);
+    pthread_cond_init(&a->cond, NULL);
+
+    if (pthread_create(&a->thread, NULL, autosave_writer_thread, a) != 0)
+    {
+        pthread_cond_destroy(&a->cond);
+        pthread_mutex_destroy(&a->mutex);
+        free(a->path);
+        free(a->temp_path);
+        free(a);
+        return NSGBE_ERR;
+    }
+
+    // changes made before now are only saved along with later ones
+    CTX(ext_ram_dirty) = 0;
+    CTX(autosave) = a;
+
+    return NSGBE_OK;
+}
+
+void nsgbe_autosave_disable()
+{
+    struct AUTOSAVE *a = CTX(autosave);
+
+    if (!a)
+        return;
+
+    // hand over what hasn't been saved yet, the writer finishes it before exiting
+    if (CTX(battery_enabled) && CTX(ext_ram) && (CTX(ext_ram_dirty) || a->first_change_nsec))
+    {
+        CTX(ext_ram_dirty) = 0;
+        autosave_submit(a);
+    }
+
+    CTX(autosave) = NULL;
+    autosave_free(a);
+}
+
+uint64_t nsgbe_autosave_failures()
+{
+    struct AUTOSAVE *a = CTX(autosave);
+
+    if (!a)
+        return 0;
+
+    pthread_mutex_lock(&a->mutex);
+    uint64_t failures = a->failures;
+    pthread_mutex_unlock(&a->mutex);
+
+    return failures;
+}
+
+#else
+
+void autosave_on_frame()
+{
+
+}
+
+void autosave_free(struct AUTOSAVE *a)
+{
+
+}
+
+int nsgbe_autosave_enable(uint32_t quiet_msec, uint32_t interval_sec)
+{
+    return NSGBE_ERR;
+}
+
+void nsgbe_autosave_disable()
+{
+
+}
+
+uint64_t nsgbe_autosave_failures()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,368 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// stepping many instances at once
+
+// nsgbe_batch_step() hands the instances out to a pool of worker threads, one per host cpu by default, the calling
+// thread being one of them. every worker starts out with an equal share of the instances, takes them from the front
+// of its share and, once that's empty, steals from the back of the others', so instances that take longer (busier
+// games, the lcd being on) don't leave the rest of the pool idle. a share is a [head, tail) range packed into one
+// word, so the owner and thieves agree on who gets an instance with a single compare-and-swap.
+// between batches, the workers sleep on a condition variable
+
+#include "env.h"
+#include <string.h>
+#include <unistd.h>
+
+#define BATCH_FRAME_PIXELS (GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT)
+
+struct BATCH_SHARE {
+    uint64_t range CTX_ALIGNED; // head in the low, tail in the high 32 bits
+};
+
+struct BATCH_POOL {
+    uint32_t workers; // including the calling thread
+    struct BATCH_SHARE *shares;
+
+#ifndef EMSCRIPTEN
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+#endif
+    uint64_t generation; // bumped for every batch, under mutex
+    uint32_t busy;       // workers not done with the current batch yet
+    _Bool stopping;
+
+    // the current batch
+    struct nsgbe_ctx **ctxs;
+    const union BUTTON_STATE *inputs;
+    uint32_t frames;
+    _Bool observations;  // hand out observations instead of frames
+    size_t output_size;  // per instance, in bytes
+    byte *output;
+    size_t output_capacity;
+};
+
+static struct BATCH_POOL batch_pool;
+static uint32_t batch_requested_workers = 0; // 0: one per host cpu
+
+#ifndef EMSCRIPTEN
+static pthread_mutex_t batch_call_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*-------------------WORK SHARES------------------*/
+
+static _Bool batch_share_take(struct BATCH_SHARE *share, _Bool from_back, uint32_t *index)
+{
+    uint64_t range = __atomic_load_n(&share->range, __ATOMIC_ACQUIRE);
+
+    for (;;)
+    {
+        uint32_t head = (uint32_t)range;
+        uint32_t tail = (uint32_t)(range >> 32);
+
+        if (head >= tail)
+            return 0;
+
+        uint64_t taken = (from_back ? ((uint64_t)(tail - 1) << 32) | head : ((uint64_t)tail << 32) | (head + 1));
+
+        if (__atomic_compare_exchange_n(&share->range, &range, taken, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *index = (from_back ? tail - 1 : head);
+            return 1;
+        }
+    }
+}
+
+static void batch_step_instance(uint32_t index)
+{
+    struct BATCH_POOL *pool = &batch_pool;
+
+    nsgbe_ctx_bind(pool->ctxs[index]);
+
+    if (pool->inputs)
+        nsgbe_set_buttons(pool->inputs[index]);
+
+    // an instance whose machine has stopped stays where it is
+    for (uint32_t f = 0; f < pool->frames; f++)
+        if (!nsgbe_run_frame())
+            break;
+
+    byte *output = pool->output + (size_t)index * pool->output_size;
+
+    if (pool->observations)
+    {
+        // an instance set up differently gets its observation cut short or padded with zeroes
+        size_t size = nsgbe_observation_size();
+
+        if (size > pool->output_size)
+            size = pool->output_size;
+
+        if (size)
+            memcpy(output, nsgbe_observation(NULL, NULL), size);
+
+        memset(output + size, 0, pool->output_size - size);
+    }
+    else
+        memcpy(output, nsgbe_framebuffer(), pool->output_size);
+}
+
+static void batch_work(uint32_t worker)
+{
+    struct BATCH_POOL *pool = &batch_pool;
+    uint32_t index;
+
+    for (;;)
+    {
+        _Bool found = batch_share_take(&pool->shares[worker], 0, &index);
+
+        for (uint32_t k = 1; k < pool->workers && !found; k++)
+            found = batch_share_take(&pool->shares[(worker + k) % pool->workers], 1, &index);
+
+        if (!found)
+            break;
+
+        batch_step_instance(index);
+    }
+}
+
+/*-------------------POOL------------------*/
+
+#ifndef EMSCRIPTEN
+
+static void *batch_worker_thread(void *arg)
+{
+    struct BATCH_POOL *pool = &batch_pool;
+    uint32_t worker = (uint32_t)(uintptr_t)arg;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;)
+    {
+        while (pool->generation == generation && !pool->stopping)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+
+        if (pool->stopping)
+            break;
+
+        generation = pool->generation;
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        batch_work(worker);
+        nsgbe_ctx_bind(NULL);
+
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+static void batch_pool_stop()
+{
+    struct BATCH_POOL *pool = &batch_pool;
+
+    if (pool->workers == 0)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (uint32_t i = 1; i < pool->workers; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->mutex);
+
+    free(pool->threads);
+    free(pool->shares);
+    free(pool->output);
+
+    memset(pool, 0, sizeof(struct BATCH_POOL));
+}
+
+static _Bool batch_pool_start()
+{
+    struct BATCH_POOL *pool = &batch_pool;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t workers = (batch_requested_workers ? batch_requested_workers : (cpus > 0 ? cpus : 1));
+
+    pool->shares = aligned_alloc(CTX_CACHE_LINE, workers * sizeof(struct BATCH_SHARE));
+    pool->threads = calloc(workers, sizeof(pthread_t));
+
+    if (!pool->shares || !pool->threads)
+    {
+        free(pool->shares);
+        free(pool->threads);
+        pool->shares = NULL;
+        pool->threads = NULL;
+        return 0;
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    pool->workers = 1;
+
+    // worker 0 is whoever calls nsgbe_batch_step(); a pool short of threads still works, just with fewer of them
+    for (uint32_t i = 1; i < workers; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, batch_worker_thread, (void *)(uintptr_t)i) != 0)
+            break;
+
+        pool->workers++;
+    }
+
+    return 1;
+}
+
+#else
+
+static void batch_pool_stop()
+{
+    free(batch_pool.shares);
+    free(batch_pool.output);
+
+    memset(&batch_pool, 0, sizeof(struct BATCH_POOL));
+}
+
+static _Bool batch_pool_start()
+{
+    batch_pool.shares = aligned_alloc(CTX_CACHE_LINE, sizeof(struct BATCH_SHARE));
+    batch_pool.workers = (batch_pool.shares ? 1 : 0);
+
+    return (batch_pool.shares != NULL);
+}
+
+#endif
+
+/*-------------------API------------------*/
+
+void nsgbe_batch_set_workers(uint32_t workers)
+{
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&batch_call_mtx);
+#endif
+
+    batch_requested_workers = workers;
+    batch_pool_stop();
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_unlock(&batch_call_mtx);
+#endif
+}
+
+static byte *batch_run(struct nsgbe_ctx **ctxs, uint32_t n, const union BUTTON_STATE *inputs, uint32_t frames,
+    _Bool observations)
+{
+    struct BATCH_POOL *pool = &batch_pool;
+
+    if (pool->workers == 0 && !batch_pool_start())
+        return NULL;
+
+    struct nsgbe_ctx *bound = nsgbe_ctx_bound();
+    size_t output_size = BATCH_FRAME_PIXELS * sizeof(uint32_t);
+
+    // the first instance's setup decides the size of every observation
+    if (observations)
+    {
+        nsgbe_ctx_bind(ctxs[0]);
+        output_size = nsgbe_observation_size();
+        nsgbe_ctx_bind(bound);
+
+        if (output_size == 0)
+            return NULL;
+    }
+
+    size_t size = (size_t)n * output_size;
+
+    if (pool->output_capacity < size)
+    {
+        byte *grown = realloc(pool->output, size);
+
+        if (!grown)
+            return NULL;
+
+        pool->output = grown;
+        pool->output_capacity = size;
+    }
+
+    pool->ctxs = ctxs;
+    pool->inputs = inputs;
+    pool->frames = frames;
+    pool->observations = observations;
+    pool->output_size = output_size;
+
+    for (uint32_t w = 0; w < pool->workers; w++)
+    {
+        uint64_t head = (uint64_t)n * w / pool->workers;
+        uint64_t tail = (uint64_t)n * (w + 1) / pool->workers;
+
+        __atomic_store_n(&pool->shares[w].range, (tail << 32) | head, __ATOMIC_RELAXED);
+    }
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&pool->mutex);
+    pool->busy = pool->workers - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+#endif
+
+    batch_work(0);
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->busy)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+    pthread_mutex_unlock(&pool->mutex);
+#endif
+
+    nsgbe_ctx_bind(bound);
+
+    return pool->output;
+}
+
+static byte *batch_step(struct nsgbe_ctx **ctxs, uint32_t n, const union BUTTON_STATE *inputs, uint32_t frames,
+    _Bool observations)
+{
+    if (!ctxs || n == 0)
+        return NULL;
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&batch_call_mtx);
+#endif
+
+    byte *output = batch_run(ctxs, n, inputs, frames, observations);
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_unlock(&batch_call_mtx);
+#endif
+
+    return output;
+}
+
+uint32_t *nsgbe_batch_step(struct nsgbe_ctx **ctxs, uint32_t n, const union BUTTON_STATE *inputs, uint32_t frames)
+{
+    return (uint32_t *)batch_step(ctxs, n, inputs, frames, 0);
+}
+
+uint8_t *nsgbe_batch_step_observations(struct nsgbe_ctx **ctxs, uint32_t n, const union BUTTON_STATE *inputs,
+    uint32_t frames)
+{
+    return batch_step(ctxs, n, inputs, frames, 1);
+}
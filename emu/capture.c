@@ -0,0 +1,415 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// video capture of the presented frames
+
+// vblank() copies every frame it hands to the frontend into a ring (see ring.c), which a writer thread drains, encoding
+// the frames into the capture file or an encoder's stdin.
+//
+// NSGBE_CAPTURE_Y4M writes YUV4MPEG2 (4:4:4, bt.601), which encoders take as is, e.g.
+// "ffmpeg -i - -c:v libx264 -crf 0 session.mkv". a dropped frame is made up for by repeating the frame before it, so
+// the video keeps its length.
+//
+// NSGBE_CAPTURE_TILE_DIFF is lossless and only stores what changed. integers are little endian:
+//   header: "NSGBECAP", u16 version (1), u16 width (160), u16 height (144), u16 tile size (8),
+//           u32 frame rate numerator, u32 frame rate denominator (frames per second)
+//   frame:  u64 sequence number (frames presented before it since the capture started, so gaps are dropped frames),
+//           u16 number of changed tiles, a bitmap of the changed tiles (one bit per tile, row by row, lsb first),
+//           then the changed tiles in bitmap order, each as 8 rows of 8 rgb triplets. the first frame has every tile
+
+#include "env.h"
+#include <string.h>
+#include <signal.h>
+
+#define CAPTURE_QUEUE_FRAMES        32 // power of two
+#define CAPTURE_FLUSH_INTERVAL_USEC 4000
+
+#define CAPTURE_FRAME_PIXELS (GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT)
+#define CAPTURE_TILE         8
+#define CAPTURE_TILES_X      (GB_FRAMEBUFFER_WIDTH / CAPTURE_TILE)
+#define CAPTURE_TILES_Y      (GB_FRAMEBUFFER_HEIGHT / CAPTURE_TILE)
+#define CAPTURE_TILE_MAP     ((CAPTURE_TILES_X * CAPTURE_TILES_Y + 7) / 8)
+
+// the ppu's frame rate: one frame every 70224 cpu clock cycles
+#define CAPTURE_RATE_NUMERATOR   4194304
+#define CAPTURE_RATE_DENOMINATOR 70224
+
+struct CAPTURE_FRAME {
+    uint64_t sequence;
+    uint32_t pixels[CAPTURE_FRAME_PIXELS];
+};
+
+struct CAPTURE {
+    struct RING queue; // of struct CAPTURE_FRAME
+    uint64_t written;
+
+    // emulation thread state
+    uint64_t sequence CTX_ALIGNED;
+
+    // writer thread state
+    enum NSGBE_CAPTURE_FORMAT format;
+    FILE *file;
+    _Bool piped;
+    _Bool failed;
+    uint64_t next_sequence;
+    _Bool have_previous;
+    uint32_t previous[CAPTURE_FRAME_PIXELS];
+    byte planes[CAPTURE_FRAME_PIXELS * 3]; // y4m: y, u, v; tile diff: the changed tiles
+
+#ifndef EMSCRIPTEN
+    pthread_t thread;
+#endif
+};
+
+#ifndef EMSCRIPTEN
+
+void capture_frame(const uint32_t *pixels)
+{
+    struct CAPTURE *c = CTX(capture);
+    uint64_t sequence = c->sequence++;
+    struct CAPTURE_FRAME *frame = ring_slot(&c->queue);
+
+    if (!frame)
+        return;
+
+    frame->sequence = sequence;
+    memcpy(frame->pixels, pixels, sizeof(frame->pixels));
+
+    ring_push(&c->queue);
+}
+
+/*-------------------WRITER THREAD------------------*/
+
+__always_inline static void capture_put16(byte *out, uint16_t value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+__always_inline static void capture_put32(byte *out, uint32_t value)
+{
+    capture_put16(out, value);
+    capture_put16(out + 2, value >> 16);
+}
+
+__always_inline static void capture_put64(byte *out, uint64_t value)
+{
+    capture_put32(out, value);
+    capture_put32(out + 4, value >> 32);
+}
+
+static void capture_write(struct CAPTURE *c, const void *data, size_t size)
+{
+    if (!c->failed && fwrite(data, 1, size, c->file) != size)
+        c->failed = 1;
+}
+
+static void capture_write_header(struct CAPTURE *c)
+{
+    if (c->format == NSGBE_CAPTURE_Y4M)
+    {
+        fprintf(c->file, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C444\n", GB_FRAMEBUFFER_WIDTH, GB_FRAMEBUFFER_HEIGHT,
+                CAPTURE_RATE_NUMERATOR, CAPTURE_RATE_DENOMINATOR);
+        return;
+    }
+
+    byte header[24];
+
+    memcpy(header, "NSGBECAP", 8);
+    capture_put16(header + 8, 1);
+    capture_put16(header + 10, GB_FRAMEBUFFER_WIDTH);
+    capture_put16(header + 12, GB_FRAMEBUFFER_HEIGHT);
+    capture_put16(header + 14, CAPTURE_TILE);
+    capture_put32(header + 16, CAPTURE_RATE_NUMERATOR);
+    capture_put32(header + 20, CAPTURE_RATE_DENOMINATOR);
+
+    capture_write(c, header, sizeof(header));
+}
+
+// pixels hold red in the low byte, see display.c
+static void capture_write_y4m(struct CAPTURE *c, const struct CAPTURE_FRAME *frame)
+{
+    byte *y = c->planes;
+    byte *u = y + CAPTURE_FRAME_PIXELS;
+    byte *v = u + CAPTURE_FRAME_PIXELS;
+
+    // frames dropped since the previous one are filled in with it, its planes are still around
+    uint64_t repeats = (c->have_previous ? frame->sequence - c->next_sequence : 0);
+
+    for (uint64_t i = 0; i < repeats; i++)
+    {
+        capture_write(c, "FRAME\n", 6);
+        capture_write(c, c->planes, sizeof(c->planes));
+    }
+
+    for (uint32_t i = 0; i < CAPTURE_FRAME_PIXELS; i++)
+    {
+        int32_t r = frame->pixels[i] & 0xFF;
+        int32_t g = (frame->pixels[i] >> 8) & 0xFF;
+        int32_t b = (frame->pixels[i] >> 16) & 0xFF;
+
+        y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+
+    capture_write(c, "FRAME\n", 6);
+    capture_write(c, c->planes, sizeof(c->planes));
+}
+
+static void capture_write_tile_diff(struct CAPTURE *c, const struct CAPTURE_FRAME *frame)
+{
+    byte header[8 + 2 + CAPTURE_TILE_MAP] = { 0 };
+    byte *tiles = c->planes;
+    uint16_t changed = 0;
+
+    for (uint32_t ty = 0; ty < CAPTURE_TILES_Y; ty++)
+    {
+        for (uint32_t tx = 0; tx < CAPTURE_TILES_X; tx++)
+        {
+            uint32_t origin = ty * CAPTURE_TILE * GB_FRAMEBUFFER_WIDTH + tx * CAPTURE_TILE;
+            _Bool dirty = !c->have_previous;
+
+            for (uint32_t row = 0; row < CAPTURE_TILE && !dirty; row++)
+            {
+                uint32_t offset = origin + row * GB_FRAMEBUFFER_WIDTH;
+                dirty = (memcmp(frame->pixels + offset, c->previous + offset, CAPTURE_TILE * sizeof(uint32_t)) != 0);
+            }
+
+            if (!dirty)
+                continue;
+
+            uint32_t tile = ty * CAPTURE_TILES_X + tx;
+            header[10 + tile / 8] |= 1 << (tile % 8);
+            changed++;
+
+            for (uint32_t row = 0; row < CAPTURE_TILE; row++)
+            {
+                for (uint32_t x = 0; x < CAPTURE_TILE; x++)
+                {
+                    uint32_t pixel = frame->pixels[origin + row * GB_FRAMEBUFFER_WIDTH + x];
+
+                    *tiles++ = pixel & 0xFF;
+                    *tiles++ = (pixel >> 8) & 0xFF;
+                    *tiles++ = (pixel >> 16) & 0xFF;
+                }
+            }
+        }
+    }
+
+    capture_put64(header, frame->sequence);
+    capture_put16(header + 8, changed);
+
+    capture_write(c, header, sizeof(header));
+    capture_write(c, c->planes, tiles - c->planes);
+}
+
+static void capture_write_frame(void *slot, void *user)
+{
+    struct CAPTURE *c = user;
+    const struct CAPTURE_FRAME *frame = slot;
+
+    if (c->format == NSGBE_CAPTURE_Y4M)
+        capture_write_y4m(c, frame);
+    else
+        capture_write_tile_diff(c, frame);
+
+    memcpy(c->previous, frame->pixels, sizeof(c->previous));
+    c->have_previous = 1;
+    c->next_sequence = frame->sequence + 1;
+
+    if (!c->failed)
+        __atomic_fetch_add(&c->written, 1, __ATOMIC_RELAXED);
+}
+
+// returns the number of frames taken off the queue
+static uint32_t capture_drain(void *user)
+{
+    struct CAPTURE *c = user;
+    uint32_t count = ring_drain(&c->queue, capture_write_frame, c);
+
+    if (count && !c->failed && fflush(c->file) != 0)
+        c->failed = 1;
+
+    return count;
+}
+
+static void *capture_writer_thread(void *arg)
+{
+    struct CAPTURE *c = arg;
+
+    // an encoder that has quit shows up as a failed write instead of a signal taking down the process
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, NULL);
+
+    capture_write_header(c);
+    ring_drain_until_stopped(&c->queue, capture_drain, c, CAPTURE_FLUSH_INTERVAL_USEC);
+
+    if (c->piped)
+    {
+        if (pclose(c->file) != 0)
+            c->failed = 1;
+    }
+    else if (fclose(c->file) != 0)
+        c->failed = 1;
+
+    c->file = NULL;
+
+    if (c->failed)
+        printf("Failed to write video capture.\n");
+
+    return NULL;
+}
+
+/*-------------------API------------------*/
+
+void capture_free(struct CAPTURE *c)
+{
+    if (!c)
+        return;
+
+    if (c->file)
+    {
+        ring_stop(&c->queue);
+        pthread_join(c->thread, NULL);
+    }
+
+    ring_free(&c->queue);
+    free(c);
+}
+
+static int capture_start(FILE *file, _Bool piped, enum NSGBE_CAPTURE_FORMAT format)
+{
+    struct CAPTURE *c = calloc(1, sizeof(struct CAPTURE));
+
+    if (!c)
+        return NSGBE_ERR;
+
+    if (!ring_init(&c->queue, sizeof(struct CAPTURE_FRAME), CAPTURE_QUEUE_FRAMES))
+    {
+        free(c);
+        return NSGBE_ERR;
+    }
+
+    c->format = format;
+    c->file = file;
+    c->piped = piped;
+
+    if (pthread_create(&c->thread, NULL, capture_writer_thread, c) != 0)
+    {
+        ring_free(&c->queue);
+        free(c);
+        return NSGBE_ERR;
+    }
+
+    // vblank() looks at capture under mtx
+    pthread_mutex_lock(&CTX(mtx));
+    CTX(capture) = c;
+    pthread_mutex_unlock(&CTX(mtx));
+
+    return NSGBE_OK;
+}
+
+int nsgbe_capture_start(const char *path, enum NSGBE_CAPTURE_FORMAT format)
+{
+    nsgbe_capture_stop();
+
+    if (!path || format > NSGBE_CAPTURE_TILE_DIFF)
+        return NSGBE_ERR;
+
+    FILE *file = fopen(path, "wb");
+
+    if (!file)
+        return NSGBE_ERR;
+
+    if (!capture_start(file, 0, format))
+    {
+        fclose(file);
+        return NSGBE_ERR;
+    }
+
+    return NSGBE_OK;
+}
+
+int nsgbe_capture_start_pipe(const char *command, enum NSGBE_CAPTURE_FORMAT format)
+{
+    nsgbe_capture_stop();
+
+    if (!command || format > NSGBE_CAPTURE_TILE_DIFF)
+        return NSGBE_ERR;
+
+    FILE *file = popen(command, "w");
+
+    if (!file)
+        return NSGBE_ERR;
+
+    if (!capture_start(file, 1, format))
+    {
+        pclose(file);
+        return NSGBE_ERR;
+    }
+
+    return NSGBE_OK;
+}
+
+void nsgbe_capture_stop()
+{
+    pthread_mutex_lock(&CTX(mtx));
+    struct CAPTURE *c = CTX(capture);
+    CTX(capture) = NULL;
+    pthread_mutex_unlock(&CTX(mtx));
+
+    capture_free(c);
+}
+
+uint64_t nsgbe_capture_frames()
+{
+    return (CTX(capture) ? __atomic_load_n(&CTX(capture)->written, __ATOMIC_RELAXED) : 0);
+}
+
+uint64_t nsgbe_capture_dropped()
+{
+    return (CTX(capture) ? ring_dropped(&CTX(capture)->queue) : 0);
+}
+
+#else
+
+void capture_frame(const uint32_t *pixels)
+{
+
+}
+
+void capture_free(struct CAPTURE *c)
+{
+
+}
+
+int nsgbe_capture_start(const char *path, enum NSGBE_CAPTURE_FORMAT format)
+{
+    return NSGBE_ERR;
+}
+
+int nsgbe_capture_start_pipe(const char *command, enum NSGBE_CAPTURE_FORMAT format)
+{
+    return NSGBE_ERR;
+}
+
+void nsgbe_capture_stop()
+{
+
+}
+
+uint64_t nsgbe_capture_frames()
+{
+    return 0;
+}
+
+uint64_t nsgbe_capture_dropped()
+{
+    return 0;
+}
+
+#endif
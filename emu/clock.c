@@ -3,31 +3,70 @@
 // SPDX-License-Identifier: LGPL-2.0-only
 
 #include "env.h"
-#include <sys/time.h>
+#include <string.h>
 #include <unistd.h>
 
-#define SYSTEM_OVERCLOCK_MULTIPLIER     4
-#define EFFECTIVE_MACHINE_CLOCK_HZ      (MACHINE_CLOCK_HZ * (system_overclock ? SYSTEM_OVERCLOCK_MULTIPLIER : 1))
+#define NSEC_PER_USEC                   1000
+#define NSEC_PER_SEC                    1000000000ULL
 
 #define CLOCK_TICKS_PER_SLEEP_CYCLE     1024
-#define SLEEP_CYCLE_HZ                  (EFFECTIVE_MACHINE_CLOCK_HZ / CLOCK_TICKS_PER_SLEEP_CYCLE)
-#define USEC_PER_SLEEP_CYCLE            (USEC_PER_SEC / SLEEP_CYCLE_HZ)
+#define SLEEP_CYCLE_HZ                  ((float)MACHINE_CLOCK_HZ * CTX(system_speed) / CLOCK_TICKS_PER_SLEEP_CYCLE)
+#define NSEC_PER_SLEEP_CYCLE            ((uint64_t)(NSEC_PER_SEC / SLEEP_CYCLE_HZ))
+
+#define SPEED_SAMPLE_CLOCK_TICKS        (64 * CLOCK_TICKS_PER_SLEEP_CYCLE) // how many machine clock ticks to run between two looks at the host clock
+#define SPEED_SAMPLE_WINDOW_NSEC        500000000ULL // achieved speed is averaged over (at least) this long
+
+#define CPU_TICKS_PER_FRAME             (154 * 456) // 144 visible + 10 vblank lines
 
 #define CLOCK_CYCLES_PER_CLOCK_TICK     1 // setting this value higher may result in bugs due to chip synchronisation, as they're all running on one thread
 
-#define system_alive (cpu_alive && ppu_alive)
+#define system_alive (CTX(cpu_alive) && CTX(ppu_alive))
+
+__always_inline static void clock_sample_speed(uint32_t clock_ticks)
+{
+    CTX(speed_sample_clock_ticks) += clock_ticks;
+
+    if (CTX(speed_sample_clock_ticks) - CTX(speed_sample_clock_ticks_checked) < SPEED_SAMPLE_CLOCK_TICKS)
+        return;
+
+    CTX(speed_sample_clock_ticks_checked) = CTX(speed_sample_clock_ticks);
+
+    uint64_t time_now = host_nsec();
 
-_Bool system_overclock = 0;  // indicates whether to apply SYSTEM_OVERCLOCK_MULTIPLIER to the base machine clock frequency
-_Bool system_running = 0;    // indicates whether the system (clock) is running
+    if (CTX(speed_sample_time_start) == 0 || time_now < CTX(speed_sample_time_start))
+    {
+        CTX(speed_sample_time_start) = time_now;
+        CTX(speed_sample_clock_ticks) = 0;
+        CTX(speed_sample_clock_ticks_checked) = 0;
+        return;
+    }
+
+    uint64_t sample_elapsed = time_now - CTX(speed_sample_time_start);
+
+    if (sample_elapsed < SPEED_SAMPLE_WINDOW_NSEC)
+        return;
 
-int32_t cpu_clock_cycles_behind = 0; // negative means the cpu is in the future by given number of clock cycles
-int32_t ppu_clock_cycles_behind = 0; // negative means the ppu is in the future by given number of clock cycles
+    double emulated_nsec = (double)CTX(speed_sample_clock_ticks) * NSEC_PER_SEC / MACHINE_CLOCK_HZ;
+    CTX(system_achieved_speed) = emulated_nsec / sample_elapsed;
+
+    CTX(speed_sample_time_start) = time_now;
+    CTX(speed_sample_clock_ticks) = 0;
+    CTX(speed_sample_clock_ticks_checked) = 0;
+}
 
 __always_inline static void clock_tick_cpu_ppu()
 {
+    PROFILE_BEGIN_SAMPLED(NSGBE_PROFILE_IO);
     io_exec_cycles(1);
-    cpu_clock_cycles_behind = cpu_exec_cycles(cpu_clock_cycles_behind + 1);
-    ppu_clock_cycles_behind = ppu_exec_cycles(ppu_clock_cycles_behind + 1);
+    PROFILE_END_SAMPLED(NSGBE_PROFILE_IO);
+
+    PROFILE_BEGIN_SAMPLED(NSGBE_PROFILE_CPU);
+    CTX(cpu_clock_cycles_behind) = cpu_exec_cycles(CTX(cpu_clock_cycles_behind) + 1);
+    PROFILE_END_SAMPLED(NSGBE_PROFILE_CPU);
+
+    PROFILE_BEGIN_SAMPLED(NSGBE_PROFILE_PPU);
+    CTX(ppu_clock_cycles_behind) = ppu_exec_cycles(CTX(ppu_clock_cycles_behind) + 1);
+    PROFILE_END_SAMPLED(NSGBE_PROFILE_PPU);
 }
 
 __always_inline static void clock_tick_machine()
@@ -36,57 +75,203 @@ __always_inline static void clock_tick_machine()
         clock_tick_cpu_ppu();
 }
 
+// runs until the ppu completes a frame; returns the number of cpu clock cycles that took
+__always_inline static uint32_t clock_run_frame()
+{
+    uint32_t frame = CTX(ppu_frame_counter);
+    uint32_t c;
+
+    // with the lcd turned off, the ppu never completes a frame, so give up after twice the usual frame time
+    for (c = 0; c < 2 * CPU_TICKS_PER_FRAME && frame == CTX(ppu_frame_counter) && system_alive; c++)
+        clock_tick_cpu_ppu();
+
+    return c;
+}
+
+static void clock_run_ahead()
+{
+    if (CTX(runahead_last_frame) == CTX(ppu_frame_counter))
+        return;
+
+    size_t state_size = nsgbe_state_size();
+    size_t ext_ram_size = (size_t)CTX(ext_ram_bank_count) * 0x2000;
+
+    if (CTX(runahead_state_size) != state_size + ext_ram_size)
+    {
+        free_ptr((void **)&CTX(runahead_state));
+
+        CTX(runahead_state) = malloc(state_size + ext_ram_size);
+        CTX(runahead_state_size) = (CTX(runahead_state) ? state_size + ext_ram_size : 0);
+    }
+
+    if (state_size == 0 || CTX(runahead_state_size) == 0 || !nsgbe_state_save(CTX(runahead_state), state_size))
+        return;
+
+    // frames run ahead get cart ram of their own: with the battery file mapped, their writes would otherwise reach it
+    // (and make autosave and rewind see changes) only to be rolled back. cart ram itself is left alone by the rollback
+    byte *ext_ram_copy = CTX(runahead_state) + state_size;
+    byte *ext_ram_banks[EXT_RAM_BANKS_MAX];
+    _Bool ext_ram_dirty = CTX(ext_ram_dirty);
+
+    cow_unshare_all(nsgbe_ctx_current);
+    memcpy(ext_ram_banks, CTX(ext_ram_banks), sizeof(ext_ram_banks));
+    memcpy(ext_ram_copy, CTX(ext_ram), ext_ram_size);
+
+    for (uint16_t i = 0; i < CTX(ext_ram_bank_count); i++)
+        CTX(ext_ram_banks)[i] = ext_ram_copy + (i * 0x2000);
+
+    CTX(running_ahead) = 1;
+
+    // intermediate frames don't need to be drawn, only the one that gets presented
+    for (uint32_t i = 1; i < CTX(runahead_frames); i++)
+        clock_run_frame();
+
+    CTX(render_suppressed) = 0;
+    clock_run_frame();
+    CTX(render_suppressed) = 1;
+
+    memcpy(CTX(ext_ram_banks), ext_ram_banks, sizeof(ext_ram_banks));
+    CTX(ext_ram_dirty) = ext_ram_dirty;
+
+    state_load_machine(CTX(runahead_state), state_size);
+
+    CTX(running_ahead) = 0;
+
+    CTX(runahead_last_frame) = CTX(ppu_frame_counter);
+}
+
+// things that want to look at the machine in between frames; called right where the ppu completes one (frame being
+// ppu_frame_counter from before), so snapshots are always taken, and frames always run ahead, from a frame boundary
+__always_inline static void clock_frame_hooks(uint32_t frame)
+{
+    if (frame == CTX(ppu_frame_counter))
+        return;
+
+    if (CTX(cow_pages_held))
+        cow_on_frame();
+
+    if (CTX(rewind_buffer))
+        rewind_on_frame();
+
+    if (CTX(runahead_frames))
+        clock_run_ahead();
+}
+
 __always_inline void clock_perform_sleep_cycle_ticks()
 {
     for (uint32_t c = 0; c < CLOCK_TICKS_PER_SLEEP_CYCLE; c++)
     {
-        if (!system_running)
-            break;
+        if (!CTX(system_running))
+            return;
+
+        uint32_t frame = CTX(ppu_frame_counter);
 
         clock_tick_machine();
+        clock_frame_hooks(frame);
     }
+
+    clock_sample_speed(CLOCK_TICKS_PER_SLEEP_CYCLE);
 }
 
-uint32_t time_pre;
 __always_inline void clock_perform_sleep_cycle()
 {
-    struct timeval tv;
-    uint32_t time_now, target_time;
+    uint64_t time_now, target_time, time_per_sleep_cycle;
+
+    if (CTX(system_speed) == NSGBE_SPEED_UNCAPPED)
+    {
+        // run as fast as the host allows; start pacing from scratch once a cap is set again
+        CTX(time_pre) = 0;
+        clock_perform_sleep_cycle_ticks();
+        return;
+    }
+
+    time_per_sleep_cycle = NSEC_PER_SLEEP_CYCLE;
+    target_time = CTX(time_pre) + time_per_sleep_cycle;
+
+    time_now = host_nsec();
 
-    target_time = time_pre + USEC_PER_SLEEP_CYCLE;
+    uint64_t target = (target_time - time_now) - 20 * NSEC_PER_USEC;
+    _Bool sleeping = (target < time_per_sleep_cycle);
 
-    gettimeofday(&tv, NULL);
-    time_now = (USEC_PER_SEC * tv.tv_sec + tv.tv_usec);
+    if (CTX(trace) && sleeping)
+        trace_event(TRACE_SLEEP_BEGIN, 0);
 
-    uint32_t target = (target_time - time_now) - 20;
-    if (target < USEC_PER_SLEEP_CYCLE)
+    if (sleeping)
     {
-        usleep(target);
+        usleep(target / NSEC_PER_USEC);
 
-        gettimeofday(&tv, NULL);
-        time_now = (USEC_PER_SEC * tv.tv_sec + tv.tv_usec);
+        time_now = host_nsec();
     }
     else
         target_time = time_now;
 
-    while (system_running && time_now < target_time)
+    while (CTX(system_running) && time_now < target_time)
     {
         usleep(1);
 
-        gettimeofday(&tv, NULL);
-        time_now = (USEC_PER_SEC * tv.tv_sec + tv.tv_usec);
+        time_now = host_nsec();
     }
 
-    time_pre = target_time;
+    if (CTX(trace) && sleeping)
+        trace_event(TRACE_SLEEP_END, 0);
+
+    if (sleeping)
+        stats_on_sleep(time_now > target_time ? time_now - target_time : 0);
+
+    CTX(time_pre) = target_time;
 
     clock_perform_sleep_cycle_ticks();
 }
 
+float clock_sleep_cycle_hz()
+{
+    if (CTX(system_speed) == NSGBE_SPEED_UNCAPPED)
+        return 0.f;
+
+    return SLEEP_CYCLE_HZ;
+}
+
+uint64_t nsgbe_cycle_count()
+{
+    return CTX(emulated_cycles);
+}
+
+uint64_t nsgbe_instruction_count()
+{
+    return CTX(instruction_counter);
+}
+
+int nsgbe_run_cycles(uint32_t clock_cycles)
+{
+    for (uint32_t c = 0; c < clock_cycles && system_alive; c++)
+    {
+        uint32_t frame = CTX(ppu_frame_counter);
+
+        clock_tick_cpu_ppu();
+        clock_frame_hooks(frame);
+    }
+
+    clock_sample_speed(clock_cycles / CPU_TICKS_PER_MACHINE_CLOCK);
+
+    return (system_alive ? NSGBE_OK : NSGBE_ERR);
+}
+
+int nsgbe_run_frame()
+{
+    uint32_t frame = CTX(ppu_frame_counter);
+    uint32_t c = clock_run_frame();
+
+    clock_sample_speed(c / CPU_TICKS_PER_MACHINE_CLOCK);
+    clock_frame_hooks(frame);
+
+    return (system_alive ? NSGBE_OK : NSGBE_ERR);
+}
+
 void clock_loop()
 {
-    while (system_alive)
+    while (system_alive && !CTX(system_stopping))
     {
-        while (system_running && system_alive)
+        while (CTX(system_running) && system_alive)
             clock_perform_sleep_cycle();
 
         usleep(100);
@@ -97,18 +282,73 @@ void clock_loop()
         printf("--------------------------------------------------------------------------\n");
         printf("A critical component stopped executing, forcing the system to shut down...\n");
         printf("System overview:\n");
-        printf("CPU alive: %s, PC: 0x%04X\n", (cpu_alive ? "Yes" : "No"), cpu_regs.PC);
-        printf("PPU alive: %s, Mode: %d\n", (ppu_alive ? "Yes" : "No"), ppu_regs.stat->mode);
+        printf("CPU alive: %s, PC: 0x%04X\n", (CTX(cpu_alive) ? "Yes" : "No"), CTX(cpu_regs).PC);
+        printf("PPU alive: %s, Mode: %d\n", (CTX(ppu_alive) ? "Yes" : "No"), CTX(ppu_regs).stat->mode);
         printf("--------------------------------------------------------------------------\n");
     }
 }
 
+void system_set_speed(float multiplier)
+{
+    if (multiplier != NSGBE_SPEED_UNCAPPED)
+    {
+        if (multiplier < NSGBE_SPEED_MIN)
+            multiplier = NSGBE_SPEED_MIN;
+
+        if (multiplier > NSGBE_SPEED_MAX)
+            multiplier = NSGBE_SPEED_MAX;
+    }
+
+    CTX(system_speed) = multiplier;
+}
+
+float system_get_speed()
+{
+    return CTX(system_speed);
+}
+
+float system_get_achieved_speed()
+{
+    return CTX(system_achieved_speed);
+}
+
+void system_set_runahead(uint32_t frames)
+{
+    if (frames > NSGBE_RUNAHEAD_MAX)
+        frames = NSGBE_RUNAHEAD_MAX;
+
+    CTX(runahead_frames) = frames;
+    CTX(runahead_last_frame) = CTX(ppu_frame_counter);
+
+    // the frames the machine actually lives through are never shown while running ahead
+    CTX(render_suppressed) = (frames > 0);
+
+    if (frames == 0)
+    {
+        free_ptr((void **)&CTX(runahead_state));
+        CTX(runahead_state_size) = 0;
+    }
+}
+
+uint32_t system_get_runahead()
+{
+    return CTX(runahead_frames);
+}
+
 void system_resume()
 {
-    system_running = 1;
+    CTX(system_running) = 1;
 }
 
 void system_pause()
 {
-    system_running = 0;
+    CTX(system_running) = 0;
+    CTX(system_achieved_speed) = 0.f;
+    CTX(speed_sample_time_start) = 0;
+}
+
+void system_stop()
+{
+    CTX(system_stopping) = 1;
+    system_pause();
 }
@@ -0,0 +1,299 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// emulator instances
+
+// every piece of machine state lives in a struct nsgbe_ctx; the rest of the core reaches
+// the fields through CTX() (see env.h), which goes to nsgbe_ctx_current, the context bound
+// to the calling thread. the public api keeps working on a default instance unless an
+// embedder creates and binds contexts of its own.
+
+#include "env.h"
+#include <string.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define CTX_HUGE_PAGE_SIZE 0x200000
+
+static struct nsgbe_ctx default_ctx;
+
+NSGBE_TLS struct nsgbe_ctx *nsgbe_ctx_current = &default_ctx;
+
+void ctx_init(struct nsgbe_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(struct nsgbe_ctx));
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_init(&ctx->mtx, NULL);
+#endif
+
+    ctx->system_speed = 1.f;
+
+    ctx->rom_bank_count = 2;
+    ctx->active_rom_bank = word(0x0001);
+    ctx->active_ext_ram_bank = word(0x0000);
+    ctx->ext_ram_enabled = 1;
+
+    ctx->selected_rtc_reg = 0x8;
+
+    ctx->active_display_viewport = ctx->view_port_1;
+    ctx->next_display_viewport = ctx->view_port_2;
+    ctx->next_ppu_viewport = ctx->view_port_3;
+
+    for (uint16_t i = 0; i < 8; i++)
+        ctx->wram_banks[i] = ctx->cgb_extra_wram_banks[i];
+
+#ifdef NSGBE_PROFILING
+    ctx->profile_report_interval = PROFILE_REPORT_INTERVAL;
+#endif
+}
+
+__attribute__((constructor)) static void default_ctx_init()
+{
+    ctx_init(&default_ctx);
+}
+
+// contexts are allocated cache line aligned, or huge page aligned and sized so the kernel can back them with
+// transparent huge pages; either way, free() takes them back
+struct nsgbe_ctx *ctx_alloc(uint32_t flags)
+{
+    size_t alignment = CTX_CACHE_LINE;
+    size_t size = sizeof(struct nsgbe_ctx);
+
+#ifdef MADV_HUGEPAGE
+    if (flags & NSGBE_CTX_HUGE_PAGES)
+    {
+        alignment = CTX_HUGE_PAGE_SIZE;
+        size = (size + CTX_HUGE_PAGE_SIZE - 1) & ~(size_t)(CTX_HUGE_PAGE_SIZE - 1);
+    }
+#endif
+
+    void *arena;
+
+    if (posix_memalign(&arena, alignment, size) != 0)
+        return NULL;
+
+#ifdef MADV_HUGEPAGE
+    if (flags & NSGBE_CTX_HUGE_PAGES)
+        madvise(arena, size, MADV_HUGEPAGE);
+#endif
+
+    return arena;
+}
+
+struct nsgbe_ctx *nsgbe_ctx_create_flags(uint32_t flags)
+{
+    struct nsgbe_ctx *ctx = ctx_alloc(flags);
+
+    if (!ctx)
+        return NULL;
+
+    ctx_init(ctx);
+
+    ctx->arena_flags = flags;
+
+    return ctx;
+}
+
+struct nsgbe_ctx *nsgbe_ctx_create()
+{
+    return nsgbe_ctx_create_flags(0);
+}
+
+// moves the pointers ctx has into itself over from the context it was copied from; pointers elsewhere (a mapped
+// battery file, shared pages) are left alone
+void ctx_rebase(struct nsgbe_ctx *ctx, const struct nsgbe_ctx *from)
+{
+#define CTX_REBASE(ptr) \
+    if ((const byte *)(ptr) >= (const byte *)from && (const byte *)(ptr) < (const byte *)(from + 1)) \
+        ptr = (void *)((byte *)ctx + ((const byte *)(ptr) - (const byte *)from))
+
+    CTX_REBASE(ctx->active_display_viewport);
+    CTX_REBASE(ctx->next_display_viewport);
+    CTX_REBASE(ctx->next_ppu_viewport);
+    CTX_REBASE(ctx->ppu_regs.lcdc);
+    CTX_REBASE(ctx->ppu_regs.stat);
+    CTX_REBASE(ctx->ext_ram);
+
+    for (uint16_t i = 0; i < EXT_RAM_BANKS_MAX; i++)
+        CTX_REBASE(ctx->ext_ram_banks[i]);
+
+    for (uint16_t i = 0; i < 8; i++)
+        CTX_REBASE(ctx->wram_banks[i]);
+
+#undef CTX_REBASE
+}
+
+// turns a copy of from into an instance of its own: the rom and shared pages are shared, the bios copied, everything
+// else belonging to the original the copy goes without
+void ctx_detach(struct nsgbe_ctx *ctx, const struct nsgbe_ctx *from)
+{
+    if (ctx->rom_mapping)
+        rom_retain(ctx->rom_mapping);
+    else
+    {
+        ctx->rombuffer = NULL;
+        ctx->romsize = 0;
+    }
+
+    cow_retain_all(ctx);
+
+    if (ctx->biosbuffer)
+    {
+        ctx->biosbuffer = malloc(ctx->biossize);
+
+        if (ctx->biosbuffer)
+            memcpy(ctx->biosbuffer, from->biosbuffer, ctx->biossize);
+        else
+        {
+            ctx->biossize = 0;
+            ctx->enable_bootrom = 0;
+        }
+    }
+
+    ctx->pending_battery_buffer = NULL;
+    ctx->pending_battery_size = 0;
+    ctx->battery_path = NULL;
+    ctx->ext_ram_dirty = 0;
+    ctx->runahead_state = NULL;
+    ctx->runahead_state_size = 0;
+    ctx->system_running = 0;
+    ctx->system_stopping = 0;
+    ctx->display_notify_vblank = NULL;
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_init(&ctx->mtx, NULL);
+#endif
+
+    size_t tooling = offsetof(struct nsgbe_ctx, rewind_buffer);
+
+    memset((byte *)ctx + tooling, 0, sizeof(struct nsgbe_ctx) - tooling);
+
+#ifdef NSGBE_PROFILING
+    ctx->profile_report_interval = PROFILE_REPORT_INTERVAL;
+#endif
+}
+
+struct nsgbe_ctx *nsgbe_ctx_clone(struct nsgbe_ctx *ctx)
+{
+    if (!ctx)
+        return NULL;
+
+    struct nsgbe_ctx *clone = ctx_alloc(ctx->arena_flags);
+
+    if (!clone)
+        return NULL;
+
+    memcpy(clone, ctx, sizeof(struct nsgbe_ctx));
+
+    ctx_rebase(clone, ctx);
+
+    // a mapped battery file (or a movie's cart ram) stays with the original, the clone gets the contents
+    if (ctx->ext_ram && ctx->ext_ram != ctx->ext_ram_arena)
+    {
+        memcpy(clone->ext_ram_arena, ctx->ext_ram, (size_t)ctx->ext_ram_bank_count * 0x2000);
+
+        clone->ext_ram = clone->ext_ram_arena;
+        clone->ext_ram_mapped_size = 0;
+
+        for (uint16_t i = 0; i < clone->ext_ram_bank_count; i++)
+            clone->ext_ram_banks[i] = clone->ext_ram + (i * 0x2000);
+    }
+
+    ctx_detach(clone, ctx);
+
+    return clone;
+}
+
+void nsgbe_ctx_destroy(struct nsgbe_ctx *ctx)
+{
+    if (!ctx || ctx == &default_ctx)
+        return;
+
+    // a movie hands back the game's cart ram, then the autosave writer gets the last changes and is joined while that
+    // is still there to be copied or synced
+    struct nsgbe_ctx *bound = nsgbe_ctx_current;
+
+    nsgbe_ctx_current = ctx;
+    nsgbe_movie_stop();
+    nsgbe_autosave_disable();
+    nsgbe_ctx_current = (bound == ctx ? &default_ctx : bound);
+
+    rom_release(&ctx->rombuffer, &ctx->rom_mapping);
+    free_ptr((void **)&ctx->biosbuffer);
+    free_ptr((void **)&ctx->pending_battery_buffer);
+    free_ptr((void **)&ctx->runahead_state);
+    ext_ram_release(&ctx->ext_ram, &ctx->ext_ram_mapped_size);
+    cow_release_all(ctx);
+    free_ptr((void **)&ctx->battery_path);
+
+    rewind_buffer_free(ctx->rewind_buffer);
+    movie_free(ctx->movie);
+    hotspots_free(ctx->hotspots);
+    trace_free(ctx->trace);
+    capture_free(ctx->capture);
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_destroy(&ctx->mtx);
+#endif
+
+    free(ctx);
+}
+
+void nsgbe_ctx_bind(struct nsgbe_ctx *ctx)
+{
+    nsgbe_ctx_current = (ctx ? ctx : &default_ctx);
+}
+
+struct nsgbe_ctx *nsgbe_ctx_bound()
+{
+    return nsgbe_ctx_current;
+}
+
+struct nsgbe_ctx *nsgbe_ctx_default()
+{
+    return &default_ctx;
+}
+
+union BUTTON_STATE *nsgbe_ctx_button_states(struct nsgbe_ctx *ctx)
+{
+    return &ctx->button_states;
+}
+
+void (** nsgbe_ctx_display_notify_vblank(struct nsgbe_ctx *ctx))()
+{
+    return &ctx->display_notify_vblank;
+}
+
+struct ROM_HEADER *nsgbe_ctx_rom_header(struct nsgbe_ctx *ctx)
+{
+    return ctx->rom_header;
+}
+
+// sequence lock reader, see stats.c
+void nsgbe_ctx_stats(struct nsgbe_ctx *ctx, struct NSGBE_STATS *stats)
+{
+    uint32_t sequence;
+
+    if (!ctx || !stats)
+        return;
+
+    for (;;)
+    {
+        sequence = __atomic_load_n(&ctx->stats_sequence, __ATOMIC_ACQUIRE);
+
+        if (sequence & 1)
+            continue;
+
+        memcpy(stats, &ctx->stats_published, sizeof(struct NSGBE_STATS));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (__atomic_load_n(&ctx->stats_sequence, __ATOMIC_RELAXED) == sequence)
+            break;
+    }
+
+    stats->frames_presented = __atomic_load_n(&ctx->stats_frames_presented, __ATOMIC_RELAXED);
+    stats->frames_duplicated = __atomic_load_n(&ctx->stats_frames_duplicated, __ATOMIC_RELAXED);
+    stats->speed = ctx->system_achieved_speed * 100.f;
+}
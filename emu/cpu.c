@@ -4,8 +4,8 @@
 
 #include "env.h"
 
-#define SHOULD_INT(interrupt) ((mem.map.interrupt_flag_reg.interrupt) \
-                            && (mem.map.interrupt_enable_reg.interrupt))
+#define SHOULD_INT(interrupt) ((CTX(mem).map.interrupt_flag_reg.interrupt) \
+                            && (CTX(mem).map.interrupt_enable_reg.interrupt))
 
 struct CPU_INSTRUCTION {
     byte opcode;
@@ -17,17 +17,6 @@ struct CPU_INSTRUCTION {
     void (*progresser)(struct CPU_INSTRUCTION *);
 };
 
-struct CPU_REGS cpu_regs;
-
-_Bool cpu_alive = 0;
-_Bool cpu_int_halt = 0;
-_Bool cpu_dma_halt = 0;
-
-byte interrupt_master_enable = 0; // 0: disabled, 1: enabled, >1: disabled but transitioning to enabled
-
-int32_t clock_cycle_counter = 0;
-uint32_t global_cycle_counter = 0;
-
 #ifdef __DEBUG
 _Bool single_steps = 0; // sort of hacky single-stepping mechanism for debugging
 _Bool activate_single_stepping_on_condition = 0; // toggle-able user key to set single_steps = 1 only if activate_single_stepping_on_condition == 1
@@ -39,19 +28,19 @@ _Bool till_carry = 0;   // flag to continue executing until the carry flag is se
 
 static void prog_default(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.PC += instr->operands_length + 1; // increase PC
+    CTX(cpu_regs).PC += instr->operands_length + 1; // increase PC
 }
 
 static void prog_jmp(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.PC = (uint16_t)(uintptr_t)instr->operands[0];
+    CTX(cpu_regs).PC = (uint16_t)(uintptr_t)instr->operands[0];
 }
 
 /* GENERAL INSTRUCTION HANDLERS */
 
 static void instr_illegal(struct CPU_INSTRUCTION *instr)
 {
-    printf("CPU instructed to execute illegal opcode 0x%02X at 0x%04X. Breaking...\n", instr->opcode, cpu_regs.PC);
+    printf("CPU instructed to execute illegal opcode 0x%02X at 0x%04X. Breaking...\n", instr->opcode, CTX(cpu_regs).PC);
 
     cpu_break();
 }
@@ -69,7 +58,7 @@ static void instr_STOP(struct CPU_INSTRUCTION *instr)
 static void instr_HALT(struct CPU_INSTRUCTION *instr)
 {
     DEBUG_PRINT(("halting cpu until next interrupt...\n"));
-    cpu_int_halt = 1;
+    CTX(cpu_int_halt) = 1;
 }
 
 static void instr_LD_r_s(struct CPU_INSTRUCTION *instr) // Load register data8
@@ -97,9 +86,9 @@ static void instr_INC_r(struct CPU_INSTRUCTION *instr) // Increase register
     byte *reg = (byte *)instr->operands[0];
     (* reg)++;
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = (((* reg) & 0xF) == 0);
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = (((* reg) & 0xF) == 0);
 }
 
 static void instr_INC_rr(struct CPU_INSTRUCTION *instr) // Increase combined register
@@ -112,9 +101,9 @@ static void instr_DEC_r(struct CPU_INSTRUCTION *instr) // Decrease register
     byte *reg = (byte *)instr->operands[0];
     (* reg)--;
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 1;
-    cpu_regs.F.H = (((* reg) & 0xF) == 0xF);
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 1;
+    CTX(cpu_regs).F.H = (((* reg) & 0xF) == 0xF);
 }
 
 static void instr_DEC_rr(struct CPU_INSTRUCTION *instr) // Decrease combined register
@@ -128,15 +117,15 @@ static void instr_INC_dd(struct CPU_INSTRUCTION *instr) // Increase data8 at des
 
     uint16_t value = mem_read(offset);
 
-    cpu_regs.F.H = (value & 0xF) == 0xF;
+    CTX(cpu_regs).F.H = (value & 0xF) == 0xF;
 
     value++;
     value &= 0xFF; // todo: maybe only do this on write as this may set the Z flag incorrectly
 
     mem_write(offset, value);
 
-    cpu_regs.F.Z = (value == 0);
-    cpu_regs.F.N = 0;
+    CTX(cpu_regs).F.Z = (value == 0);
+    CTX(cpu_regs).F.N = 0;
 }
 
 static void instr_DEC_dd(struct CPU_INSTRUCTION *instr) // Decrease data8 at destination16
@@ -145,42 +134,42 @@ static void instr_DEC_dd(struct CPU_INSTRUCTION *instr) // Decrease data8 at des
 
     byte value = mem_read(offset);
 
-    cpu_regs.F.H = (value & 0xF) == 0x0;
+    CTX(cpu_regs).F.H = (value & 0xF) == 0x0;
 
     value--;
     value &= 0xFF;
 
     mem_write(offset, value);
 
-    cpu_regs.F.Z = (value == 0);
-    cpu_regs.F.N = 1;
+    CTX(cpu_regs).F.Z = (value == 0);
+    CTX(cpu_regs).F.N = 1;
 }
 
 static void instr_AND_s(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.A &= (* (byte *)instr->operands[0]);
+    CTX(cpu_regs).A &= (* (byte *)instr->operands[0]);
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 1;
-    cpu_regs.F.C = 0;
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 1;
+    CTX(cpu_regs).F.C = 0;
 }
 
 static void instr_ADD_r_s(struct CPU_INSTRUCTION *instr) // Add register data8
 {
     // todo: test
     uint16_t result = (* (byte *)instr->operands[0]) + (* (byte *)instr->operands[1]);
-    cpu_regs.F.H = ((result & 0xF) < ((* (byte *)instr->operands[0]) & 0xF));
-    cpu_regs.F.C = (result > 0xFF);
+    CTX(cpu_regs).F.H = ((result & 0xF) < ((* (byte *)instr->operands[0]) & 0xF));
+    CTX(cpu_regs).F.C = (result > 0xFF);
 
     result &= 0xFF;
 
     (* (byte *)instr->operands[0]) = result;
 
-    cpu_regs.F.Z = (result == 0);
-    cpu_regs.F.N = 0;
+    CTX(cpu_regs).F.Z = (result == 0);
+    CTX(cpu_regs).F.N = 0;
     //printf("[DEBUG] instr_ADD_r_s: 0x%04X + 0x%04X = 0x%04X | Z: %d N: %d H: %d C: %d\n", (* (byte *)instr->operands[0]), (* (byte *)instr->operands[1]), \
-      result, cpu_regs.F.Z, cpu_regs.F.N, cpu_regs.F.H, cpu_regs.F.C);
+      result, CTX(cpu_regs).F.Z, CTX(cpu_regs).F.N, CTX(cpu_regs).F.H, CTX(cpu_regs).F.C);
 }
 
 static void instr_ADC_r_s(struct CPU_INSTRUCTION *instr) // Add register data8 + carry flag
@@ -188,74 +177,74 @@ static void instr_ADC_r_s(struct CPU_INSTRUCTION *instr) // Add register data8 +
     byte *reg = (byte *)instr->operands[0];
     byte *val = (byte *)instr->operands[1];
 
-    uint16_t result = (* reg) + *val + cpu_regs.F.C;
-    uint16_t half_result = ((* reg) & 0xF) + (*val & 0xF) + cpu_regs.F.C;
+    uint16_t result = (* reg) + *val + CTX(cpu_regs).F.C;
+    uint16_t half_result = ((* reg) & 0xF) + (*val & 0xF) + CTX(cpu_regs).F.C;
 
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = half_result > 0x0F;
-    cpu_regs.F.C = result > 0xFF;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = half_result > 0x0F;
+    CTX(cpu_regs).F.C = result > 0xFF;
 
     *reg = (result & 0xFF);
-    cpu_regs.F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
 }
 
 static void instr_ADD_rr_rr(struct CPU_INSTRUCTION *instr) // Add combined register combined register
 {
     uint32_t result = (* instr->operands[0]).w + (* instr->operands[1]).w;
-    cpu_regs.F.H = ((result & 0xFFF) < ((* instr->operands[0]).w & 0xFFF));
-    cpu_regs.F.C = (result > 0xFFFF);
+    CTX(cpu_regs).F.H = ((result & 0xFFF) < ((* instr->operands[0]).w & 0xFFF));
+    CTX(cpu_regs).F.C = (result > 0xFFFF);
 
     (* instr->operands[0]).w = result & 0xFFFF;
 
-    cpu_regs.F.N = 0;
+    CTX(cpu_regs).F.N = 0;
 }
 
 static void instr_SUB_r(struct CPU_INSTRUCTION *instr) // Sub register (from A); untested
 {
     byte value = (* (byte *)instr->operands[0]);
 
-    cpu_regs.F.H = ((cpu_regs.A & 0xF) < (value & 0xF) ? 1 : 0); // todo: verify that this is actually correct
-    cpu_regs.F.C = (cpu_regs.A < value ? 1 : 0);
+    CTX(cpu_regs).F.H = ((CTX(cpu_regs).A & 0xF) < (value & 0xF) ? 1 : 0); // todo: verify that this is actually correct
+    CTX(cpu_regs).F.C = (CTX(cpu_regs).A < value ? 1 : 0);
 
-    cpu_regs.A -= value;
+    CTX(cpu_regs).A -= value;
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.N = 1;
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.N = 1;
 }
 
 static void instr_SUB_ss(struct CPU_INSTRUCTION *instr) // Sub data8 (from A)
 {
     byte value = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.H = ((cpu_regs.A & 0xF) < (value & 0xF) ? 1 : 0); // todo: verify that this is actually correct
-    cpu_regs.F.C = (cpu_regs.A < value ? 1 : 0);
+    CTX(cpu_regs).F.H = ((CTX(cpu_regs).A & 0xF) < (value & 0xF) ? 1 : 0); // todo: verify that this is actually correct
+    CTX(cpu_regs).F.C = (CTX(cpu_regs).A < value ? 1 : 0);
 
-    cpu_regs.A -= value;
+    CTX(cpu_regs).A -= value;
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.N = 1;
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.N = 1;
 }
 
 static void instr_XOR_s(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.A = cpu_regs.A ^ (* (byte *)instr->operands[0]);
+    CTX(cpu_regs).A = CTX(cpu_regs).A ^ (* (byte *)instr->operands[0]);
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = 0;
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = 0;
 }
 
 static void instr_XOR_ss(struct CPU_INSTRUCTION *instr)
 {
     byte value = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.A = cpu_regs.A ^ value;
+    CTX(cpu_regs).A = CTX(cpu_regs).A ^ value;
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = 0;
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = 0;
 }
 
 static void instr_SBC_r_s(struct CPU_INSTRUCTION *instr)
@@ -263,113 +252,113 @@ static void instr_SBC_r_s(struct CPU_INSTRUCTION *instr)
     byte *reg = (byte *)instr->operands[0];
     byte *val = (byte *)instr->operands[1];
 
-    int16_t result = (* reg) - *val - cpu_regs.F.C;
-    int16_t half_result = ((* reg) & 0xF) - (*val & 0xF) - cpu_regs.F.C;
+    int16_t result = (* reg) - *val - CTX(cpu_regs).F.C;
+    int16_t half_result = ((* reg) & 0xF) - (*val & 0xF) - CTX(cpu_regs).F.C;
 
-    cpu_regs.F.N = 1;
-    cpu_regs.F.H = half_result < 0;
-    cpu_regs.F.C = result < 0;
+    CTX(cpu_regs).F.N = 1;
+    CTX(cpu_regs).F.H = half_result < 0;
+    CTX(cpu_regs).F.C = result < 0;
 
     *reg = ((uint16_t)result & 0xFF);
-    cpu_regs.F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
 }
 
 static void instr_CPL(struct CPU_INSTRUCTION *instr) // untested (guessing it's bitwise complement)
 {
-    cpu_regs.A = ~cpu_regs.A;
+    CTX(cpu_regs).A = ~CTX(cpu_regs).A;
 
-    cpu_regs.F.N = 1;
-    cpu_regs.F.H = 1;
+    CTX(cpu_regs).F.N = 1;
+    CTX(cpu_regs).F.H = 1;
 }
 
 static void instr_RLCA(struct CPU_INSTRUCTION *instr) // Rotate register A through carry left
 {
-    cpu_regs.F.C = (cpu_regs.A > 0x7F);
+    CTX(cpu_regs).F.C = (CTX(cpu_regs).A > 0x7F);
 
-    cpu_regs.A = ((cpu_regs.A << 1) & 0xFF) | (cpu_regs.A >> 7);
+    CTX(cpu_regs).A = ((CTX(cpu_regs).A << 1) & 0xFF) | (CTX(cpu_regs).A >> 7);
 
     //cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.Z = 0;
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = 0;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RRCA(struct CPU_INSTRUCTION *instr) // Rotate register A through carry right (not tested)
 {
-    cpu_regs.F.C = cpu_regs.A & 1;
+    CTX(cpu_regs).F.C = CTX(cpu_regs).A & 1;
 
-    cpu_regs.A = (cpu_regs.A >> 1) | ((cpu_regs.A << 7) & 0xFF);
+    CTX(cpu_regs).A = (CTX(cpu_regs).A >> 1) | ((CTX(cpu_regs).A << 7) & 0xFF);
 
     //cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.Z = 0;
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = 0;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RLA(struct CPU_INSTRUCTION *instr) // Rotate register A left
 {
-    byte carry = cpu_regs.F.C;
-    cpu_regs.F.C = (cpu_regs.A > 0x7F);
+    byte carry = CTX(cpu_regs).F.C;
+    CTX(cpu_regs).F.C = (CTX(cpu_regs).A > 0x7F);
 
-    cpu_regs.A = ((cpu_regs.A << 1) & 0xFF) | carry;
+    CTX(cpu_regs).A = ((CTX(cpu_regs).A << 1) & 0xFF) | carry;
 
-    cpu_regs.F.Z = 0;
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = 0;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RRA(struct CPU_INSTRUCTION *instr) // Rotate register A right
 {
-    byte carry = cpu_regs.F.C ? 0x80 : 0;
-    cpu_regs.F.C = (cpu_regs.A) & 1;
+    byte carry = CTX(cpu_regs).F.C ? 0x80 : 0;
+    CTX(cpu_regs).F.C = (CTX(cpu_regs).A) & 1;
 
-    cpu_regs.A = (cpu_regs.A >> 1) | carry;
+    CTX(cpu_regs).A = (CTX(cpu_regs).A >> 1) | carry;
 
-    cpu_regs.F.Z = 0;
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = 0;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_DAA(struct CPU_INSTRUCTION *instr)
 {
-    uint16_t val = cpu_regs.A;
+    uint16_t val = CTX(cpu_regs).A;
 
-    if (!cpu_regs.F.N)
+    if (!CTX(cpu_regs).F.N)
     {
-        if (cpu_regs.F.H || (val & 0xF) > 0x9)
+        if (CTX(cpu_regs).F.H || (val & 0xF) > 0x9)
             val += 0x06;
 
-        if (cpu_regs.F.C || val > 0x9F)
+        if (CTX(cpu_regs).F.C || val > 0x9F)
             val += 0x60;
     }
     else
     {
-        if (cpu_regs.F.H)
+        if (CTX(cpu_regs).F.H)
             val = (val - 0x06) & 0xFF;
 
-        if (cpu_regs.F.C)
+        if (CTX(cpu_regs).F.C)
             val -= 0x60;
     }
 
-    cpu_regs.A = (val & 0xFF);
+    CTX(cpu_regs).A = (val & 0xFF);
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = (val > 0xFF ? 1 : cpu_regs.F.C);
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = (val > 0xFF ? 1 : CTX(cpu_regs).F.C);
 }
 
 static void instr_SCF(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = 1;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = 1;
 }
 
 static void instr_CCF(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C ^= 1;
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C ^= 1;
 }
 
 /* ---------------------------- */
@@ -379,26 +368,26 @@ static void instr_CCF(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_LDD_A_lHL(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.A = mem_read(cpu_regs.HL);
-    cpu_regs.HL--;
+    CTX(cpu_regs).A = mem_read(CTX(cpu_regs).HL);
+    CTX(cpu_regs).HL--;
 }
 
 static void uinstr_LDD_lHL_A(struct CPU_INSTRUCTION *instr)
 {
-    mem_write(cpu_regs.HL, cpu_regs.A);
-    cpu_regs.HL--;
+    mem_write(CTX(cpu_regs).HL, CTX(cpu_regs).A);
+    CTX(cpu_regs).HL--;
 }
 
 static void uinstr_LDI_A_lHL(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.A = mem_read(cpu_regs.HL);
-    cpu_regs.HL++;
+    CTX(cpu_regs).A = mem_read(CTX(cpu_regs).HL);
+    CTX(cpu_regs).HL++;
 }
 
 static void uinstr_LDI_lHL_A(struct CPU_INSTRUCTION *instr)
 {
-    mem_write(cpu_regs.HL, cpu_regs.A);
-    cpu_regs.HL++;
+    mem_write(CTX(cpu_regs).HL, CTX(cpu_regs).A);
+    CTX(cpu_regs).HL++;
 }
 
 /* --------------------------- */
@@ -407,40 +396,40 @@ static void uinstr_LDI_lHL_A(struct CPU_INSTRUCTION *instr)
 
 __always_inline void push16(word data)
 {
-    cpu_regs.SP--;
-    cpu_regs.SP--;
-    mem_write_16(cpu_regs.SP, data);
+    CTX(cpu_regs).SP--;
+    CTX(cpu_regs).SP--;
+    mem_write_16(CTX(cpu_regs).SP, data);
 
     //printf("pushing 0x%04X onto stack @0x%04X\n", data, cpu_regs.SP);
 }
 
 __always_inline word pop16()
 {
-    word value = mem_read_16(cpu_regs.SP);
+    word value = mem_read_16(CTX(cpu_regs).SP);
 
     //printf("popping 0x%04X from stack @0x%04X\n", value.w, cpu_regs.SP);
 
-    cpu_regs.SP++;
-    cpu_regs.SP++;
+    CTX(cpu_regs).SP++;
+    CTX(cpu_regs).SP++;
 
     return value;
 }
 
 __always_inline void push8(byte data)
 {
-    cpu_regs.SP--;
-    mem_write(cpu_regs.SP, data);
+    CTX(cpu_regs).SP--;
+    mem_write(CTX(cpu_regs).SP, data);
 
     //printf("pushing 0x%02X onto stack @0x%04X\n", data, cpu_regs.SP);
 }
 
 __always_inline byte pop8()
 {
-    byte value = mem_read(cpu_regs.SP);
+    byte value = mem_read(CTX(cpu_regs).SP);
 
     //printf("popping 0x%02X from stack @0x%04X\n", value, cpu_regs.SP);
 
-    cpu_regs.SP++;
+    CTX(cpu_regs).SP++;
 
     return value;
 }
@@ -449,26 +438,26 @@ static void instr_RLC_r(struct CPU_INSTRUCTION *instr) // Rotate register A thro
 {
     byte *reg = (byte *)instr->operands[0];
 
-    cpu_regs.F.C = ((* reg) > 0x7F);
+    CTX(cpu_regs).F.C = ((* reg) > 0x7F);
 
     *reg = (((* reg) << 1) & 0xFF) | ((* reg) >> 7);
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RLC_dd(struct CPU_INSTRUCTION *instr) // Rotate register A through carry left
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.C = (val > 0x7F);
+    CTX(cpu_regs).F.C = (val > 0x7F);
 
     val = ((val << 1) & 0xFF) | (val >> 7);
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -477,26 +466,26 @@ static void instr_RRC_r(struct CPU_INSTRUCTION *instr)
 {
     byte *reg = (byte *)instr->operands[0];
 
-    cpu_regs.F.C = (* reg) & 1;
+    CTX(cpu_regs).F.C = (* reg) & 1;
 
     *reg = ((* reg) >> 1) | (((* reg) << 7) & 0xFF);
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RRC_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.C = val & 1;
+    CTX(cpu_regs).F.C = val & 1;
 
     val = (val >> 1) | ((val << 7) & 0xFF);
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -505,28 +494,28 @@ static void instr_RL_r(struct CPU_INSTRUCTION *instr) // do NOT use this for RLA
 {
     byte *reg = (byte *)instr->operands[0];
 
-    byte carry = cpu_regs.F.C;
-    cpu_regs.F.C = ((* reg) > 0x7F);
+    byte carry = CTX(cpu_regs).F.C;
+    CTX(cpu_regs).F.C = ((* reg) > 0x7F);
 
     *reg = (((* reg) << 1) & 0xFF) | carry;
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RL_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    byte carry = cpu_regs.F.C;
-    cpu_regs.F.C = (val > 0x7F);
+    byte carry = CTX(cpu_regs).F.C;
+    CTX(cpu_regs).F.C = (val > 0x7F);
 
     val = ((val << 1) & 0xFF) | carry;
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -535,30 +524,30 @@ static void instr_RR_r(struct CPU_INSTRUCTION *instr) // do NOT use this for RRA
 {
     byte *reg = (byte *)instr->operands[0];
 
-    byte carry = cpu_regs.F.C ? 0x80 : 0;
-    cpu_regs.F.C = (* reg) & 1;
+    byte carry = CTX(cpu_regs).F.C ? 0x80 : 0;
+    CTX(cpu_regs).F.C = (* reg) & 1;
 
     // todo: test
     *reg = ((* reg) >> 1) | carry;
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_RR_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    byte carry = cpu_regs.F.C ? 0x80 : 0;
-    cpu_regs.F.C = val & 1;
+    byte carry = CTX(cpu_regs).F.C ? 0x80 : 0;
+    CTX(cpu_regs).F.C = val & 1;
 
     // todo: test
     val = (val >> 1) | carry;
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -567,26 +556,26 @@ static void instr_SLA_r(struct CPU_INSTRUCTION *instr)
 {
     byte *reg = (byte *)instr->operands[0];
 
-    cpu_regs.F.C = ((* reg) & 0x80) >> 7;
+    CTX(cpu_regs).F.C = ((* reg) & 0x80) >> 7;
 
     *reg = (* reg) << 1;
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_SLA_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.C = (val & 0x80) >> 7;
+    CTX(cpu_regs).F.C = (val & 0x80) >> 7;
 
     val = val << 1;
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -595,26 +584,26 @@ static void instr_SRA_r(struct CPU_INSTRUCTION *instr)
 {
     byte *reg = (byte *)instr->operands[0];
 
-    cpu_regs.F.C = (* reg) & 1;
+    CTX(cpu_regs).F.C = (* reg) & 1;
 
     *reg = (* reg) >> 1 | ((* reg) & 0x80);
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_SRA_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.C = val & 1;
+    CTX(cpu_regs).F.C = val & 1;
 
     val = val >> 1 | (val & 0x80);
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -623,54 +612,54 @@ static void instr_SRL_r(struct CPU_INSTRUCTION *instr)
 {
     byte *reg = (byte *)instr->operands[0];
 
-    cpu_regs.F.C = (* reg) & 1;
+    CTX(cpu_regs).F.C = (* reg) & 1;
 
     // todo: test
     *reg = (* reg) >> 1;
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 }
 
 static void instr_SRL_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.C = val & 1;
+    CTX(cpu_regs).F.C = val & 1;
 
     // todo: test
     val = val >> 1;
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
 
 static void instr_CP_s(struct CPU_INSTRUCTION *instr)
 {
-    byte previous = cpu_regs.A;
+    byte previous = CTX(cpu_regs).A;
     byte value = (* (byte *)instr->operands[0]);
 
-    cpu_regs.F.H = ((previous & 0xF) < (value & 0xF) ? 1 : 0); // todo: verify that this is actually correct
-    cpu_regs.F.C = (previous < value ? 1 : 0);
+    CTX(cpu_regs).F.H = ((previous & 0xF) < (value & 0xF) ? 1 : 0); // todo: verify that this is actually correct
+    CTX(cpu_regs).F.C = (previous < value ? 1 : 0);
 
     previous -= value;
 
-    cpu_regs.F.Z = (previous == 0);
-    cpu_regs.F.N = 1;
+    CTX(cpu_regs).F.Z = (previous == 0);
+    CTX(cpu_regs).F.N = 1;
 }
 
 static void instr_OR_s(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.A |= (* (byte *)instr->operands[0]);
+    CTX(cpu_regs).A |= (* (byte *)instr->operands[0]);
 
-    cpu_regs.F.Z = (cpu_regs.A == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = 0;
+    CTX(cpu_regs).F.Z = (CTX(cpu_regs).A == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = 0;
 }
 
 static void instr_RES_r(struct CPU_INSTRUCTION *instr)
@@ -687,18 +676,18 @@ static void instr_RES_dd(struct CPU_INSTRUCTION *instr)
 
 static void instr_BIT_r(struct CPU_INSTRUCTION *instr)
 {
-    cpu_regs.F.Z = (!((* (byte *)instr->operands[0]) & (* (byte *)instr->operands[1])));
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 1;
+    CTX(cpu_regs).F.Z = (!((* (byte *)instr->operands[0]) & (* (byte *)instr->operands[1])));
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 1;
 }
 
 static void instr_BIT_dd(struct CPU_INSTRUCTION *instr)
 {
     byte val = mem_read((* instr->operands[0]).w);
 
-    cpu_regs.F.Z = (!(val & (* (byte *)instr->operands[1])));
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 1;
+    CTX(cpu_regs).F.Z = (!(val & (* (byte *)instr->operands[1])));
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 1;
 }
 
 static void instr_SET_r(struct CPU_INSTRUCTION *instr)
@@ -720,10 +709,10 @@ static void instr_SWAP_r(struct CPU_INSTRUCTION *instr)
     // swap high and low nibbles
     (* reg) = (((* reg) & 0x0F) << 4) + (((* reg) & 0xF0) >> 4);
 
-    cpu_regs.F.Z = ((* reg) == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = 0;
+    CTX(cpu_regs).F.Z = ((* reg) == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = 0;
 }
 
 static void instr_SWAP_dd(struct CPU_INSTRUCTION *instr)
@@ -733,10 +722,10 @@ static void instr_SWAP_dd(struct CPU_INSTRUCTION *instr)
     // swap high and low nibbles
     val = ((val & 0x0F) << 4) + ((val & 0xF0) >> 4);
 
-    cpu_regs.F.Z = (val == 0);
-    cpu_regs.F.N = 0;
-    cpu_regs.F.H = 0;
-    cpu_regs.F.C = 0;
+    CTX(cpu_regs).F.Z = (val == 0);
+    CTX(cpu_regs).F.N = 0;
+    CTX(cpu_regs).F.H = 0;
+    CTX(cpu_regs).F.C = 0;
 
     mem_write((* instr->operands[0]).w, val);
 }
@@ -753,7 +742,7 @@ static void instr_POP(struct CPU_INSTRUCTION *instr)
 
 static void instr_RST_l(struct CPU_INSTRUCTION *instr)
 {
-    push16(word(cpu_regs.PC + instr->operands_length + 1));
+    push16(word(CTX(cpu_regs).PC + instr->operands_length + 1));
 }
 
 static void uinstr_ADD_SP_s(struct CPU_INSTRUCTION *instr)
@@ -762,18 +751,18 @@ static void uinstr_ADD_SP_s(struct CPU_INSTRUCTION *instr)
 
     byte val = (* (byte *)instr->operands[0]);
 
-    uint32_t result = cpu_regs.SP + (int8_t)val;
+    uint32_t result = CTX(cpu_regs).SP + (int8_t)val;
 
-    cpu_regs.F.Z = 0;
-    cpu_regs.F.N = 0;
+    CTX(cpu_regs).F.Z = 0;
+    CTX(cpu_regs).F.N = 0;
 
     // ADD SP,-1 == ADD SP,0xFF
     // carry from bit 3
-    cpu_regs.F.H = (0xF - (cpu_regs.SP & 0xF)) < (val & 0xF);
+    CTX(cpu_regs).F.H = (0xF - (CTX(cpu_regs).SP & 0xF)) < (val & 0xF);
     // carry from bit 7
-    cpu_regs.F.C = (0xFF - (cpu_regs.SP & 0xFF)) < val;
+    CTX(cpu_regs).F.C = (0xFF - (CTX(cpu_regs).SP & 0xFF)) < val;
 
-    cpu_regs.SP = result & 0xFFFF;
+    CTX(cpu_regs).SP = result & 0xFFFF;
 }
 
 static void uinstr_LDHL_SP_s(struct CPU_INSTRUCTION *instr)
@@ -782,22 +771,22 @@ static void uinstr_LDHL_SP_s(struct CPU_INSTRUCTION *instr)
 
     byte val = (* (byte *)instr->operands[0]);
 
-    uint32_t result = cpu_regs.SP + (int8_t)val;
+    uint32_t result = CTX(cpu_regs).SP + (int8_t)val;
 
-    cpu_regs.F.Z = 0;
-    cpu_regs.F.N = 0;
+    CTX(cpu_regs).F.Z = 0;
+    CTX(cpu_regs).F.N = 0;
 
     // carry from bit 3
-    cpu_regs.F.H = (0xF - (cpu_regs.SP & 0xF)) < (val & 0xF);
+    CTX(cpu_regs).F.H = (0xF - (CTX(cpu_regs).SP & 0xF)) < (val & 0xF);
     // carry from bit 7
-    cpu_regs.F.C = (0xFF - (cpu_regs.SP & 0xFF)) < val;
+    CTX(cpu_regs).F.C = (0xFF - (CTX(cpu_regs).SP & 0xFF)) < val;
 
-    cpu_regs.HL = result & 0xFFFF;
+    CTX(cpu_regs).HL = result & 0xFFFF;
 }
 
 static void uinstr_JP_NZ(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.Z == 0)
+    if (CTX(cpu_regs).F.Z == 0)
     {
         instr->clock_cycles = 16;
         instr->progresser = &prog_jmp;
@@ -806,7 +795,7 @@ static void uinstr_JP_NZ(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_JP_Z(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.Z == 1)
+    if (CTX(cpu_regs).F.Z == 1)
     {
         instr->clock_cycles = 16;
         instr->progresser = &prog_jmp;
@@ -815,7 +804,7 @@ static void uinstr_JP_Z(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_JP_NC(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.C == 0)
+    if (CTX(cpu_regs).F.C == 0)
     {
         instr->clock_cycles = 16;
         instr->progresser = &prog_jmp;
@@ -824,7 +813,7 @@ static void uinstr_JP_NC(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_JP_C(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.C == 1)
+    if (CTX(cpu_regs).F.C == 1)
     {
         instr->clock_cycles = 16;
         instr->progresser = &prog_jmp;
@@ -833,52 +822,52 @@ static void uinstr_JP_C(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_CALL(struct CPU_INSTRUCTION *instr)
 {
-    push16(word(cpu_regs.PC + instr->operands_length + 1));
+    push16(word(CTX(cpu_regs).PC + instr->operands_length + 1));
 }
 
 static void uinstr_CALL_NZ(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.Z == 0)
+    if (CTX(cpu_regs).F.Z == 0)
     {
         instr->clock_cycles = 24;
-        push16(word(cpu_regs.PC + instr->operands_length + 1));
+        push16(word(CTX(cpu_regs).PC + instr->operands_length + 1));
         instr->progresser = &prog_jmp;
     }
 }
 
 static void uinstr_CALL_Z(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.Z == 1)
+    if (CTX(cpu_regs).F.Z == 1)
     {
         instr->clock_cycles = 24;
-        push16(word(cpu_regs.PC + instr->operands_length + 1));
+        push16(word(CTX(cpu_regs).PC + instr->operands_length + 1));
         instr->progresser = &prog_jmp;
     }
 }
 
 static void uinstr_CALL_NC(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.C == 0)
+    if (CTX(cpu_regs).F.C == 0)
     {
         instr->clock_cycles = 24;
-        push16(word(cpu_regs.PC + instr->operands_length + 1));
+        push16(word(CTX(cpu_regs).PC + instr->operands_length + 1));
         instr->progresser = &prog_jmp;
     }
 }
 
 static void uinstr_CALL_C(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.C == 1)
+    if (CTX(cpu_regs).F.C == 1)
     {
         instr->clock_cycles = 24;
-        push16(word(cpu_regs.PC + instr->operands_length + 1));
+        push16(word(CTX(cpu_regs).PC + instr->operands_length + 1));
         instr->progresser = &prog_jmp;
     }
 }
 
 static void uinstr_RET_NZ(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.Z == 0)
+    if (CTX(cpu_regs).F.Z == 0)
     {
         instr->clock_cycles = 20;
         word value = pop16();
@@ -889,7 +878,7 @@ static void uinstr_RET_NZ(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_RET_Z(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.Z == 1)
+    if (CTX(cpu_regs).F.Z == 1)
     {
         instr->clock_cycles = 20;
         word value = pop16();
@@ -900,7 +889,7 @@ static void uinstr_RET_Z(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_RET_NC(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.C == 0)
+    if (CTX(cpu_regs).F.C == 0)
     {
         instr->clock_cycles = 20;
         word value = pop16();
@@ -911,7 +900,7 @@ static void uinstr_RET_NC(struct CPU_INSTRUCTION *instr)
 
 static void uinstr_RET_C(struct CPU_INSTRUCTION *instr)
 {
-    if (cpu_regs.F.C == 1)
+    if (CTX(cpu_regs).F.C == 1)
     {
         instr->clock_cycles = 20;
         word value = pop16();
@@ -923,31 +912,31 @@ static void uinstr_RET_C(struct CPU_INSTRUCTION *instr)
 static void uinstr_RETI(struct CPU_INSTRUCTION *instr)
 {
     // same as EI RET, so transition to enabled immediately
-    interrupt_master_enable = 1;
+    CTX(interrupt_master_enable) = 1;
     DEBUG_PRINT(("returning from interrupt\n"));
 }
 
 static void uinstr_DI(struct CPU_INSTRUCTION *instr)
 {
-    interrupt_master_enable = 0;
+    CTX(interrupt_master_enable) = 0;
 }
 
 static void uinstr_EI(struct CPU_INSTRUCTION *instr)
 {
-    interrupt_master_enable = 3;
+    CTX(interrupt_master_enable) = 3;
 }
 
 /* EOF UNSTABLE */
 
 __always_inline void fake_dmg_bootrom() // spoof the results of executing the gameboy (classic) bootrom
 {
-    cpu_regs.AF = 0x01B0; // GB/SGB: 0x01B0, GBP: 0xFFB0, GBC: 0x11B0
-    cpu_regs.BC = 0x0013;
-    cpu_regs.DE = 0x00D8;
-    cpu_regs.HL = 0x014D;
+    CTX(cpu_regs).AF = 0x01B0; // GB/SGB: 0x01B0, GBP: 0xFFB0, GBC: 0x11B0
+    CTX(cpu_regs).BC = 0x0013;
+    CTX(cpu_regs).DE = 0x00D8;
+    CTX(cpu_regs).HL = 0x014D;
 
-    cpu_regs.PC = 0x0100; // if bootstrap's validation succeeds, this is where the cartridge's code takes control
-    cpu_regs.SP = 0xFFFE;
+    CTX(cpu_regs).PC = 0x0100; // if bootstrap's validation succeeds, this is where the cartridge's code takes control
+    CTX(cpu_regs).SP = 0xFFFE;
 
     mem_write(0xFF05, 0x00);
     mem_write(0xFF06, 0x00);
@@ -981,34 +970,34 @@ __always_inline void fake_dmg_bootrom() // spoof the results of executing the ga
     mem_write(0xFF4B, 0x00);
     mem_write(0xFFFF, 0x00);
 
-    enable_bootrom = 0;
+    CTX(enable_bootrom) = 0;
 }
 
 __always_inline void fake_cgb_bootrom()
 {
     fake_dmg_bootrom();
 
-    cpu_regs.AF = 0x11B0; // GB/SGB: 0x01B0, GBP: 0xFFB0, GBC: 0x11B0
+    CTX(cpu_regs).AF = 0x11B0; // GB/SGB: 0x01B0, GBP: 0xFFB0, GBC: 0x11B0
 }
 
 void cpu_reset()
 {
-    cpu_alive = 1;
-
-    cpu_regs.A = 0x00;
-    cpu_regs.B = 0x00;
-    cpu_regs.C = 0x00;
-    cpu_regs.D = 0x00;
-    cpu_regs.E = 0x00;
-    cpu_regs.F.b = 0x00;
-    cpu_regs.H = 0x00;
-    cpu_regs.L = 0x00;
-
-    cpu_regs.PC = 0x0000;
-    cpu_regs.SP = 0x0000;
-
-    enable_bootrom = 1;
-    interrupt_master_enable = 0;
+    CTX(cpu_alive) = 1;
+
+    CTX(cpu_regs).A = 0x00;
+    CTX(cpu_regs).B = 0x00;
+    CTX(cpu_regs).C = 0x00;
+    CTX(cpu_regs).D = 0x00;
+    CTX(cpu_regs).E = 0x00;
+    CTX(cpu_regs).F.b = 0x00;
+    CTX(cpu_regs).H = 0x00;
+    CTX(cpu_regs).L = 0x00;
+
+    CTX(cpu_regs).PC = 0x0000;
+    CTX(cpu_regs).SP = 0x0000;
+
+    CTX(enable_bootrom) = 1;
+    CTX(interrupt_master_enable) = 0;
 }
 
 /* old code, removing soon
@@ -1032,17 +1021,20 @@ __always_inline void cpu_step() // advance one op
     struct CPU_INSTRUCTION instr;
     word inst_value = word(0x1000);
 
+    uint16_t pc = CTX(cpu_regs).PC;
     cpu_next_instruction(&instr, &inst_value); // fetch next instruction
 
-    if (!cpu_int_halt && !cpu_dma_halt)
+    _Bool executed = !CTX(cpu_int_halt) && !CTX(cpu_dma_halt);
+
+    if (executed)
     {
-        DEBUG_PRINT(("@($%04X): 0x%02X ", cpu_regs.PC, instr.opcode));
+        DEBUG_PRINT(("@($%04X): 0x%02X ", CTX(cpu_regs).PC, instr.opcode));
         if (instr.operands_length > 0)
-            DEBUG_PRINT(("0x%02X ", mem_read(cpu_regs.PC + 1)));
+            DEBUG_PRINT(("0x%02X ", mem_read(CTX(cpu_regs).PC + 1)));
         else
             DEBUG_PRINT(("     "));
         if (instr.operands_length > 1)
-            DEBUG_PRINT(("0x%02X ", mem_read(cpu_regs.PC + 2)));
+            DEBUG_PRINT(("0x%02X ", mem_read(CTX(cpu_regs).PC + 2)));
         else
             DEBUG_PRINT(("     "));
         DEBUG_PRINT(("; "));
@@ -1055,17 +1047,22 @@ __always_inline void cpu_step() // advance one op
         // hacky fix for POP AF
         // blargg instr test 1 tries to set these 4 bits to something
         // ...using POP AF, but they should always be 0
-        cpu_regs.F.unused = 0;
+        CTX(cpu_regs).F.unused = 0;
 
-        global_cycle_counter += instr.clock_cycles;
+        CTX(global_cycle_counter) += instr.clock_cycles;
+        CTX(instruction_counter)++;
     }
 
-    if (interrupt_master_enable > 1) // may need to do this after the interrupt handler, not before it (but probably not)
-        interrupt_master_enable--;
+    if (CTX(interrupt_master_enable) > 1) // may need to do this after the interrupt handler, not before it (but probably not)
+        CTX(interrupt_master_enable)--;
 
     handle_interrupts();
 
-    clock_cycle_counter += instr.clock_cycles;
+    // frames run ahead are emulated again for real, count them once
+    if (CTX(hotspots) && !CTX(running_ahead))
+        hotspots_record(pc, instr.clock_cycles, executed);
+
+    CTX(clock_cycle_counter) += instr.clock_cycles;
 
     // recycle memory, so the next line is commented out
     //free(instr);
@@ -1077,7 +1074,7 @@ __always_inline int32_t cpu_exec_cycles(int32_t clock_cycles_to_execute)
     char input[2];
 #endif
 
-    for (clock_cycle_counter = 0; clock_cycle_counter < clock_cycles_to_execute && cpu_alive == 1;)
+    for (CTX(clock_cycle_counter) = 0; CTX(clock_cycle_counter) < clock_cycles_to_execute && CTX(cpu_alive) == 1;)
     {
 
 #ifdef __DEBUG
@@ -1086,13 +1083,13 @@ __always_inline int32_t cpu_exec_cycles(int32_t clock_cycles_to_execute)
 
         if (activate_single_stepping_on_condition)
             printf("A: 0x%02X B: 0x%02X C: 0x%02X D: 0x%02X E: 0x%02X F: 0x%02X H: 0x%02X L: 0x%02X PC: 0x%04X SP: 0x%04X Z: %d N: %d H: %d C: %d\n", \
-              cpu_regs.A, cpu_regs.B, cpu_regs.C, cpu_regs.D, cpu_regs.E, cpu_regs.F, cpu_regs.H, cpu_regs.L, cpu_regs.PC, cpu_regs.SP, cpu_regs.F.Z, \
-              cpu_regs.F.N, cpu_regs.F.H, cpu_regs.F.C);
+              CTX(cpu_regs).A, CTX(cpu_regs).B, CTX(cpu_regs).C, CTX(cpu_regs).D, CTX(cpu_regs).E, CTX(cpu_regs).F, CTX(cpu_regs).H, CTX(cpu_regs).L, CTX(cpu_regs).PC, CTX(cpu_regs).SP, CTX(cpu_regs).F.Z, \
+              CTX(cpu_regs).F.N, CTX(cpu_regs).F.H, CTX(cpu_regs).F.C);
 
-        if (till_zero && cpu_regs.F.Z == 1)
+        if (till_zero && CTX(cpu_regs).F.Z == 1)
             single_steps = 1;
 
-        if (till_carry && cpu_regs.F.C == 1)
+        if (till_carry && CTX(cpu_regs).F.C == 1)
             single_steps = 1;
 
         if (single_steps)
@@ -1126,29 +1123,44 @@ __always_inline int32_t cpu_exec_cycles(int32_t clock_cycles_to_execute)
         cpu_step();
     }
 
-    return (clock_cycles_to_execute - clock_cycle_counter);
+    return (clock_cycles_to_execute - CTX(clock_cycle_counter));
 }
 
 void cpu_break()
 {
-    cpu_alive = 0;
+    CTX(cpu_alive) = 0;
+}
+
+void nsgbe_cpu_state(struct NSGBE_CPU_STATE *state)
+{
+    state->af = CTX(cpu_regs).AF;
+    state->bc = CTX(cpu_regs).BC;
+    state->de = CTX(cpu_regs).DE;
+    state->hl = CTX(cpu_regs).HL;
+    state->sp = CTX(cpu_regs).SP;
+    state->pc = CTX(cpu_regs).PC;
+    state->alive = CTX(cpu_alive);
 }
 
 __always_inline void handle_interrupts()
 {
-    if (mem.map.interrupt_flag_reg.b > 0)
-        cpu_int_halt = 0;
+    if (CTX(mem).map.interrupt_flag_reg.b > 0)
+        CTX(cpu_int_halt) = 0;
 
-    if (interrupt_master_enable != 1)
+    if (CTX(interrupt_master_enable) != 1)
         return;
 
-    if (ppu_regs.stat->mode == 1 && SHOULD_INT(VBLANK))
+    if (CTX(ppu_regs).stat->mode == 1 && SHOULD_INT(VBLANK))
     {
         // vblank interrupt
-        interrupt_master_enable = 0;
-        push16(word(cpu_regs.PC));
-        cpu_regs.PC = 0x0040;
-        mem.map.interrupt_flag_reg.VBLANK = 0;
+        CTX(interrupt_master_enable) = 0;
+        push16(word(CTX(cpu_regs).PC));
+        CTX(cpu_regs).PC = 0x0040;
+        CTX(mem).map.interrupt_flag_reg.VBLANK = 0;
+
+        if (CTX(trace))
+            trace_event(TRACE_INTERRUPT, 0x0040);
+
         DEBUG_PRINT(("entering vblank interrupt\n"));
         return;
     }
@@ -1156,10 +1168,14 @@ __always_inline void handle_interrupts()
     if (SHOULD_INT(LCD_STAT))
     {
         // lcd stat interrupt
-        interrupt_master_enable = 0;
-        push16(word(cpu_regs.PC));
-        cpu_regs.PC = 0x0048;
-        mem.map.interrupt_flag_reg.LCD_STAT = 0;
+        CTX(interrupt_master_enable) = 0;
+        push16(word(CTX(cpu_regs).PC));
+        CTX(cpu_regs).PC = 0x0048;
+        CTX(mem).map.interrupt_flag_reg.LCD_STAT = 0;
+
+        if (CTX(trace))
+            trace_event(TRACE_INTERRUPT, 0x0048);
+
         DEBUG_PRINT(("entering lcd stat interrupt\n"));
         return;
     }
@@ -1167,10 +1183,14 @@ __always_inline void handle_interrupts()
     if (SHOULD_INT(TIMER))
     {
         // timer interrupt
-        interrupt_master_enable = 0;
-        push16(word(cpu_regs.PC));
-        cpu_regs.PC = 0x0050;
-        mem.map.interrupt_flag_reg.TIMER = 0;
+        CTX(interrupt_master_enable) = 0;
+        push16(word(CTX(cpu_regs).PC));
+        CTX(cpu_regs).PC = 0x0050;
+        CTX(mem).map.interrupt_flag_reg.TIMER = 0;
+
+        if (CTX(trace))
+            trace_event(TRACE_INTERRUPT, 0x0050);
+
         DEBUG_PRINT(("entering timer interrupt\n"));
         return;
     }
@@ -1182,15 +1202,33 @@ __always_inline void handle_interrupts()
     if (SHOULD_INT(JOYPAD))
     {
         // joypad interrupt
-        interrupt_master_enable = 0;
-        push16(word(cpu_regs.PC));
-        cpu_regs.PC = 0x0060;
-        mem.map.interrupt_flag_reg.JOYPAD = 0;
+        CTX(interrupt_master_enable) = 0;
+        push16(word(CTX(cpu_regs).PC));
+        CTX(cpu_regs).PC = 0x0060;
+        CTX(mem).map.interrupt_flag_reg.JOYPAD = 0;
+
+        if (CTX(trace))
+            trace_event(TRACE_INTERRUPT, 0x0060);
+
         DEBUG_PRINT(("entering joypad interrupt\n"));
         return;
     }
 }
 
+// mnemonic of the instruction at offset, for tools that list or profile guest code
+const char *cpu_instruction_description(uint16_t offset)
+{
+    struct CPU_INSTRUCTION instr;
+    word inst_value;
+    uint16_t pc = CTX(cpu_regs).PC;
+
+    CTX(cpu_regs).PC = offset;
+    cpu_next_instruction(&instr, &inst_value);
+    CTX(cpu_regs).PC = pc;
+
+    return instr.description;
+}
+
 //word inst_value = word(0x0000);
 __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *inst_value)
 {
@@ -1206,9 +1244,9 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
 
     inst_value->w = 0;
 
-    if (mem_read(cpu_regs.PC) != 0xCB)
+    if (mem_read(CTX(cpu_regs).PC) != 0xCB)
     { // primary instruction table
-        instr->opcode = mem_read(cpu_regs.PC);
+        instr->opcode = mem_read(CTX(cpu_regs).PC);
 
         switch (instr->opcode)
         {
@@ -1222,8 +1260,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_rr_ss;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                instr->operands[0] = (word *)&cpu_regs.BC;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).BC;
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD BC,d16";
                 break;
@@ -1231,29 +1269,29 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x02:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.BC;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).BC;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD (BC),A";
                 break;
 
             case 0x03:
                 instr->handler = &instr_INC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.BC;
+                instr->operands[0] = (word *)&CTX(cpu_regs).BC;
                 instr->description = "INC BC";
                 break;
 
             case 0x04:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "INC B";
                 break;
 
             case 0x05:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "DEC B";
                 break;
 
@@ -1261,8 +1299,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD B,d8";
                 break;
@@ -1277,25 +1315,25 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_dd_ss;
                 instr->clock_cycles = 20;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
-                instr->operands[1] = (word *)&cpu_regs.SP;
+                instr->operands[1] = (word *)&CTX(cpu_regs).SP;
                 instr->description = "LD (a16),SP";
                 break;
 
             case 0x09:
                 instr->handler = &instr_ADD_rr_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.BC;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).BC;
                 instr->description = "ADD HL,BC";
                 break;
 
             case 0x0A:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.BC);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).BC);
                 instr->operands[1] = inst_value;
                 instr->description = "LD A,(BC)";
                 break;
@@ -1303,21 +1341,21 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x0B:
                 instr->handler = &instr_DEC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.BC;
+                instr->operands[0] = (word *)&CTX(cpu_regs).BC;
                 instr->description = "DEC BC";
                 break;
 
             case 0x0C:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "INC C";
                 break;
 
             case 0x0D:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "DEC C";
                 break;
 
@@ -1325,8 +1363,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD C,d8";
                 break;
@@ -1347,8 +1385,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_rr_ss;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                instr->operands[0] = (word *)&cpu_regs.DE;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).DE;
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD DE,d16";
                 break;
@@ -1356,29 +1394,29 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x12:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.DE;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).DE;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD (DE),A";
                 break;
 
             case 0x13:
                 instr->handler = &instr_INC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.DE;
+                instr->operands[0] = (word *)&CTX(cpu_regs).DE;
                 instr->description = "INC DE";
                 break;
 
             case 0x14:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "INC D";
                 break;
 
             case 0x15:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "DEC D";
                 break;
 
@@ -1386,8 +1424,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD D,d8";
                 break;
@@ -1403,7 +1441,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->progresser = &prog_jmp;
                 instr->clock_cycles = 12;
                 instr->operands_length = 1;
-                inst_value->w = cpu_regs.PC + (int8_t)mem_read(cpu_regs.PC + 1) + 2;
+                inst_value->w = CTX(cpu_regs).PC + (int8_t)mem_read(CTX(cpu_regs).PC + 1) + 2;
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "JR r8";
                 break;
@@ -1411,16 +1449,16 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x19:
                 instr->handler = &instr_ADD_rr_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.DE;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).DE;
                 instr->description = "ADD HL,DE";
                 break;
 
             case 0x1A:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.DE);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).DE);
                 instr->operands[1] = inst_value;
                 instr->description = "LD A,(DE)";
                 break;
@@ -1428,21 +1466,21 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x1B:
                 instr->handler = &instr_DEC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.DE;
+                instr->operands[0] = (word *)&CTX(cpu_regs).DE;
                 instr->description = "DEC DE";
                 break;
 
             case 0x1C:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "INC E";
                 break;
 
             case 0x1D:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "DEC E";
                 break;
 
@@ -1450,8 +1488,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD E,d8";
                 break;
@@ -1463,12 +1501,12 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 break;
 
             case 0x20:
-                if (!cpu_regs.F.Z)
+                if (!CTX(cpu_regs).F.Z)
                 {
                     instr->handler = &instr_nop;
                     instr->progresser = &prog_jmp;
                     instr->clock_cycles = 12; // or 8 if action is not taken (zero)
-                    inst_value->w = cpu_regs.PC + (int8_t)mem_read(cpu_regs.PC + 1) + 2;
+                    inst_value->w = CTX(cpu_regs).PC + (int8_t)mem_read(CTX(cpu_regs).PC + 1) + 2;
                     instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 }
                 else
@@ -1484,8 +1522,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_rr_ss;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD HL,d16";
                 break;
@@ -1499,21 +1537,21 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x23:
                 instr->handler = &instr_INC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "INC HL";
                 break;
 
             case 0x24:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "INC H";
                 break;
 
             case 0x25:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "DEC H";
                 break;
 
@@ -1521,8 +1559,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD H,d8";
                 break;
@@ -1534,12 +1572,12 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 break;
 
             case 0x28:
-                if (cpu_regs.F.Z)
+                if (CTX(cpu_regs).F.Z)
                 {
                     instr->handler = &instr_nop;
                     instr->progresser = &prog_jmp;
                     instr->clock_cycles = 12; // or 8 if action is not taken (not zero)
-                    inst_value->w = cpu_regs.PC + (int8_t)mem_read(cpu_regs.PC + 1) + 2;
+                    inst_value->w = CTX(cpu_regs).PC + (int8_t)mem_read(CTX(cpu_regs).PC + 1) + 2;
                     instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 }
                 else
@@ -1554,8 +1592,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x29:
                 instr->handler = &instr_ADD_rr_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "ADD HL,HL";
                 break;
 
@@ -1568,21 +1606,21 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x2B:
                 instr->handler = &instr_DEC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "DEC HL";
                 break;
 
             case 0x2C:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "INC L";
                 break;
 
             case 0x2D:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "DEC L";
                 break;
 
@@ -1590,8 +1628,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD L,d8";
                 break;
@@ -1603,12 +1641,12 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 break;
 
             case 0x30:
-                if (!cpu_regs.F.C)
+                if (!CTX(cpu_regs).F.C)
                 {
                     instr->handler = &instr_nop;
                     instr->progresser = &prog_jmp;
                     instr->clock_cycles = 12; // or 8 if action is not taken (carry)
-                    inst_value->w = cpu_regs.PC + (int8_t)mem_read(cpu_regs.PC + 1) + 2;
+                    inst_value->w = CTX(cpu_regs).PC + (int8_t)mem_read(CTX(cpu_regs).PC + 1) + 2;
                     instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 }
                 else
@@ -1624,8 +1662,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_rr_ss;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                instr->operands[0] = (word *)&cpu_regs.SP;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).SP;
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD SP,d16";
                 break;
@@ -1639,21 +1677,21 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x33:
                 instr->handler = &instr_INC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.SP;
+                instr->operands[0] = (word *)&CTX(cpu_regs).SP;
                 instr->description = "INC SP";
                 break;
 
             case 0x34:
                 instr->handler = &instr_INC_dd;
                 instr->clock_cycles = 12;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "INC (HL)";
                 break;
 
             case 0x35:
                 instr->handler = &instr_DEC_dd;
                 instr->clock_cycles = 12;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "DEC (HL)";
                 break;
 
@@ -1661,8 +1699,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 12;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = (word *)inst_value;
                 instr->description = "LD (HL),d8";
                 break;
@@ -1674,12 +1712,12 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 break;
 
             case 0x38:
-                if (cpu_regs.F.C)
+                if (CTX(cpu_regs).F.C)
                 {
                     instr->handler = &instr_nop;
                     instr->progresser = &prog_jmp;
                     instr->clock_cycles = 12; // or 8 if action is not taken (not carry)
-                    inst_value->w = cpu_regs.PC + (int8_t)mem_read(cpu_regs.PC + 1) + 2;
+                    inst_value->w = CTX(cpu_regs).PC + (int8_t)mem_read(CTX(cpu_regs).PC + 1) + 2;
                     instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 }
                 else
@@ -1694,8 +1732,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x39:
                 instr->handler = &instr_ADD_rr_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.SP;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).SP;
                 instr->description = "ADD HL,SP";
                 break;
 
@@ -1708,21 +1746,21 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x3B:
                 instr->handler = &instr_DEC_rr;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.SP;
+                instr->operands[0] = (word *)&CTX(cpu_regs).SP;
                 instr->description = "DEC SP";
                 break;
 
             case 0x3C:
                 instr->handler = &instr_INC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "INC A";
                 break;
 
             case 0x3D:
                 instr->handler = &instr_DEC_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "DEC A";
                 break;
 
@@ -1730,8 +1768,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "LD A,d8";
                 break;
@@ -1751,48 +1789,48 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x41:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD B,C";
                 break;
 
             case 0x42:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD B,D";
                 break;
 
             case 0x43:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD B,E";
                 break;
 
             case 0x44:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD B,H";
                 break;
 
             case 0x45:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD B,L";
                 break;
 
             case 0x46:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD B,(HL)";
                 break;
@@ -1800,16 +1838,16 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x47:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD B,A";
                 break;
 
             case 0x48:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD C,B";
                 break;
 
@@ -1822,40 +1860,40 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4A:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD C,D";
                 break;
 
             case 0x4B:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD C,E";
                 break;
 
             case 0x4C:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD C,H";
                 break;
 
             case 0x4D:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD C,L";
                 break;
 
             case 0x4E:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD C,(HL)";
                 break;
@@ -1863,24 +1901,24 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4F:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD C,A";
                 break;
 
             case 0x50:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD D,B";
                 break;
 
             case 0x51:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD D,C";
                 break;
 
@@ -1893,32 +1931,32 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x53:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD D,E";
                 break;
 
             case 0x54:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD D,H";
                 break;
 
             case 0x55:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD D,L";
                 break;
 
             case 0x56:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD D,(HL)";
                 break;
@@ -1926,32 +1964,32 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x57:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD D,A";
                 break;
 
             case 0x58:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD E,B";
                 break;
 
             case 0x59:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD E,C";
                 break;
 
             case 0x5A:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD E,D";
                 break;
 
@@ -1964,24 +2002,24 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5C:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD E,H";
                 break;
 
             case 0x5D:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD E,L";
                 break;
 
             case 0x5E:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD E,(HL)";
                 break;
@@ -1989,40 +2027,40 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5F:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD E,A";
                 break;
 
             case 0x60:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD H,B";
                 break;
 
             case 0x61:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD H,C";
                 break;
 
             case 0x62:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD H,D";
                 break;
 
             case 0x63:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD H,E";
                 break;
 
@@ -2035,16 +2073,16 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x65:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD H,L";
                 break;
 
             case 0x66:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD H,(HL)";
                 break;
@@ -2052,48 +2090,48 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x67:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD H,A";
                 break;
 
             case 0x68:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD L,B";
                 break;
 
             case 0x69:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD L,C";
                 break;
 
             case 0x6A:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD L,D";
                 break;
 
             case 0x6B:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD L,E";
                 break;
 
             case 0x6C:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD L,H";
                 break;
 
@@ -2106,8 +2144,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6E:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD L,(HL)";
                 break;
@@ -2115,56 +2153,56 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6F:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD L,A";
                 break;
 
             case 0x70:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD (HL),B";
                 break;
 
             case 0x71:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD (HL),C";
                 break;
 
             case 0x72:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD (HL),D";
                 break;
 
             case 0x73:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD (HL),E";
                 break;
 
             case 0x74:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD (HL),H";
                 break;
 
             case 0x75:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD (HL),L";
                 break;
 
@@ -2177,64 +2215,64 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x77:
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD (HL),A";
                 break;
 
             case 0x78:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "LD A,B";
                 break;
 
             case 0x79:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "LD A,C";
                 break;
 
             case 0x7A:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "LD A,D";
                 break;
 
             case 0x7B:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "LD A,E";
                 break;
 
             case 0x7C:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "LD A,H";
                 break;
 
             case 0x7D:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "LD A,L";
                 break;
 
             case 0x7E:
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "LD A,(HL)";
                 break;
@@ -2248,56 +2286,56 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x80:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "ADD A,B";
                 break;
 
             case 0x81:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "ADD A,C";
                 break;
 
             case 0x82:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "ADD A,D";
                 break;
 
             case 0x83:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "ADD A,E";
                 break;
 
             case 0x84:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "ADD A,H";
                 break;
 
             case 0x85:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "ADD A,L";
                 break;
 
             case 0x86:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "ADD A,(HL)";
                 break;
@@ -2305,64 +2343,64 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x87:
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "ADD A,A";
                 break;
 
             case 0x88:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "ADC A,B";
                 break;
 
             case 0x89:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "ADC A,C";
                 break;
 
             case 0x8A:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "ADC A,D";
                 break;
 
             case 0x8B:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "ADC A,E";
                 break;
 
             case 0x8C:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "ADC A,H";
                 break;
 
             case 0x8D:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "ADC A,L";
                 break;
 
             case 0x8E:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "ADC A,(HL)";
                 break;
@@ -2370,120 +2408,120 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8F:
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "ADC A,A";
                 break;
 
             case 0x90:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "SUB B";
                 break;
 
             case 0x91:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "SUB C";
                 break;
 
             case 0x92:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "SUB D";
                 break;
 
             case 0x93:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "SUB E";
                 break;
 
             case 0x94:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "SUB H";
                 break;
 
             case 0x95:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "SUB L";
                 break;
 
             case 0x96:
                 instr->handler = &instr_SUB_ss;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "SUB (HL)";
                 break;
 
             case 0x97:
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "SUB A";
                 break;
 
             case 0x98:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).B;
                 instr->description = "SBC A,B";
                 break;
 
             case 0x99:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).C;
                 instr->description = "SBC A,C";
                 break;
 
             case 0x9A:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).D;
                 instr->description = "SBC A,D";
                 break;
 
             case 0x9B:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).E;
                 instr->description = "SBC A,E";
                 break;
 
             case 0x9C:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).H;
                 instr->description = "SBC A,H";
                 break;
 
             case 0x9D:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).L;
                 instr->description = "SBC A,L";
                 break;
 
             case 0x9E:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[1] = inst_value;
                 instr->description = "SBC A,(HL)";
                 break;
@@ -2491,57 +2529,57 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9F:
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "SBC A,A";
                 break;
 
             case 0xA0:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "AND B";
                 break;
 
             case 0xA1:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "AND C";
                 break;
 
             case 0xA2:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "AND D";
                 break;
 
             case 0xA3:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "AND E";
                 break;
 
             case 0xA4:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "AND H";
                 break;
 
             case 0xA5:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "AND L";
                 break;
 
             case 0xA6:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 8;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[0] = inst_value;
                 instr->description = "AND (HL)";
                 break;
@@ -2549,56 +2587,56 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA7:
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "AND A";
                 break;
 
             case 0xA8:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "XOR B";
                 break;
 
             case 0xA9:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "XOR C";
                 break;
 
             case 0xAA:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "XOR D";
                 break;
 
             case 0xAB:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "XOR E";
                 break;
 
             case 0xAC:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "XOR H";
                 break;
 
             case 0xAD:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "XOR L";
                 break;
 
             case 0xAE:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 8;
-                inst_value->w = mem_read(cpu_regs.HL);
+                inst_value->w = mem_read(CTX(cpu_regs).HL);
                 instr->operands[0] = inst_value;
                 instr->description = "XOR (HL)";
                 break;
@@ -2606,7 +2644,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAF:
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "XOR A";
                 break;
 
@@ -2615,49 +2653,49 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB0:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "OR B";
                 break;
 
             case 0xB1:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "OR C";
                 break;
 
             case 0xB2:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "OR D";
                 break;
 
             case 0xB3:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "OR E";
                 break;
 
             case 0xB4:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "OR H";
                 break;
 
             case 0xB5:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "OR L";
                 break;
 
             case 0xB6:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 8;
-                inst_value->w = mem_read(cpu_regs.HL);
+                inst_value->w = mem_read(CTX(cpu_regs).HL);
                 instr->operands[0] = inst_value;
                 instr->description = "OR (HL)";
                 break;
@@ -2665,56 +2703,56 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB7:
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "OR A";
                 break;
 
             case 0xB8:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "CP B";
                 break;
 
             case 0xB9:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "CP C";
                 break;
 
             case 0xBA:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "CP D";
                 break;
 
             case 0xBB:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "CP E";
                 break;
 
             case 0xBC:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "CP H";
                 break;
 
             case 0xBD:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "CP L";
                 break;
 
             case 0xBE:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 8;
-                inst_value->b.l = mem_read(cpu_regs.HL);
+                inst_value->b.l = mem_read(CTX(cpu_regs).HL);
                 instr->operands[0] = inst_value;
                 instr->description = "CP (HL)";
                 break;
@@ -2722,7 +2760,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBF:
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "CP A";
                 break;
 
@@ -2735,7 +2773,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC1:
                 instr->handler = &instr_POP;
                 instr->clock_cycles = 12;
-                instr->operands[0] = (word *)&cpu_regs.BC;
+                instr->operands[0] = (word *)&CTX(cpu_regs).BC;
                 instr->description = "POP BC";
                 break;
 
@@ -2743,7 +2781,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_JP_NZ;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "JP NZ,a16";
                 break;
@@ -2753,7 +2791,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->progresser = &prog_jmp;
                 instr->clock_cycles = 16;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "JP a16";
                 break;
@@ -2762,7 +2800,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_CALL_NZ;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "CALL NZ,a16";
                 break;
@@ -2770,7 +2808,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC5:
                 instr->handler = &instr_PUSH;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.BC;
+                instr->operands[0] = (word *)&CTX(cpu_regs).BC;
                 instr->description = "PUSH BC";
                 break;
 
@@ -2778,8 +2816,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_ADD_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "ADD A,d8";
                 break;
@@ -2811,7 +2849,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_JP_Z;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "JP Z,a16";
                 break;
@@ -2820,7 +2858,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_CALL_Z;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "CALL Z,a16";
                 break;
@@ -2830,7 +2868,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->progresser = &prog_jmp;
                 instr->clock_cycles = 24;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "CALL a16";
                 break;
@@ -2839,8 +2877,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_ADC_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "ADC A,d8";
                 break;
@@ -2862,7 +2900,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD1:
                 instr->handler = &instr_POP;
                 instr->clock_cycles = 12;
-                instr->operands[0] = (word *)&cpu_regs.DE;
+                instr->operands[0] = (word *)&CTX(cpu_regs).DE;
                 instr->description = "POP DE";
                 break;
 
@@ -2870,7 +2908,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_JP_NC;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "JP NC,a16";
                 break;
@@ -2879,7 +2917,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_CALL_NC;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "CALL NC,a16";
                 break;
@@ -2887,7 +2925,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD5:
                 instr->handler = &instr_PUSH;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.DE;
+                instr->operands[0] = (word *)&CTX(cpu_regs).DE;
                 instr->description = "PUSH DE";
                 break;
 
@@ -2895,7 +2933,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_SUB_r;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "SUB d8";
                 break;
@@ -2927,7 +2965,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_JP_C;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "JP C,a16";
                 break;
@@ -2936,7 +2974,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_CALL_C;
                 instr->clock_cycles = 12;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = (word *)(uintptr_t)inst_value->w;
                 instr->description = "CALL C,a16";
                 break;
@@ -2945,8 +2983,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_SBC_r_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[1] = inst_value;
                 instr->description = "SBC A,d8";
                 break;
@@ -2964,16 +3002,16 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->clock_cycles = 12;
                 instr->operands_length = 1;
                 inst_value->w = 0xFF00;
-                inst_value->w += mem_read(cpu_regs.PC + 1);
+                inst_value->w += mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LDH (a8),A";
                 break;
 
             case 0xE1:
                 instr->handler = &instr_POP;
                 instr->clock_cycles = 12;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "POP HL";
                 break;
 
@@ -2982,16 +3020,16 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->clock_cycles = 8;
                 //instr->operands_length = 1;
                 // todo: find out if ^this needs to be one
-                (* inst_value) = word(0xFF00 + cpu_regs.C);
+                (* inst_value) = word(0xFF00 + CTX(cpu_regs).C);
                 instr->operands[0] = inst_value;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD (C),A";
                 break;
 
             case 0xE5:
                 instr->handler = &instr_PUSH;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "PUSH HL";
                 break;
 
@@ -2999,7 +3037,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_AND_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "AND d8";
                 break;
@@ -3016,7 +3054,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_ADD_SP_s;
                 instr->clock_cycles = 16;
                 instr->operands_length = 1;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "ADD SP,r8";
                 break;
@@ -3025,7 +3063,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_nop;
                 instr->progresser = &prog_jmp;
                 instr->clock_cycles = 4;
-                instr->operands[0] = (word *)(uintptr_t)cpu_regs.HL;
+                instr->operands[0] = (word *)(uintptr_t)CTX(cpu_regs).HL;
                 instr->description = "JP (HL)";
                 break;
 
@@ -3033,9 +3071,9 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_dd_s;
                 instr->clock_cycles = 16;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
-                instr->operands[1] = (word *)&cpu_regs.A;
+                instr->operands[1] = (word *)&CTX(cpu_regs).A;
                 instr->description = "LD (a16),A";
                 break;
 
@@ -3043,7 +3081,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_XOR_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "XOR d8";
                 break;
@@ -3061,9 +3099,9 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->clock_cycles = 12;
                 instr->operands_length = 1;
                 inst_value->w = 0xFF00;
-                inst_value->w += mem_read(cpu_regs.PC + 1);
+                inst_value->w += mem_read(CTX(cpu_regs).PC + 1);
                 inst_value->w = mem_read(inst_value->w);
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->operands[1] = inst_value;
                 instr->description = "LDH A,(a8)";
                 break;
@@ -3071,7 +3109,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF1:
                 instr->handler = &instr_POP;
                 instr->clock_cycles = 12;
-                instr->operands[0] = (word *)&cpu_regs.AF;
+                instr->operands[0] = (word *)&CTX(cpu_regs).AF;
                 instr->description = "POP AF";
                 break;
 
@@ -3080,8 +3118,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->clock_cycles = 8;
                 //instr->operands_length = 1;
                 // todo: find out if ^this needs to be one
-                instr->operands[0] = (word *)&cpu_regs.A;
-                inst_value->b.l = mem_read(0xFF00 + cpu_regs.C);
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
+                inst_value->b.l = mem_read(0xFF00 + CTX(cpu_regs).C);
                 instr->operands[1] = inst_value;
                 instr->description = "LD (C),A";
                 break;
@@ -3095,7 +3133,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF5:
                 instr->handler = &instr_PUSH;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.AF;
+                instr->operands[0] = (word *)&CTX(cpu_regs).AF;
                 instr->description = "PUSH AF";
                 break;
 
@@ -3103,7 +3141,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_OR_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "OR d8";
                 break;
@@ -3120,7 +3158,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &uinstr_LDHL_SP_s;
                 instr->clock_cycles = 12;
                 instr->operands_length = 1;
-                inst_value->w = mem_read(cpu_regs.PC + 1);
+                inst_value->w = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "LD HL,SP+r8";
                 break;
@@ -3128,8 +3166,8 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF9:
                 instr->handler = &instr_LD_rr_ss;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.SP;
-                instr->operands[1] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).SP;
+                instr->operands[1] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "LD SP,HL";
                 break;
 
@@ -3137,9 +3175,9 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_LD_r_s;
                 instr->clock_cycles = 16;
                 instr->operands_length = 2;
-                (* inst_value) = mem_read_16(cpu_regs.PC + 1);
+                (* inst_value) = mem_read_16(CTX(cpu_regs).PC + 1);
                 inst_value->w = mem_read(inst_value->w);
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->operands[1] = inst_value;
                 instr->description = "LD A,(a16)";
                 break;
@@ -3154,7 +3192,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
                 instr->handler = &instr_CP_s;
                 instr->clock_cycles = 8;
                 instr->operands_length = 1;
-                inst_value->b.l = mem_read(cpu_regs.PC + 1);
+                inst_value->b.l = mem_read(CTX(cpu_regs).PC + 1);
                 instr->operands[0] = inst_value;
                 instr->description = "CP d8";
                 break;
@@ -3177,10 +3215,10 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
     }
     else
     { // secondary instruction table
-        DEBUG_PRINT(("@($%04X): 0xCB           ; Use secondary instruction table for next opcode\n", cpu_regs.PC));
+        DEBUG_PRINT(("@($%04X): 0xCB           ; Use secondary instruction table for next opcode\n", CTX(cpu_regs).PC));
 
-        cpu_regs.PC++;
-        instr->opcode = mem_read(cpu_regs.PC);
+        CTX(cpu_regs).PC++;
+        instr->opcode = mem_read(CTX(cpu_regs).PC);
 
         switch (instr->opcode)
         {
@@ -3189,455 +3227,455 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x00:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "RLC B";
                 break;
 
             case 0x01:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "RLC C";
                 break;
 
             case 0x02:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "RLC D";
                 break;
 
             case 0x03:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "RLC E";
                 break;
 
             case 0x04:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "RLC H";
                 break;
 
             case 0x05:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "RLC L";
                 break;
 
             case 0x06:
                 instr->handler = &instr_RLC_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "RLC (HL)";
                 break;
 
             case 0x07:
                 instr->handler = &instr_RLC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "RLC A";
                 break;
 
             case 0x08:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "RRC B";
                 break;
 
             case 0x09:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "RRC C";
                 break;
 
             case 0x0A:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "RRC D";
                 break;
 
             case 0x0B:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "RRC E";
                 break;
 
             case 0x0C:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "RRC H";
                 break;
 
             case 0x0D:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "RRC L";
                 break;
 
             case 0x0E:
                 instr->handler = &instr_RRC_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "RRC (HL)";
                 break;
 
             case 0x0F:
                 instr->handler = &instr_RRC_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "RRC A";
                 break;
 
             case 0x10:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "RL B";
                 break;
 
             case 0x11:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "RL C";
                 break;
 
             case 0x12:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "RL D";
                 break;
 
             case 0x13:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "RL E";
                 break;
 
             case 0x14:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "RL H";
                 break;
 
             case 0x15:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "RL L";
                 break;
 
             case 0x16:
                 instr->handler = &instr_RL_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "RL (HL)";
                 break;
 
             case 0x17:
                 instr->handler = &instr_RL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "RL A";
                 break;
 
             case 0x18:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "RR B";
                 break;
 
             case 0x19:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "RR C";
                 break;
 
             case 0x1A:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "RR D";
                 break;
 
             case 0x1B:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "RR E";
                 break;
 
             case 0x1C:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "RR H";
                 break;
 
             case 0x1D:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "RR L";
                 break;
 
             case 0x1E:
                 instr->handler = &instr_RR_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "RR (HL)";
                 break;
 
             case 0x1F:
                 instr->handler = &instr_RR_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "RR A";
                 break;
 
             case 0x20:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "SLA B";
                 break;
 
             case 0x21:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "SLA C";
                 break;
 
             case 0x22:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "SLA D";
                 break;
 
             case 0x23:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "SLA E";
                 break;
 
             case 0x24:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "SLA H";
                 break;
 
             case 0x25:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "SLA L";
                 break;
 
             case 0x26:
                 instr->handler = &instr_SLA_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "SLA (HL)";
                 break;
 
             case 0x27:
                 instr->handler = &instr_SLA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "SLA A";
                 break;
 
             case 0x28:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "SRA B";
                 break;
 
             case 0x29:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "SRA C";
                 break;
 
             case 0x2A:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "SRA D";
                 break;
 
             case 0x2B:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "SRA E";
                 break;
 
             case 0x2C:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "SRA H";
                 break;
 
             case 0x2D:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "SRA L";
                 break;
 
             case 0x2E:
                 instr->handler = &instr_SRA_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "SRA (HL)";
                 break;
 
             case 0x2F:
                 instr->handler = &instr_SRA_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "SRA A";
                 break;
 
             case 0x30:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "SWAP B";
                 break;
 
             case 0x31:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "SWAP C";
                 break;
 
             case 0x32:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "SWAP D";
                 break;
 
             case 0x33:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "SWAP E";
                 break;
 
             case 0x34:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "SWAP H";
                 break;
 
             case 0x35:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "SWAP L";
                 break;
 
             case 0x36:
                 instr->handler = &instr_SWAP_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "SWAP (HL)";
                 break;
 
             case 0x37:
                 instr->handler = &instr_SWAP_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "SWAP A";
                 break;
 
             case 0x38:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 instr->description = "SRL B";
                 break;
 
             case 0x39:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 instr->description = "SRL C";
                 break;
 
             case 0x3A:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 instr->description = "SRL D";
                 break;
 
             case 0x3B:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 instr->description = "SRL E";
                 break;
 
             case 0x3C:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 instr->description = "SRL H";
                 break;
 
             case 0x3D:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 instr->description = "SRL L";
                 break;
 
             case 0x3E:
                 instr->handler = &instr_SRL_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 instr->description = "SRL (HL)";
                 break;
 
             case 0x3F:
                 instr->handler = &instr_SRL_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 instr->description = "SRL A";
                 break;
 
             case 0x40:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,B";
@@ -3646,7 +3684,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x41:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,C";
@@ -3655,7 +3693,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x42:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,D";
@@ -3664,7 +3702,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x43:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,E";
@@ -3673,7 +3711,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x44:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,H";
@@ -3682,7 +3720,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x45:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,L";
@@ -3691,7 +3729,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x46:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,(HL)";
@@ -3700,7 +3738,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x47:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 0,A";
@@ -3709,7 +3747,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x48:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,B";
@@ -3718,7 +3756,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x49:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,C";
@@ -3727,7 +3765,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4A:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,D";
@@ -3736,7 +3774,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4B:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,E";
@@ -3745,7 +3783,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4C:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,H";
@@ -3754,7 +3792,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4D:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,L";
@@ -3763,7 +3801,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4E:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,(HL)";
@@ -3772,7 +3810,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x4F:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 1,A";
@@ -3781,7 +3819,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x50:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,B";
@@ -3790,7 +3828,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x51:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,C";
@@ -3799,7 +3837,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x52:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,D";
@@ -3808,7 +3846,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x53:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,E";
@@ -3817,7 +3855,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x54:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,H";
@@ -3826,7 +3864,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x55:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,L";
@@ -3835,7 +3873,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x56:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,(HL)";
@@ -3844,7 +3882,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x57:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 2,A";
@@ -3853,7 +3891,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x58:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,B";
@@ -3862,7 +3900,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x59:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,C";
@@ -3871,7 +3909,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5A:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,D";
@@ -3880,7 +3918,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5B:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,E";
@@ -3889,7 +3927,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5C:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,H";
@@ -3898,7 +3936,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5D:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,L";
@@ -3907,7 +3945,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5E:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,(HL)";
@@ -3916,7 +3954,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x5F:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 3,A";
@@ -3925,7 +3963,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x60:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,B";
@@ -3934,7 +3972,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x61:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,C";
@@ -3943,7 +3981,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x62:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,D";
@@ -3952,7 +3990,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x63:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,E";
@@ -3961,7 +3999,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x64:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,H";
@@ -3970,7 +4008,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x65:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,L";
@@ -3979,7 +4017,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x66:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,(HL)";
@@ -3988,7 +4026,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x67:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 4,A";
@@ -3997,7 +4035,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x68:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,B";
@@ -4006,7 +4044,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x69:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,C";
@@ -4015,7 +4053,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6A:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,D";
@@ -4024,7 +4062,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6B:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,E";
@@ -4033,7 +4071,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6C:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,H";
@@ -4042,7 +4080,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6D:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,L";
@@ -4051,7 +4089,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6E:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,(HL)";
@@ -4060,7 +4098,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x6F:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 5,A";
@@ -4069,7 +4107,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x70:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,B";
@@ -4078,7 +4116,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x71:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,C";
@@ -4087,7 +4125,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x72:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,D";
@@ -4096,7 +4134,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x73:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,E";
@@ -4105,7 +4143,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x74:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,H";
@@ -4114,7 +4152,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x75:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,L";
@@ -4123,7 +4161,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x76:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,(HL)";
@@ -4132,7 +4170,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x77:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 6,A";
@@ -4141,7 +4179,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x78:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,B";
@@ -4150,7 +4188,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x79:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,C";
@@ -4159,7 +4197,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x7A:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,D";
@@ -4168,7 +4206,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x7B:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,E";
@@ -4177,7 +4215,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x7C:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,H";
@@ -4186,7 +4224,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x7D:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,L";
@@ -4195,7 +4233,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x7E:
                 instr->handler = &instr_BIT_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,(HL)";
@@ -4204,7 +4242,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x7F:
                 instr->handler = &instr_BIT_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "BIT 7,A";
@@ -4213,7 +4251,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x80:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,B";
@@ -4222,7 +4260,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x81:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,C";
@@ -4231,7 +4269,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x82:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,D";
@@ -4240,7 +4278,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x83:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,E";
@@ -4249,7 +4287,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x84:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,H";
@@ -4258,7 +4296,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x85:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,L";
@@ -4267,7 +4305,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x86:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,(HL)";
@@ -4276,7 +4314,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x87:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 0,A";
@@ -4285,7 +4323,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x88:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,B";
@@ -4294,7 +4332,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x89:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,C";
@@ -4303,7 +4341,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8A:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,D";
@@ -4312,7 +4350,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8B:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,E";
@@ -4321,7 +4359,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8C:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,H";
@@ -4330,7 +4368,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8D:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,L";
@@ -4339,7 +4377,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8E:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,(HL)";
@@ -4348,7 +4386,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x8F:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 1,A";
@@ -4357,7 +4395,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x90:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,B";
@@ -4366,7 +4404,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x91:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,C";
@@ -4375,7 +4413,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x92:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,D";
@@ -4384,7 +4422,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x93:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,E";
@@ -4393,7 +4431,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x94:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,H";
@@ -4402,7 +4440,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x95:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,L";
@@ -4411,7 +4449,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x96:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,(HL)";
@@ -4420,7 +4458,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x97:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 2,A";
@@ -4429,7 +4467,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x98:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,B";
@@ -4438,7 +4476,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x99:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,C";
@@ -4447,7 +4485,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9A:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,D";
@@ -4456,7 +4494,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9B:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,E";
@@ -4465,7 +4503,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9C:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,H";
@@ -4474,7 +4512,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9D:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,L";
@@ -4483,7 +4521,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9E:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,(HL)";
@@ -4492,7 +4530,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0x9F:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 3,A";
@@ -4501,7 +4539,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA0:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,B";
@@ -4510,7 +4548,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA1:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,C";
@@ -4519,7 +4557,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA2:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,D";
@@ -4528,7 +4566,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA3:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,E";
@@ -4537,7 +4575,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA4:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,H";
@@ -4546,7 +4584,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA5:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,L";
@@ -4555,7 +4593,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA6:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,(HL)";
@@ -4564,7 +4602,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA7:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 4,A";
@@ -4573,7 +4611,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA8:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,B";
@@ -4582,7 +4620,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xA9:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,C";
@@ -4591,7 +4629,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAA:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,D";
@@ -4600,7 +4638,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAB:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,E";
@@ -4609,7 +4647,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAC:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,H";
@@ -4618,7 +4656,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAD:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,L";
@@ -4627,7 +4665,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAE:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,(HL)";
@@ -4636,7 +4674,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xAF:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 5,A";
@@ -4645,7 +4683,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB0:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,B";
@@ -4654,7 +4692,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB1:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,C";
@@ -4663,7 +4701,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB2:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,D";
@@ -4672,7 +4710,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB3:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,E";
@@ -4681,7 +4719,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB4:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,H";
@@ -4690,7 +4728,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB5:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,L";
@@ -4699,7 +4737,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB6:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,(HL)";
@@ -4708,7 +4746,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB7:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 6,A";
@@ -4717,7 +4755,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB8:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,B";
@@ -4726,7 +4764,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xB9:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,C";
@@ -4735,7 +4773,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBA:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,D";
@@ -4744,7 +4782,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBB:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,E";
@@ -4753,7 +4791,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBC:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,H";
@@ -4762,7 +4800,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBD:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,L";
@@ -4771,7 +4809,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBE:
                 instr->handler = &instr_RES_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,(HL)";
@@ -4780,7 +4818,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xBF:
                 instr->handler = &instr_RES_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->b.l = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "RES 7,A";
@@ -4789,7 +4827,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC0:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,B";
@@ -4798,7 +4836,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC1:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,C";
@@ -4807,7 +4845,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC2:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,D";
@@ -4816,7 +4854,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC3:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,E";
@@ -4825,7 +4863,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC4:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,H";
@@ -4834,7 +4872,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC5:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,L";
@@ -4843,7 +4881,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC6:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,(HL)";
@@ -4852,7 +4890,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC7:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00000001;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 0,A";
@@ -4861,7 +4899,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC8:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,B";
@@ -4870,7 +4908,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xC9:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,C";
@@ -4879,7 +4917,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xCA:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,D";
@@ -4888,7 +4926,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xCB:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,E";
@@ -4897,7 +4935,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xCC:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,H";
@@ -4906,7 +4944,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xCD:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,L";
@@ -4915,7 +4953,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xCE:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,(HL)";
@@ -4924,7 +4962,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xCF:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00000010;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 1,A";
@@ -4933,7 +4971,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD0:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,B";
@@ -4942,7 +4980,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD1:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,C";
@@ -4951,7 +4989,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD2:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,D";
@@ -4960,7 +4998,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD3:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,E";
@@ -4969,7 +5007,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD4:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,H";
@@ -4978,7 +5016,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD5:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,L";
@@ -4987,7 +5025,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD6:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,(HL)";
@@ -4996,7 +5034,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD7:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00000100;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 2,A";
@@ -5005,7 +5043,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD8:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,B";
@@ -5014,7 +5052,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xD9:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,C";
@@ -5023,7 +5061,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xDA:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,D";
@@ -5032,7 +5070,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xDB:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,E";
@@ -5041,7 +5079,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xDC:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,H";
@@ -5050,7 +5088,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xDD:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,L";
@@ -5059,7 +5097,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xDE:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,(HL)";
@@ -5068,7 +5106,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xDF:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00001000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 3,A";
@@ -5077,7 +5115,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE0:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,B";
@@ -5086,7 +5124,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE1:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,C";
@@ -5095,7 +5133,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE2:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,D";
@@ -5104,7 +5142,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE3:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,E";
@@ -5113,7 +5151,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE4:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,H";
@@ -5122,7 +5160,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE5:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,L";
@@ -5131,7 +5169,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE6:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,(HL)";
@@ -5140,7 +5178,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE7:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00010000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 4,A";
@@ -5149,7 +5187,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE8:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,B";
@@ -5158,7 +5196,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xE9:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,C";
@@ -5167,7 +5205,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xEA:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,D";
@@ -5176,7 +5214,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xEB:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,E";
@@ -5185,7 +5223,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xEC:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,H";
@@ -5194,7 +5232,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xED:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,L";
@@ -5203,7 +5241,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xEE:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,(HL)";
@@ -5212,7 +5250,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xEF:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b00100000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 5,A";
@@ -5221,7 +5259,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF0:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,B";
@@ -5230,7 +5268,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF1:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,C";
@@ -5239,7 +5277,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF2:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,D";
@@ -5248,7 +5286,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF3:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,E";
@@ -5257,7 +5295,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF4:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,H";
@@ -5266,7 +5304,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF5:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,L";
@@ -5275,7 +5313,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF6:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,(HL)";
@@ -5284,7 +5322,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF7:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b01000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 6,A";
@@ -5293,7 +5331,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF8:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.B;
+                instr->operands[0] = (word *)&CTX(cpu_regs).B;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,B";
@@ -5302,7 +5340,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xF9:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.C;
+                instr->operands[0] = (word *)&CTX(cpu_regs).C;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,C";
@@ -5311,7 +5349,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xFA:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.D;
+                instr->operands[0] = (word *)&CTX(cpu_regs).D;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,D";
@@ -5320,7 +5358,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xFB:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.E;
+                instr->operands[0] = (word *)&CTX(cpu_regs).E;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,E";
@@ -5329,7 +5367,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xFC:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.H;
+                instr->operands[0] = (word *)&CTX(cpu_regs).H;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,H";
@@ -5338,7 +5376,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xFD:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.L;
+                instr->operands[0] = (word *)&CTX(cpu_regs).L;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,L";
@@ -5347,7 +5385,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xFE:
                 instr->handler = &instr_SET_dd;
                 instr->clock_cycles = 16;
-                instr->operands[0] = (word *)&cpu_regs.HL;
+                instr->operands[0] = (word *)&CTX(cpu_regs).HL;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,(HL)";
@@ -5356,7 +5394,7 @@ __always_inline void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *i
             case 0xFF:
                 instr->handler = &instr_SET_r;
                 instr->clock_cycles = 8;
-                instr->operands[0] = (word *)&cpu_regs.A;
+                instr->operands[0] = (word *)&CTX(cpu_regs).A;
                 inst_value->w = 0b10000000;
                 instr->operands[1] = inst_value;
                 instr->description = "SET 7,A";
@@ -11,17 +11,13 @@
 // -> this may fail some tests, but it should be good enough for most games
 
 #include "env.h"
-
-#ifndef EMSCRIPTEN
-#include <pthread.h>
-pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
-#endif
+#include <string.h>
 
 // todo: this most likely doesn't make much sense; redo
-#define WINDOW_VISIBLE  ((int8_t)mem.raw[WY] >= 0 && \
-                         (int8_t)mem.raw[WX] >= 0 && \
-                         (uint8_t)mem.raw[WY] < 144 && \
-                         (uint8_t)mem.raw[WX] < 167)
+#define WINDOW_VISIBLE  ((int8_t)CTX(mem).raw[WY] >= 0 && \
+                         (int8_t)CTX(mem).raw[WX] >= 0 && \
+                         (uint8_t)CTX(mem).raw[WY] < 144 && \
+                         (uint8_t)CTX(mem).raw[WX] < 167)
 
 #define TILE_DATA_BLOCK_0_OFFSET 0x0
 #define TILE_DATA_BLOCK_1_OFFSET 0x800
@@ -43,29 +39,6 @@ pthread_mutex_t mtx = PTHREAD_MUTEX_INITIALIZER;
 #define BG_WINDOW_TILE_MAP_1 0x9800
 #define BG_WINDOW_TILE_MAP_2 0x9C00
 
-struct PPU_REGS ppu_regs;
-
-_Bool ppu_alive = 0;
-
-uint32_t ppu_clock_cycle_counter = 0;
-int32_t ppu_exec_cycle_counter = 0;
-
-uint32_t view_port_1[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT];
-uint32_t view_port_2[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT];
-uint32_t view_port_3[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT];
-
-uint32_t *active_display_viewport = view_port_1;
-uint32_t *next_display_viewport = view_port_2;
-uint32_t *next_ppu_viewport = view_port_3;
-
-_Bool new_frame_available = 0;
-
-byte bg_color_indices[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT]; // which palette index a pixel had for transparency / blending
-
-void (* display_notify_vblank)();
-
-uint8_t window_internal_line_counter = 0;
-
 /* DMG stuff */
 
 byte dmg_color_palette[] = {0xFF, 0xAA, 0x55, 0x00};
@@ -142,18 +115,6 @@ struct DMG_SPRITE_ATTRIBUTE {
 #define CACGB_GREEN(low, high) ((tmp = ACGB_GREEN(low, high)) && tmp > 0xFF ? 0xFF : (tmp < 0 ? 0 : (byte)tmp))
 #define CACGB_BLUE(low, high) ((tmp = ACGB_BLUE(low, high)) && tmp > 0xFF ? 0xFF : (tmp < 0 ? 0 : (byte)tmp))
 
-int16_t tmp;
-
-byte rgb_bg_color_palettes[0x40];
-byte rgb_obj_color_palettes[0x40];
-
-byte adjusted_bg_color_palettes_r[0x20];
-byte adjusted_bg_color_palettes_g[0x20];
-byte adjusted_bg_color_palettes_b[0x20];
-byte adjusted_obj_color_palettes_r[0x20];
-byte adjusted_obj_color_palettes_g[0x20];
-byte adjusted_obj_color_palettes_b[0x20];
-
 union CGB_SPRITE_ATTRIBUTE_FLAGS {
     struct __attribute__((packed)) {
 #ifdef __LITTLE_ENDIAN__
@@ -202,7 +163,7 @@ union CGB_COLOR_PALETTE_SPECIFICATION {
 #endif
     };
     word w;
-} *color_palette_spec;
+};
 
 union CGB_BG_MAP_ATTRIBUTES {
     struct __attribute__((packed)) {
@@ -223,35 +184,42 @@ union CGB_BG_MAP_ATTRIBUTES {
 #endif
     };
     word w;
-} *bg_map_attributes;
+};
 
 /* EOF CGB stuff */
 
 uint32_t *display_request_next_frame()
 {
-    if (new_frame_available)
+    stats_on_present(CTX(new_frame_available));
+
+    if (CTX(new_frame_available))
     {
 #ifndef EMSCRIPTEN
-        pthread_mutex_lock(&mtx);
+        pthread_mutex_lock(&CTX(mtx));
 #endif
 
-        uint32_t *tmp = next_display_viewport;
-        next_display_viewport = active_display_viewport;
-        active_display_viewport = tmp;
+        uint32_t *tmp = CTX(next_display_viewport);
+        CTX(next_display_viewport) = CTX(active_display_viewport);
+        CTX(active_display_viewport) = tmp;
 
-        new_frame_available = 0;
+        CTX(new_frame_available) = 0;
 
 #ifndef EMSCRIPTEN
-        pthread_mutex_unlock(&mtx);
+        pthread_mutex_unlock(&CTX(mtx));
 #endif
     }
 
-    return active_display_viewport;
+    return CTX(active_display_viewport);
+}
+
+uint32_t *nsgbe_framebuffer()
+{
+    return display_request_next_frame();
 }
 
 void ppu_break()
 {
-    ppu_alive = 0;
+    CTX(ppu_alive) = 0;
 }
 
 __always_inline static void oam_search()
@@ -265,14 +233,14 @@ __always_inline static void draw_background_line_dmg(uint8_t line)
 {
     byte color = 0x00;
 
-    byte scx = mem.raw[SCX];
-    byte scy = mem.raw[SCY];
+    byte scx = CTX(mem).raw[SCX];
+    byte scy = CTX(mem).raw[SCY];
 
     // addressing method
-    uint16_t tile_data_base_block_0 = (ppu_regs.lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0 : TILE_DATA_BLOCK_2);
+    uint16_t tile_data_base_block_0 = (CTX(ppu_regs).lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0 : TILE_DATA_BLOCK_2);
     uint16_t tile_data_base_block_1 = TILE_DATA_BLOCK_1;
 
-    uint16_t bg_tile_map_base = (ppu_regs.lcdc->bg_tile_map_area ? BG_WINDOW_TILE_MAP_2 : BG_WINDOW_TILE_MAP_1);
+    uint16_t bg_tile_map_base = (CTX(ppu_regs).lcdc->bg_tile_map_area ? BG_WINDOW_TILE_MAP_2 : BG_WINDOW_TILE_MAP_1);
 
     for (byte x = 0; x < GB_FRAMEBUFFER_WIDTH; x++)
     {
@@ -295,7 +263,7 @@ __always_inline static void draw_background_line_dmg(uint8_t line)
 
         // seems fine
         // bg tilemap is 32*32 tiles, layout is row by row
-        byte bg_tile_index = mem.raw[bg_tile_map_base + bg_map_tile_index_x + (bg_map_tile_index_y * 32)];
+        byte bg_tile_index = CTX(mem).raw[bg_tile_map_base + bg_map_tile_index_x + (bg_map_tile_index_y * 32)];
 
         // printf("bg_tile_index: %d\n", bg_tile_index);
 
@@ -307,7 +275,7 @@ __always_inline static void draw_background_line_dmg(uint8_t line)
         // each tile is 16 bytes
         tile_offset += (16 * bg_tile_index);
 
-        byte *tile_ptr = mem.raw + tile_offset;
+        byte *tile_ptr = CTX(mem).raw + tile_offset;
 
         //printf("tile_offset: 0x%04X\n", tile_offset);
 
@@ -326,7 +294,7 @@ __always_inline static void draw_background_line_dmg(uint8_t line)
 
         //printf("color_palette_index: %d\n", color_palette_index);
 
-        byte color_index = mem.raw[BGP];
+        byte color_index = CTX(mem).raw[BGP];
 
         /*
         Bit 7-6 - Shade for Color Number 3
@@ -341,8 +309,9 @@ __always_inline static void draw_background_line_dmg(uint8_t line)
         color = dmg_color_palette[color_index];
 
         uint16_t pixel_index = x + (line % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
-        next_ppu_viewport[pixel_index] = (0xFF << 24) + (color << 16) + (color << 8) + color;
-        bg_color_indices[pixel_index] = color_palette_index;
+        CTX(next_ppu_viewport)[pixel_index] = (0xFF << 24) + (color << 16) + (color << 8) + color;
+        CTX(bg_color_indices)[pixel_index] = color_palette_index;
+        CTX(line_palette_indices)[x] = color_index;
     }
 }
 
@@ -350,8 +319,8 @@ __always_inline static void draw_window_line_dmg(uint8_t line)
 {
     byte color = 0x00;
 
-    byte wx = mem.raw[WX];
-    byte wy = mem.raw[WY];
+    byte wx = CTX(mem).raw[WX];
+    byte wy = CTX(mem).raw[WY];
 
     int16_t real_window_origin_x = wx - 7;
     int16_t real_window_origin_y = wy;
@@ -360,10 +329,10 @@ __always_inline static void draw_window_line_dmg(uint8_t line)
         return;
 
     // addressing method
-    uint16_t tile_data_base_block_0 = (ppu_regs.lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0 : TILE_DATA_BLOCK_2);
+    uint16_t tile_data_base_block_0 = (CTX(ppu_regs).lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0 : TILE_DATA_BLOCK_2);
     uint16_t tile_data_base_block_1 = TILE_DATA_BLOCK_1;
 
-    uint16_t window_tile_map_base = (ppu_regs.lcdc->window_tile_map_area ? BG_WINDOW_TILE_MAP_2 : BG_WINDOW_TILE_MAP_1);
+    uint16_t window_tile_map_base = (CTX(ppu_regs).lcdc->window_tile_map_area ? BG_WINDOW_TILE_MAP_2 : BG_WINDOW_TILE_MAP_1);
 
     for (byte x = real_window_origin_x; x < GB_FRAMEBUFFER_WIDTH; x++)
     {
@@ -385,7 +354,7 @@ __always_inline static void draw_window_line_dmg(uint8_t line)
 
         // seems fine
         // window tilemap is 32*32 tiles, layout is row by row
-        byte window_tile_index = mem.raw[window_tile_map_base + window_map_tile_index_x + (window_map_tile_index_y * 32)];
+        byte window_tile_index = CTX(mem).raw[window_tile_map_base + window_map_tile_index_x + (window_map_tile_index_y * 32)];
 
         // printf("bg_tile_index: %d\n", bg_tile_index);
 
@@ -397,7 +366,7 @@ __always_inline static void draw_window_line_dmg(uint8_t line)
         // each tile is 16 bytes
         tile_offset += (16 * window_tile_index);
 
-        byte *tile_ptr = mem.raw + tile_offset;
+        byte *tile_ptr = CTX(mem).raw + tile_offset;
 
         //printf("tile_offset: 0x%04X\n", tile_offset);
 
@@ -416,7 +385,7 @@ __always_inline static void draw_window_line_dmg(uint8_t line)
 
         //printf("color_palette_index: %d\n", color_palette_index);
 
-        byte color_index = mem.raw[BGP];
+        byte color_index = CTX(mem).raw[BGP];
 
         /*
         Bit 7-6 - Shade for Color Number 3
@@ -431,11 +400,12 @@ __always_inline static void draw_window_line_dmg(uint8_t line)
         color = dmg_color_palette[color_index];
 
         uint16_t pixel_index = x + (line % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
-        next_ppu_viewport[pixel_index] = (0xFF << 24) + (color << 16) + (color << 8) + color;
-        bg_color_indices[pixel_index] = color_palette_index;
+        CTX(next_ppu_viewport)[pixel_index] = (0xFF << 24) + (color << 16) + (color << 8) + color;
+        CTX(bg_color_indices)[pixel_index] = color_palette_index;
+        CTX(line_palette_indices)[x] = color_index;
     }
 
-    window_internal_line_counter++;
+    CTX(window_internal_line_counter)++;
 }
 
 __always_inline static void draw_sprites_line_dmg(uint8_t line)
@@ -445,7 +415,7 @@ __always_inline static void draw_sprites_line_dmg(uint8_t line)
     uint16_t sprite_data_base_block_0 = SPRITE_DATA_BLOCK_0;
     uint16_t sprite_data_base_block_1 = SPRITE_DATA_BLOCK_1;
 
-    byte sprite_height = (ppu_regs.lcdc->obj_size ? 16 : 8);
+    byte sprite_height = (CTX(ppu_regs).lcdc->obj_size ? 16 : 8);
     byte sprite_width = 8;
 
     for (byte oam_index = 40; oam_index > 0; oam_index--)
@@ -453,7 +423,7 @@ __always_inline static void draw_sprites_line_dmg(uint8_t line)
         // if y is in sprite (handle 8x8 or 8x16)
             // write sprite pixel (x,y) to active_view_port
 
-        struct DMG_SPRITE_ATTRIBUTE *spr_attrs = (struct DMG_SPRITE_ATTRIBUTE *)(mem.map.sprite_attr_table + ((oam_index - 1) * 4));
+        struct DMG_SPRITE_ATTRIBUTE *spr_attrs = (struct DMG_SPRITE_ATTRIBUTE *)(CTX(mem).map.sprite_attr_table + ((oam_index - 1) * 4));
 
         int16_t real_sprite_origin_y = (spr_attrs->pos_y - 16);
         int16_t real_sprite_origin_x = (spr_attrs->pos_x - 8);
@@ -468,7 +438,7 @@ __always_inline static void draw_sprites_line_dmg(uint8_t line)
 
                     byte sprite_tile_index = spr_attrs->tile_index;
 
-                    if (ppu_regs.lcdc->obj_size)
+                    if (CTX(ppu_regs).lcdc->obj_size)
                     {
                         // for y-flipping
                         if (spr_attrs->flags.y_flip)
@@ -496,7 +466,7 @@ __always_inline static void draw_sprites_line_dmg(uint8_t line)
 
                     tile_offset += ((2 * 8) * sprite_tile_index);
 
-                    byte *tile_ptr = mem.raw + tile_offset;
+                    byte *tile_ptr = CTX(mem).raw + tile_offset;
 
                     byte *high = (tile_ptr + sprite_pixel_index_y * 2);
                     byte *low = (tile_ptr + sprite_pixel_index_y * 2 + 1);
@@ -509,16 +479,19 @@ __always_inline static void draw_sprites_line_dmg(uint8_t line)
                     color_palette_index += ((*high >> pixel_color_shift) & 1);
                     color_palette_index += ((*low >> pixel_color_shift) & 1) << 1;
 
-                    byte color_index = mem.raw[(spr_attrs->flags.palette_num ? OBP1 : OBP0)];
+                    byte color_index = CTX(mem).raw[(spr_attrs->flags.palette_num ? OBP1 : OBP0)];
                     color_index = (color_index >> (color_palette_index * 2)) & 3;
 
                     color = dmg_color_palette[color_index];
 
-                    uint16_t pixel_index = real_sprite_origin_x + sprite_pixel_index_x + (mem.raw[LY] % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
+                    uint16_t pixel_index = real_sprite_origin_x + sprite_pixel_index_x + (CTX(mem).raw[LY] % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
 
                     // this is not correct -- see pandocs note on sprite priorities and conflicts
-                    if (color_palette_index != 0 && (!spr_attrs->flags.bg_win_on_top || bg_color_indices[pixel_index] == 0))
-                        next_ppu_viewport[pixel_index] = (0xFF << 24) + (color << 16) + (color << 8) + color;
+                    if (color_palette_index != 0 && (!spr_attrs->flags.bg_win_on_top || CTX(bg_color_indices)[pixel_index] == 0))
+                    {
+                        CTX(next_ppu_viewport)[pixel_index] = (0xFF << 24) + (color << 16) + (color << 8) + color;
+                        CTX(line_palette_indices)[real_sprite_origin_x + sprite_pixel_index_x] = color_index;
+                    }
                 }
             }
         }
@@ -531,15 +504,17 @@ __always_inline static void draw_sprites_line_dmg(uint8_t line)
 
 __always_inline static void draw_background_line_cgb(uint8_t line)
 {
-    byte scx = mem.raw[SCX];
-    byte scy = mem.raw[SCY];
+    union CGB_BG_MAP_ATTRIBUTES *bg_map_attributes;
+
+    byte scx = CTX(mem).raw[SCX];
+    byte scy = CTX(mem).raw[SCY];
 
     // addressing method
     // using the base instead as we're mapping directly onto vram, instead of mem.raw
-    uint16_t tile_data_base_block_0 = (ppu_regs.lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0_OFFSET : TILE_DATA_BLOCK_2_OFFSET);
+    uint16_t tile_data_base_block_0 = (CTX(ppu_regs).lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0_OFFSET : TILE_DATA_BLOCK_2_OFFSET);
     uint16_t tile_data_base_block_1 = TILE_DATA_BLOCK_1_OFFSET;
 
-    uint16_t bg_tile_map_base = (ppu_regs.lcdc->bg_tile_map_area ? BG_WINDOW_TILE_MAP_2_OFFSET : BG_WINDOW_TILE_MAP_1_OFFSET);
+    uint16_t bg_tile_map_base = (CTX(ppu_regs).lcdc->bg_tile_map_area ? BG_WINDOW_TILE_MAP_2_OFFSET : BG_WINDOW_TILE_MAP_1_OFFSET);
 
     for (byte x = 0; x < GB_FRAMEBUFFER_WIDTH; x++)
     {
@@ -562,11 +537,11 @@ __always_inline static void draw_background_line_cgb(uint8_t line)
 
         uint16_t bg_tile_map = bg_tile_map_base + bg_map_tile_index_x + (bg_map_tile_index_y * 32);
 
-        bg_map_attributes = (union CGB_BG_MAP_ATTRIBUTES *)(cgb_extra_vram_bank + bg_tile_map);
+        bg_map_attributes = (union CGB_BG_MAP_ATTRIBUTES *)(CTX(cgb_extra_vram_bank) + bg_tile_map);
 
         // seems fine
         // bg tilemap is 32*32 tiles, layout is row by row
-        byte bg_tile_index = mem.map.video_ram[bg_tile_map];
+        byte bg_tile_index = CTX(mem).map.video_ram[bg_tile_map];
 
         // printf("bg_tile_index: %d\n", bg_tile_index);
 
@@ -581,9 +556,9 @@ __always_inline static void draw_background_line_cgb(uint8_t line)
         byte *tile_ptr = 0;
 
         if (bg_map_attributes->vram_bank == 1)
-            tile_ptr = cgb_extra_vram_bank + tile_offset;
+            tile_ptr = CTX(cgb_extra_vram_bank) + tile_offset;
         else
-            tile_ptr = mem.map.video_ram + tile_offset;
+            tile_ptr = CTX(mem).map.video_ram + tile_offset;
 
         //printf("tile_offset: 0x%04X\n", tile_offset);
 
@@ -618,25 +593,28 @@ __always_inline static void draw_background_line_cgb(uint8_t line)
         //printf("color_index: %d\n", color_index);
 
         uint16_t pixel_index = x + (line % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
-        next_ppu_viewport[pixel_index] = (0xFF << 24) + (adjusted_bg_color_palettes_b[color_index] << 16) \
-          + (adjusted_bg_color_palettes_g[color_index] << 8) + adjusted_bg_color_palettes_r[color_index];
+        CTX(next_ppu_viewport)[pixel_index] = (0xFF << 24) + (CTX(adjusted_bg_color_palettes_b)[color_index] << 16) \
+          + (CTX(adjusted_bg_color_palettes_g)[color_index] << 8) + CTX(adjusted_bg_color_palettes_r)[color_index];
+        CTX(line_palette_indices)[x] = color_index;
 
-        if (ppu_regs.lcdc->bg_window_enable_prio)
+        if (CTX(ppu_regs).lcdc->bg_window_enable_prio)
         {
             if (bg_map_attributes->bg_to_oam_prio)
-                bg_color_indices[pixel_index] = (color_palette_index == 0 ? 0 : 4);
+                CTX(bg_color_indices)[pixel_index] = (color_palette_index == 0 ? 0 : 4);
             else
-                bg_color_indices[pixel_index] = color_palette_index;
+                CTX(bg_color_indices)[pixel_index] = color_palette_index;
         }
         else
-            bg_color_indices[pixel_index] = 5;
+            CTX(bg_color_indices)[pixel_index] = 5;
     }
 }
 
 __always_inline static void draw_window_line_cgb(uint8_t line)
 {
-    byte wx = mem.raw[WX];
-    byte wy = mem.raw[WY];
+    union CGB_BG_MAP_ATTRIBUTES *bg_map_attributes;
+
+    byte wx = CTX(mem).raw[WX];
+    byte wy = CTX(mem).raw[WY];
 
     int16_t real_window_origin_x = wx - 7;
     int16_t real_window_origin_y = wy;
@@ -645,10 +623,10 @@ __always_inline static void draw_window_line_cgb(uint8_t line)
         return;
 
     // addressing method
-    uint16_t tile_data_base_block_0 = (ppu_regs.lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0_OFFSET : TILE_DATA_BLOCK_2_OFFSET);
+    uint16_t tile_data_base_block_0 = (CTX(ppu_regs).lcdc->bg_window_tile_data_area ? TILE_DATA_BLOCK_0_OFFSET : TILE_DATA_BLOCK_2_OFFSET);
     uint16_t tile_data_base_block_1 = TILE_DATA_BLOCK_1_OFFSET;
 
-    uint16_t window_tile_map_base = (ppu_regs.lcdc->window_tile_map_area ? BG_WINDOW_TILE_MAP_2_OFFSET : BG_WINDOW_TILE_MAP_1_OFFSET);
+    uint16_t window_tile_map_base = (CTX(ppu_regs).lcdc->window_tile_map_area ? BG_WINDOW_TILE_MAP_2_OFFSET : BG_WINDOW_TILE_MAP_1_OFFSET);
 
     for (byte x = real_window_origin_x; x < GB_FRAMEBUFFER_WIDTH; x++)
     {
@@ -670,11 +648,11 @@ __always_inline static void draw_window_line_cgb(uint8_t line)
 
         uint16_t window_tile_map = window_tile_map_base + window_map_tile_index_x + (window_map_tile_index_y * 32);
 
-        bg_map_attributes = (union CGB_BG_MAP_ATTRIBUTES *)(cgb_extra_vram_bank + window_tile_map);
+        bg_map_attributes = (union CGB_BG_MAP_ATTRIBUTES *)(CTX(cgb_extra_vram_bank) + window_tile_map);
 
         // seems fine
         // window tilemap is 32*32 tiles, layout is row by row
-        byte window_tile_index = mem.map.video_ram[window_tile_map];
+        byte window_tile_index = CTX(mem).map.video_ram[window_tile_map];
 
         // printf("bg_tile_index: %d\n", bg_tile_index);
 
@@ -689,9 +667,9 @@ __always_inline static void draw_window_line_cgb(uint8_t line)
         byte *tile_ptr = 0;
 
         if (bg_map_attributes->vram_bank == 1)
-            tile_ptr = cgb_extra_vram_bank + tile_offset;
+            tile_ptr = CTX(cgb_extra_vram_bank) + tile_offset;
         else
-            tile_ptr = mem.map.video_ram + tile_offset;
+            tile_ptr = CTX(mem).map.video_ram + tile_offset;
 
         //printf("tile_offset: 0x%04X\n", tile_offset);
 
@@ -726,21 +704,22 @@ __always_inline static void draw_window_line_cgb(uint8_t line)
         //printf("color_index: %d\n", color_index);
 
         uint16_t pixel_index = x + (line % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
-        next_ppu_viewport[pixel_index] = (0xFF << 24) + (adjusted_bg_color_palettes_b[color_index] << 16) \
-          + (adjusted_bg_color_palettes_g[color_index] << 8) + adjusted_bg_color_palettes_r[color_index];
+        CTX(next_ppu_viewport)[pixel_index] = (0xFF << 24) + (CTX(adjusted_bg_color_palettes_b)[color_index] << 16) \
+          + (CTX(adjusted_bg_color_palettes_g)[color_index] << 8) + CTX(adjusted_bg_color_palettes_r)[color_index];
+        CTX(line_palette_indices)[x] = color_index;
 
-        if (ppu_regs.lcdc->bg_window_enable_prio)
+        if (CTX(ppu_regs).lcdc->bg_window_enable_prio)
         {
             if (bg_map_attributes->bg_to_oam_prio)
-                bg_color_indices[pixel_index] = (color_palette_index == 0 ? 0 : 4);
+                CTX(bg_color_indices)[pixel_index] = (color_palette_index == 0 ? 0 : 4);
             else
-                bg_color_indices[pixel_index] = color_palette_index;
+                CTX(bg_color_indices)[pixel_index] = color_palette_index;
         }
         else
-            bg_color_indices[pixel_index] = 5;
+            CTX(bg_color_indices)[pixel_index] = 5;
     }
 
-    window_internal_line_counter++;
+    CTX(window_internal_line_counter)++;
 }
 
 __always_inline static void draw_sprites_line_cgb(uint8_t line)
@@ -748,7 +727,7 @@ __always_inline static void draw_sprites_line_cgb(uint8_t line)
     uint16_t sprite_data_base_block_0 = SPRITE_DATA_BLOCK_0_OFFSET;
     uint16_t sprite_data_base_block_1 = SPRITE_DATA_BLOCK_1_OFFSET;
 
-    byte sprite_height = (ppu_regs.lcdc->obj_size ? 16 : 8);
+    byte sprite_height = (CTX(ppu_regs).lcdc->obj_size ? 16 : 8);
     byte sprite_width = 8;
 
     for (byte oam_index = 40; oam_index > 0; oam_index--)
@@ -756,7 +735,7 @@ __always_inline static void draw_sprites_line_cgb(uint8_t line)
         // if y is in sprite (handle 8x8 or 8x16)
             // write sprite pixel (x,y) to active_view_port
 
-        struct CGB_SPRITE_ATTRIBUTE *spr_attrs = (struct CGB_SPRITE_ATTRIBUTE *)(mem.map.sprite_attr_table + ((oam_index - 1) * 4));
+        struct CGB_SPRITE_ATTRIBUTE *spr_attrs = (struct CGB_SPRITE_ATTRIBUTE *)(CTX(mem).map.sprite_attr_table + ((oam_index - 1) * 4));
 
         int16_t real_sprite_origin_y = (spr_attrs->pos_y - 16);
         int16_t real_sprite_origin_x = (spr_attrs->pos_x - 8);
@@ -771,7 +750,7 @@ __always_inline static void draw_sprites_line_cgb(uint8_t line)
 
                     byte sprite_tile_index = spr_attrs->tile_index;
 
-                    if (ppu_regs.lcdc->obj_size)
+                    if (CTX(ppu_regs).lcdc->obj_size)
                     {
                         // for y-flipping
                         if (spr_attrs->flags.y_flip)
@@ -802,9 +781,9 @@ __always_inline static void draw_sprites_line_cgb(uint8_t line)
                     byte *tile_ptr = 0;
 
                     if (spr_attrs->flags.vram_bank == 1)
-                        tile_ptr = cgb_extra_vram_bank + tile_offset;
+                        tile_ptr = CTX(cgb_extra_vram_bank) + tile_offset;
                     else
-                        tile_ptr = mem.map.video_ram + tile_offset;
+                        tile_ptr = CTX(mem).map.video_ram + tile_offset;
 
                     byte *high = (tile_ptr + sprite_pixel_index_y * 2);
                     byte *low = (tile_ptr + sprite_pixel_index_y * 2 + 1);
@@ -822,13 +801,16 @@ __always_inline static void draw_sprites_line_cgb(uint8_t line)
 
                     byte color_index = spr_attrs->flags.palette_num * 4 + color_palette_index;
 
-                    uint16_t pixel_index = real_sprite_origin_x + sprite_pixel_index_x + (mem.raw[LY] % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
+                    uint16_t pixel_index = real_sprite_origin_x + sprite_pixel_index_x + (CTX(mem).raw[LY] % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
 
                     // this is not correct -- see pandocs note on sprite priorities and conflicts
-                    if (color_palette_index != 0 && (bg_color_indices[pixel_index] == 5 || (bg_color_indices[pixel_index] != 4 \
-                      && (!spr_attrs->flags.bg_win_on_top || bg_color_indices[pixel_index] == 0))))
-                        next_ppu_viewport[pixel_index] = (0xFF << 24) + (adjusted_obj_color_palettes_b[color_index] << 16) \
-                          + (adjusted_obj_color_palettes_g[color_index] << 8) + adjusted_obj_color_palettes_r[color_index];
+                    if (color_palette_index != 0 && (CTX(bg_color_indices)[pixel_index] == 5 || (CTX(bg_color_indices)[pixel_index] != 4 \
+                      && (!spr_attrs->flags.bg_win_on_top || CTX(bg_color_indices)[pixel_index] == 0))))
+                    {
+                        CTX(next_ppu_viewport)[pixel_index] = (0xFF << 24) + (CTX(adjusted_obj_color_palettes_b)[color_index] << 16) \
+                          + (CTX(adjusted_obj_color_palettes_g)[color_index] << 8) + CTX(adjusted_obj_color_palettes_r)[color_index];
+                        CTX(line_palette_indices)[real_sprite_origin_x + sprite_pixel_index_x] = 32 + color_index;
+                    }
                 }
             }
         }
@@ -837,40 +819,149 @@ __always_inline static void draw_sprites_line_cgb(uint8_t line)
 
 /* EOF CGB rendering */
 
+/* observations */
+
+// rec. 601 weights summing up to 256, so dmg shades keep their value
+__always_inline static byte observation_luma(uint32_t pixel)
+{
+    return ((pixel & 0xFF) * 77 + ((pixel >> 8) & 0xFF) * 150 + ((pixel >> 16) & 0xFF) * 29) >> 8;
+}
+
+// turns the line just drawn into its row of the observation while it's still in cache
+__always_inline static void observe_line(uint8_t line)
+{
+    if (line < CTX(observation_y) || line >= CTX(observation_y) + CTX(observation_height))
+        return;
+
+    uint8_t row = line - CTX(observation_y);
+    uint8_t stride = CTX(observation_stride);
+    uint8_t block_line = row % stride;
+    uint8_t width = CTX(observation_width) / stride;
+
+    byte *output = CTX(observation_buffer) + (row / stride) * width;
+    uint32_t *pixels = CTX(next_ppu_viewport) + CTX(observation_x) + line * GB_FRAMEBUFFER_WIDTH;
+
+    if (CTX(observation_format) == NSGBE_OBSERVATION_PALETTE_INDEX)
+    {
+        if (block_line == 0)
+            for (uint8_t i = 0; i < width; i++)
+                output[i] = CTX(line_palette_indices)[CTX(observation_x) + i * stride];
+    }
+    else if (!CTX(observation_average))
+    {
+        if (block_line == 0)
+            for (uint8_t i = 0; i < width; i++)
+                output[i] = observation_luma(pixels[i * stride]);
+    }
+    else
+    {
+        // luma is summed up per block over its lines, the last one writes out the average
+        for (uint8_t i = 0; i < width; i++)
+        {
+            uint16_t sum = (block_line == 0 ? 0 : CTX(observation_sums)[i]);
+
+            for (uint8_t k = 0; k < stride; k++)
+                sum += observation_luma(pixels[i * stride + k]);
+
+            CTX(observation_sums)[i] = sum;
+        }
+
+        if (block_line == stride - 1)
+            for (uint8_t i = 0; i < width; i++)
+                output[i] = CTX(observation_sums)[i] / (stride * stride);
+    }
+}
+
+int nsgbe_observation_configure(const struct NSGBE_OBSERVATION_CONFIG *config)
+{
+    if (!config || config->format == NSGBE_OBSERVATION_OFF)
+    {
+        CTX(observation_format) = NSGBE_OBSERVATION_OFF;
+        return NSGBE_OK;
+    }
+
+    uint8_t stride = (config->stride ? config->stride : 1);
+    uint8_t width = (config->width ? config->width : GB_FRAMEBUFFER_WIDTH - config->x);
+    uint8_t height = (config->height ? config->height : GB_FRAMEBUFFER_HEIGHT - config->y);
+
+    if (config->format > NSGBE_OBSERVATION_PALETTE_INDEX || stride > 16 || config->x >= GB_FRAMEBUFFER_WIDTH
+        || config->y >= GB_FRAMEBUFFER_HEIGHT || config->x + width > GB_FRAMEBUFFER_WIDTH
+        || config->y + height > GB_FRAMEBUFFER_HEIGHT || width < stride || height < stride)
+        return NSGBE_ERR;
+
+    CTX(observation_format) = config->format;
+    CTX(observation_x) = config->x;
+    CTX(observation_y) = config->y;
+    CTX(observation_width) = width - width % stride;
+    CTX(observation_height) = height - height % stride;
+    CTX(observation_stride) = stride;
+    CTX(observation_average) = config->average;
+
+    memset(CTX(observation_buffer), 0, sizeof(CTX(observation_buffer)));
+
+    return NSGBE_OK;
+}
+
+const uint8_t *nsgbe_observation(uint32_t *width, uint32_t *height)
+{
+    if (CTX(observation_format) == NSGBE_OBSERVATION_OFF)
+        return NULL;
+
+    if (width)
+        *width = CTX(observation_width) / CTX(observation_stride);
+
+    if (height)
+        *height = CTX(observation_height) / CTX(observation_stride);
+
+    return CTX(observation_buffer);
+}
+
+size_t nsgbe_observation_size()
+{
+    if (CTX(observation_format) == NSGBE_OBSERVATION_OFF)
+        return 0;
+
+    return (size_t)(CTX(observation_width) / CTX(observation_stride)) * (CTX(observation_height) / CTX(observation_stride));
+}
+
 __always_inline static void render_scanline()
 {
-    byte line = mem.raw[LY];
+    byte line = CTX(mem).raw[LY];
 
-    if (gb_mode == MODE_CGB)
+    if (CTX(gb_mode) == MODE_CGB)
     {
         draw_background_line_cgb(line);
 
-        if (ppu_regs.lcdc->window_enable)
+        if (CTX(ppu_regs).lcdc->window_enable)
             draw_window_line_cgb(line);
 
-        if (ppu_regs.lcdc->obj_enable)
+        if (CTX(ppu_regs).lcdc->obj_enable)
             draw_sprites_line_cgb(line);
     }
     else
     {
-        if (ppu_regs.lcdc->bg_window_enable_prio)
+        if (CTX(ppu_regs).lcdc->bg_window_enable_prio)
         {
             draw_background_line_dmg(line);
 
-            if (ppu_regs.lcdc->window_enable && WINDOW_VISIBLE)
+            if (CTX(ppu_regs).lcdc->window_enable && WINDOW_VISIBLE)
                 draw_window_line_dmg(line);
         }
         else
             for (byte x = 0; x < GB_FRAMEBUFFER_WIDTH; x++)
             {
-                uint16_t pixel_index = x + (mem.raw[LY] % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
-                next_ppu_viewport[pixel_index] = 0xFFFFFFFF;
-                bg_color_indices[pixel_index] = 0;
+                uint16_t pixel_index = x + (CTX(mem).raw[LY] % GB_FRAMEBUFFER_HEIGHT) * GB_FRAMEBUFFER_WIDTH;
+                CTX(next_ppu_viewport)[pixel_index] = 0xFFFFFFFF;
+                CTX(bg_color_indices)[pixel_index] = 0;
+                CTX(line_palette_indices)[x] = 0;
             }
 
-        if (ppu_regs.lcdc->obj_enable)
+        if (CTX(ppu_regs).lcdc->obj_enable)
             draw_sprites_line_dmg(line);
     }
+
+    if (CTX(observation_format))
+        observe_line(line);
 }
 
 __always_inline static void oam_read()
@@ -883,84 +974,133 @@ __always_inline static void vram_read()
     // do vram read stuff
 
     // render scanline
-    render_scanline();
+    if (!CTX(render_suppressed))
+    {
+        if (CTX(cow_pages_held))
+            cow_before_render();
+
+        PROFILE_BEGIN(NSGBE_PROFILE_RENDER);
+        render_scanline();
+        PROFILE_END(NSGBE_PROFILE_RENDER);
+    }
 }
 
 __always_inline static void hblank()
 {
     // do hblank stuff
     // todo: maybe this has to be mem.raw[LY] + 1 instead
-    ppu_regs.stat->lyc_eq_ly = (mem.raw[LYC] == mem.raw[LY] + 1);
+    CTX(ppu_regs).stat->lyc_eq_ly = (CTX(mem).raw[LYC] == CTX(mem).raw[LY] + 1);
 
-    if ((ppu_regs.stat->lyc_eq_ly || ppu_regs.stat->hblank_int) && mem.map.interrupt_enable_reg.LCD_STAT)
-        mem.map.interrupt_flag_reg.LCD_STAT = 1;
+    if ((CTX(ppu_regs).stat->lyc_eq_ly || CTX(ppu_regs).stat->hblank_int) && CTX(mem).map.interrupt_enable_reg.LCD_STAT)
+        CTX(mem).map.interrupt_flag_reg.LCD_STAT = 1;
 }
 
 __always_inline static void vblank()
 {
-    window_internal_line_counter = 0;
+    CTX(window_internal_line_counter) = 0;
 
     // do vblank stuff
 
 #ifndef EMSCRIPTEN
-    pthread_mutex_lock(&mtx);
+    pthread_mutex_lock(&CTX(mtx));
 #endif
 
-    uint32_t *tmp = next_ppu_viewport;
-    next_ppu_viewport = next_display_viewport;
-    next_display_viewport = tmp;
+    // frames that haven't been drawn aren't handed to the frontend
+    if (!CTX(render_suppressed))
+    {
+        if (CTX(new_frame_available))
+            stats_on_frame_dropped();
+
+        uint32_t *tmp = CTX(next_ppu_viewport);
+        CTX(next_ppu_viewport) = CTX(next_display_viewport);
+        CTX(next_display_viewport) = tmp;
+
+        CTX(new_frame_available) = 1;
+
+        if (CTX(capture))
+            capture_frame(CTX(next_display_viewport));
+    }
+
+    CTX(ppu_frame_counter)++;
+
+    if (!CTX(running_ahead))
+        stats_on_frame();
+
+    if (CTX(trace))
+        trace_event(TRACE_FRAME, CTX(ppu_frame_counter));
+
+    if (CTX(autosave) && !CTX(running_ahead))
+        autosave_on_frame();
 
-    new_frame_available = 1;
+    if (CTX(frame_hash_parts) && !CTX(running_ahead))
+        frame_hash_on_frame();
+
+#ifdef NSGBE_PROFILING
+    // frames run ahead count towards the frame they're presented for
+    if (!CTX(running_ahead))
+        profile_on_frame();
+#endif
 
 #ifndef EMSCRIPTEN
-    pthread_mutex_unlock(&mtx);
+    pthread_mutex_unlock(&CTX(mtx));
 #endif
 
+    if (CTX(frame_hash_parts) && !CTX(running_ahead))
+        frame_hash_publish();
+
     //printf("drawing frame\n");
-    if (display_notify_vblank)
-        display_notify_vblank();
+    if (CTX(display_notify_vblank) && !CTX(render_suppressed))
+        CTX(display_notify_vblank)();
 
-    mem.map.interrupt_flag_reg.VBLANK = 1;
+    CTX(mem).map.interrupt_flag_reg.VBLANK = 1;
+}
+
+__always_inline static void ppu_set_mode(byte mode)
+{
+    if (CTX(trace) && CTX(ppu_regs).stat->mode != mode)
+        trace_event(TRACE_PPU_MODE, mode);
+
+    CTX(ppu_regs).stat->mode = mode;
 }
 
 __always_inline void ppu_step()
 {
-    ppu_clock_cycle_counter++;
+    CTX(ppu_clock_cycle_counter)++;
 
-    if (mem.raw[LY] <= 143)
+    if (CTX(mem).raw[LY] <= 143)
     {
         // todo: improve this so it doesn't cycle through all the modes all the time
-        if (ppu_clock_cycle_counter > 456) // leave HBLANK_MODE; hardcoded duration 204, it's 85 to 208 depending on previous duration
+        if (CTX(ppu_clock_cycle_counter) > 456) // leave HBLANK_MODE; hardcoded duration 204, it's 85 to 208 depending on previous duration
         {
-            ppu_clock_cycle_counter = 0;
-            mem.raw[LY]++;
+            CTX(ppu_clock_cycle_counter) = 0;
+            CTX(mem).raw[LY]++;
             //DEBUG_PRINT(("drawing scanline 0x%02X\n", mem.raw[LY]));
-            ppu_regs.stat->mode = PPU_OAM_READ_MODE;
+            ppu_set_mode(PPU_OAM_READ_MODE);
             oam_read();
         }
-        else if (ppu_clock_cycle_counter == 253) // leave VRAM_READ_MODE; hardcoded duration 172, it's 168 to 291 depending on sprite count
+        else if (CTX(ppu_clock_cycle_counter) == 253) // leave VRAM_READ_MODE; hardcoded duration 172, it's 168 to 291 depending on sprite count
         {
-            ppu_regs.stat->mode = PPU_HBLANK_MODE;
+            ppu_set_mode(PPU_HBLANK_MODE);
             hblank();
         }
-        else if (ppu_clock_cycle_counter == 81) // leave OAM_READ_MODE
+        else if (CTX(ppu_clock_cycle_counter) == 81) // leave OAM_READ_MODE
         {
-            ppu_regs.stat->mode = PPU_VRAM_READ_MODE;
+            ppu_set_mode(PPU_VRAM_READ_MODE);
             vram_read();
         }
     }
-    else if (mem.raw[LY] >= 144)
+    else if (CTX(mem).raw[LY] >= 144)
     {
-        ppu_regs.stat->mode = PPU_VBLANK_MODE;
+        ppu_set_mode(PPU_VBLANK_MODE);
 
-        mem.raw[LY] = 144 + (ppu_clock_cycle_counter / 456);
+        CTX(mem).raw[LY] = 144 + (CTX(ppu_clock_cycle_counter) / 456);
 
-        if (ppu_clock_cycle_counter > 4560)
+        if (CTX(ppu_clock_cycle_counter) > 4560)
         {
             vblank();
-            ppu_clock_cycle_counter = 0;
-            mem.raw[LY] = 0;
-            ppu_regs.stat->mode = PPU_OAM_READ_MODE;
+            CTX(ppu_clock_cycle_counter) = 0;
+            CTX(mem).raw[LY] = 0;
+            ppu_set_mode(PPU_OAM_READ_MODE);
             oam_read();
         }
     }
@@ -968,14 +1108,14 @@ __always_inline void ppu_step()
 
 __always_inline int32_t ppu_exec_cycles(int32_t clock_cycles_to_execute)
 {
-    ppu_exec_cycle_counter = 0;
+    CTX(ppu_exec_cycle_counter) = 0;
 
-    if (ppu_regs.lcdc->lcd_ppu_enable)
+    if (CTX(ppu_regs).lcdc->lcd_ppu_enable)
     {
-        while (ppu_exec_cycle_counter < clock_cycles_to_execute)
+        while (CTX(ppu_exec_cycle_counter) < clock_cycles_to_execute)
         {
             ppu_step();
-            ppu_exec_cycle_counter++;
+            CTX(ppu_exec_cycle_counter)++;
         }
     }
 
@@ -986,120 +1126,126 @@ void hi_test()
 {
     // H
 
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
-    next_ppu_viewport[7 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
-
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
-    next_ppu_viewport[7 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
-
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 6] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 7] = 0xFF;
-
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
-    next_ppu_viewport[7 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
-
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
-    next_ppu_viewport[7 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
+    CTX(next_ppu_viewport)[7 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 4] = 0xFF;
+
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
+    CTX(next_ppu_viewport)[7 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 5] = 0xFF;
+
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 6] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 7] = 0xFF;
+
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
+    CTX(next_ppu_viewport)[7 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 8] = 0xFF;
+
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
+    CTX(next_ppu_viewport)[7 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 9] = 0xFF;
 
     // I
 
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
-    next_ppu_viewport[7 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
+    CTX(next_ppu_viewport)[7 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 12] = 0xFF;
 
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
-    next_ppu_viewport[7 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
+    CTX(next_ppu_viewport)[7 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 13] = 0xFF;
 
     // !
 
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 17] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 17] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 17] = 0xFF;
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 17] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 17] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 17] = 0xFF;
 
-    next_ppu_viewport[4 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
-    next_ppu_viewport[5 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
-    next_ppu_viewport[6 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
-    next_ppu_viewport[8 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
+    CTX(next_ppu_viewport)[4 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
+    CTX(next_ppu_viewport)[5 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
+    CTX(next_ppu_viewport)[6 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
+    CTX(next_ppu_viewport)[8 * GB_FRAMEBUFFER_WIDTH + 18] = 0xFF;
 }
 
 __always_inline void adjust_bg_color_palettes(byte index, byte low, byte high)
 {
+    int16_t tmp; // scratch for CACGB_*
+
 #if EMULATED_CGB_DISPLAY_TONE == 2
-    adjusted_bg_color_palettes_r[index] = CACGB_RED(low, high);
-    adjusted_bg_color_palettes_g[index] = CACGB_GREEN(low, high);
-    adjusted_bg_color_palettes_b[index] = CACGB_BLUE(low, high);
+    CTX(adjusted_bg_color_palettes_r)[index] = CACGB_RED(low, high);
+    CTX(adjusted_bg_color_palettes_g)[index] = CACGB_GREEN(low, high);
+    CTX(adjusted_bg_color_palettes_b)[index] = CACGB_BLUE(low, high);
 #elif EMULATED_CGB_DISPLAY_TONE == 1
-    adjusted_bg_color_palettes_r[index] = FCGB_RED(low, high);
-    adjusted_bg_color_palettes_g[index] = FCGB_GREEN(low, high);
-    adjusted_bg_color_palettes_b[index] = FCGB_BLUE(low, high);
+    CTX(adjusted_bg_color_palettes_r)[index] = FCGB_RED(low, high);
+    CTX(adjusted_bg_color_palettes_g)[index] = FCGB_GREEN(low, high);
+    CTX(adjusted_bg_color_palettes_b)[index] = FCGB_BLUE(low, high);
 #else
-    adjusted_bg_color_palettes_r[index] = RGB_RED(low, high);
-    adjusted_bg_color_palettes_g[index] = RGB_GREEN(low, high);
-    adjusted_bg_color_palettes_b[index] = RGB_BLUE(low, high);
+    CTX(adjusted_bg_color_palettes_r)[index] = RGB_RED(low, high);
+    CTX(adjusted_bg_color_palettes_g)[index] = RGB_GREEN(low, high);
+    CTX(adjusted_bg_color_palettes_b)[index] = RGB_BLUE(low, high);
 #endif
 }
 
 __always_inline void adjust_obj_color_palettes(byte index, byte low, byte high)
 {
+    int16_t tmp; // scratch for CACGB_*
+
 #if EMULATED_CGB_DISPLAY_TONE == 2
-    adjusted_obj_color_palettes_r[index] = CACGB_RED(low, high);
-    adjusted_obj_color_palettes_g[index] = CACGB_GREEN(low, high);
-    adjusted_obj_color_palettes_b[index] = CACGB_BLUE(low, high);
+    CTX(adjusted_obj_color_palettes_r)[index] = CACGB_RED(low, high);
+    CTX(adjusted_obj_color_palettes_g)[index] = CACGB_GREEN(low, high);
+    CTX(adjusted_obj_color_palettes_b)[index] = CACGB_BLUE(low, high);
 #elif EMULATED_CGB_DISPLAY_TONE == 1
-    adjusted_obj_color_palettes_r[index] = FCGB_RED(low, high);
-    adjusted_obj_color_palettes_g[index] = FCGB_GREEN(low, high);
-    adjusted_obj_color_palettes_b[index] = FCGB_BLUE(low, high);
+    CTX(adjusted_obj_color_palettes_r)[index] = FCGB_RED(low, high);
+    CTX(adjusted_obj_color_palettes_g)[index] = FCGB_GREEN(low, high);
+    CTX(adjusted_obj_color_palettes_b)[index] = FCGB_BLUE(low, high);
 #else
-    adjusted_obj_color_palettes_r[index] = RGB_RED(low, high);
-    adjusted_obj_color_palettes_g[index] = RGB_GREEN(low, high);
-    adjusted_obj_color_palettes_b[index] = RGB_BLUE(low, high);
+    CTX(adjusted_obj_color_palettes_r)[index] = RGB_RED(low, high);
+    CTX(adjusted_obj_color_palettes_g)[index] = RGB_GREEN(low, high);
+    CTX(adjusted_obj_color_palettes_b)[index] = RGB_BLUE(low, high);
 #endif
 }
 
 void ppu_reset()
 {
-    ppu_alive = 1;
+    CTX(ppu_alive) = 1;
 
     // set up registers by pointing them to the correct locations in memory
-    ppu_regs.lcdc = (union PPU_LCDC *)(mem.raw + LCDC);
-    ppu_regs.stat = (union PPU_STAT *)(mem.raw + STAT);
+    CTX(ppu_regs).lcdc = (union PPU_LCDC *)(CTX(mem).raw + LCDC);
+    CTX(ppu_regs).stat = (union PPU_STAT *)(CTX(mem).raw + STAT);
 
-    ppu_regs.stat->mode = PPU_OAM_READ_MODE;
+    CTX(ppu_regs).stat->mode = PPU_OAM_READ_MODE;
 
     // hi_test();
 }
 
 __always_inline uint16_t ppu_interpret_read(uint16_t offset)
 {
-    if (gb_mode == MODE_CGB)
+    union CGB_COLOR_PALETTE_SPECIFICATION *color_palette_spec;
+
+    if (CTX(gb_mode) == MODE_CGB)
     {
         if (offset == BCPD)
         {
-            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(mem.raw + BCPS);
-            return (0x100 | rgb_bg_color_palettes[color_palette_spec->index]);
+            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(CTX(mem).raw + BCPS);
+            return (0x100 | CTX(rgb_bg_color_palettes)[color_palette_spec->index]);
         }
 
         if (offset == OCPD)
         {
-            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(mem.raw + OCPS);
-            return (0x100 | rgb_obj_color_palettes[color_palette_spec->index]);
+            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(CTX(mem).raw + OCPS);
+            return (0x100 | CTX(rgb_obj_color_palettes)[color_palette_spec->index]);
         }
     }
 
@@ -1108,38 +1254,40 @@ __always_inline uint16_t ppu_interpret_read(uint16_t offset)
 
 __always_inline uint16_t ppu_interpret_write(uint16_t offset, byte data)
 {
+    union CGB_COLOR_PALETTE_SPECIFICATION *color_palette_spec;
+
     if (offset == LY)
         return 0x100; // LY is read-only
 
     if (offset >= OAM && offset <= OAM_END) // we can only write here during hblank and vblank
-        if (ppu_regs.stat->mode == PPU_OAM_READ_MODE || ppu_regs.stat->mode == PPU_VRAM_READ_MODE)
+        if (CTX(ppu_regs).stat->mode == PPU_OAM_READ_MODE || CTX(ppu_regs).stat->mode == PPU_VRAM_READ_MODE)
         {
             DEBUG_PRINT(("ppu blocking mistimed oam write\n"));
             return 0x100;
         }
 
-    if (gb_mode != MODE_CGB)
+    if (CTX(gb_mode) != MODE_CGB)
     {
         if (offset >= BCPD && offset <= OCPD) // we can't write here during vram read mode (3)
-            if (ppu_regs.stat->mode == PPU_VRAM_READ_MODE)
+            if (CTX(ppu_regs).stat->mode == PPU_VRAM_READ_MODE)
             {
                 DEBUG_PRINT(("ppu blocking mistimed palette data write\n"));
                 return 0x100;
             }
     }
 
-    if (gb_mode == MODE_CGB)
+    if (CTX(gb_mode) == MODE_CGB)
     {
         if (offset == BCPD)
         {
-            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(mem.raw + BCPS);
+            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(CTX(mem).raw + BCPS);
 
-            rgb_bg_color_palettes[color_palette_spec->index] = data;
+            CTX(rgb_bg_color_palettes)[color_palette_spec->index] = data;
 
             byte low_index = color_palette_spec->index & 0xFE;
             byte high_index = low_index + 1;
 
-            adjust_bg_color_palettes((low_index / 2), rgb_bg_color_palettes[low_index], rgb_bg_color_palettes[high_index]);
+            adjust_bg_color_palettes((low_index / 2), CTX(rgb_bg_color_palettes)[low_index], CTX(rgb_bg_color_palettes)[high_index]);
 
             if (color_palette_spec->increment)
                 color_palette_spec->index++;
@@ -1149,14 +1297,14 @@ __always_inline uint16_t ppu_interpret_write(uint16_t offset, byte data)
 
         if (offset == OCPD)
         {
-            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(mem.raw + OCPS);
+            color_palette_spec = (union CGB_COLOR_PALETTE_SPECIFICATION *)(CTX(mem).raw + OCPS);
 
-            rgb_obj_color_palettes[color_palette_spec->index] = data;
+            CTX(rgb_obj_color_palettes)[color_palette_spec->index] = data;
 
             byte low_index = color_palette_spec->index & 0xFE;
             byte high_index = low_index + 1;
 
-            adjust_obj_color_palettes((low_index / 2), rgb_obj_color_palettes[low_index], rgb_obj_color_palettes[high_index]);
+            adjust_obj_color_palettes((low_index / 2), CTX(rgb_obj_color_palettes)[low_index], CTX(rgb_obj_color_palettes)[high_index]);
 
             if (color_palette_spec->increment)
                 color_palette_spec->index++;
@@ -8,8 +8,13 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <time.h>
 #include "nsgbe.h"
 
+#ifndef EMSCRIPTEN
+#include <pthread.h>
+#endif
+
 /*---------------------ENV-----------------------*/
 
 #ifdef __DEBUG
@@ -64,20 +69,30 @@ enum GB_MODE {
     MODE_CGB
 };
 
-extern enum GB_MODE gb_mode;
+extern void battery_load(byte *battery_ram, size_t size);
 
-extern uint8_t *rombuffer;
-extern uintptr_t romsize;
+// a rom image shared by reference between instances: a mapped rom file (see nsgbe_load_rom_file()) or a heap copy
+struct ROM_MAPPING;
 
-extern uint8_t *biosbuffer;
-extern uintptr_t biossize;
+extern void rom_retain(struct ROM_MAPPING *mapping);
 
-extern void battery_load(byte **battery_banks, uint16_t bank_count);
+// drops a reference to a rom buffer, freeing or unmapping it along with the last one
+extern void rom_release(uint8_t **buffer, struct ROM_MAPPING **mapping);
 
 /*--------------------CLOCK----------------------*/
 
 #define USEC_PER_SEC 1000000
 
+// host time for pacing and everything measured alongside it (stats, traces, autosave, profiling); monotonic, so
+// adjustments of the wall clock don't disturb any of it
+__always_inline static uint64_t host_nsec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 // #define MACHINE_CLOCK_HZ             1053360 // 60 fps
 #define MACHINE_CLOCK_HZ                1048576 // original DMG
 #define CPU_TICKS_PER_MACHINE_CLOCK     4
@@ -86,6 +101,8 @@ extern void battery_load(byte **battery_banks, uint16_t bank_count);
 #define VRAM_TICKS_PER_MACHINE_CLOCK    2
 #define IO_TICKS_PER_MACHINE_CLOCK      CPU_TICKS_PER_MACHINE_CLOCK     // currently ticking at cpu rate
 
+#define CPU_CLOCK_HZ                    (MACHINE_CLOCK_HZ * CPU_TICKS_PER_MACHINE_CLOCK)
+
 extern void clock_loop();
 
 /*---------------------CPU-----------------------*/
@@ -173,16 +190,12 @@ struct CPU_REGS {
 
 struct CPU_INSTRUCTION;
 
-extern struct CPU_REGS cpu_regs;
-extern _Bool cpu_alive;
-extern _Bool cpu_dma_halt;
-extern byte interrupt_master_enable;
-
 extern void cpu_reset();
 extern void cpu_step();
 extern int32_t cpu_exec_cycles(int32_t clock_cycles_to_execute);
 extern void cpu_break();
 extern void cpu_next_instruction(struct CPU_INSTRUCTION *instr, word *inst_value);
+extern const char *cpu_instruction_description(uint16_t offset);
 extern void handle_interrupts();
 
 extern void fake_dmg_bootrom();
@@ -216,7 +229,7 @@ union MEMORY {
         /* perm   */ byte rom_bank[0x4000];                    // 16kB..0x0000 - 0x3FFF // cartridge mapped
         /* switch */ byte rom_bank_s[0x4000];                  // 16kB..0x4000 - 0x7FFF // switchable for roms > 32kB
         /* perm   */ byte video_ram[0x2000];                   //  8kB..0x8000 - 0x9FFF // VRAM
-        /* switch */ byte cart_ram_bank_s[0x2000];             //  8kB..0xA000 - 0xBFFF // external ram (cartridge/built-in nvram, eg. used for savegames)
+        /* switch */ byte cart_ram_bank_s[0x2000];             //  8kB..0xA000 - 0xBFFF // external ram (cartridge/built-in nvram, eg. used for savegames), redirected to ext_ram_banks
         /* perm   */ byte ram_bank_0[0x1000];                  //  4kB..0xC000 - 0xCFFF // internal ram (W(orking)RAM)
         /* perm   */ byte ram_bank_1[0x1000];                  //  4kB..0xD000 - 0xDFFF // internal ram (W(orking)RAM)
         /* perm   */ byte undefined[0x1E00];                   //  7kB..0xE000 - 0xFDFF // internal ram, mirror of 0xC000 - 0xDDFF (ram_bank_0 & ram_bank_1)
@@ -231,23 +244,12 @@ union MEMORY {
     byte raw[0x10000]; // 64kB
 };
 
-extern union MEMORY mem; // due to endianess & mapping you shouldn't access this directly; instead, use the 4 functions below
-
-/* CGB stuff */
-
-extern byte cgb_extra_vram_bank[0x2000];
-extern byte cgb_extra_wram_banks[8][0x1000];
-
-/* EOF CGB stuff */
-
-extern void init_memory();
+extern int init_memory();
 extern byte mem_read(uint16_t offset);
 extern word mem_read_16(uint16_t offset);
 extern void mem_write(uint16_t offset, byte data);
 extern void mem_write_16(uint16_t offset, word data);
 
-extern _Bool enable_bootrom;
-
 /*-----------------------IO-----------------------*/
 
 // gameboy joypad byte encoding
@@ -289,25 +291,36 @@ union TIMER_CONTROL_IO {
     byte b;
 };
 
+#define SERIAL_OUTPUT_SIZE 0x1000 // most recent bytes sent over the serial port that are kept around
+
 extern int32_t io_exec_cycles(int32_t clock_cycles_to_execute);
 extern uint16_t io_interpret_read(uint16_t offset);
 extern uint16_t io_interpret_write(uint16_t offset, byte data);
 
 /*--------------------EXT_CHIP--------------------*/
 
-extern uint16_t rom_bank_count;
-extern uint16_t ext_ram_bank_count;
-extern byte **rom_banks;
-extern byte **ext_ram_banks;
-extern word active_rom_bank;
-extern word active_ext_ram_bank;
-
-extern _Bool battery_enabled;
-
-extern uint16_t (* active_mbc_writes_interpreter)(uint16_t offset, byte data);
-extern uint16_t (* active_mbc_reads_interpreter)(uint16_t offset);
+union RTC_DH {
+    struct __attribute__((packed)) {
+#ifdef __LITTLE_ENDIAN__
+        _Bool day_high  : 1;
+        byte unused     : 5;
+        _Bool halt      : 1;
+        _Bool day_carry : 1;
+#else
+        _Bool day_carry : 1;
+        _Bool halt      : 1;
+        byte unused     : 5;
+        _Bool day_high  : 1;
+#endif
+    };
+    byte b;
+};
 
 extern int ext_chip_setup();
+extern int ext_ram_setup(uint16_t bank_count);
+extern void ext_ram_release(byte **block, size_t *mapped_size);
+extern void ext_ram_sync();
+extern time_t mbc3_rtc_now();
 extern uint32_t mbc3_setup();
 extern uint32_t mbc5_setup();
 extern uint16_t mbc_interpret_write(uint16_t offset, byte data);
@@ -404,9 +417,6 @@ struct PPU_REGS {
     } *stat;
 };
 
-extern struct PPU_REGS ppu_regs;
-extern _Bool ppu_alive;
-
 extern void ppu_reset();
 extern void ppu_step();
 extern int32_t ppu_exec_cycles(int32_t clock_cycles_to_execute);
@@ -415,6 +425,437 @@ extern void ppu_break();
 extern uint16_t ppu_interpret_read(uint16_t offset);
 extern uint16_t ppu_interpret_write(uint16_t offset, byte data);
 
+/*---------------------STATE---------------------*/
+
+extern int state_load_machine(const uint8_t *buffer, size_t size);
+
+/*--------------------REWIND---------------------*/
+
+struct REWIND_BUFFER;
+
+extern void rewind_on_frame();
+extern void rewind_buffer_free(struct REWIND_BUFFER *buffer);
+
+/*--------------------MOVIE----------------------*/
+
+struct MOVIE;
+
+extern union BUTTON_STATE movie_sync_buttons(union BUTTON_STATE state);
+extern void movie_on_state_loaded();
+extern void movie_free(struct MOVIE *m);
+
+/*-------------------HOTSPOTS--------------------*/
+
+struct HOTSPOTS;
+
+extern void hotspots_record(uint16_t pc, uint32_t clock_cycles, _Bool executed);
+extern void hotspots_free(struct HOTSPOTS *h);
+
+/*---------------------RING----------------------*/
+
+#define RING_ALIGNED __attribute__((aligned(64))) // a cache line, see CTX_CACHE_LINE
+
+// single-producer / single-consumer ring of fixed size slots, from the emulation thread to a writer (see ring.c)
+struct RING {
+    byte *slots;
+    size_t slot_size;
+    uint32_t slot_count;        // power of two
+    uint32_t head RING_ALIGNED; // advanced by the producer only
+    uint32_t tail RING_ALIGNED; // advanced by the consumer only
+    uint64_t dropped;
+    _Bool stopping;
+};
+
+extern _Bool ring_init(struct RING *r, size_t slot_size, uint32_t slot_count);
+extern void ring_free(struct RING *r);
+
+// producer: the slot to fill next, NULL (and counted as dropped) while the ring is full; ring_push() hands it over
+__always_inline static void *ring_slot(struct RING *r)
+{
+    uint32_t head = r->head;
+
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->slot_count)
+    {
+        __atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    return r->slots + (head & (r->slot_count - 1)) * r->slot_size;
+}
+
+__always_inline static void ring_push(struct RING *r)
+{
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+// consumer: passes the slots pushed so far to consume, in order; returns how many there were
+extern uint32_t ring_drain(struct RING *r, void (* consume)(void *slot, void *user), void *user);
+// the consumer thread's loop: calls drain every interval_usec until ring_stop(), then until nothing is left
+extern void ring_drain_until_stopped(struct RING *r, uint32_t (* drain)(void *user), void *user, uint32_t interval_usec);
+extern void ring_stop(struct RING *r);
+extern uint64_t ring_dropped(struct RING *r);
+
+/*--------------------TRACE----------------------*/
+
+struct TRACE;
+
+enum TRACE_EVENT_TYPE {
+    TRACE_FRAME,        // arg: ppu_frame_counter
+    TRACE_PPU_MODE,     // arg: the mode entered
+    TRACE_INTERRUPT,    // arg: vector
+    TRACE_DMA_BEGIN,    // arg: enum TRACE_DMA
+    TRACE_DMA_END,
+    TRACE_ROM_BANK,     // arg: bank
+    TRACE_RAM_BANK,
+    TRACE_SLEEP_BEGIN,
+    TRACE_SLEEP_END
+};
+
+enum TRACE_DMA {
+    TRACE_DMA_OAM,
+    TRACE_DMA_VRAM,
+    TRACE_DMA_VRAM_HBLANK
+};
+
+// only to be called while tracing (trace != NULL); ignored while running ahead
+extern void trace_event(enum TRACE_EVENT_TYPE type, uint32_t arg);
+extern void trace_free(struct TRACE *t);
+
+/*--------------------STATS----------------------*/
+
+extern void stats_on_frame();
+extern void stats_on_frame_dropped();
+extern void stats_on_sleep(uint64_t overshoot_nsec);
+extern void stats_on_present(_Bool new_frame);
+
+/*-------------------AUTOSAVE--------------------*/
+
+struct AUTOSAVE;
+
+// only to be called while autosave != NULL
+extern void autosave_on_frame();
+extern void autosave_free(struct AUTOSAVE *a);
+
+/*-------------------CAPTURE---------------------*/
+
+struct CAPTURE;
+
+// only to be called while capture != NULL, under mtx
+extern void capture_frame(const uint32_t *pixels);
+extern void capture_free(struct CAPTURE *c);
+
+/*------------------FRAME HASH-------------------*/
+
+// only to be called while frame_hash_parts != 0
+extern void frame_hash_on_frame();
+extern void frame_hash_publish();
+
+/*---------------------FORK----------------------*/
+
+// a copy of some memory, shared by forked instances until they write to it (see fork.c)
+struct COW_PAGE;
+
+// only to be called while cow_pages_held != 0
+extern void cow_before_write(uint16_t offset);
+extern void cow_before_render();
+extern void cow_on_frame();
+
+extern void cow_unshare_all(struct nsgbe_ctx *ctx);
+extern void cow_retain_all(struct nsgbe_ctx *ctx);
+extern void cow_release_all(struct nsgbe_ctx *ctx);
+
+/*--------------------PROFILE--------------------*/
+
+#define PROFILE_REPORT_INTERVAL 600 // frames between two summaries on stderr
+#define PROFILE_SAMPLE_INTERVAL 64  // sampled sections only time every this many calls (power of two)
+
+#ifdef NSGBE_PROFILING
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define profile_now() __rdtsc() // converted to nsec at frame boundaries
+#else
+#define profile_now() host_nsec()
+#endif
+
+// the cost of reading the clock itself is left out
+#define profile_elapsed(begin) \
+    ({ \
+        uint64_t profile_delta = profile_now() - (begin); \
+        (profile_delta > CTX(profile_overhead_ticks) ? profile_delta - CTX(profile_overhead_ticks) : 0); \
+    })
+
+// time the code in between against the given NSGBE_PROFILE_SECTION
+#define PROFILE_BEGIN(section) uint64_t profile_begin_##section = profile_now()
+#define PROFILE_END(section) \
+    do { \
+        CTX(profile_ticks)[section] += profile_elapsed(profile_begin_##section); \
+        CTX(profile_calls)[section]++; \
+    } while (0)
+
+// same, for sections entered millions of times per second: reading the clock would cost more than the section itself,
+// so only every PROFILE_SAMPLE_INTERVAL-th call is timed and taken as representative for the ones in between
+#define PROFILE_BEGIN_SAMPLED(section) \
+    _Bool profile_sampled_##section = ((CTX(profile_calls)[section] & (PROFILE_SAMPLE_INTERVAL - 1)) == 0); \
+    uint64_t profile_begin_##section = (profile_sampled_##section ? profile_now() : 0)
+#define PROFILE_END_SAMPLED(section) \
+    do { \
+        if (profile_sampled_##section) \
+            CTX(profile_ticks)[section] += profile_elapsed(profile_begin_##section) * PROFILE_SAMPLE_INTERVAL; \
+        CTX(profile_calls)[section]++; \
+    } while (0)
+#else
+#define PROFILE_BEGIN(section)
+#define PROFILE_END(section)
+#define PROFILE_BEGIN_SAMPLED(section)
+#define PROFILE_END_SAMPLED(section)
+#endif
+
+#ifdef NSGBE_PROFILING
+extern void profile_on_frame();
+#endif
+
+/*--------------------CONTEXT--------------------*/
+
+#define CTX_CACHE_LINE 64
+#define CTX_ALIGNED __attribute__((aligned(CTX_CACHE_LINE)))
+
+#define ROM_BANKS_MAX 0x200 // mbc5's 8 MiB
+#define EXT_RAM_BANKS_MAX 0x10
+
+// all state of one emulated machine
+// (the core reaches the fields of the bound instance, nsgbe_ctx_current, through CTX())
+// the context is the one allocation an instance's mutable state lives in (see nsgbe_ctx_create_flags()). the fields
+// touched on every step come first, packed into as few cache lines as possible, followed by the bulk memories and
+// buffers, each starting on a cache line of its own, and the host-side tooling at the end. a copy of the whole context
+// is a working machine once the few pointers into itself have been rebased (see nsgbe_ctx_clone() and
+// nsgbe_ctx_fork())
+struct nsgbe_ctx {
+    /* system */
+    uint8_t *rombuffer;
+    uintptr_t romsize;
+    struct ROM_MAPPING *rom_mapping; // the shared rom image rombuffer belongs to
+    uint8_t *biosbuffer;
+    uintptr_t biossize;
+    struct ROM_HEADER *rom_header;
+    enum GB_MODE gb_mode;
+    uint8_t *pending_battery_buffer; // handed over by nsgbe_load_battery(), consumed by battery_load()
+    long pending_battery_size;
+    uint32_t arena_flags; // NSGBE_CTX_* the context was allocated with
+
+    /* cpu */
+    struct CPU_REGS cpu_regs;
+    _Bool cpu_alive;
+    _Bool cpu_int_halt;
+    _Bool cpu_dma_halt;
+    byte interrupt_master_enable; // 0: disabled, 1: enabled, >1: disabled but transitioning to enabled
+    int32_t clock_cycle_counter;
+    uint32_t global_cycle_counter;
+    uint64_t instruction_counter; // instructions executed since the context was created (statistics only, not part of states)
+
+    /* clock */
+    float system_speed;             // multiplier applied to the base machine clock frequency; NSGBE_SPEED_UNCAPPED disables pacing
+    float system_achieved_speed;    // emulated time / real time, as measured over the last sample window
+    _Bool system_running;           // indicates whether the system (clock) is running
+    _Bool system_stopping;          // system_run_event_loop() is to return
+    int32_t cpu_clock_cycles_behind; // negative means the cpu is in the future by given number of clock cycles
+    int32_t ppu_clock_cycles_behind; // negative means the ppu is in the future by given number of clock cycles
+    uint32_t speed_sample_clock_ticks;
+    uint32_t speed_sample_clock_ticks_checked;
+    uint64_t speed_sample_time_start;
+    uint64_t time_pre;
+    uint32_t runahead_frames;       // how many frames ahead of the emulated machine to present (0 = off)
+    uint32_t runahead_last_frame;
+    byte *runahead_state;           // the machine as it was before running ahead, then the cart ram used meanwhile
+    size_t runahead_state_size;     // of the whole block
+    _Bool running_ahead;            // set while emulating frames that are going to be rolled back
+
+    /* io */
+    union BUTTON_STATE button_states; // modified by frontend
+    union BUTTON_STATE unencoded_button_state; // local copy of button_states
+    byte dma_byte;
+    uint16_t oam_dma_timer;
+    uint16_t divider_counter;
+    uint32_t timer_counter;
+    uint16_t vram_dma_timer;
+    uint16_t vram_dma_length;
+    _Bool active_dma_is_hblank;
+    byte vram_dma_hblank_timer;
+    _Bool did_transfer_during_current_hblank;
+    uint16_t cgb_dma_source;
+    uint16_t cgb_dma_destination;
+    uint64_t emulated_cycles; // cpu clock cycles emulated since reset, the time base for movies
+
+    /* ext_chip */
+    uint16_t rom_bank_count;
+    uint16_t ext_ram_bank_count;
+    byte *ext_ram; // all ext ram banks back to back, in ext_ram_arena or mapping the battery file
+    size_t ext_ram_mapped_size; // non-zero while ext_ram is a shared mapping of the battery file
+    _Bool ext_ram_dirty; // raised by writes to cart ram, cleared by the autosave
+    char *battery_path; // set by nsgbe_battery_file()
+    word active_rom_bank; // most games only have up to 256 rom banks, still there are some with more, hence using word
+    word active_ext_ram_bank;
+    _Bool ext_ram_enabled;
+    _Bool battery_enabled;
+    uint16_t (* active_mbc_writes_interpreter)(uint16_t offset, byte data);
+    uint16_t (* active_mbc_reads_interpreter)(uint16_t offset);
+
+    /* mbc3 */
+    union RTC_DH rtc_dh;
+    _Bool rtc_reg_selected;
+    uint8_t selected_rtc_reg;
+    _Bool latching;
+    time_t initial_tv_seconds;
+    time_t time_elapsed;
+    _Bool rtc_emulated_time; // derive the rtc from emulated_cycles instead of the host clock (for movies)
+
+    /* display/ppu */
+#ifndef EMSCRIPTEN
+    pthread_mutex_t mtx;
+#endif
+    struct PPU_REGS ppu_regs;
+    _Bool ppu_alive;
+    uint32_t ppu_clock_cycle_counter;
+    int32_t ppu_exec_cycle_counter;
+    uint32_t ppu_frame_counter; // number of completed frames, lets the headless api find frame boundaries
+    uint32_t *active_display_viewport;
+    uint32_t *next_display_viewport;
+    uint32_t *next_ppu_viewport;
+    _Bool new_frame_available;
+    _Bool render_suppressed; // frames are emulated, but neither drawn nor presented (used by run-ahead)
+    void (* display_notify_vblank)();
+    uint8_t window_internal_line_counter;
+    byte rgb_bg_color_palettes[0x40];
+    byte rgb_obj_color_palettes[0x40];
+    byte adjusted_bg_color_palettes_r[0x20];
+    byte adjusted_bg_color_palettes_g[0x20];
+    byte adjusted_bg_color_palettes_b[0x20];
+    byte adjusted_obj_color_palettes_r[0x20];
+    byte adjusted_obj_color_palettes_g[0x20];
+    byte adjusted_obj_color_palettes_b[0x20];
+    byte observation_format; // NSGBE_OBSERVATION_*, see nsgbe_observation_configure()
+    uint8_t observation_x;
+    uint8_t observation_y;
+    uint8_t observation_width;  // multiple of observation_stride
+    uint8_t observation_height; // multiple of observation_stride
+    uint8_t observation_stride;
+    _Bool observation_average;
+
+    /* fork */
+    uint32_t cow_pages_held; // how many of the pages below are set; writes only look closer while it's non-zero
+    struct COW_PAGE *ext_ram_pages[EXT_RAM_BANKS_MAX];
+    struct COW_PAGE *wram_pages[8];
+    struct COW_PAGE *view_ports_page;
+
+    // bulk state
+
+    /* memory */
+    union MEMORY mem CTX_ALIGNED; // due to endianess & mapping you shouldn't access this directly; instead, use mem_read / mem_write
+    byte cgb_extra_vram_bank[0x2000];
+    byte *wram_banks[8]; // [0x1000], pointing into cgb_extra_wram_banks or a shared page
+    _Bool enable_bootrom;
+
+    /* ext_chip (banks) */
+    byte *rom_banks[ROM_BANKS_MAX]; // [0x4000], pointing into rombuffer
+    byte *ext_ram_banks[EXT_RAM_BANKS_MAX]; // [0x2000], pointing into ext_ram or a shared page
+
+    /* display/ppu (buffers) */
+    byte bg_color_indices[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT] CTX_ALIGNED; // which palette index a pixel had for transparency / blending
+    byte line_palette_indices[GB_FRAMEBUFFER_WIDTH]; // which palette (and color) each pixel of the line being drawn ended up with
+    uint16_t observation_sums[GB_FRAMEBUFFER_WIDTH]; // luma per observation pixel, summed over the lines of its block so far
+    byte observation_buffer[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT] CTX_ALIGNED; // host-facing, not part of states
+
+    /* io (serial) */
+    byte serial_output[SERIAL_OUTPUT_SIZE] CTX_ALIGNED; // bytes sent over the serial port (host-facing, not part of states)
+    uint32_t serial_output_length;
+
+    // memories nsgbe_ctx_fork() leaves shared between instances until they get written to; while they are, the
+    // pointers above lead to the shared copies instead (see fork.c)
+
+    /* memory (wram banks) */
+    byte cgb_extra_wram_banks[8][0x1000] CTX_ALIGNED;
+
+    /* ext_chip (ram) */
+    byte ext_ram_arena[EXT_RAM_BANKS_MAX * 0x2000] CTX_ALIGNED; // ext_ram, unless it maps the battery file
+
+    /* display/ppu (frame buffers) */
+    uint32_t view_port_1[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT] CTX_ALIGNED;
+    uint32_t view_port_2[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT];
+    uint32_t view_port_3[GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT];
+
+    // host-side tooling, not carried over by nsgbe_ctx_clone(); it starts on a cache line of its own, so the
+    // counters other threads write to never share one with the machine state
+
+    /* rewind */
+    struct REWIND_BUFFER *rewind_buffer CTX_ALIGNED; // NULL unless rewind is enabled
+    _Bool rewinding; // modified by frontend
+
+    /* movie */
+    struct MOVIE *movie; // NULL unless recording or playing back
+
+    /* hotspots */
+    struct HOTSPOTS *hotspots; // NULL unless guest code profiling is enabled
+
+    /* trace */
+    struct TRACE *trace; // NULL unless tracing
+
+    /* stats */
+    uint32_t stats_sequence CTX_ALIGNED;    // odd while the emulation thread updates stats_published
+    struct NSGBE_STATS stats_published;     // everything but the presentation counters below
+    uint64_t stats_frames_presented;        // updated atomically by the thread fetching frames
+    uint64_t stats_frames_duplicated;
+    uint64_t stats_last_frame_nsec;
+    uint64_t stats_window_start_nsec;
+    uint64_t stats_window_frames;
+    uint64_t stats_window_presented;
+    uint64_t stats_window_instructions;
+    float stats_window_frame_usec_sum;
+    float stats_window_frame_usec_max;
+
+    /* autosave */
+    struct AUTOSAVE *autosave; // NULL unless enabled
+
+    /* capture */
+    struct CAPTURE *capture; // NULL unless capturing
+
+    /* frame hash */
+    uint32_t frame_hash_parts; // NSGBE_HASH_*, 0 unless enabled
+    void (* frame_hash_callback)(const struct NSGBE_FRAME_HASH *hash, void *user);
+    void *frame_hash_user;
+    struct NSGBE_FRAME_HASH frame_hash_last;
+    _Bool frame_hash_valid; // frame_hash_last is set
+
+#ifdef NSGBE_PROFILING
+    /* profile */
+    uint64_t profile_ticks[NSGBE_PROFILE_SECTIONS]; // current frame, in profile_now() units
+    uint64_t profile_calls[NSGBE_PROFILE_SECTIONS];
+    uint64_t profile_frame_start_nsec;
+    uint64_t profile_calibration_ticks; // first frame boundary, profile_now() units are converted by comparing against it
+    uint64_t profile_calibration_nsec;
+    uint64_t profile_overhead_ticks; // what timing an empty section measures
+    struct NSGBE_PROFILE profile_last_frame;
+    struct NSGBE_PROFILE profile_totals;
+    struct NSGBE_PROFILE profile_report; // frames since the last summary
+    uint32_t profile_report_interval;
+#endif
+};
+
+#ifdef EMSCRIPTEN
+#define NSGBE_TLS __thread
+#else
+#define NSGBE_TLS __thread __attribute__((tls_model("initial-exec")))
+#endif
+
+// the instance the calling thread is currently working on (see nsgbe_ctx_bind)
+extern NSGBE_TLS struct nsgbe_ctx *nsgbe_ctx_current;
+
+extern void ctx_init(struct nsgbe_ctx *ctx);
+extern struct nsgbe_ctx *ctx_alloc(uint32_t flags);
+extern void ctx_rebase(struct nsgbe_ctx *ctx, const struct nsgbe_ctx *from);
+extern void ctx_detach(struct nsgbe_ctx *ctx, const struct nsgbe_ctx *from);
+
+// a field of the instance the calling thread is working on, e.g. CTX(mem).raw[LY]
+#define CTX(field) (nsgbe_ctx_current->field)
+
 /*---------------------NOTES----------------------*/
 
 /*
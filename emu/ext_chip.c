@@ -5,20 +5,11 @@
 // mbc and other peripherals
 
 #include "env.h"
-
-byte **rom_banks = NULL /*[0x4000]*/;
-byte **ext_ram_banks = NULL /*[0x2000]*/;
-word active_rom_bank = word(0x0001);
-word active_ext_ram_bank = word(0x0000); // most games only have up to 256 rom banks, still there are some with more, hence using word
-
-uint16_t rom_bank_count = 2;
-uint16_t ext_ram_bank_count = 0;
-
-_Bool ext_ram_enabled = 1;
-_Bool battery_enabled = 0;
-
-uint16_t (* active_mbc_writes_interpreter)(uint16_t offset, byte data) = NULL;
-uint16_t (* active_mbc_reads_interpreter)(uint16_t offset) = NULL;
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 uint16_t generic_mbc_interpret_write(uint16_t offset, byte data);
 uint16_t generic_mbc_interpret_read(uint16_t offset);
@@ -27,47 +18,130 @@ static void init_random_ram() // todo: better; currently not in use
 {
     for (uint16_t i = 0; i < 0x1000; i++)
     {
-        mem.map.ram_bank_0[i] = (i + 1) & 0xFF;
-        mem.map.ram_bank_0[i] = (i - 1) & 0xFF;
+        CTX(mem).map.ram_bank_0[i] = (i + 1) & 0xFF;
+        CTX(mem).map.ram_bank_0[i] = (i - 1) & 0xFF;
     }
 
     for (uint16_t i = 0; i < 0x2000; i++)
     {
-        mem.map.cart_ram_bank_s[i] = (i + 1) & 0xFF;
-        mem.map.video_ram[i] = (i - 1) & 0xFF;
+        CTX(mem).map.cart_ram_bank_s[i] = (i + 1) & 0xFF;
+        CTX(mem).map.video_ram[i] = (i - 1) & 0xFF;
     }
 
     for (uint16_t i = 0; i < 0x80; i++)
-        mem.map.high_ram[i] = (i + 1) & 0xFF;
+        CTX(mem).map.high_ram[i] = (i + 1) & 0xFF;
 }
 
-uint32_t no_mbc_setup()
+// external ram is one block of ext_ram_bank_count banks of 0x2000 bytes, back to back. for battery backed cartridges
+// with a battery file (see nsgbe_battery_file()), the block is a shared mapping of that file: writes to cart ram go
+// straight to the page cache, the kernel writes dirty pages back on its own and nothing is lost if the process dies.
+// otherwise, it's ext_ram_arena inside the context, filled and saved through the load_battery / save_battery callbacks
+
+static _Bool ext_ram_map(size_t size)
+{
+    int fd = open(CTX(battery_path), O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+
+    // grow (never shrink) the file to the size of the ram; new space reads as 0s
+    if (fstat(fd, &st) != 0 || (st.st_size < size && ftruncate(fd, size) != 0))
+    {
+        close(fd);
+        return 0;
+    }
+
+    void *block = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (block == MAP_FAILED)
+        return 0;
+
+    CTX(ext_ram) = block;
+    CTX(ext_ram_mapped_size) = size;
+
+    return 1;
+}
+
+void ext_ram_release(byte **block, size_t *mapped_size)
+{
+    if (*mapped_size)
+        munmap(*block, *mapped_size);
+
+    *block = NULL;
+    *mapped_size = 0;
+}
+
+int ext_ram_setup(uint16_t bank_count)
+{
+    size_t size = (size_t)bank_count * 0x2000;
+
+    ext_ram_release(&CTX(ext_ram), &CTX(ext_ram_mapped_size));
+    memset(CTX(ext_ram_banks), 0, sizeof(CTX(ext_ram_banks)));
+
+    CTX(ext_ram_bank_count) = 0;
+
+    if (bank_count > EXT_RAM_BANKS_MAX)
+        return NSGBE_ERR;
+
+    if (!CTX(battery_enabled) || !CTX(battery_path) || !ext_ram_map(size))
+    {
+        if (CTX(battery_enabled) && CTX(battery_path))
+            printf("Failed to map battery file: %s\n", CTX(battery_path));
+
+        CTX(ext_ram) = CTX(ext_ram_arena);
+        memset(CTX(ext_ram), 0, size);
+
+        if (CTX(battery_enabled))
+            battery_load(CTX(ext_ram), size);
+    }
+
+    for (uint16_t i = 0; i < bank_count; i++)
+        CTX(ext_ram_banks)[i] = CTX(ext_ram) + (i * 0x2000);
+
+    CTX(ext_ram_bank_count) = bank_count;
+
+    return NSGBE_OK;
+}
+
+// forces the battery file mapping out to disk
+void ext_ram_sync()
 {
-    for (uint16_t i = 1; i < ext_ram_bank_count; i++)
-        free_ptr((void **)&ext_ram_banks[i]);
+    if (CTX(ext_ram_mapped_size))
+        msync(CTX(ext_ram), CTX(ext_ram_mapped_size), MS_SYNC);
+}
 
-    free_ptr((void **)&ext_ram_banks);
+const uint8_t *nsgbe_cart_ram_bank(uint16_t bank)
+{
+    if (bank >= CTX(ext_ram_bank_count))
+        return NULL;
 
-    ext_ram_bank_count = 1;
-    ext_ram_banks = malloc((size_t)(ext_ram_bank_count * sizeof(byte *)));
-    ext_ram_banks[0] = mem.map.cart_ram_bank_s;
+    return CTX(ext_ram_banks)[bank];
+}
+
+uint32_t no_mbc_setup()
+{
+    ext_ram_setup(1);
 
     return 0;
 }
 
 int ext_chip_setup()
 {
-    free_ptr((void **)&rom_banks);
+    CTX(active_mbc_writes_interpreter) = &generic_mbc_interpret_write;
+    CTX(active_mbc_reads_interpreter) = &generic_mbc_interpret_read;
 
-    active_mbc_writes_interpreter = &generic_mbc_interpret_write;
-    active_mbc_reads_interpreter = &generic_mbc_interpret_read;
+    CTX(battery_enabled) = 0;
 
-    switch (rom_header->ram_size)
+    switch (CTX(rom_header)->ram_size)
     {
 
     }
 
-    switch (rom_header->cartridge_type)
+    switch (CTX(rom_header)->cartridge_type)
     {
         case 0x00:
             // no mbc
@@ -120,7 +194,7 @@ int ext_chip_setup()
 
         case 0x10:
             // mbc3 + ram + timer + battery
-            battery_enabled = 1;
+            CTX(battery_enabled) = 1;
             mbc3_setup();
             break;
 
@@ -134,7 +208,7 @@ int ext_chip_setup()
 
         case 0x13:
             // mbc3 + ram + battery
-            battery_enabled = 1;
+            CTX(battery_enabled) = 1;
             mbc3_setup();
             break;
 
@@ -148,7 +222,7 @@ int ext_chip_setup()
 
         case 0x1B:
             // mbc5 + ram + battery
-            battery_enabled = 1;
+            CTX(battery_enabled) = 1;
             mbc5_setup();
             break;
 
@@ -190,33 +264,57 @@ int ext_chip_setup()
 
         default:
             printf("Unsupported cartridge type!\n\n");
-            exit(EXIT_FAILURE);
+            return NSGBE_ERR;
             break;
 
     }
 
-    rom_bank_count = romsize / 0x4000;
+    if (!CTX(ext_ram))
+    {
+        printf("Failed to set up external ram.\n\n");
+        return NSGBE_ERR;
+    }
 
-    rom_banks = malloc((size_t)(rom_bank_count * sizeof(byte *)));
+    CTX(rom_bank_count) = CTX(romsize) / 0x4000;
 
-    for (uint16_t i = 0; i < rom_bank_count; i++)
+    if (CTX(rom_bank_count) > ROM_BANKS_MAX)
     {
-        rom_banks[i] = (byte *)(rombuffer + (i * 0x4000));
+        printf("Unsupported rom size!\n\n");
+        return NSGBE_ERR;
+    }
+
+    memset(CTX(rom_banks), 0, sizeof(CTX(rom_banks)));
+
+    for (uint16_t i = 0; i < CTX(rom_bank_count); i++)
+    {
+        CTX(rom_banks)[i] = (byte *)(CTX(rombuffer) + (i * 0x4000));
     }
 
     //init_random_ram();
 
-    return 0;
+    return NSGBE_OK;
 }
 
 uint16_t mbc_interpret_write(uint16_t offset, byte data)
 {
-    return active_mbc_writes_interpreter(offset, data);
+    if (!CTX(trace))
+        return CTX(active_mbc_writes_interpreter)(offset, data);
+
+    word rom_bank = CTX(active_rom_bank), ext_ram_bank = CTX(active_ext_ram_bank);
+    uint16_t response = CTX(active_mbc_writes_interpreter)(offset, data);
+
+    if (CTX(active_rom_bank).w != rom_bank.w)
+        trace_event(TRACE_ROM_BANK, CTX(active_rom_bank).w);
+
+    if (CTX(active_ext_ram_bank).w != ext_ram_bank.w)
+        trace_event(TRACE_RAM_BANK, CTX(active_ext_ram_bank).w);
+
+    return response;
 }
 
 uint16_t mbc_interpret_read(uint16_t offset)
 {
-    return active_mbc_reads_interpreter(offset);
+    return CTX(active_mbc_reads_interpreter)(offset);
 }
 
 __always_inline uint16_t generic_mbc_interpret_write(uint16_t offset, byte data)
@@ -235,13 +333,13 @@ __always_inline uint16_t generic_mbc_interpret_write(uint16_t offset, byte data)
     {
         // switch ROM bank
 
-        if (data >= rom_bank_count)
+        if (data >= CTX(rom_bank_count))
         {
-            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", active_rom_bank.w, rom_bank_count);
+            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", CTX(active_rom_bank).w, CTX(rom_bank_count));
             cpu_break();
         }
 
-        active_rom_bank = word(data);
+        CTX(active_rom_bank) = word(data);
 
         return 0x100;
     }
@@ -251,7 +349,7 @@ __always_inline uint16_t generic_mbc_interpret_write(uint16_t offset, byte data)
 
 __always_inline uint16_t generic_mbc_interpret_read(uint16_t offset)
 {
-    if (offset >= 0xA000 && offset <= 0xBFFF && !ext_ram_enabled)
+    if (offset >= 0xA000 && offset <= 0xBFFF && !CTX(ext_ram_enabled))
         return 0x1FF; // external ram is disabled
 
     return 0;
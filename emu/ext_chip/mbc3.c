@@ -5,44 +5,28 @@
 // mbc3 (duh)
 
 #include "../env.h"
-#include <string.h>
 #include <sys/time.h>
 
-union RTC_DH {
-    struct __attribute__((packed)) {
-#ifdef __LITTLE_ENDIAN__
-        _Bool day_high  : 1;
-        byte unused     : 5;
-        _Bool halt      : 1;
-        _Bool day_carry : 1;
-#else
-        _Bool day_carry : 1;
-        _Bool halt      : 1;
-        byte unused     : 5;
-        _Bool day_high  : 1;
-#endif
-    };
-    byte b;
-} rtc_dh;
-
-extern _Bool ext_ram_enabled;
-
-_Bool rtc_reg_selected = 0;
-uint8_t selected_rtc_reg = 0x8;
-_Bool latching = 0;
-
-struct timeval tv;
-time_t initial_tv_seconds;
-time_t time_elapsed;
+// seconds on the clock the rtc counts from; emulated time keeps it independent of the host for movies
+time_t mbc3_rtc_now()
+{
+    if (CTX(rtc_emulated_time))
+        return (time_t)(CTX(emulated_cycles) / CPU_CLOCK_HZ);
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec;
+}
 
 uint16_t mbc3_interpret_write(uint16_t offset, byte data)
 {
     if (offset <= 0x1FFF)
     {
         if (data == 0xA0)
-            ext_ram_enabled = 1;
+            CTX(ext_ram_enabled) = 1;
         else if (data == 0x00)
-            ext_ram_enabled = 0;
+            CTX(ext_ram_enabled) = 0;
 
         return 0x100;
     }
@@ -54,11 +38,11 @@ uint16_t mbc3_interpret_write(uint16_t offset, byte data)
 
         data &= 0x7F;
 
-        active_rom_bank.w = data;
+        CTX(active_rom_bank).w = data;
 
-        if (active_rom_bank.w >= rom_bank_count)
+        if (CTX(active_rom_bank).w >= CTX(rom_bank_count))
         {
-            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", active_rom_bank.w, rom_bank_count);
+            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", CTX(active_rom_bank).w, CTX(rom_bank_count));
             cpu_break();
         }
 
@@ -72,29 +56,29 @@ uint16_t mbc3_interpret_write(uint16_t offset, byte data)
 
         if (data <= 3)
         {
-            rtc_reg_selected = 0;
-            active_ext_ram_bank.w = data;
+            CTX(rtc_reg_selected) = 0;
+            CTX(active_ext_ram_bank).w = data;
         }
         else
         {
-            rtc_reg_selected = 1;
-            selected_rtc_reg = data;
+            CTX(rtc_reg_selected) = 1;
+            CTX(selected_rtc_reg) = data;
         }
 
         return 0x100;
     }
 
-    if (offset >= 0x6000 && offset <= 0x7FFF && rtc_reg_selected)
+    if (offset >= 0x6000 && offset <= 0x7FFF && CTX(rtc_reg_selected))
     {
-        if (data == 0 && !latching)
-            latching = 1;
+        if (data == 0 && !CTX(latching))
+            CTX(latching) = 1;
 
-        if (data == 1 && latching)
+        if (data == 1 && CTX(latching))
         {
-            latching = 0;
-            gettimeofday(&tv, NULL);
-            time_elapsed = tv.tv_sec - initial_tv_seconds;
-            rtc_dh.day_high = (((time_elapsed / 3600) / 24) > 0xFF ? 1 : 0);
+            CTX(latching) = 0;
+
+            CTX(time_elapsed) = mbc3_rtc_now() - CTX(initial_tv_seconds);
+            CTX(rtc_dh).day_high = (((CTX(time_elapsed) / 3600) / 24) > 0xFF ? 1 : 0);
         }
 
         return 0x100;
@@ -103,10 +87,10 @@ uint16_t mbc3_interpret_write(uint16_t offset, byte data)
     // if (offset >= 0xA000 && offset <= 0xBFFF && !ext_ram_enabled)
         // return 0x100;
 
-    if (offset >= 0xA000 && offset <= 0xBFFF && rtc_reg_selected)
+    if (offset >= 0xA000 && offset <= 0xBFFF && CTX(rtc_reg_selected))
     {
-        if (selected_rtc_reg == 0xC)
-            rtc_dh.b = data;
+        if (CTX(selected_rtc_reg) == 0xC)
+            CTX(rtc_dh).b = data;
 
         return 0x100;
     }
@@ -119,28 +103,28 @@ uint16_t mbc3_interpret_read(uint16_t offset)
     //if (offset >= 0xA000 && offset <= 0xBFFF && !ext_ram_enabled)
         //return 0x1FF;
 
-    if (offset >= 0xA000 && offset <= 0xBFFF && rtc_reg_selected)
+    if (offset >= 0xA000 && offset <= 0xBFFF && CTX(rtc_reg_selected))
     {
-        switch (selected_rtc_reg)
+        switch (CTX(selected_rtc_reg))
         {
             case 0x8: // seconds
-                return 0x100 | (time_elapsed % 60);
+                return 0x100 | (CTX(time_elapsed) % 60);
                 break;
 
             case 0x9: // minutes
-                return 0x100 | ((time_elapsed / 60) % 60);
+                return 0x100 | ((CTX(time_elapsed) / 60) % 60);
                 break;
 
             case 0xA: // hours
-                return 0x100 | ((time_elapsed / 3600) % 24);
+                return 0x100 | ((CTX(time_elapsed) / 3600) % 24);
                 break;
 
             case 0xB: // days (low)
-                return 0x100 | ((time_elapsed / 86400) & 0xFF);
+                return 0x100 | ((CTX(time_elapsed) / 86400) & 0xFF);
                 break;
 
             case 0xC: // days (high), carry bit, halt flag
-                return 0x100 | rtc_dh.b;
+                return 0x100 | CTX(rtc_dh).b;
                 break;
 
             default:
@@ -156,33 +140,17 @@ uint32_t mbc3_setup()
 {
     printf("[Info] Using MBC3.\n");
 
-    for (uint16_t i = 1; i < ext_ram_bank_count; i++)
-        free_ptr((void **)&ext_ram_banks[i]);
-
-    free_ptr((void **)&ext_ram_banks);
+    CTX(active_mbc_writes_interpreter) = &mbc3_interpret_write;
+    CTX(active_mbc_reads_interpreter) = &mbc3_interpret_read;
 
-    active_mbc_writes_interpreter = &mbc3_interpret_write;
-    active_mbc_reads_interpreter = &mbc3_interpret_read;
+    // loads the battery, too
+    ext_ram_setup(4);
 
-    ext_ram_bank_count = 4;
-    ext_ram_banks = malloc((size_t)(ext_ram_bank_count * sizeof(byte *)));
-    ext_ram_banks[0] = mem.map.cart_ram_bank_s;
+    CTX(ext_ram_enabled) = 1;
+    CTX(active_ext_ram_bank).w = 0;
 
-    for (uint16_t i = 1; i < ext_ram_bank_count; i++)
-    {
-        ext_ram_banks[i] = malloc(0x2000);
-        memset(ext_ram_banks[i], 0x00, 0x2000);
-    }
-
-    ext_ram_enabled = 1;
-    active_ext_ram_bank.w = 0;
-
-    if (battery_enabled)
-        battery_load(ext_ram_banks, ext_ram_bank_count);
-
-    gettimeofday(&tv, NULL);
-    initial_tv_seconds = tv.tv_sec; // todo: load this from save file instead of setting it to the current time
-    time_elapsed = 0;
+    CTX(initial_tv_seconds) = mbc3_rtc_now(); // todo: load this from save file instead of setting it to the current time
+    CTX(time_elapsed) = 0;
 
     return 0;
 }
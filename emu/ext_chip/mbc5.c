@@ -5,18 +5,15 @@
 // mbc5 (duh)
 
 #include "../env.h"
-#include <string.h>
-
-extern _Bool ext_ram_enabled;
 
 uint16_t mbc5_interpret_write(uint16_t offset, byte data)
 {
     if (offset >= 0x0000 && offset <= 0x1FFF)
     {
         if ((data & 0x0F) == 0x0A) // RAM enable
-            ext_ram_enabled = 1;
+            CTX(ext_ram_enabled) = 1;
         else if (data == 0x00) // RAM disable
-            ext_ram_enabled = 0;
+            CTX(ext_ram_enabled) = 0;
 
         return 0x100;
     }
@@ -25,11 +22,11 @@ uint16_t mbc5_interpret_write(uint16_t offset, byte data)
     {
         // switch ROM bank (least significant 8 bit)
 
-        active_rom_bank.w = (active_rom_bank.w & 0xFF00) + data;
+        CTX(active_rom_bank).w = (CTX(active_rom_bank).w & 0xFF00) + data;
 
-        if (active_rom_bank.w >= rom_bank_count)
+        if (CTX(active_rom_bank).w >= CTX(rom_bank_count))
         {
-            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", active_rom_bank.w, rom_bank_count);
+            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", CTX(active_rom_bank).w, CTX(rom_bank_count));
             cpu_break();
         }
 
@@ -40,11 +37,11 @@ uint16_t mbc5_interpret_write(uint16_t offset, byte data)
     {
         // switch ROM bank (9th bit)
 
-        active_rom_bank.w = ((active_rom_bank.w & 0x00FF) + ((data & 1) << 8));
+        CTX(active_rom_bank).w = ((CTX(active_rom_bank).w & 0x00FF) + ((data & 1) << 8));
 
-        if (active_rom_bank.w >= rom_bank_count)
+        if (CTX(active_rom_bank).w >= CTX(rom_bank_count))
         {
-            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", active_rom_bank.w, rom_bank_count);
+            printf("error: selected rombank (0x%04X) oob (have 0x%04X)\n", CTX(active_rom_bank).w, CTX(rom_bank_count));
             cpu_break();
         }
 
@@ -56,7 +53,7 @@ uint16_t mbc5_interpret_write(uint16_t offset, byte data)
         // switch ext RAM bank
         data &= 0xF;
 
-        active_ext_ram_bank.w = data;
+        CTX(active_ext_ram_bank).w = data;
 
         return 0x100;
     }
@@ -76,29 +73,14 @@ uint32_t mbc5_setup()
 {
     printf("[Info] Using MBC5.\n");
 
-    for (uint16_t i = 1; i < ext_ram_bank_count; i++)
-        free_ptr((void **)&ext_ram_banks[i]);
-
-    free_ptr((void **)&ext_ram_banks);
-
-    active_mbc_writes_interpreter = &mbc5_interpret_write;
-    active_mbc_reads_interpreter = &mbc5_interpret_read;
-
-    ext_ram_bank_count = 0x10;
-    ext_ram_banks = malloc((size_t)(ext_ram_bank_count * sizeof(byte *)));
-    ext_ram_banks[0] = mem.map.cart_ram_bank_s;
-
-    for (uint16_t i = 1; i < ext_ram_bank_count; i++)
-    {
-        ext_ram_banks[i] = malloc(0x2000);
-        memset(ext_ram_banks[i], 0x00, 0x2000);
-    }
+    CTX(active_mbc_writes_interpreter) = &mbc5_interpret_write;
+    CTX(active_mbc_reads_interpreter) = &mbc5_interpret_read;
 
-    ext_ram_enabled = 1;
-    active_ext_ram_bank.w = 0;
+    // loads the battery, too
+    ext_ram_setup(0x10);
 
-    if (battery_enabled)
-        battery_load(ext_ram_banks, ext_ram_bank_count);
+    CTX(ext_ram_enabled) = 1;
+    CTX(active_ext_ram_bank).w = 0;
 
     return 0;
 }
@@ -0,0 +1,309 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// copy-on-write instance forking
+
+// nsgbe_ctx_fork() copies the small part of the context eagerly and leaves the bulk memories that sit behind a pointer
+// table (cart ram banks, the cgb's switchable wram banks and the frame buffers) shared: their contents are put into
+// reference counted pages and the fork's pointers lead there. the first write to a page, through mem_write() or the
+// scanline renderer, copies it back into the writer's own context. the original keeps its memory where it was and
+// the pages as a cache, so forking it again before it has written anything costs no copies at all; writing to a cached
+// page only drops the reference, and so does the next frame once no fork holds it any longer.
+// a page is never written to, so forks sharing it can run on different threads
+
+#include "env.h"
+#include <string.h>
+#include <stddef.h>
+
+#define VIEW_PORTS_SIZE (offsetof(struct nsgbe_ctx, view_port_3) + sizeof(((struct nsgbe_ctx *)0)->view_port_3) \
+    - offsetof(struct nsgbe_ctx, view_port_1))
+
+struct COW_PAGE {
+    uint32_t references;
+    byte data[];
+};
+
+static struct COW_PAGE *cow_page_create(const byte *data, size_t size)
+{
+    struct COW_PAGE *page = malloc(sizeof(struct COW_PAGE) + size);
+
+    if (!page)
+        return NULL;
+
+    page->references = 1;
+    memcpy(page->data, data, size);
+
+    return page;
+}
+
+__always_inline static void cow_page_retain(struct COW_PAGE *page)
+{
+    __atomic_fetch_add(&page->references, 1, __ATOMIC_RELAXED);
+}
+
+__always_inline static void cow_page_release(struct COW_PAGE *page)
+{
+    if (__atomic_fetch_sub(&page->references, 1, __ATOMIC_ACQ_REL) == 1)
+        free(page);
+}
+
+// only the instance asking holds it, nobody else can take another reference meanwhile
+__always_inline static _Bool cow_page_unique(struct COW_PAGE *page)
+{
+    return (__atomic_load_n(&page->references, __ATOMIC_ACQUIRE) == 1);
+}
+
+__always_inline static _Bool cow_view_ports_shared(struct nsgbe_ctx *ctx)
+{
+    byte *pointer = (byte *)ctx->next_ppu_viewport;
+
+    return (pointer >= ctx->view_ports_page->data && pointer < ctx->view_ports_page->data + VIEW_PORTS_SIZE);
+}
+
+/*-------------------UNSHARING------------------*/
+
+// in the instance living in the page, the contents are copied back first; the original just lets go of its cache
+
+static void cow_unshare_ext_ram_bank(struct nsgbe_ctx *ctx, uint16_t bank)
+{
+    struct COW_PAGE *page = ctx->ext_ram_pages[bank];
+
+    if (ctx->ext_ram_banks[bank] == page->data)
+    {
+        ctx->ext_ram_banks[bank] = ctx->ext_ram + (bank * 0x2000);
+        memcpy(ctx->ext_ram_banks[bank], page->data, 0x2000);
+    }
+
+    ctx->ext_ram_pages[bank] = NULL;
+    ctx->cow_pages_held--;
+
+    cow_page_release(page);
+}
+
+static void cow_unshare_wram_bank(struct nsgbe_ctx *ctx, uint16_t bank)
+{
+    struct COW_PAGE *page = ctx->wram_pages[bank];
+
+    if (ctx->wram_banks[bank] == page->data)
+    {
+        ctx->wram_banks[bank] = ctx->cgb_extra_wram_banks[bank];
+        memcpy(ctx->wram_banks[bank], page->data, 0x1000);
+    }
+
+    ctx->wram_pages[bank] = NULL;
+    ctx->cow_pages_held--;
+
+    cow_page_release(page);
+}
+
+static void cow_unshare_view_ports(struct nsgbe_ctx *ctx)
+{
+    struct COW_PAGE *page = ctx->view_ports_page;
+
+    if (cow_view_ports_shared(ctx))
+    {
+        memcpy(ctx->view_port_1, page->data, VIEW_PORTS_SIZE);
+
+        // the frontend may be looking at active_display_viewport
+#ifndef EMSCRIPTEN
+        pthread_mutex_lock(&ctx->mtx);
+#endif
+
+        ctx->active_display_viewport = (uint32_t *)((byte *)ctx->view_port_1 + ((byte *)ctx->active_display_viewport - page->data));
+        ctx->next_display_viewport = (uint32_t *)((byte *)ctx->view_port_1 + ((byte *)ctx->next_display_viewport - page->data));
+        ctx->next_ppu_viewport = (uint32_t *)((byte *)ctx->view_port_1 + ((byte *)ctx->next_ppu_viewport - page->data));
+
+#ifndef EMSCRIPTEN
+        pthread_mutex_unlock(&ctx->mtx);
+#endif
+    }
+
+    ctx->view_ports_page = NULL;
+    ctx->cow_pages_held--;
+
+    cow_page_release(page);
+}
+
+void cow_before_write(uint16_t offset)
+{
+    struct nsgbe_ctx *ctx = nsgbe_ctx_current;
+
+    if (offset >= 0xE000 && offset <= 0xFDFF)
+        offset -= 0x2000;
+
+    if (offset >= 0xA000 && offset <= 0xBFFF)
+    {
+        uint16_t bank = ctx->active_ext_ram_bank.w;
+
+        if (bank < EXT_RAM_BANKS_MAX && ctx->ext_ram_pages[bank])
+            cow_unshare_ext_ram_bank(ctx, bank);
+    }
+    else if (offset >= 0xD000 && offset <= 0xDFFF && ctx->gb_mode == MODE_CGB)
+    {
+        // bank 1 lives in mem, see redirect_to_active_wram_bank()
+        uint16_t bank = ctx->mem.raw[0xFF70] & 0x7;
+
+        if (bank > 1 && ctx->wram_pages[bank])
+            cow_unshare_wram_bank(ctx, bank);
+    }
+}
+
+void cow_before_render()
+{
+    struct nsgbe_ctx *ctx = nsgbe_ctx_current;
+
+    if (ctx->view_ports_page)
+        cow_unshare_view_ports(ctx);
+}
+
+// at frame boundaries, pages no other instance holds any more are let go of, so that writes take the fast path
+// again once the forks are gone; an instance living in such a page gets its contents back
+void cow_on_frame()
+{
+    struct nsgbe_ctx *ctx = nsgbe_ctx_current;
+
+    for (uint16_t i = 0; i < EXT_RAM_BANKS_MAX && ctx->cow_pages_held; i++)
+        if (ctx->ext_ram_pages[i] && cow_page_unique(ctx->ext_ram_pages[i]))
+            cow_unshare_ext_ram_bank(ctx, i);
+
+    for (uint16_t i = 0; i < 8 && ctx->cow_pages_held; i++)
+        if (ctx->wram_pages[i] && cow_page_unique(ctx->wram_pages[i]))
+            cow_unshare_wram_bank(ctx, i);
+
+    if (ctx->view_ports_page && cow_page_unique(ctx->view_ports_page))
+        cow_unshare_view_ports(ctx);
+}
+
+// for everything that works on the memories as a whole
+void cow_unshare_all(struct nsgbe_ctx *ctx)
+{
+    for (uint16_t i = 0; i < EXT_RAM_BANKS_MAX && ctx->cow_pages_held; i++)
+        if (ctx->ext_ram_pages[i])
+            cow_unshare_ext_ram_bank(ctx, i);
+
+    for (uint16_t i = 0; i < 8 && ctx->cow_pages_held; i++)
+        if (ctx->wram_pages[i])
+            cow_unshare_wram_bank(ctx, i);
+
+    if (ctx->view_ports_page)
+        cow_unshare_view_ports(ctx);
+}
+
+// a copy of the context holds another reference to each page
+void cow_retain_all(struct nsgbe_ctx *ctx)
+{
+    for (uint16_t i = 0; i < EXT_RAM_BANKS_MAX; i++)
+        if (ctx->ext_ram_pages[i])
+            cow_page_retain(ctx->ext_ram_pages[i]);
+
+    for (uint16_t i = 0; i < 8; i++)
+        if (ctx->wram_pages[i])
+            cow_page_retain(ctx->wram_pages[i]);
+
+    if (ctx->view_ports_page)
+        cow_page_retain(ctx->view_ports_page);
+}
+
+void cow_release_all(struct nsgbe_ctx *ctx)
+{
+    for (uint16_t i = 0; i < EXT_RAM_BANKS_MAX; i++)
+        if (ctx->ext_ram_pages[i])
+            cow_page_release(ctx->ext_ram_pages[i]);
+
+    for (uint16_t i = 0; i < 8; i++)
+        if (ctx->wram_pages[i])
+            cow_page_release(ctx->wram_pages[i]);
+
+    if (ctx->view_ports_page)
+        cow_page_release(ctx->view_ports_page);
+
+    memset(ctx->ext_ram_pages, 0, sizeof(ctx->ext_ram_pages));
+    memset(ctx->wram_pages, 0, sizeof(ctx->wram_pages));
+    ctx->view_ports_page = NULL;
+    ctx->cow_pages_held = 0;
+}
+
+/*-------------------FORKING------------------*/
+
+// makes sure every shared memory of ctx has a page with its current contents
+static _Bool cow_share(struct nsgbe_ctx *ctx)
+{
+    for (uint16_t i = 0; i < ctx->ext_ram_bank_count; i++)
+    {
+        if (ctx->ext_ram_pages[i])
+            continue;
+
+        if (!(ctx->ext_ram_pages[i] = cow_page_create(ctx->ext_ram_banks[i], 0x2000)))
+            return 0;
+
+        ctx->cow_pages_held++;
+    }
+
+    // the switchable wram banks only exist for the cgb
+    for (uint16_t i = 2; i < 8 && ctx->gb_mode == MODE_CGB; i++)
+    {
+        if (ctx->wram_pages[i])
+            continue;
+
+        if (!(ctx->wram_pages[i] = cow_page_create(ctx->wram_banks[i], 0x1000)))
+            return 0;
+
+        ctx->cow_pages_held++;
+    }
+
+    if (!ctx->view_ports_page)
+    {
+        if (!(ctx->view_ports_page = cow_page_create((byte *)ctx->view_port_1, VIEW_PORTS_SIZE)))
+            return 0;
+
+        ctx->cow_pages_held++;
+    }
+
+    return 1;
+}
+
+struct nsgbe_ctx *nsgbe_ctx_fork(struct nsgbe_ctx *ctx)
+{
+    if (!ctx || !cow_share(ctx))
+        return NULL;
+
+    struct nsgbe_ctx *fork = ctx_alloc(ctx->arena_flags);
+
+    if (!fork)
+        return NULL;
+
+    // the shared memories are the last of the machine state, only what comes before them is copied
+    memcpy(fork, ctx, offsetof(struct nsgbe_ctx, cgb_extra_wram_banks));
+
+    ctx_rebase(fork, ctx);
+
+    fork->ext_ram = fork->ext_ram_arena;
+    fork->ext_ram_mapped_size = 0;
+
+    for (uint16_t i = 0; i < fork->ext_ram_bank_count; i++)
+        fork->ext_ram_banks[i] = fork->ext_ram_pages[i]->data;
+
+    // banks without a page are part of the state all the same, even if the game can't reach them
+    for (uint16_t i = 0; i < 8; i++)
+    {
+        if (fork->wram_pages[i])
+            fork->wram_banks[i] = fork->wram_pages[i]->data;
+        else
+            memcpy(fork->cgb_extra_wram_banks[i], ctx->cgb_extra_wram_banks[i], 0x1000);
+    }
+
+    byte *view_ports = fork->view_ports_page->data;
+
+    // where the original's frame buffers aren't in a page themselves, they're in the part that wasn't copied
+    if (!cow_view_ports_shared(fork))
+    {
+        fork->active_display_viewport = (uint32_t *)(view_ports + ((byte *)ctx->active_display_viewport - (byte *)ctx->view_port_1));
+        fork->next_display_viewport = (uint32_t *)(view_ports + ((byte *)ctx->next_display_viewport - (byte *)ctx->view_port_1));
+        fork->next_ppu_viewport = (uint32_t *)(view_ports + ((byte *)ctx->next_ppu_viewport - (byte *)ctx->view_port_1));
+    }
+
+    ctx_detach(fork, ctx);
+
+    return fork;
+}
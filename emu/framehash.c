@@ -0,0 +1,210 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// per-frame hashes of the machine, for regression and differential testing
+
+// at every completed frame, vblank() has the chosen parts of the machine hashed and hands the hashes to the embedder's
+// callback; nothing is kept but the most recent ones. the hash is xxh64: it works on four independent 64-bit lanes
+// per 32-byte stripe, which keeps the host's multipliers busy (and lets compilers vectorise it), so even hashing every
+// frame in full costs little next to emulating it
+
+#include "env.h"
+#include <string.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+/*-------------------XXH64------------------*/
+
+__always_inline static uint64_t xxh_rotl(uint64_t value, uint32_t bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+__always_inline static uint64_t xxh_read64(const byte *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+
+    return value;
+}
+
+__always_inline static uint32_t xxh_read32(const byte *data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+
+    return value;
+}
+
+__always_inline static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl(acc, 31);
+
+    return acc * XXH_PRIME64_1;
+}
+
+__always_inline static uint64_t xxh_merge_round(uint64_t acc, uint64_t value)
+{
+    acc ^= xxh_round(0, value);
+
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// reads the host's byte order, so hashes are only comparable between hosts of the same endianness
+uint64_t nsgbe_hash(const void *data, size_t size, uint64_t seed)
+{
+    const byte *p = data;
+    const byte *end = p + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = xxh_round(v1, xxh_read64(p));
+            v2 = xxh_round(v2, xxh_read64(p + 8));
+            v3 = xxh_round(v3, xxh_read64(p + 16));
+            v4 = xxh_round(v4, xxh_read64(p + 24));
+        }
+
+        hash = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+        hash = xxh_merge_round(hash, v1);
+        hash = xxh_merge_round(hash, v2);
+        hash = xxh_merge_round(hash, v3);
+        hash = xxh_merge_round(hash, v4);
+    }
+    else
+        hash = seed + XXH_PRIME64_5;
+
+    hash += size;
+
+    for (; p + 8 <= end; p += 8)
+        hash = xxh_rotl(hash ^ xxh_round(0, xxh_read64(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+
+    if (p + 4 <= end)
+    {
+        hash = xxh_rotl(hash ^ (xxh_read32(p) * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+        hash = xxh_rotl(hash ^ (*p * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+
+    // avalanche
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/*-------------------MACHINE------------------*/
+
+// every region is hashed with the previous one's hash as seed
+static uint64_t frame_hash_ram()
+{
+    uint64_t hash = 0;
+
+    hash = nsgbe_hash(CTX(mem).raw + 0x8000, 0x2000, hash); // vram
+    hash = nsgbe_hash(CTX(mem).raw + 0xC000, 0x2000, hash); // wram
+    hash = nsgbe_hash(CTX(mem).raw + 0xFE00, 0xA0, hash);   // oam
+    hash = nsgbe_hash(CTX(mem).raw + 0xFF00, 0x100, hash);  // io registers, hram and ie
+
+    if (CTX(gb_mode) == MODE_CGB)
+    {
+        hash = nsgbe_hash(CTX(cgb_extra_vram_bank), sizeof(CTX(cgb_extra_vram_bank)), hash);
+
+        // bank 1 lives in mem, see redirect_to_active_wram_bank()
+        for (uint16_t i = 2; i < 8; i++)
+            hash = nsgbe_hash(CTX(wram_banks)[i], 0x1000, hash);
+    }
+
+    // the banks, rather than ext_ram: forks may have some of them elsewhere (see fork.c)
+    if (CTX(ext_ram))
+        for (uint16_t i = 0; i < CTX(ext_ram_bank_count); i++)
+            hash = nsgbe_hash(CTX(ext_ram_banks)[i], 0x2000, hash);
+
+    return hash;
+}
+
+static uint64_t frame_hash_cpu()
+{
+    byte regs[16] = {
+        CTX(cpu_regs).A, CTX(cpu_regs).F.b, CTX(cpu_regs).B, CTX(cpu_regs).C, CTX(cpu_regs).D, CTX(cpu_regs).E, CTX(cpu_regs).H, CTX(cpu_regs).L,
+        CTX(cpu_regs).PC & 0xFF, CTX(cpu_regs).PC >> 8, CTX(cpu_regs).SP & 0xFF, CTX(cpu_regs).SP >> 8,
+        CTX(interrupt_master_enable), CTX(cpu_int_halt), CTX(cpu_dma_halt), CTX(cpu_alive)
+    };
+
+    return nsgbe_hash(regs, sizeof(regs), 0);
+}
+
+void frame_hash_on_frame()
+{
+    struct NSGBE_FRAME_HASH *hash = &CTX(frame_hash_last);
+
+    hash->frame = CTX(ppu_frame_counter);
+    hash->cycle = CTX(emulated_cycles);
+    hash->frame_hash = 0;
+    hash->ram_hash = 0;
+    hash->cpu_hash = 0;
+
+    // vblank() has just handed the frame on
+    if ((CTX(frame_hash_parts) & NSGBE_HASH_FRAME) && !CTX(render_suppressed))
+        hash->frame_hash = nsgbe_hash(CTX(next_display_viewport), GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT * sizeof(uint32_t), 0);
+
+    if (CTX(frame_hash_parts) & NSGBE_HASH_RAM)
+        hash->ram_hash = frame_hash_ram();
+
+    if (CTX(frame_hash_parts) & NSGBE_HASH_CPU)
+        hash->cpu_hash = frame_hash_cpu();
+
+    CTX(frame_hash_valid) = 1;
+}
+
+// outside of mtx, so the callback can use the rest of the interface
+void frame_hash_publish()
+{
+    if (CTX(frame_hash_callback))
+        CTX(frame_hash_callback)(&CTX(frame_hash_last), CTX(frame_hash_user));
+}
+
+/*-------------------API------------------*/
+
+void nsgbe_frame_hash_enable(uint32_t parts, void (* callback)(const struct NSGBE_FRAME_HASH *hash, void *user), void *user)
+{
+    CTX(frame_hash_parts) = parts & (NSGBE_HASH_FRAME | NSGBE_HASH_RAM | NSGBE_HASH_CPU);
+    CTX(frame_hash_callback) = callback;
+    CTX(frame_hash_user) = user;
+    CTX(frame_hash_valid) = 0;
+}
+
+void nsgbe_frame_hash_disable()
+{
+    CTX(frame_hash_parts) = 0;
+    CTX(frame_hash_callback) = NULL;
+    CTX(frame_hash_user) = NULL;
+    CTX(frame_hash_valid) = 0;
+}
+
+int nsgbe_frame_hash_last(struct NSGBE_FRAME_HASH *hash)
+{
+    if (!hash || !CTX(frame_hash_parts) || !CTX(frame_hash_valid))
+        return NSGBE_ERR;
+
+    *hash = CTX(frame_hash_last);
+
+    return NSGBE_OK;
+}
@@ -0,0 +1,405 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// guest code hotspots and coverage
+
+// every executed instruction is counted, along with the cycles it took, in flat arrays indexed by its location in the
+// rom (bank * 0x4000 + offset); code running from ram (0x8000 - 0xFFFF) is counted in 0x8000 entries past the rom.
+// cycles the cpu spends halted are counted at the HALT instruction, so idle loops show up as such
+
+#include "env.h"
+#include <string.h>
+
+#define HOTSPOTS_BANK_SIZE 0x4000
+#define HOTSPOTS_RAM_SIZE  0x8000
+
+struct HOTSPOT_SYMBOL {
+    uint32_t index;
+    char *name;
+};
+
+struct HOTSPOTS {
+    uint32_t rom_entries;
+    uint32_t size;              // rom_entries + HOTSPOTS_RAM_SIZE
+    uint32_t *instructions;
+    uint64_t *cycles;
+    uint8_t *coverage;          // one bit per entry, set once the instruction there has been executed
+    struct HOTSPOT_SYMBOL *symbols; // sorted by index
+    uint32_t symbol_count;
+};
+
+__always_inline static uint32_t hotspots_index(const struct HOTSPOTS *h, uint16_t bank, uint16_t address)
+{
+    if (address < HOTSPOTS_BANK_SIZE)
+        return address;
+
+    if (address < 0x8000)
+        return (uint32_t)bank * HOTSPOTS_BANK_SIZE + (address - HOTSPOTS_BANK_SIZE);
+
+    return h->rom_entries + (address - 0x8000);
+}
+
+void hotspots_record(uint16_t pc, uint32_t clock_cycles, _Bool executed)
+{
+    struct HOTSPOTS *h = CTX(hotspots);
+    uint32_t index = hotspots_index(h, CTX(active_rom_bank).w % CTX(rom_bank_count), pc);
+
+    if (index >= h->size)
+        return;
+
+    h->cycles[index] += clock_cycles;
+
+    if (executed)
+    {
+        h->instructions[index]++;
+        h->coverage[index >> 3] |= 1 << (index & 7);
+    }
+}
+
+static void hotspots_free_symbols(struct HOTSPOTS *h)
+{
+    for (uint32_t i = 0; i < h->symbol_count; i++)
+        free(h->symbols[i].name);
+
+    free_ptr((void **)&h->symbols);
+    h->symbol_count = 0;
+}
+
+void hotspots_free(struct HOTSPOTS *h)
+{
+    if (!h)
+        return;
+
+    hotspots_free_symbols(h);
+
+    free(h->instructions);
+    free(h->cycles);
+    free(h->coverage);
+    free(h);
+}
+
+int nsgbe_hotspots_enable()
+{
+    nsgbe_hotspots_disable();
+
+    if (!CTX(rombuffer) || CTX(rom_bank_count) == 0)
+        return NSGBE_ERR;
+
+    struct HOTSPOTS *h = calloc(1, sizeof(struct HOTSPOTS));
+
+    if (!h)
+        return NSGBE_ERR;
+
+    h->rom_entries = (uint32_t)CTX(rom_bank_count) * HOTSPOTS_BANK_SIZE;
+    h->size = h->rom_entries + HOTSPOTS_RAM_SIZE;
+    h->instructions = calloc(h->size, sizeof(uint32_t));
+    h->cycles = calloc(h->size, sizeof(uint64_t));
+    h->coverage = calloc(h->size / 8, 1);
+
+    if (!h->instructions || !h->cycles || !h->coverage)
+    {
+        hotspots_free(h);
+        return NSGBE_ERR;
+    }
+
+    CTX(hotspots) = h;
+
+    return NSGBE_OK;
+}
+
+void nsgbe_hotspots_disable()
+{
+    hotspots_free(CTX(hotspots));
+    CTX(hotspots) = NULL;
+}
+
+void nsgbe_hotspots_reset()
+{
+    struct HOTSPOTS *h = CTX(hotspots);
+
+    if (!h)
+        return;
+
+    memset(h->instructions, 0, h->size * sizeof(uint32_t));
+    memset(h->cycles, 0, h->size * sizeof(uint64_t));
+    memset(h->coverage, 0, h->size / 8);
+}
+
+size_t nsgbe_hotspots_coverage(uint16_t bank, uint8_t *bitmap, size_t size)
+{
+    struct HOTSPOTS *h = CTX(hotspots);
+
+    if (!h || bank >= CTX(rom_bank_count))
+        return 0;
+
+    const uint8_t *bank_coverage = h->coverage + (uint32_t)bank * HOTSPOTS_BANK_SIZE / 8;
+    size_t covered = 0;
+
+    for (uint32_t i = 0; i < HOTSPOTS_BANK_SIZE / 8; i++)
+        covered += __builtin_popcount(bank_coverage[i]);
+
+    if (bitmap)
+        memcpy(bitmap, bank_coverage, (size < HOTSPOTS_BANK_SIZE / 8 ? size : HOTSPOTS_BANK_SIZE / 8));
+
+    return covered;
+}
+
+/*---------------------SYMBOLS---------------------*/
+
+static int hotspots_compare_symbols(const void *a, const void *b)
+{
+    uint32_t x = ((const struct HOTSPOT_SYMBOL *)a)->index, y = ((const struct HOTSPOT_SYMBOL *)b)->index;
+
+    return (x > y) - (x < y);
+}
+
+// rgbds .sym files: "bank:address name" per line, ';' starts a comment
+int nsgbe_hotspots_load_symbols(const char *path)
+{
+    struct HOTSPOTS *h = CTX(hotspots);
+
+    if (!h || !path)
+        return NSGBE_ERR;
+
+    FILE *file = fopen(path, "r");
+
+    if (!file)
+        return NSGBE_ERR;
+
+    hotspots_free_symbols(h);
+
+    char line[512], name[256];
+    unsigned bank, address;
+    uint32_t capacity = 0;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (sscanf(line, "%x:%x %255s", &bank, &address, name) != 3 || address > 0xFFFF)
+            continue;
+
+        // roms without an mbc have their second half listed as bank 0 by some tools
+        if (address >= HOTSPOTS_BANK_SIZE && address < 0x8000 && bank == 0)
+            bank = 1;
+
+        uint32_t index = hotspots_index(h, bank, address);
+
+        if (index >= h->size)
+            continue;
+
+        if (h->symbol_count == capacity)
+        {
+            capacity = (capacity ? capacity * 2 : 256);
+            struct HOTSPOT_SYMBOL *symbols = realloc(h->symbols, capacity * sizeof(struct HOTSPOT_SYMBOL));
+
+            if (!symbols)
+                break;
+
+            h->symbols = symbols;
+        }
+
+        h->symbols[h->symbol_count].index = index;
+        h->symbols[h->symbol_count].name = strdup(name);
+        h->symbol_count++;
+    }
+
+    fclose(file);
+
+    qsort(h->symbols, h->symbol_count, sizeof(struct HOTSPOT_SYMBOL), hotspots_compare_symbols);
+
+    return NSGBE_OK;
+}
+
+// rom banks and ram each form a region of their own, symbols don't reach across them
+__always_inline static uint32_t hotspots_region(const struct HOTSPOTS *h, uint32_t index)
+{
+    return (index < h->rom_entries ? index / HOTSPOTS_BANK_SIZE : UINT32_MAX);
+}
+
+// the symbol an entry belongs to (the closest one before it, within its region); -1 if there is none
+static int32_t hotspots_find_symbol(const struct HOTSPOTS *h, uint32_t index)
+{
+    uint32_t low = 0, high = h->symbol_count;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (h->symbols[mid].index <= index)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low == 0 || hotspots_region(h, h->symbols[low - 1].index) != hotspots_region(h, index))
+        return -1;
+
+    return low - 1;
+}
+
+/*---------------------OUTPUT----------------------*/
+
+struct HOTSPOT_LINE {
+    uint32_t index;     // the symbol's location, or the address
+    int32_t symbol;
+    uint64_t cycles;
+    uint64_t instructions;
+};
+
+static int hotspots_compare_lines(const void *a, const void *b)
+{
+    uint64_t x = ((const struct HOTSPOT_LINE *)a)->cycles, y = ((const struct HOTSPOT_LINE *)b)->cycles;
+
+    return (x < y) - (x > y);
+}
+
+static void hotspots_format_location(const struct HOTSPOTS *h, uint32_t index, char *buffer, size_t size)
+{
+    if (index < h->rom_entries)
+    {
+        uint32_t bank = index / HOTSPOTS_BANK_SIZE;
+        uint32_t address = (bank == 0 ? index : HOTSPOTS_BANK_SIZE + index % HOTSPOTS_BANK_SIZE);
+
+        snprintf(buffer, size, "%02X:%04X", bank, address);
+    }
+    else
+        snprintf(buffer, size, "RAM:%04X", 0x8000 + (index - h->rom_entries));
+}
+
+// one line per symbol, or per address where there is no symbol; sorted by cycles
+static struct HOTSPOT_LINE *hotspots_collect(const struct HOTSPOTS *h, uint32_t *line_count)
+{
+    int32_t *symbol_lines = malloc((h->symbol_count + 1) * sizeof(int32_t));
+    struct HOTSPOT_LINE *lines = NULL;
+    uint32_t count = 0, capacity = 0;
+
+    if (!symbol_lines)
+        return NULL;
+
+    memset(symbol_lines, 0xFF, (h->symbol_count + 1) * sizeof(int32_t));
+
+    for (uint32_t i = 0; i < h->size; i++)
+    {
+        if (h->cycles[i] == 0)
+            continue;
+
+        int32_t symbol = hotspots_find_symbol(h, i);
+        int32_t line = (symbol >= 0 ? symbol_lines[symbol] : -1);
+
+        if (line < 0)
+        {
+            if (count == capacity)
+            {
+                capacity = (capacity ? capacity * 2 : 1024);
+                struct HOTSPOT_LINE *grown = realloc(lines, capacity * sizeof(struct HOTSPOT_LINE));
+
+                if (!grown)
+                    break;
+
+                lines = grown;
+            }
+
+            line = count++;
+            lines[line] = (struct HOTSPOT_LINE) { .index = (symbol >= 0 ? h->symbols[symbol].index : i), .symbol = symbol };
+
+            if (symbol >= 0)
+                symbol_lines[symbol] = line;
+        }
+
+        lines[line].cycles += h->cycles[i];
+        lines[line].instructions += h->instructions[i];
+    }
+
+    free(symbol_lines);
+
+    qsort(lines, count, sizeof(struct HOTSPOT_LINE), hotspots_compare_lines);
+
+    *line_count = count;
+
+    return lines;
+}
+
+static void hotspots_write_flat(const struct HOTSPOTS *h, FILE *file, struct HOTSPOT_LINE *lines, uint32_t line_count)
+{
+    uint64_t total_cycles = 0;
+
+    for (uint32_t i = 0; i < line_count; i++)
+        total_cycles += lines[i].cycles;
+
+    fprintf(file, "# %-10s %7s %14s  %-10s %s\n", "cycles", "%", "instructions", "location", "symbol");
+
+    for (uint32_t i = 0; i < line_count; i++)
+    {
+        char location[16];
+        hotspots_format_location(h, lines[i].index, location, sizeof(location));
+
+        fprintf(file, "%12llu %7.2f %14llu  %-10s %s\n", (unsigned long long)lines[i].cycles,
+                (total_cycles ? lines[i].cycles * 100.0 / total_cycles : 0.0), (unsigned long long)lines[i].instructions,
+                location, (lines[i].symbol >= 0 ? h->symbols[lines[i].symbol].name : "-"));
+    }
+
+    fprintf(file, "\n# coverage (bytes of code executed per rom bank)\n");
+
+    for (uint16_t bank = 0; bank < h->rom_entries / HOTSPOTS_BANK_SIZE; bank++)
+    {
+        size_t covered = nsgbe_hotspots_coverage(bank, NULL, 0);
+
+        if (covered)
+            fprintf(file, "# bank %02X: %5zu / %u\n", bank, covered, HOTSPOTS_BANK_SIZE);
+    }
+}
+
+// collapsed stacks for flamegraph tools: global label;local label (e.g. "Main;Main.loop"), or bank;address without symbols
+static void hotspots_write_collapsed(const struct HOTSPOTS *h, FILE *file, struct HOTSPOT_LINE *lines, uint32_t line_count)
+{
+    for (uint32_t i = 0; i < line_count; i++)
+    {
+        char location[16];
+        hotspots_format_location(h, lines[i].index, location, sizeof(location));
+
+        if (lines[i].symbol < 0)
+        {
+            if (lines[i].index < h->rom_entries)
+                fprintf(file, "bank_%02X;%s %llu\n", lines[i].index / HOTSPOTS_BANK_SIZE, location, (unsigned long long)lines[i].cycles);
+            else
+                fprintf(file, "ram;%s %llu\n", location, (unsigned long long)lines[i].cycles);
+
+            continue;
+        }
+
+        const char *name = h->symbols[lines[i].symbol].name;
+        const char *local = strchr(name, '.');
+
+        if (local && local != name)
+            fprintf(file, "%.*s;%s %llu\n", (int)(local - name), name, name, (unsigned long long)lines[i].cycles);
+        else
+            fprintf(file, "%s %llu\n", name, (unsigned long long)lines[i].cycles);
+    }
+}
+
+int nsgbe_hotspots_write(const char *path, int format)
+{
+    struct HOTSPOTS *h = CTX(hotspots);
+
+    if (!h || !path)
+        return NSGBE_ERR;
+
+    uint32_t line_count = 0;
+    struct HOTSPOT_LINE *lines = hotspots_collect(h, &line_count);
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        free(lines);
+        return NSGBE_ERR;
+    }
+
+    if (format == NSGBE_HOTSPOTS_COLLAPSED)
+        hotspots_write_collapsed(h, file, lines, line_count);
+    else
+        hotspots_write_flat(h, file, lines, line_count);
+
+    free(lines);
+
+    return (fclose(file) == 0 ? NSGBE_OK : NSGBE_ERR);
+}
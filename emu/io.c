@@ -3,7 +3,9 @@
 // SPDX-License-Identifier: LGPL-2.0-only
 
 #include "env.h"
+#include <string.h>
 
+#define IO_SERIAL_DATA     0xFF01
 #define IO_SERIAL_CONTROL  0xFF02
 #define IO_BOOTROM_CONTROL 0xFF50
 #define IO_JOYPAD          0xFF00
@@ -12,25 +14,8 @@
 #define IO_TIMER_MOD       0xFF06
 #define IO_TIMER_CONTROL   0xFF07
 
-byte dma_byte;
-uint16_t oam_dma_timer = 0;
-
-uint16_t divider_counter;
-uint32_t timer_counter;
-
-union BUTTON_STATE unencoded_button_state; // local copy of button_states
-
 /* CGB stuff */
 
-uint16_t vram_dma_timer = 0;
-uint16_t vram_dma_length = 0;
-_Bool active_dma_is_hblank = 0;
-byte vram_dma_hblank_timer = 0;
-_Bool did_transfer_during_current_hblank = 0;
-
-uint16_t cgb_dma_source;
-uint16_t cgb_dma_destination;
-
 enum CGB_DMA_TYPE {
     CGB_DMA_TYPE_GENERAL_PURPOSE = 0,
     CGB_DMA_TYPE_HBLANK = 1,
@@ -49,36 +34,38 @@ union CGB_DMA_REG {
 #endif
     };
     byte b;
-} *cgb_dma_reg = (union CGB_DMA_REG *)(mem.raw + HDMA5);
+};
+
+#define cgb_dma_reg ((union CGB_DMA_REG *)(CTX(mem).raw + HDMA5))
 
 /* EOF CGB stuff */
 
 __always_inline void oam_dma_transfer()
 {
-    if (oam_dma_timer % IO_TICKS_PER_MACHINE_CLOCK == 0)
+    if (CTX(oam_dma_timer) % IO_TICKS_PER_MACHINE_CLOCK == 0)
     {
         word source = word(0x0000);
-        source.b.h = dma_byte;
+        source.b.h = CTX(dma_byte);
 
-        byte i = 0xA0 - (oam_dma_timer / IO_TICKS_PER_MACHINE_CLOCK);
-        mem.map.sprite_attr_table[i] = mem_read(source.w + i);
+        byte i = 0xA0 - (CTX(oam_dma_timer) / IO_TICKS_PER_MACHINE_CLOCK);
+        CTX(mem).map.sprite_attr_table[i] = mem_read(source.w + i);
     }
 
-    oam_dma_timer--;
+    CTX(oam_dma_timer)--;
 }
 
 __always_inline void vram_dma_transfer()
 {
-    if (vram_dma_timer % IO_TICKS_PER_MACHINE_CLOCK == 0)
+    if (CTX(vram_dma_timer) % IO_TICKS_PER_MACHINE_CLOCK == 0)
     {
-        uint16_t i = vram_dma_length - (vram_dma_timer / IO_TICKS_PER_MACHINE_CLOCK);
-        mem_write(cgb_dma_destination + i, mem_read(cgb_dma_source + i));
+        uint16_t i = CTX(vram_dma_length) - (CTX(vram_dma_timer) / IO_TICKS_PER_MACHINE_CLOCK);
+        mem_write(CTX(cgb_dma_destination) + i, mem_read(CTX(cgb_dma_source) + i));
 
-        byte remaining = 0xFF - ((vram_dma_length - (i + 1)) & 0xFF);
+        byte remaining = 0xFF - ((CTX(vram_dma_length) - (i + 1)) & 0xFF);
         cgb_dma_reg->b = remaining;
     }
 
-    vram_dma_timer--;
+    CTX(vram_dma_timer)--;
 }
 
 __always_inline static void encode_joypad_byte(byte data)
@@ -88,23 +75,23 @@ __always_inline static void encode_joypad_byte(byte data)
     _Bool as_action = (jp->ACT ? 0 : 1);
     _Bool as_direction = (jp->DIR ? 0 : 1);
 
-    jp = (union JOYPAD_IO *)(mem.raw + IO_JOYPAD);
+    jp = (union JOYPAD_IO *)(CTX(mem).raw + IO_JOYPAD);
 
     // JOYPAD_IO bits are inverted (0 to select / press)
 
     if (as_action)
     {
-        jp->RA = !unencoded_button_state.A;
-        jp->LB = !unencoded_button_state.B;
-        jp->USEL = !unencoded_button_state.SELECT;
-        jp->DSTR = !unencoded_button_state.START;
+        jp->RA = !CTX(unencoded_button_state).A;
+        jp->LB = !CTX(unencoded_button_state).B;
+        jp->USEL = !CTX(unencoded_button_state).SELECT;
+        jp->DSTR = !CTX(unencoded_button_state).START;
     }
     else if (as_direction)
     {
-        jp->RA = !unencoded_button_state.RIGHT;
-        jp->LB = !unencoded_button_state.LEFT;
-        jp->USEL = !unencoded_button_state.UP;
-        jp->DSTR = !unencoded_button_state.DOWN;
+        jp->RA = !CTX(unencoded_button_state).RIGHT;
+        jp->LB = !CTX(unencoded_button_state).LEFT;
+        jp->USEL = !CTX(unencoded_button_state).UP;
+        jp->DSTR = !CTX(unencoded_button_state).DOWN;
     }
     else
         jp->b = 0xFF;
@@ -114,15 +101,50 @@ __always_inline static void encode_joypad_byte(byte data)
 
 __always_inline void sync_button_states()
 {
-    if (unencoded_button_state.b != button_states.b)
-        if (mem.map.interrupt_enable_reg.JOYPAD)
-            mem.map.interrupt_flag_reg.JOYPAD = 1;
+    union BUTTON_STATE state = CTX(button_states);
+
+    // a movie records the states seen here or replaces them with recorded ones
+    if (CTX(movie))
+        state = movie_sync_buttons(state);
 
-    unencoded_button_state.b = button_states.b;
+    if (CTX(unencoded_button_state).b != state.b)
+        if (CTX(mem).map.interrupt_enable_reg.JOYPAD)
+            CTX(mem).map.interrupt_flag_reg.JOYPAD = 1;
+
+    CTX(unencoded_button_state).b = state.b;
 
     //encode_joypad_byte(0);
 }
 
+void nsgbe_set_buttons(union BUTTON_STATE state)
+{
+    CTX(button_states) = state;
+}
+
+// there's never a link partner: a transfer started with the internal clock completes right away, shifting in 0xFF.
+// the byte sent is kept for the frontend (test roms report their results this way)
+__always_inline static void serial_transfer()
+{
+    if (CTX(serial_output_length) == SERIAL_OUTPUT_SIZE)
+    {
+        // keep the more recent half
+        memmove(CTX(serial_output), CTX(serial_output) + SERIAL_OUTPUT_SIZE / 2, SERIAL_OUTPUT_SIZE / 2);
+        CTX(serial_output_length) = SERIAL_OUTPUT_SIZE / 2;
+    }
+
+    CTX(serial_output)[CTX(serial_output_length)++] = CTX(mem).raw[IO_SERIAL_DATA];
+    CTX(mem).raw[IO_SERIAL_DATA] = 0xFF;
+}
+
+size_t nsgbe_serial_output(uint8_t *buffer, size_t size)
+{
+    size_t length = (CTX(serial_output_length) < size ? CTX(serial_output_length) : size);
+
+    memcpy(buffer, CTX(serial_output) + CTX(serial_output_length) - length, length);
+
+    return length;
+}
+
 __always_inline uint16_t io_interpret_read(uint16_t offset)
 {
     //if (offset == IO_JOYPAD) // keypad register; todo: better
@@ -131,7 +153,7 @@ __always_inline uint16_t io_interpret_read(uint16_t offset)
     if (offset == IO_SERIAL_CONTROL)
         return 0x100;
 
-    if (offset >= OAM && offset <= OAM_END && oam_dma_timer > 0)
+    if (offset >= OAM && offset <= OAM_END && CTX(oam_dma_timer) > 0)
         return 0x1FF;
 
     return 0;
@@ -141,19 +163,30 @@ __always_inline uint16_t io_interpret_write(uint16_t offset, byte data)
 {
     if (offset == IO_BOOTROM_CONTROL)
         if (data > 0)
-            enable_bootrom = 0;
+            CTX(enable_bootrom) = 0;
 
     if (offset == DMA)
     {
-        if (oam_dma_timer == 0)
+        if (CTX(oam_dma_timer) == 0)
         {
-            dma_byte = (data > 0xDF ? 0xDF : data);
-            oam_dma_timer = 160 * IO_TICKS_PER_MACHINE_CLOCK;
+            CTX(dma_byte) = (data > 0xDF ? 0xDF : data);
+            CTX(oam_dma_timer) = 160 * IO_TICKS_PER_MACHINE_CLOCK;
+
+            if (CTX(trace))
+                trace_event(TRACE_DMA_BEGIN, TRACE_DMA_OAM);
         }
         else
             return 0x100;
     }
 
+    if (offset == IO_SERIAL_CONTROL)
+    {
+        if ((data & 0x81) == 0x81) // transfer start, internal clock
+            serial_transfer();
+
+        return 0x100;
+    }
+
     if (offset == IO_JOYPAD)
     {
         encode_joypad_byte(data);
@@ -162,48 +195,54 @@ __always_inline uint16_t io_interpret_write(uint16_t offset, byte data)
 
     if (offset == IO_DIVIDER)
     {
-        divider_counter = 0;
-        mem.raw[IO_DIVIDER] = 0;
+        CTX(divider_counter) = 0;
+        CTX(mem).raw[IO_DIVIDER] = 0;
         return 0x100;
     }
 
     if (offset == IO_TIMER)
     {
         // timer_counter = 0; // ?
-        mem.raw[IO_TIMER] = 0;
+        CTX(mem).raw[IO_TIMER] = 0;
         return 0x100;
     }
 
-    if (gb_mode == MODE_CGB)
+    if (CTX(gb_mode) == MODE_CGB)
     {
         if (offset == HDMA5)
         {
-            if (vram_dma_timer == 0)
+            if (CTX(vram_dma_timer) == 0)
             {
                 cgb_dma_reg->b = data;
 
-                cgb_dma_source = ((mem.raw[HDMA1] << 8) | mem.raw[HDMA2]) & 0xFFF0; // 0xFFF0 -> last 4 bits are ignored
-                cgb_dma_destination = (((mem.raw[HDMA3] << 8) | mem.raw[HDMA4]) | 0x8000) & 0x9FF0; // 0x8000 -> transfer to vram
+                CTX(cgb_dma_source) = ((CTX(mem).raw[HDMA1] << 8) | CTX(mem).raw[HDMA2]) & 0xFFF0; // 0xFFF0 -> last 4 bits are ignored
+                CTX(cgb_dma_destination) = (((CTX(mem).raw[HDMA3] << 8) | CTX(mem).raw[HDMA4]) | 0x8000) & 0x9FF0; // 0x8000 -> transfer to vram
 
                 if (cgb_dma_reg->type == CGB_DMA_TYPE_GENERAL_PURPOSE)
                 {
-                    cpu_dma_halt = 1;
-                    active_dma_is_hblank = 0;
+                    CTX(cpu_dma_halt) = 1;
+                    CTX(active_dma_is_hblank) = 0;
                 }
                 else if (cgb_dma_reg->type == CGB_DMA_TYPE_HBLANK)
                 {
-                    active_dma_is_hblank = 1;
+                    CTX(active_dma_is_hblank) = 1;
                 }
 
-                vram_dma_length = ((cgb_dma_reg->transfer_length + 1) * 0x10);
-                vram_dma_timer = vram_dma_length * IO_TICKS_PER_MACHINE_CLOCK;
+                CTX(vram_dma_length) = ((cgb_dma_reg->transfer_length + 1) * 0x10);
+                CTX(vram_dma_timer) = CTX(vram_dma_length) * IO_TICKS_PER_MACHINE_CLOCK;
+
+                if (CTX(trace))
+                    trace_event(TRACE_DMA_BEGIN, (CTX(active_dma_is_hblank) ? TRACE_DMA_VRAM_HBLANK : TRACE_DMA_VRAM));
             }
             else
             {
                 if (((union CGB_DMA_REG) data).type == 0) // cancel (hblank) vram dma transfer
                 {
-                    vram_dma_timer = 0;
+                    CTX(vram_dma_timer) = 0;
                     cgb_dma_reg->type = CGB_DMA_TRANSFER_INACTIVE;
+
+                    if (CTX(trace))
+                        trace_event(TRACE_DMA_END, TRACE_DMA_VRAM_HBLANK);
                 }
             }
 
@@ -216,21 +255,21 @@ __always_inline uint16_t io_interpret_write(uint16_t offset, byte data)
 
 __always_inline void io_divider_step()
 {
-    divider_counter++;
-    mem.raw[IO_DIVIDER] = (divider_counter >> 8) & 0xFF;
+    CTX(divider_counter)++;
+    CTX(mem).raw[IO_DIVIDER] = (CTX(divider_counter) >> 8) & 0xFF;
 }
 
 __always_inline void io_timer_step()
 {
-    union TIMER_CONTROL_IO *tac = (union TIMER_CONTROL_IO *)(mem.raw + IO_TIMER_CONTROL);
+    union TIMER_CONTROL_IO *tac = (union TIMER_CONTROL_IO *)(CTX(mem).raw + IO_TIMER_CONTROL);
 
     if (!tac->enable)
     {
-        timer_counter = 0;
+        CTX(timer_counter) = 0;
         return;
     }
 
-    timer_counter++;
+    CTX(timer_counter)++;
     uint32_t timer_threshold = 0;
 
     switch (tac->clock)
@@ -256,71 +295,90 @@ __always_inline void io_timer_step()
             break;
     }
 
-    if (timer_counter > timer_threshold)
+    if (CTX(timer_counter) > timer_threshold)
     {
-        uint16_t timer_reg = mem.raw[IO_TIMER];
+        uint16_t timer_reg = CTX(mem).raw[IO_TIMER];
         timer_reg++;
-        timer_counter = 0;
+        CTX(timer_counter) = 0;
 
         if (timer_reg > 0xFF)
         {
-            mem.raw[IO_TIMER] = mem.raw[IO_TIMER_MOD];
+            CTX(mem).raw[IO_TIMER] = CTX(mem).raw[IO_TIMER_MOD];
 
-            if (mem.map.interrupt_enable_reg.TIMER)
-                mem.map.interrupt_flag_reg.TIMER = 1;
+            if (CTX(mem).map.interrupt_enable_reg.TIMER)
+                CTX(mem).map.interrupt_flag_reg.TIMER = 1;
         }
         else
-            mem.raw[IO_TIMER] = timer_reg;
+            CTX(mem).raw[IO_TIMER] = timer_reg;
     }
 }
 
 __always_inline void io_step()
 {
-    if (oam_dma_timer > 0)
+    CTX(emulated_cycles)++;
+
+    if (CTX(oam_dma_timer) > 0)
+    {
+        PROFILE_BEGIN(NSGBE_PROFILE_DMA);
         oam_dma_transfer();
+        PROFILE_END(NSGBE_PROFILE_DMA);
+
+        if (CTX(trace) && CTX(oam_dma_timer) == 0)
+            trace_event(TRACE_DMA_END, TRACE_DMA_OAM);
+    }
 
     io_divider_step();
     io_timer_step();
 
-    if (gb_mode == MODE_CGB)
+    if (CTX(gb_mode) == MODE_CGB)
     {
-        if (vram_dma_timer > 0)
+        if (CTX(vram_dma_timer) > 0)
         {
-            if (active_dma_is_hblank) // hblank transfer
+            if (CTX(active_dma_is_hblank)) // hblank transfer
             {
-                if (ppu_regs.stat->mode != PPU_HBLANK_MODE)
+                if (CTX(ppu_regs).stat->mode != PPU_HBLANK_MODE)
                 {
-                    did_transfer_during_current_hblank = 0;
-                    cpu_dma_halt = 0;
+                    CTX(did_transfer_during_current_hblank) = 0;
+                    CTX(cpu_dma_halt) = 0;
                 }
                 else
                 {
-                    if (!did_transfer_during_current_hblank && ppu_regs.stat->mode == PPU_HBLANK_MODE)
+                    if (!CTX(did_transfer_during_current_hblank) && CTX(ppu_regs).stat->mode == PPU_HBLANK_MODE)
                     {
-                        uint16_t remaining_bytes = (vram_dma_timer / IO_TICKS_PER_MACHINE_CLOCK);
-                        vram_dma_hblank_timer += (remaining_bytes < 0x10 ? remaining_bytes : 0x10) * IO_TICKS_PER_MACHINE_CLOCK;
-                        did_transfer_during_current_hblank = 1;
+                        uint16_t remaining_bytes = (CTX(vram_dma_timer) / IO_TICKS_PER_MACHINE_CLOCK);
+                        CTX(vram_dma_hblank_timer) += (remaining_bytes < 0x10 ? remaining_bytes : 0x10) * IO_TICKS_PER_MACHINE_CLOCK;
+                        CTX(did_transfer_during_current_hblank) = 1;
                     }
 
-                    if (vram_dma_hblank_timer > 0)
+                    if (CTX(vram_dma_hblank_timer) > 0)
                     {
-                        cpu_dma_halt = 1;
+                        PROFILE_BEGIN(NSGBE_PROFILE_DMA);
+                        CTX(cpu_dma_halt) = 1;
                         vram_dma_transfer();
-                        vram_dma_hblank_timer--;
+                        CTX(vram_dma_hblank_timer)--;
+                        PROFILE_END(NSGBE_PROFILE_DMA);
+
+                        if (CTX(trace) && CTX(vram_dma_timer) == 0)
+                            trace_event(TRACE_DMA_END, TRACE_DMA_VRAM_HBLANK);
                     }
 
-                    if (vram_dma_hblank_timer == 0)
-                        cpu_dma_halt = 0;
+                    if (CTX(vram_dma_hblank_timer) == 0)
+                        CTX(cpu_dma_halt) = 0;
                 }
             }
             else // general purpose transfer
             {
+                PROFILE_BEGIN(NSGBE_PROFILE_DMA);
                 vram_dma_transfer();
+                PROFILE_END(NSGBE_PROFILE_DMA);
 
-                if (vram_dma_timer == 0)
+                if (CTX(vram_dma_timer) == 0)
                 {
                     cgb_dma_reg->b = 0xFF;
-                    cpu_dma_halt = 0;
+                    CTX(cpu_dma_halt) = 0;
+
+                    if (CTX(trace))
+                        trace_event(TRACE_DMA_END, TRACE_DMA_VRAM);
                 }
             }
         }
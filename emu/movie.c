@@ -0,0 +1,415 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// movies (input recording and replay)
+
+// a movie is the state the machine was in when recording started, followed by every change of the
+// button states together with the emulated cycle it was observed at. while recording or playing back,
+// the rtc runs on emulated time, so replaying doesn't depend on the host in any way. playback runs on cart ram of its
+// own, leaving the game's saved data (and the battery file) alone
+
+#include "env.h"
+#include <string.h>
+
+#define MOVIE_MAGIC   "NSMV"
+#define MOVIE_VERSION 1
+
+#define MOVIE_RECORD_BUTTONS 0
+#define MOVIE_RECORD_END     1
+
+enum MOVIE_MODE { MOVIE_RECORDING, MOVIE_PLAYBACK };
+
+// file layout: header, start state (state_size bytes), records up to an end record (or the end of the file)
+struct __attribute__((packed)) MOVIE_HEADER {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t rom_checksum;
+    uint32_t state_size;
+};
+
+struct __attribute__((packed)) MOVIE_RECORD {
+    uint64_t cycle;
+    uint8_t type;
+    uint8_t buttons;
+};
+
+struct MOVIE {
+    enum MOVIE_MODE mode;
+    union BUTTON_STATE buttons; // last recorded / currently replayed state
+
+    // recording; records are flushed as they happen, so a movie survives the program being killed
+    FILE *file;
+
+    // playback
+    struct MOVIE_RECORD *records;
+    uint32_t record_count;
+    uint32_t next_record;
+    uint64_t next_cycle;    // cycle of next_record, UINT64_MAX once there is none
+    uint64_t end_cycle;     // where the recording stopped (UINT64_MAX if it was never stopped properly)
+    byte *ext_ram;          // what cart ram is replayed on, NULL if the game has none
+
+    // the game's cart ram, put back once playback ends
+    byte *battery_ram;
+    size_t battery_ram_mapped_size;
+    _Bool battery_enabled;
+    _Bool battery_ram_dirty;
+};
+
+// fnv-1a over the whole rom
+static uint32_t movie_rom_checksum()
+{
+    uint32_t hash = 0x811C9DC5;
+
+    for (uintptr_t i = 0; i < CTX(romsize); i++)
+        hash = (hash ^ CTX(rombuffer)[i]) * 0x01000193;
+
+    return hash;
+}
+
+void movie_free(struct MOVIE *m)
+{
+    if (!m)
+        return;
+
+    if (m->file)
+        fclose(m->file);
+
+    free_ptr((void **)&m->records);
+    free_ptr((void **)&m->ext_ram);
+
+    free(m);
+}
+
+// switch the rtc between host and emulated time without it jumping
+static void movie_use_emulated_time(_Bool enable)
+{
+    time_t before = mbc3_rtc_now();
+
+    CTX(rtc_emulated_time) = enable;
+    CTX(initial_tv_seconds) += mbc3_rtc_now() - before;
+}
+
+static void movie_close(_Bool write_end);
+
+__always_inline static void movie_point_ext_ram_banks()
+{
+    for (uint16_t i = 0; i < CTX(ext_ram_bank_count); i++)
+        CTX(ext_ram_banks)[i] = CTX(ext_ram) + (i * 0x2000);
+}
+
+// moves cart ram over to a copy of its own, with saving turned off meanwhile
+static _Bool movie_detach_ext_ram(struct MOVIE *m)
+{
+    size_t size = (size_t)CTX(ext_ram_bank_count) * 0x2000;
+
+    if (size == 0 || !CTX(ext_ram))
+        return 1;
+
+    if (!(m->ext_ram = malloc(size)))
+        return 0;
+
+    cow_unshare_all(nsgbe_ctx_current);
+
+    memcpy(m->ext_ram, CTX(ext_ram), size);
+
+    m->battery_ram = CTX(ext_ram);
+    m->battery_ram_mapped_size = CTX(ext_ram_mapped_size);
+    m->battery_enabled = CTX(battery_enabled);
+    m->battery_ram_dirty = CTX(ext_ram_dirty);
+
+    CTX(ext_ram) = m->ext_ram;
+    CTX(ext_ram_mapped_size) = 0;
+    CTX(battery_enabled) = 0;
+
+    movie_point_ext_ram_banks();
+
+    return 1;
+}
+
+static void movie_attach_ext_ram(struct MOVIE *m)
+{
+    if (!m->ext_ram)
+        return;
+
+    cow_unshare_all(nsgbe_ctx_current);
+
+    if (CTX(ext_ram) == m->ext_ram)
+    {
+        CTX(ext_ram) = m->battery_ram;
+        CTX(ext_ram_mapped_size) = m->battery_ram_mapped_size;
+        CTX(battery_enabled) = m->battery_enabled;
+        CTX(ext_ram_dirty) = m->battery_ram_dirty;
+
+        movie_point_ext_ram_banks();
+    }
+    else // the machine has been reset meanwhile, which set up cart ram anew
+        ext_ram_release(&m->battery_ram, &m->battery_ram_mapped_size);
+
+    free_ptr((void **)&m->ext_ram);
+}
+
+static void movie_write_record(struct MOVIE *m, uint8_t type, uint8_t buttons)
+{
+    struct MOVIE_RECORD record = { .cycle = CTX(emulated_cycles), .type = type, .buttons = buttons };
+
+    if (fwrite(&record, sizeof(record), 1, m->file) != 1 || fflush(m->file) != 0)
+        printf("Failed to write movie file.\n");
+}
+
+// points next_record at the first record past the current cycle, e.g. after a state has been loaded
+static void movie_seek(struct MOVIE *m)
+{
+    uint32_t low = 0, high = m->record_count;
+
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (m->records[mid].cycle <= CTX(emulated_cycles))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    m->next_record = low;
+    m->next_cycle = (low < m->record_count ? m->records[low].cycle : UINT64_MAX);
+    m->buttons.b = (low > 0 ? m->records[low - 1].buttons : CTX(unencoded_button_state).b);
+}
+
+union BUTTON_STATE movie_sync_buttons(union BUTTON_STATE state)
+{
+    struct MOVIE *m = CTX(movie);
+
+    if (m->mode == MOVIE_PLAYBACK)
+    {
+        while (CTX(emulated_cycles) >= m->next_cycle)
+        {
+            m->buttons.b = m->records[m->next_record++].buttons;
+            m->next_cycle = (m->next_record < m->record_count ? m->records[m->next_record].cycle : UINT64_MAX);
+        }
+
+        return m->buttons;
+    }
+
+    // frames emulated while running ahead get rolled back, the real ones will see the same input again
+    if (state.b != m->buttons.b && !CTX(running_ahead))
+    {
+        m->buttons = state;
+        movie_write_record(m, MOVIE_RECORD_BUTTONS, state.b);
+    }
+
+    return state;
+}
+
+void movie_on_state_loaded()
+{
+    struct MOVIE *m = CTX(movie);
+
+    if (m->mode == MOVIE_PLAYBACK)
+    {
+        movie_seek(m);
+        return;
+    }
+
+    // rolling back run-ahead frames doesn't affect the recording, anything else would break it;
+    // the movie then simply ends with its last input
+    if (!CTX(running_ahead))
+    {
+        printf("Stopped recording movie, the machine state was restored.\n");
+        movie_close(0);
+    }
+}
+
+int nsgbe_movie_record(const char *path)
+{
+    nsgbe_movie_stop();
+
+    size_t state_size = nsgbe_state_size();
+
+    if (!path || state_size == 0)
+        return NSGBE_ERR;
+
+    struct MOVIE *m = calloc(1, sizeof(struct MOVIE));
+    uint8_t *state = malloc(state_size);
+
+    if (!m || !state)
+    {
+        free(m);
+        free(state);
+        return NSGBE_ERR;
+    }
+
+    m->mode = MOVIE_RECORDING;
+    m->buttons = CTX(unencoded_button_state);
+
+    // the start state already has to count on emulated time
+    movie_use_emulated_time(1);
+
+    struct MOVIE_HEADER header;
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    header.version = MOVIE_VERSION;
+    header.header_size = sizeof(struct MOVIE_HEADER);
+    header.rom_checksum = movie_rom_checksum();
+    header.state_size = state_size;
+
+    int result = NSGBE_ERR;
+
+    if (nsgbe_state_save(state, state_size) == state_size && (m->file = fopen(path, "wb")))
+        if (fwrite(&header, sizeof(header), 1, m->file) == 1 && fwrite(state, state_size, 1, m->file) == 1 && fflush(m->file) == 0)
+            result = NSGBE_OK;
+
+    free(state);
+
+    if (result != NSGBE_OK)
+    {
+        printf("Failed to write movie file.\n");
+        movie_use_emulated_time(0);
+        movie_free(m);
+        return NSGBE_ERR;
+    }
+
+    CTX(movie) = m;
+
+    return NSGBE_OK;
+}
+
+// reads header, start state and records of a movie file into m / state
+static _Bool movie_read(FILE *file, struct MOVIE *m, uint8_t *state, size_t state_size)
+{
+    struct MOVIE_HEADER header;
+
+    fseek(file, 0, SEEK_END);
+    long records_size = ftell(file) - (long)sizeof(header) - (long)state_size;
+    rewind(file);
+
+    if (records_size < 0 || fread(&header, sizeof(header), 1, file) != 1)
+        return 0;
+
+    if (memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) != 0 || header.version != MOVIE_VERSION
+        || header.header_size != sizeof(header) || header.state_size != state_size)
+        return 0;
+
+    if (header.rom_checksum != movie_rom_checksum())
+    {
+        printf("This movie has been recorded with a different rom.\n");
+        return 0;
+    }
+
+    m->record_count = records_size / sizeof(struct MOVIE_RECORD);
+    m->records = malloc(m->record_count * sizeof(struct MOVIE_RECORD) + 1);
+
+    if (!m->records || fread(state, state_size, 1, file) != 1)
+        return 0;
+
+    if (fread(m->records, sizeof(struct MOVIE_RECORD), m->record_count, file) != m->record_count)
+        return 0;
+
+    // everything past an end record is ignored, leaving nothing but button records
+    m->end_cycle = UINT64_MAX;
+
+    for (uint32_t i = 0; i < m->record_count; i++)
+    {
+        if (m->records[i].type == MOVIE_RECORD_END)
+        {
+            m->end_cycle = m->records[i].cycle;
+            m->record_count = i;
+            break;
+        }
+    }
+
+    return 1;
+}
+
+int nsgbe_movie_play(const char *path)
+{
+    nsgbe_movie_stop();
+
+    size_t state_size = nsgbe_state_size();
+
+    if (!path || state_size == 0)
+        return NSGBE_ERR;
+
+    FILE *file = fopen(path, "rb");
+
+    if (!file)
+        return NSGBE_ERR;
+
+    struct MOVIE *m = calloc(1, sizeof(struct MOVIE));
+    uint8_t *state = malloc(state_size);
+    int result = NSGBE_ERR;
+
+    if (m && state && movie_read(file, m, state, state_size) && movie_detach_ext_ram(m))
+    {
+        m->mode = MOVIE_PLAYBACK;
+
+        CTX(rtc_emulated_time) = 1;
+
+        if (nsgbe_state_load(state, state_size))
+        {
+            CTX(movie) = m;
+            movie_seek(m);
+
+            result = NSGBE_OK;
+        }
+        else
+        {
+            CTX(rtc_emulated_time) = 0;
+            movie_attach_ext_ram(m);
+        }
+    }
+
+    if (result != NSGBE_OK)
+        movie_free(m);
+
+    free(state);
+    fclose(file);
+
+    return result;
+}
+
+static void movie_close(_Bool write_end)
+{
+    struct MOVIE *m = CTX(movie);
+
+    if (m->mode == MOVIE_RECORDING && write_end)
+        movie_write_record(m, MOVIE_RECORD_END, m->buttons.b);
+
+    movie_attach_ext_ram(m);
+
+    CTX(movie) = NULL;
+    movie_free(m);
+
+    movie_use_emulated_time(0);
+}
+
+void nsgbe_movie_stop()
+{
+    if (CTX(movie))
+        movie_close(1);
+}
+
+_Bool nsgbe_movie_playing()
+{
+    return (CTX(movie) && CTX(movie)->mode == MOVIE_PLAYBACK);
+}
+
+_Bool nsgbe_movie_recording()
+{
+    return (CTX(movie) && CTX(movie)->mode == MOVIE_RECORDING);
+}
+
+_Bool nsgbe_movie_finished()
+{
+    struct MOVIE *m = CTX(movie);
+
+    if (!m || m->mode != MOVIE_PLAYBACK)
+        return 1;
+
+    // movies that have never been stopped properly end with their last input
+    if (m->end_cycle == UINT64_MAX)
+        return (m->next_record >= m->record_count);
+
+    return (CTX(emulated_cycles) >= m->end_cycle);
+}
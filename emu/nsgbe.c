@@ -5,24 +5,25 @@
 /* nsGBE - no special Game Boy Emulator */
 
 #include "env.h"
-
-uint8_t *biosbuffer = NULL;
-uintptr_t biossize;
-
-uint8_t *rombuffer = NULL;
-uintptr_t romsize;
-struct ROM_HEADER *rom_header = NULL;
-
-enum GB_MODE gb_mode;
-
-static byte calc_header_checksum(void *rombuffer)
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+long (* load_rom)(uint8_t **buffer) = NULL;
+long (* load_bios)(uint8_t **buffer) = NULL;
+long (* load_battery)(uint8_t **buffer) = NULL;
+int (* save_battery)(uint8_t *buffer, size_t size) = NULL;
+
+static byte calc_header_checksum(void *buffer)
 {
     byte checksum = 0;
     uint32_t offset = 0x0134;
 
     while (offset <= 0x014C)
     {
-        checksum = checksum - *(byte *)(rombuffer + (offset++)) - 1;
+        checksum = checksum - *(byte *)(buffer + (offset++)) - 1;
     }
 
     return checksum;
@@ -41,11 +42,14 @@ static int bios_load()
 {
     // load file
 
-    free_ptr((void **)&biosbuffer);
+    if (!load_bios)
+        return NSGBE_ERR;
 
-    biossize = load_bios(&biosbuffer);
+    free_ptr((void **)&CTX(biosbuffer));
 
-    if (biossize == 0)
+    CTX(biossize) = load_bios(&CTX(biosbuffer));
+
+    if (CTX(biossize) == 0)
     {
         printf("Failed to load bios file.\n");
         return NSGBE_ERR;
@@ -54,21 +58,93 @@ static int bios_load()
     return NSGBE_OK;
 }
 
+// rom images are reference counted, so instances (and their clones, see nsgbe_ctx_clone()) share them. mapped rom
+// files are listed in rom_mappings, keyed by file identity and modification time, so a rom replaced on disk gets a
+// mapping of its own rather than reusing the stale one; heap copies aren't listed anywhere
+struct ROM_MAPPING {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    uint8_t *data;
+    _Bool mapped;
+    uint32_t references;
+    struct ROM_MAPPING *next;
+};
+
+static struct ROM_MAPPING *rom_mappings = NULL;
+
+#ifndef EMSCRIPTEN
+static pthread_mutex_t rom_mappings_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+__always_inline static void rom_mappings_lock()
+{
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&rom_mappings_mtx);
+#endif
+}
+
+__always_inline static void rom_mappings_unlock()
+{
+#ifndef EMSCRIPTEN
+    pthread_mutex_unlock(&rom_mappings_mtx);
+#endif
+}
+
+// takes ownership of a heap rom buffer
+static struct ROM_MAPPING *rom_adopt(uint8_t *buffer, size_t size)
+{
+    struct ROM_MAPPING *mapping = calloc(1, sizeof(struct ROM_MAPPING));
+
+    if (!mapping)
+        return NULL;
+
+    mapping->data = buffer;
+    mapping->size = size;
+    mapping->references = 1;
+
+    return mapping;
+}
+
+void rom_retain(struct ROM_MAPPING *mapping)
+{
+    rom_mappings_lock();
+    mapping->references++;
+    rom_mappings_unlock();
+}
+
 static int rom_load()
 {
     // load file
 
-    free_ptr((void **)&rombuffer);
+    // without a load_rom implementation, rombuffer has been filled by nsgbe_load_rom()
+    if (load_rom)
+    {
+        rom_release(&CTX(rombuffer), &CTX(rom_mapping));
+
+        CTX(romsize) = load_rom(&CTX(rombuffer));
 
-    romsize = load_rom(&rombuffer);
+        if (CTX(romsize) != 0 && CTX(rombuffer))
+        {
+            CTX(rom_mapping) = rom_adopt(CTX(rombuffer), CTX(romsize));
 
-    if (romsize == 0)
+            if (!CTX(rom_mapping))
+                free_ptr((void **)&CTX(rombuffer));
+        }
+    }
+
+    if (CTX(romsize) == 0 || !CTX(rombuffer))
     {
         printf("Failed to load rom file.\n");
         return NSGBE_ERR;
     }
 
-    rom_header = (struct ROM_HEADER *)(rombuffer + 0x100);
+    CTX(rom_header) = (struct ROM_HEADER *)(CTX(rombuffer) + 0x100);
+
+    // once per process rather than for every instance set up alongside (clones, batches)
+    if (nsgbe_ctx_current != nsgbe_ctx_default())
+        return NSGBE_OK;
 
     printf("\n");
     printf("nsGBE - no special Game Boy Emulator\n");
@@ -79,50 +155,61 @@ static int rom_load()
 #endif
     printf("------------------------------------\n");
     // printf("Start vector: 0x%02x 0x%02x 0x%02x 0x%02x\n", rom_header->start_vector[0], rom_header->start_vector[1], rom_header->start_vector[2], \
-      rom_header->start_vector[3]);
-    printf("Rom size: %lu byte\n", romsize);
-    printf("Rom title: %.*s\n", 15, rom_header->game_title);
-    printf("Destination code: 0x%02X\n", rom_header->destination_code);
-    printf("Cartridge type: 0x%02X\n", rom_header->cartridge_type);
-    printf("GBC flag: 0x%02X\n", rom_header->gbc_flag);
-    printf("SGB flag: 0x%02X\n", rom_header->sgb_flag);
-    printf("Header checksum is %s\n", (rom_header->header_checksum == calc_header_checksum(rombuffer) ? "valid" : "invalid"));
+      CTX(rom_header)->start_vector[3]);
+    printf("Rom size: %lu byte\n", CTX(romsize));
+    printf("Rom title: %.*s\n", 15, CTX(rom_header)->game_title);
+    printf("Destination code: 0x%02X\n", CTX(rom_header)->destination_code);
+    printf("Cartridge type: 0x%02X\n", CTX(rom_header)->cartridge_type);
+    printf("GBC flag: 0x%02X\n", CTX(rom_header)->gbc_flag);
+    printf("SGB flag: 0x%02X\n", CTX(rom_header)->sgb_flag);
+    printf("Header checksum is %s\n", (CTX(rom_header)->header_checksum == calc_header_checksum(CTX(rombuffer)) ? "valid" : "invalid"));
     printf("------------------------------------\n\n");
 
     return NSGBE_OK;
 }
 
-void battery_load(byte **battery_banks, uint16_t bank_count)
+void battery_load(byte *battery_ram, size_t size)
 {
     uint8_t *battery_buffer;
     long battery_size;
 
     // load file
 
-    battery_size = load_battery(&battery_buffer);
+    if (load_battery)
+        battery_size = load_battery(&battery_buffer);
+    else
+    {
+        battery_buffer = CTX(pending_battery_buffer);
+        battery_size = CTX(pending_battery_size);
+
+        CTX(pending_battery_buffer) = NULL;
+        CTX(pending_battery_size) = 0;
+    }
 
-    if (battery_size == 0)
+    if (battery_size == 0 || !battery_buffer)
     {
         printf("Failed to load battery file.\n");
         return;
     }
 
-    for (uint16_t i = 0; i < bank_count; i++)
-        for (uint16_t field = 0; field < 0x2000; field++)
-            battery_banks[i][field] = ((byte *)battery_buffer)[field + (i * 0x2000)];
+    memcpy(battery_ram, battery_buffer, (battery_size < size ? battery_size : size));
 
     free(battery_buffer);
 }
 
-static void battery_save(byte **battery_banks, uint16_t bank_count)
+static void battery_save(byte *battery_ram, size_t size)
 {
-    byte *battery_buffer = malloc(0x2000 * bank_count);
+    byte *battery_buffer = malloc(size);
+
+    if (!battery_buffer)
+    {
+        printf("Failed to write battery file.\n");
+        return;
+    }
 
-    for (uint16_t i = 0; i < bank_count; i++)
-        for (uint16_t field = 0; field < 0x2000; field++)
-            battery_buffer[field + (i * 0x2000)] = battery_banks[i][field];
+    memcpy(battery_buffer, battery_ram, size);
 
-    if (save_battery(battery_buffer, 0x2000 * bank_count) == 0)
+    if (save_battery(battery_buffer, size) == 0)
         printf("Failed to write battery file.\n");
 
     free(battery_buffer);
@@ -130,8 +217,223 @@ static void battery_save(byte **battery_banks, uint16_t bank_count)
 
 void write_battery()
 {
-    if (battery_enabled)
-        battery_save(ext_ram_banks, ext_ram_bank_count);
+    if (!CTX(battery_enabled))
+        return;
+
+    // a mapped battery file is up to date already, this only makes sure it has reached the disk
+    if (CTX(ext_ram_mapped_size))
+        ext_ram_sync();
+    else if (save_battery)
+    {
+        cow_unshare_all(nsgbe_ctx_current);
+        battery_save(CTX(ext_ram), 0x2000 * CTX(ext_ram_bank_count));
+    }
+}
+
+int nsgbe_load_rom(const uint8_t *data, size_t size)
+{
+    if (!data || size < 0x8000)
+        return NSGBE_ERR;
+
+    rom_release(&CTX(rombuffer), &CTX(rom_mapping));
+    CTX(romsize) = 0;
+
+    uint8_t *buffer = malloc(size);
+
+    if (!buffer)
+        return NSGBE_ERR;
+
+    memcpy(buffer, data, size);
+
+    CTX(rom_mapping) = rom_adopt(buffer, size);
+
+    if (!CTX(rom_mapping))
+    {
+        free(buffer);
+        return NSGBE_ERR;
+    }
+
+    CTX(rombuffer) = buffer;
+    CTX(romsize) = size;
+
+    return NSGBE_OK;
+}
+
+static struct ROM_MAPPING *rom_mapping_acquire(int fd, struct stat *st)
+{
+    rom_mappings_lock();
+
+    struct ROM_MAPPING *mapping = rom_mappings;
+
+    while (mapping && !(mapping->device == st->st_dev && mapping->inode == st->st_ino && mapping->size == st->st_size
+        && mapping->modified.tv_sec == st->st_mtim.tv_sec && mapping->modified.tv_nsec == st->st_mtim.tv_nsec))
+        mapping = mapping->next;
+
+    if (!mapping)
+    {
+        // private and read-only: the pages are the page cache's, and writes to rom never reach the buffer anyway
+        void *data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data != MAP_FAILED)
+        {
+            // banks get switched in in no particular order, so start reading the whole rom in right away
+            madvise(data, st->st_size, MADV_WILLNEED);
+
+            mapping = malloc(sizeof(struct ROM_MAPPING));
+
+            if (mapping)
+            {
+                *mapping = (struct ROM_MAPPING) {
+                    .device = st->st_dev,
+                    .inode = st->st_ino,
+                    .size = st->st_size,
+                    .modified = st->st_mtim,
+                    .data = data,
+                    .mapped = 1,
+                    .references = 0,
+                    .next = rom_mappings
+                };
+
+                rom_mappings = mapping;
+            }
+            else
+                munmap(data, st->st_size);
+        }
+    }
+
+    if (mapping)
+        mapping->references++;
+
+    rom_mappings_unlock();
+
+    return mapping;
+}
+
+void rom_release(uint8_t **buffer, struct ROM_MAPPING **mapping)
+{
+    if (!*mapping)
+    {
+        free_ptr((void **)buffer);
+        return;
+    }
+
+    rom_mappings_lock();
+
+    if (--(*mapping)->references == 0)
+    {
+        if ((*mapping)->mapped)
+        {
+            struct ROM_MAPPING **link = &rom_mappings;
+
+            while (*link != *mapping)
+                link = &(*link)->next;
+
+            *link = (*mapping)->next;
+
+            munmap((*mapping)->data, (*mapping)->size);
+        }
+        else
+            free((*mapping)->data);
+
+        free(*mapping);
+    }
+
+    rom_mappings_unlock();
+
+    *mapping = NULL;
+    *buffer = NULL;
+}
+
+int nsgbe_load_rom_file(const char *path)
+{
+    rom_release(&CTX(rombuffer), &CTX(rom_mapping));
+    CTX(romsize) = 0;
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        printf("Error trying to open file: %s\n", path);
+        return NSGBE_ERR;
+    }
+
+    struct stat st;
+    struct ROM_MAPPING *mapping = NULL;
+
+    if (fstat(fd, &st) == 0 && st.st_size >= 0x8000)
+        mapping = rom_mapping_acquire(fd, &st);
+
+    // the mapping stays valid without the descriptor
+    close(fd);
+
+    if (!mapping)
+    {
+        printf("Error trying to map file: %s\n", path);
+        return NSGBE_ERR;
+    }
+
+    CTX(rom_mapping) = mapping;
+    CTX(rombuffer) = mapping->data;
+    CTX(romsize) = mapping->size;
+
+    return NSGBE_OK;
+}
+
+int nsgbe_load_battery(const uint8_t *data, size_t size)
+{
+    free_ptr((void **)&CTX(pending_battery_buffer));
+    CTX(pending_battery_size) = 0;
+
+    if (!data || size == 0)
+        return NSGBE_ERR;
+
+    CTX(pending_battery_buffer) = malloc(size);
+
+    if (!CTX(pending_battery_buffer))
+        return NSGBE_ERR;
+
+    memcpy(CTX(pending_battery_buffer), data, size);
+    CTX(pending_battery_size) = size;
+
+    return NSGBE_OK;
+}
+
+int nsgbe_battery_file(const char *path)
+{
+    free_ptr((void **)&CTX(battery_path));
+
+    if (!path)
+        return NSGBE_OK;
+
+    CTX(battery_path) = strdup(path);
+
+    return (CTX(battery_path) ? NSGBE_OK : NSGBE_ERR);
+}
+
+_Bool nsgbe_battery_file_mapped()
+{
+    return (CTX(ext_ram_mapped_size) != 0);
+}
+
+size_t nsgbe_battery_size()
+{
+    if (!CTX(battery_enabled))
+        return 0;
+
+    return 0x2000 * CTX(ext_ram_bank_count);
+}
+
+size_t nsgbe_save_battery(uint8_t *buffer, size_t size)
+{
+    size_t battery_size = nsgbe_battery_size();
+
+    if (!buffer || battery_size == 0 || size < battery_size)
+        return 0;
+
+    for (uint16_t i = 0; i < CTX(ext_ram_bank_count); i++)
+        memcpy(buffer + i * 0x2000, CTX(ext_ram_banks)[i], 0x2000);
+
+    return battery_size;
 }
 
 int system_reset()
@@ -139,9 +441,12 @@ int system_reset()
     if (!rom_load())
         return NSGBE_ERR;
 
-    if (rom_header->gbc_flag == 0xC0)
+    CTX(system_stopping) = 0;
+    CTX(gb_mode) = MODE_DMG;
+
+    if (CTX(rom_header)->gbc_flag == 0xC0)
     {
-        gb_mode = MODE_CGB;
+        CTX(gb_mode) = MODE_CGB;
 
         printf("This game is a Game Boy Color exclusive.\n");
         printf("Please note that support for some GBC-specific features is experimental, others are missing completely.\n");
@@ -149,18 +454,22 @@ int system_reset()
     }
 
 #if PREFER_CGB_MODE
-    if (rom_header->gbc_flag == 0x80)
-        gb_mode = MODE_CGB;
+    if (CTX(rom_header)->gbc_flag == 0x80)
+        CTX(gb_mode) = MODE_CGB;
 #endif
 
     // if (!bios_load())
         // return;
 
-    init_memory();
+    if (!init_memory())
+        return NSGBE_ERR;
+
+    CTX(serial_output_length) = 0;
+
     cpu_reset();
     ppu_reset();
 
-    if (gb_mode == MODE_CGB)
+    if (CTX(gb_mode) == MODE_CGB)
         fake_cgb_bootrom();
     else
         fake_dmg_bootrom();
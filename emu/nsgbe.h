@@ -45,16 +45,50 @@ union BUTTON_STATE {
     uint8_t b;
 };
 
-/*------------platform-specific gui------------*/
+/*-------------------INSTANCES-------------------*/
+
+// every emulated machine lives in its own context; everything below acts on the
+// context bound to the calling thread, which is a default instance unless told otherwise
+struct nsgbe_ctx;
+
+// a context is a single allocation holding all of the instance's state; NSGBE_CTX_HUGE_PAGES lets the kernel back it
+// with transparent huge pages where available (fewer tlb misses, at the cost of rounding it up to 2 MiB)
+#define NSGBE_CTX_HUGE_PAGES 0x1
+
+extern struct nsgbe_ctx *nsgbe_ctx_create();
+extern struct nsgbe_ctx *nsgbe_ctx_create_flags(uint32_t flags);
+extern void nsgbe_ctx_destroy(struct nsgbe_ctx *ctx);
+
+// a new instance in exactly the state ctx is in, made with a single copy of its context. the rom is shared and cart
+// ram copied; the clone doesn't take over the battery file, rewind history, movie, hotspots, trace, autosave, capture
+// or statistics. ctx must not be running on another thread meanwhile
+extern struct nsgbe_ctx *nsgbe_ctx_clone(struct nsgbe_ctx *ctx);
 
-// copy of button states owned and modified by frontend
-extern union BUTTON_STATE button_states;
+// like nsgbe_ctx_clone(), but cart ram, the cgb's switchable wram banks and the frame buffers stay shared with ctx
+// until either instance writes to them, which makes spawning many instances off the same state cheap
+extern struct nsgbe_ctx *nsgbe_ctx_fork(struct nsgbe_ctx *ctx);
 
-// any frontend or gui provides implementations for these
-extern long load_rom(uint8_t **buffer);
-extern long load_bios(uint8_t **buffer);
-extern long load_battery(uint8_t **buffer);
-extern int save_battery(uint8_t *buffer, size_t size);
+// bind ctx to the calling thread (NULL binds the default instance);
+// a context must not be bound to more than one running thread at a time
+extern void nsgbe_ctx_bind(struct nsgbe_ctx *ctx);
+extern struct nsgbe_ctx *nsgbe_ctx_bound();
+extern struct nsgbe_ctx *nsgbe_ctx_default();
+
+// per-instance state frontends work with directly, pass nsgbe_ctx_bound() for the calling thread's instance:
+// the button states owned by the core and modified by the frontend, the callback notifying it about new frames, and
+// the header of the rom loaded (NULL before)
+extern union BUTTON_STATE *nsgbe_ctx_button_states(struct nsgbe_ctx *ctx);
+extern void (** nsgbe_ctx_display_notify_vblank(struct nsgbe_ctx *ctx))();
+extern struct ROM_HEADER *nsgbe_ctx_rom_header(struct nsgbe_ctx *ctx);
+
+/*------------platform-specific gui------------*/
+
+// a frontend or gui may point these to its own implementations before calling system_reset();
+// if left NULL, the rom / battery handed over via nsgbe_load_rom() / nsgbe_load_battery() is used instead
+extern long (* load_rom)(uint8_t **buffer);
+extern long (* load_bios)(uint8_t **buffer);
+extern long (* load_battery)(uint8_t **buffer);
+extern int (* save_battery)(uint8_t *buffer, size_t size);
 
 /*--------------------NSGBE----------------------*/
 
@@ -62,18 +96,41 @@ extern int save_battery(uint8_t *buffer, size_t size);
 #define NSGBE_OK    1
 #define NSGBE_ERR   0
 
-// frontend can toggle system overclock by changing this bool
-extern _Bool system_overclock;
+// emulation speed multipliers accepted by system_set_speed()
+#define NSGBE_SPEED_UNCAPPED 0.f   // run as fast as the host allows, without sleeping
+#define NSGBE_SPEED_MIN      0.25f
+#define NSGBE_SPEED_MAX      64.f
+
+// frontend can change the emulation speed relative to the original machine clock;
+// values outside NSGBE_SPEED_MIN - NSGBE_SPEED_MAX are clamped (except NSGBE_SPEED_UNCAPPED)
+extern void system_set_speed(float multiplier);
+extern float system_get_speed();
+
+// ratio of emulated time to real time (1.0 = full speed), averaged over roughly half a second
+extern float system_get_achieved_speed();
+
+#define NSGBE_RUNAHEAD_MAX 8
+
+// run-ahead hides the game's own input lag: after every frame, the core emulates this many frames further with the
+// current button states, presents the last of them and returns to where it was (0 = off, the default).
+// costs one extra frame of emulation per frame run ahead; call this while the event loop isn't running
+extern void system_set_runahead(uint32_t frames);
+extern uint32_t system_get_runahead();
 
 // run this at least once before launching the event loop
 extern int system_reset();
 
 // launch this in a new thread to run the core in a self-contained timed event loop
 extern int system_run_event_loop();
+// makes system_run_event_loop() return, right away if it hasn't been entered yet, until the next system_reset(). a
+// frontend shutting down calls this and joins the core's thread before stopping movies, traces, autosave and capture,
+// none of which may be torn down while the core is still running
+extern void system_stop();
 
 // call either of these if you wish to implement your own event loop
 extern void clock_perform_sleep_cycle_ticks(); // untimed
 extern void clock_perform_sleep_cycle(); // timed
+extern float clock_sleep_cycle_hz(); // how many sleep cycles per second the current speed calls for (0 if uncapped)
 
 // frontend can pause / resume emulation using these two functions
 extern void system_resume();
@@ -83,8 +140,305 @@ extern void system_pause();
 extern void write_battery();
 extern uint32_t *display_request_next_frame();
 
-// frontend can set up a callback on this to be notified about new frames
-extern void (* display_notify_vblank)();
+/*--------------------HEADLESS--------------------*/
+
+// these let an embedder drive the core synchronously without a frontend or event loop
+
+// copy a rom / battery image into the core; call these before system_reset()
+extern int nsgbe_load_rom(const uint8_t *data, size_t size);
+// map a rom file read-only instead of copying it; instances loading the same file share one mapping
+// (and, through the page cache, so do processes). the file must not be truncated while it's loaded
+extern int nsgbe_load_rom_file(const char *path);
+extern int nsgbe_load_battery(const uint8_t *data, size_t size);
+// keep battery backed cartridge ram in the given file (created if missing) instead of going through load_battery /
+// save_battery: the ram becomes a shared mapping of the file, so every write lands in it right away and survives
+// crashes. falls back to the callbacks if the file can't be mapped; NULL switches back to them, too.
+// call before system_reset(); instances must not share a file
+extern int nsgbe_battery_file(const char *path);
+// whether, after system_reset(), battery ram actually is a mapping of the battery file
+extern _Bool nsgbe_battery_file_mapped();
+
+// size of the battery backed cartridge ram (0 if the cartridge has no battery)
+extern size_t nsgbe_battery_size();
+// copy battery backed cartridge ram into buffer; returns number of bytes written
+extern size_t nsgbe_save_battery(uint8_t *buffer, size_t size);
+
+// run until the ppu has completed the next frame (or a frame's worth of cycles has passed with the lcd off)
+extern int nsgbe_run_frame();
+// run for the given number of cpu clock cycles (4194304 per emulated second)
+extern int nsgbe_run_cycles(uint32_t clock_cycles);
+
+// most recently completed frame, GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT pixels
+extern uint32_t *nsgbe_framebuffer();
+extern void nsgbe_set_buttons(union BUTTON_STATE state);
+
+// copy the most recent (up to size) bytes the game has sent over the serial port into buffer, oldest first;
+// returns number of bytes written. there's no link partner, so this is mostly useful for test roms
+extern size_t nsgbe_serial_output(uint8_t *buffer, size_t size);
+
+// cpu clock cycles emulated since the machine was reset
+extern uint64_t nsgbe_cycle_count();
+// cpu instructions executed so far
+extern uint64_t nsgbe_instruction_count();
+
+struct NSGBE_CPU_STATE {
+    uint16_t af, bc, de, hl, sp, pc;
+    _Bool alive; // cleared once the cpu has run into an illegal opcode or a bank out of range
+};
+
+// the cpu's registers, e.g. for telling a test rom's verdict
+extern void nsgbe_cpu_state(struct NSGBE_CPU_STATE *state);
+// cartridge ram bank (0x2000 bytes) as the game sees it, NULL if the cartridge has no such bank
+extern const uint8_t *nsgbe_cart_ram_bank(uint16_t bank);
+
+/*------------------OBSERVATIONS-------------------*/
+
+// compact 8-bit images of the screen (e.g. as input for machine learning), produced by the scanline renderer while the
+// line it has just drawn is still in cache, so nobody has to read back and convert the argb frame afterwards
+
+enum NSGBE_OBSERVATION_FORMAT {
+    NSGBE_OBSERVATION_OFF = 0,
+    NSGBE_OBSERVATION_LUMA = 1,         // luminance of the presented colors (rec. 601), 0 = black
+    NSGBE_OBSERVATION_PALETTE_INDEX = 2 // dmg: shade 0-3 after bgp / obp0 / obp1 (0 = lightest); cgb: bg and window
+                                        // palette * 4 + color (0-31), sprites 32 + palette * 4 + color (32-63)
+};
+
+struct NSGBE_OBSERVATION_CONFIG {
+    enum NSGBE_OBSERVATION_FORMAT format;
+    uint8_t x, y;          // top left corner of the region to observe
+    uint8_t width, height; // 0 = up to the edge of the screen; shrunk to a multiple of stride
+    uint8_t stride;        // keep every stride-th pixel of every stride-th line (1-16, 0 counts as 1)
+    _Bool average;         // luma only: each kept pixel is the average of its stride * stride block (stride 2 = 2x downsample)
+};
+
+// set up the observation of the bound instance; NULL or NSGBE_OBSERVATION_OFF turns it off (the default).
+// fails for a region that isn't on the screen
+extern int nsgbe_observation_configure(const struct NSGBE_OBSERVATION_CONFIG *config);
+// observation of the most recently completed frame, row by row without padding (NULL while off). it's owned by the
+// core and gets overwritten line by line while the next frame is drawn, so read it in between nsgbe_run_frame() calls
+extern const uint8_t *nsgbe_observation(uint32_t *width, uint32_t *height);
+// width * height of an observation in bytes (0 while off)
+extern size_t nsgbe_observation_size();
+
+/*---------------------BATCH-----------------------*/
+
+// advance n instances by frames frames each, spread over a pool of worker threads (one per host cpu, including the
+// calling thread). inputs (one per instance, may be NULL to leave the buttons alone) are applied before stepping.
+// returns the instances' resulting frames back to back, n * GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT pixels
+// (NULL on failure). that buffer is owned by the core and reused: it is only valid until the next batch call (from any
+// thread, either kind) or nsgbe_batch_set_workers(), so copy out what has to stay. the instances must not be bound to
+// or running on any other thread meanwhile; the calling thread's binding is left as it was
+extern uint32_t *nsgbe_batch_step(struct nsgbe_ctx **ctxs, uint32_t n, const union BUTTON_STATE *inputs, uint32_t frames);
+// same, but returns the instances' observations back to back, n * nsgbe_observation_size() bytes, in the same reused
+// buffer; all instances need the same observation setup
+extern uint8_t *nsgbe_batch_step_observations(struct nsgbe_ctx **ctxs, uint32_t n, const union BUTTON_STATE *inputs,
+    uint32_t frames);
+// size the pool differently (0 = one worker per host cpu); takes effect with the next batch and frees the buffer
+// the last one returned
+extern void nsgbe_batch_set_workers(uint32_t workers);
+
+/*-------------------SAVE STATES-------------------*/
+
+// full machine state snapshots; only valid after system_reset() and only for the rom that was loaded at the time.
+// call these from the thread driving the core, between frames / cycles (never while the event loop is running)
+
+// size of a state of the currently loaded rom (0 if none)
+extern size_t nsgbe_state_size();
+// snapshot the machine into buffer; returns number of bytes written (0 on failure)
+extern size_t nsgbe_state_save(uint8_t *buffer, size_t size);
+// restore the machine from a state; fails on states of another rom or format version
+extern int nsgbe_state_load(const uint8_t *buffer, size_t size);
+
+extern int nsgbe_state_save_file(const char *path);
+extern int nsgbe_state_load_file(const char *path);
+
+/*---------------------REWIND----------------------*/
+
+// keep a history of machine states to step back through; a state is captured every frame_interval frames,
+// every keyframe_interval-th capture is stored in full, the ones in between as deltas.
+// budget_bytes bounds the history (oldest states are dropped first), plus roughly three states worth of working memory.
+// call this after system_reset(), before launching the event loop
+extern int nsgbe_rewind_enable(size_t budget_bytes, uint32_t frame_interval, uint32_t keyframe_interval);
+extern void nsgbe_rewind_disable();
+
+// restore the newest state in the history and drop it from there
+extern int nsgbe_rewind_step();
+// number of states currently held
+extern uint32_t nsgbe_rewind_length();
+
+// while enabled, the core steps back through the history after every emulated frame instead of recording it;
+// frontends can bind this to a key
+extern void system_set_rewinding(_Bool enable);
+
+/*---------------------MOVIES----------------------*/
+
+// record every change of the button states, cycle-exact, along with the current machine state, so the session can be
+// replayed deterministically (e.g. headless at uncapped speed). while a movie is active, the rtc runs on emulated time.
+// recording ends with nsgbe_movie_stop() or when the program exits; restoring a state stops it, too
+extern int nsgbe_movie_record(const char *path);
+// restore the movie's start state and replay its input instead of the button states; fails for movies of another rom.
+// playback runs on cart ram of its own, the game's (and the battery file) is left as it was and back once it stops
+extern int nsgbe_movie_play(const char *path);
+extern void nsgbe_movie_stop();
+
+extern _Bool nsgbe_movie_recording();
+extern _Bool nsgbe_movie_playing();
+// whether playback has reached the point the recording was stopped at (or its last input, if it wasn't stopped)
+extern _Bool nsgbe_movie_finished();
+
+/*--------------------PROFILING--------------------*/
+
+// host time spent in the core's components, per emulated frame; only measured by builds with NSGBE_PROFILING defined
+// (cmake -DNSGBE_PROFILING=ON), which are somewhat slower. sections nest: io contains dma, cpu contains mem_read /
+// mem_write, ppu contains render; io, cpu and ppu together make up the time spent emulating
+enum NSGBE_PROFILE_SECTION {
+    NSGBE_PROFILE_IO,
+    NSGBE_PROFILE_CPU,
+    NSGBE_PROFILE_PPU,
+    NSGBE_PROFILE_RENDER,
+    NSGBE_PROFILE_DMA,
+    NSGBE_PROFILE_MEM_READ,
+    NSGBE_PROFILE_MEM_WRITE,
+    NSGBE_PROFILE_SECTIONS
+};
+
+struct NSGBE_PROFILE {
+    uint32_t frames;                        // emulated frames covered
+    uint64_t host_nsec;                     // wall time those frames took (including any sleeping in between)
+    uint64_t nsec[NSGBE_PROFILE_SECTIONS];  // time spent in each section
+    uint64_t calls[NSGBE_PROFILE_SECTIONS];
+};
+
+// these fail if profiling hasn't been built in
+extern int nsgbe_profile_last_frame(struct NSGBE_PROFILE *profile);
+extern int nsgbe_profile_totals(struct NSGBE_PROFILE *profile); // since the first frame or the last reset
+extern void nsgbe_profile_reset();
+// print a summary to stderr every this many frames (0 = never, default is 600)
+extern void nsgbe_profile_set_report_interval(uint32_t frames);
+
+/*---------------------HOTSPOTS--------------------*/
+
+// guest code profiling: instructions executed and cpu clock cycles spent per rom location (bank and address), plus
+// which parts of each rom bank have been executed at all. cheap enough to leave enabled; the counters are tied to the
+// loaded rom, enable again after loading another one
+#define NSGBE_HOTSPOTS_FLAT      0 // one line per symbol (or address), sorted by cycles, followed by coverage per bank
+#define NSGBE_HOTSPOTS_COLLAPSED 1 // "stack count" lines for flamegraph tools (e.g. flamegraph.pl, speedscope)
+
+extern int nsgbe_hotspots_enable(); // (re)starts counting from zero
+extern void nsgbe_hotspots_disable();
+extern void nsgbe_hotspots_reset();
+// name locations after the labels in an rgbds .sym file (e.g. "game.sym"), local labels nest under their global one
+extern int nsgbe_hotspots_load_symbols(const char *path);
+extern int nsgbe_hotspots_write(const char *path, int format);
+// bit n of the (up to 0x800 byte) bitmap is set if the instruction at offset n of the rom bank has been executed;
+// returns the number of such bytes
+extern size_t nsgbe_hotspots_coverage(uint16_t bank, uint8_t *bitmap, size_t size);
+
+/*----------------------STATS----------------------*/
+
+#define NSGBE_STATS_OVERSHOOT_BUCKETS 8
+
+// live numbers for title bars and monitoring; counters run from the creation of the context, rates and frame times
+// cover the last half second or so
+struct NSGBE_STATS {
+    uint64_t frames_emulated;       // completed by the ppu (frames run ahead don't count)
+    uint64_t frames_presented;      // fetched through display_request_next_frame() / nsgbe_framebuffer()
+    uint64_t frames_dropped;        // completed, but replaced by the next one before anyone fetched them
+    uint64_t frames_duplicated;     // fetches that found no new frame and got the previous one again
+    float speed;                    // achieved speed in percent (100 = full speed)
+    float emulated_fps;
+    float presented_fps;
+    float instructions_per_second;
+    float frame_host_usec;          // host time between the two most recent emulated frames
+    float frame_host_usec_avg;
+    float frame_host_usec_max;
+    // how late the timed event loop woke up from sleeping: < 50 us, < 100 us, < 250 us, < 500 us, < 1 ms, < 2 ms, < 5 ms, later
+    uint64_t sleep_overshoot[NSGBE_STATS_OVERSHOOT_BUCKETS];
+};
+
+// these never block and may be called from any thread, also while the event loop is running
+extern void nsgbe_stats(struct NSGBE_STATS *stats);
+extern void nsgbe_ctx_stats(struct nsgbe_ctx *ctx, struct NSGBE_STATS *stats);
+
+/*----------------------TRACE----------------------*/
+
+// write a timeline of frames, ppu modes, interrupts, dma transfers, bank switches and the host sleeping between
+// emulation slices to a json file in chrome's trace event format (open it in ui.perfetto.dev or chrome://tracing).
+// events are buffered and written by a background thread; if it falls behind, events are dropped rather than slowing
+// down emulation. not available on the web builds
+extern int nsgbe_trace_start(const char *path);
+// finishes writing the file; call it on the thread running the core, or once that has stopped (see system_stop())
+extern void nsgbe_trace_stop();
+extern uint64_t nsgbe_trace_dropped(); // events dropped so far
+
+/*---------------------CAPTURE----------------------*/
+
+enum NSGBE_CAPTURE_FORMAT {
+    NSGBE_CAPTURE_Y4M = 0,      // raw yuv4mpeg2 video (4:4:4), for encoders and players
+    NSGBE_CAPTURE_TILE_DIFF = 1 // lossless, only the 8x8 tiles that changed (see capture.c for the layout)
+};
+
+// record the frames presented to the frontend into a file, or into the stdin of an encoder started with command (e.g.
+// "ffmpeg -y -i - -c:v libx264 -crf 0 out.mkv"). frames are queued for a background thread to encode and write; if it
+// falls behind, frames are dropped rather than slowing down emulation. not available on the web builds
+extern int nsgbe_capture_start(const char *path, enum NSGBE_CAPTURE_FORMAT format);
+extern int nsgbe_capture_start_pipe(const char *command, enum NSGBE_CAPTURE_FORMAT format);
+extern void nsgbe_capture_stop(); // writes what's queued, then closes the file / waits for the encoder to exit
+extern uint64_t nsgbe_capture_frames(); // frames written so far
+extern uint64_t nsgbe_capture_dropped(); // frames dropped so far
+
+/*---------------------AUTOSAVE---------------------*/
+
+// save battery ram to the battery file (see nsgbe_battery_file()) in the background, once the game hasn't written to it
+// for quiet_msec, and at least every interval_sec while it keeps writing (0 = only when quiet). if the ram maps the
+// file, this only makes sure it reaches the disk; otherwise the file is replaced atomically with a copy of the ram.
+// the emulation thread never waits for the disk. not available on the web builds
+extern int nsgbe_autosave_enable(uint32_t quiet_msec, uint32_t interval_sec);
+extern void nsgbe_autosave_disable(); // saves what's left
+extern uint64_t nsgbe_autosave_failures(); // saves that failed so far
+
+/*-------------------FRAME HASHES------------------*/
+
+// for regression and differential testing: at the end of every frame, the core hashes (xxh64) the chosen parts of the
+// machine and hands the hashes to callback, storing nothing. two builds running the same rom and movie have to produce
+// the same sequence; the first frame they disagree on tells where (and, by the part, what) started to go wrong.
+// see nsgbe-bench's --hashes / --check-hashes
+#define NSGBE_HASH_FRAME 0x1 // the frame drawn (0 for frames that aren't, see system_set_runahead())
+#define NSGBE_HASH_RAM   0x2 // vram, wram, oam, io registers, hram and cartridge ram
+#define NSGBE_HASH_CPU   0x4 // cpu registers, interrupt master enable and halt state
+
+struct NSGBE_FRAME_HASH {
+    uint32_t frame;      // frames the ppu has completed so far, including this one
+    uint64_t cycle;      // nsgbe_cycle_count() at the end of the frame
+    uint64_t frame_hash; // 0 for parts that aren't hashed
+    uint64_t ram_hash;
+    uint64_t cpu_hash;
+};
+
+// called on the emulation thread at the end of every frame (frames run ahead are left out); callback may be NULL to
+// only keep nsgbe_frame_hash_last() up to date
+extern void nsgbe_frame_hash_enable(uint32_t parts, void (* callback)(const struct NSGBE_FRAME_HASH *hash, void *user), void *user);
+extern void nsgbe_frame_hash_disable();
+// hashes of the most recent frame; fails while hashing is off or before a frame has completed
+extern int nsgbe_frame_hash_last(struct NSGBE_FRAME_HASH *hash);
+// the hash used for the above, for hashing frames or observations fetched through the rest of the interface.
+// it depends on the host's byte order
+extern uint64_t nsgbe_hash(const void *data, size_t size, uint64_t seed);
+
+/*---------------------SCALING---------------------*/
+
+// pixel art upscaling, so frontends get a frame ready to present rather than drawing every pixel as a rectangle
+#define NSGBE_SCALE_NEAREST 0x0   // nearest neighbour
+#define NSGBE_SCALE_EPX     0x1   // scale2x / scale3x (epx): stays sharp, fills in the steps of diagonals
+#define NSGBE_SCALE_XBR     0x2   // xbr-lite: blends the corners along diagonal edges for smoother lines
+#define NSGBE_SCALE_SWAP_RB 0x100 // or'ed in: red in the third byte, blue in the first (e.g. cairo's RGB24)
+
+// scales frame (GB_FRAMEBUFFER_WIDTH * GB_FRAMEBUFFER_HEIGHT pixels, e.g. from nsgbe_framebuffer()) to fill output,
+// a width * height image whose rows are pitch bytes apart. epx and xbr work at 2x or 3x (3x for multiples of three),
+// any other size is nearest neighbour sampled from that. fails for bad arguments
+extern int nsgbe_scale(const uint32_t *frame, uint32_t *output, uint32_t width, uint32_t height, size_t pitch, uint32_t mode);
+// splits the output into row bands for this many threads, the calling one included (1 to 4, 1 by default)
+extern void nsgbe_scale_set_threads(uint32_t threads);
 
 /*--------------------MISC--------------------*/
 
@@ -104,6 +458,3 @@ struct ROM_HEADER {
     uint8_t header_checksum;
     uint8_t global_checksum[2];
 };
-
-// after rom has been loaded, this is available
-extern struct ROM_HEADER *rom_header;
@@ -0,0 +1,153 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// component profiler (instrumentation builds only, see NSGBE_PROFILING)
+
+// the sections are timed with the cheapest clock around (the time stamp counter on x86) and summed up per frame.
+// at every frame boundary, the sums are converted to nsec by comparing the clock against the host's monotonic one
+
+#include "env.h"
+#include <string.h>
+
+#ifdef NSGBE_PROFILING
+
+static const char *profile_section_names[NSGBE_PROFILE_SECTIONS] = {
+    "io", "cpu", "ppu", "render", "dma", "mem_read", "mem_write"
+};
+
+static void profile_add(struct NSGBE_PROFILE *sum, const struct NSGBE_PROFILE *frame)
+{
+    sum->frames += frame->frames;
+    sum->host_nsec += frame->host_nsec;
+
+    for (uint32_t i = 0; i < NSGBE_PROFILE_SECTIONS; i++)
+    {
+        sum->nsec[i] += frame->nsec[i];
+        sum->calls[i] += frame->calls[i];
+    }
+}
+
+static void profile_print(const struct NSGBE_PROFILE *p)
+{
+    double emulating_nsec = p->nsec[NSGBE_PROFILE_IO] + p->nsec[NSGBE_PROFILE_CPU] + p->nsec[NSGBE_PROFILE_PPU];
+
+    fprintf(stderr, "[profile] %u frames, %.3f ms/frame emulating, %.3f ms/frame wall time\n", p->frames,
+            emulating_nsec / p->frames / 1e6, (double)p->host_nsec / p->frames / 1e6);
+
+    for (uint32_t i = 0; i < NSGBE_PROFILE_SECTIONS; i++)
+        fprintf(stderr, "[profile]   %-10s %8.3f ms/frame %6.1f%% %10.0f calls/frame %8.1f ns/call\n", profile_section_names[i],
+                (double)p->nsec[i] / p->frames / 1e6, (emulating_nsec > 0 ? p->nsec[i] * 100.0 / emulating_nsec : 0.0),
+                (double)p->calls[i] / p->frames, (p->calls[i] ? (double)p->nsec[i] / p->calls[i] : 0.0));
+}
+
+void profile_on_frame()
+{
+    uint64_t now_ticks = profile_now();
+    uint64_t now_nsec = host_nsec();
+
+    // the first frame has no known start, it only serves as reference point
+    if (CTX(profile_calibration_nsec) == 0 || now_ticks <= CTX(profile_calibration_ticks))
+    {
+        CTX(profile_calibration_ticks) = now_ticks;
+        CTX(profile_calibration_nsec) = now_nsec;
+        CTX(profile_frame_start_nsec) = now_nsec;
+
+        CTX(profile_overhead_ticks) = UINT64_MAX;
+
+        for (uint32_t i = 0; i < 1000; i++)
+        {
+            uint64_t begin = profile_now();
+            uint64_t delta = profile_now() - begin;
+
+            if (delta < CTX(profile_overhead_ticks))
+                CTX(profile_overhead_ticks) = delta;
+        }
+
+        memset(CTX(profile_ticks), 0, sizeof(CTX(profile_ticks)));
+        memset(CTX(profile_calls), 0, sizeof(CTX(profile_calls)));
+        return;
+    }
+
+    double nsec_per_tick = (double)(now_nsec - CTX(profile_calibration_nsec)) / (now_ticks - CTX(profile_calibration_ticks));
+
+    struct NSGBE_PROFILE frame;
+    frame.frames = 1;
+    frame.host_nsec = now_nsec - CTX(profile_frame_start_nsec);
+
+    for (uint32_t i = 0; i < NSGBE_PROFILE_SECTIONS; i++)
+    {
+        frame.nsec[i] = CTX(profile_ticks)[i] * nsec_per_tick;
+        frame.calls[i] = CTX(profile_calls)[i];
+    }
+
+    CTX(profile_last_frame) = frame;
+    profile_add(&CTX(profile_totals), &frame);
+    profile_add(&CTX(profile_report), &frame);
+
+    memset(CTX(profile_ticks), 0, sizeof(CTX(profile_ticks)));
+    memset(CTX(profile_calls), 0, sizeof(CTX(profile_calls)));
+    CTX(profile_frame_start_nsec) = now_nsec;
+
+    if (CTX(profile_report_interval) && CTX(profile_report).frames >= CTX(profile_report_interval))
+    {
+        profile_print(&CTX(profile_report));
+        memset(&CTX(profile_report), 0, sizeof(CTX(profile_report)));
+    }
+}
+
+int nsgbe_profile_last_frame(struct NSGBE_PROFILE *profile)
+{
+    if (!profile || CTX(profile_last_frame).frames == 0)
+        return NSGBE_ERR;
+
+    *profile = CTX(profile_last_frame);
+
+    return NSGBE_OK;
+}
+
+int nsgbe_profile_totals(struct NSGBE_PROFILE *profile)
+{
+    if (!profile || CTX(profile_totals).frames == 0)
+        return NSGBE_ERR;
+
+    *profile = CTX(profile_totals);
+
+    return NSGBE_OK;
+}
+
+void nsgbe_profile_reset()
+{
+    memset(&CTX(profile_last_frame), 0, sizeof(CTX(profile_last_frame)));
+    memset(&CTX(profile_totals), 0, sizeof(CTX(profile_totals)));
+    memset(&CTX(profile_report), 0, sizeof(CTX(profile_report)));
+}
+
+void nsgbe_profile_set_report_interval(uint32_t frames)
+{
+    CTX(profile_report_interval) = frames;
+}
+
+#else
+
+int nsgbe_profile_last_frame(struct NSGBE_PROFILE *profile)
+{
+    return NSGBE_ERR;
+}
+
+int nsgbe_profile_totals(struct NSGBE_PROFILE *profile)
+{
+    return NSGBE_ERR;
+}
+
+void nsgbe_profile_reset()
+{
+
+}
+
+void nsgbe_profile_set_report_interval(uint32_t frames)
+{
+
+}
+
+#endif
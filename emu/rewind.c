@@ -0,0 +1,456 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// rewind
+
+// snapshots are kept in a fixed-size ring; a keyframe holds a complete (run-length encoded) state,
+// the entries following it only the run-length encoded xor against their predecessor. the full state
+// of the newest entry is kept around, so stepping back is mostly a matter of xor-ing one delta into it
+
+#include "env.h"
+#include <string.h>
+
+#define REWIND_MIN_ZERO_RUN 4 // a literal run only ends at this many unchanged bytes
+#define REWIND_MIN_ENTRIES  64
+#define REWIND_MAX_ENTRIES  0x10000
+
+struct REWIND_ENTRY {
+    size_t offset; // into arena
+    size_t length;
+    _Bool keyframe;
+};
+
+struct REWIND_BUFFER {
+    // configuration
+    size_t arena_size;
+    uint32_t frame_interval;
+    uint32_t keyframe_interval;
+
+    // working buffers, sized for the loaded rom's state
+    size_t state_size;
+    byte *head_state; // full state of the newest entry
+    byte *capture_state;
+    byte *encoded;
+
+    // snapshot ring
+    byte *arena;
+    size_t arena_write_offset;
+    struct REWIND_ENTRY *entries;
+    uint32_t entry_capacity;
+    uint32_t first_entry;
+    uint32_t entry_count;
+    uint32_t entries_since_keyframe; // deltas following the newest keyframe
+
+    uint32_t last_frame;
+    uint32_t frames_since_capture;
+};
+
+/* encoding */
+
+__always_inline static uint64_t load_64(const byte *src)
+{
+    uint64_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+__always_inline static size_t varint_put(byte *dst, size_t value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80)
+    {
+        dst[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+
+    dst[length++] = value;
+
+    return length;
+}
+
+__always_inline static size_t varint_get(const byte *src, size_t *value)
+{
+    size_t length = 0;
+    uint32_t shift = 0;
+
+    *value = 0;
+
+    do
+    {
+        *value |= (size_t)(src[length] & 0x7F) << shift;
+        shift += 7;
+    } while (src[length++] & 0x80);
+
+    return length;
+}
+
+// worst case: every token covers REWIND_MIN_ZERO_RUN + 1 bytes and carries two varints of up to 5 bytes each
+__always_inline static size_t rle_max_encoded_size(size_t size)
+{
+    return size + (size / (REWIND_MIN_ZERO_RUN + 1) + 1) * 10;
+}
+
+// encodes state (xor base, if given) as alternating runs of zero bytes and literal bytes
+static size_t rle_encode(const byte *state, const byte *base, size_t size, byte *dst)
+{
+    size_t i = 0, length = 0;
+
+#define DELTA(index) (state[index] ^ (base ? base[index] : 0))
+
+    while (i < size)
+    {
+        size_t start = i;
+
+        if (base)
+            while (i + 8 <= size && load_64(state + i) == load_64(base + i))
+                i += 8;
+        else
+            while (i + 8 <= size && load_64(state + i) == 0)
+                i += 8;
+
+        while (i < size && DELTA(i) == 0)
+            i++;
+
+        length += varint_put(dst + length, i - start);
+
+        start = i;
+
+        uint32_t zeros = 0;
+
+        while (i < size && zeros < REWIND_MIN_ZERO_RUN)
+        {
+            zeros = (DELTA(i) == 0 ? zeros + 1 : 0);
+            i++;
+        }
+
+        if (zeros == REWIND_MIN_ZERO_RUN)
+            i -= zeros;
+
+        length += varint_put(dst + length, i - start);
+
+        for (size_t k = start; k < i; k++)
+            dst[length++] = DELTA(k);
+    }
+
+#undef DELTA
+
+    return length;
+}
+
+// decodes into dst; delta entries are xor-ed into it, keyframes replace it
+static void rle_decode(const byte *src, size_t length, byte *dst, _Bool keyframe)
+{
+    size_t i = 0, offset = 0, run;
+
+    while (i < length)
+    {
+        i += varint_get(src + i, &run);
+
+        if (keyframe)
+            memset(dst + offset, 0, run);
+
+        offset += run;
+
+        i += varint_get(src + i, &run);
+
+        if (keyframe)
+            memcpy(dst + offset, src + i, run);
+        else
+            for (size_t k = 0; k < run; k++)
+                dst[offset + k] ^= src[i + k];
+
+        offset += run;
+        i += run;
+    }
+}
+
+/* ring */
+
+__always_inline static struct REWIND_ENTRY *rewind_entry(struct REWIND_BUFFER *rb, uint32_t index)
+{
+    return &rb->entries[(rb->first_entry + index) % rb->entry_capacity];
+}
+
+static void rewind_clear(struct REWIND_BUFFER *rb)
+{
+    rb->first_entry = 0;
+    rb->entry_count = 0;
+    rb->entries_since_keyframe = 0;
+    rb->arena_write_offset = 0;
+    rb->frames_since_capture = 0;
+}
+
+// the oldest group (a keyframe and its deltas) goes all at once, so the ring always starts with a keyframe
+static void rewind_evict_oldest_group(struct REWIND_BUFFER *rb)
+{
+    do
+    {
+        rb->first_entry = (rb->first_entry + 1) % rb->entry_capacity;
+        rb->entry_count--;
+    } while (rb->entry_count > 0 && !rewind_entry(rb, 0)->keyframe);
+}
+
+// finds room for length bytes after the newest entry (or at the start of the arena); returns 0 if there is none
+static _Bool rewind_find_room(struct REWIND_BUFFER *rb, size_t length, size_t *offset)
+{
+    if (rb->entry_count == 0)
+    {
+        *offset = 0;
+        return (length <= rb->arena_size);
+    }
+
+    if (rb->entry_count == rb->entry_capacity)
+        return 0;
+
+    size_t tail = rewind_entry(rb, 0)->offset;
+    size_t head = rb->arena_write_offset;
+
+    if (head > tail)
+    {
+        if (rb->arena_size - head >= length)
+        {
+            *offset = head;
+            return 1;
+        }
+
+        // wrap around; keep head != tail, that's reserved for an empty ring
+        if (length < tail)
+        {
+            *offset = 0;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (head + length < tail)
+    {
+        *offset = head;
+        return 1;
+    }
+
+    return 0;
+}
+
+static _Bool rewind_prepare(struct REWIND_BUFFER *rb, size_t state_size)
+{
+    if (rb->state_size == state_size)
+        return 1;
+
+    free_ptr((void **)&rb->head_state);
+    free_ptr((void **)&rb->capture_state);
+    free_ptr((void **)&rb->encoded);
+
+    rewind_clear(rb);
+    rb->state_size = 0;
+
+    if (state_size == 0)
+        return 0;
+
+    rb->head_state = malloc(state_size);
+    rb->capture_state = malloc(state_size);
+    rb->encoded = malloc(rle_max_encoded_size(state_size));
+
+    if (!rb->head_state || !rb->capture_state || !rb->encoded)
+        return 0;
+
+    rb->state_size = state_size;
+
+    return 1;
+}
+
+static void rewind_capture(struct REWIND_BUFFER *rb)
+{
+    if (!rewind_prepare(rb, nsgbe_state_size()))
+        return;
+
+    if (nsgbe_state_save(rb->capture_state, rb->state_size) == 0)
+        return;
+
+    _Bool keyframe = (rb->entry_count == 0 || rb->entries_since_keyframe + 1 >= rb->keyframe_interval);
+    size_t length = rle_encode(rb->capture_state, (keyframe ? NULL : rb->head_state), rb->state_size, rb->encoded);
+    size_t offset;
+
+    while (!rewind_find_room(rb, length, &offset))
+    {
+        if (rb->entry_count == 0)
+            return; // doesn't even fit into an empty ring
+
+        // a delta can't outlive the group it belongs to; start over with a keyframe instead
+        if (!keyframe && rb->entry_count == rb->entries_since_keyframe + 1)
+        {
+            rewind_clear(rb);
+
+            keyframe = 1;
+            length = rle_encode(rb->capture_state, NULL, rb->state_size, rb->encoded);
+
+            continue;
+        }
+
+        rewind_evict_oldest_group(rb);
+    }
+
+    memcpy(rb->arena + offset, rb->encoded, length);
+
+    struct REWIND_ENTRY *entry = rewind_entry(rb, rb->entry_count++);
+    entry->offset = offset;
+    entry->length = length;
+    entry->keyframe = keyframe;
+
+    rb->arena_write_offset = offset + length;
+    rb->entries_since_keyframe = (keyframe ? 0 : rb->entries_since_keyframe + 1);
+
+    // swap instead of copying, the capture buffer gets overwritten next time anyways
+    byte *head_state = rb->head_state;
+    rb->head_state = rb->capture_state;
+    rb->capture_state = head_state;
+}
+
+// drops the newest entry and turns head_state into the full state of the one before it
+static void rewind_drop_newest(struct REWIND_BUFFER *rb)
+{
+    struct REWIND_ENTRY *entry = rewind_entry(rb, --rb->entry_count);
+
+    if (rb->entry_count == 0)
+    {
+        rewind_clear(rb);
+        return;
+    }
+
+    if (!entry->keyframe)
+    {
+        rle_decode(rb->arena + entry->offset, entry->length, rb->head_state, 0);
+        rb->entries_since_keyframe--;
+
+        rb->arena_write_offset = entry->offset;
+        return;
+    }
+
+    // the previous group has to be rebuilt from its keyframe
+    uint32_t keyframe_index = rb->entry_count - 1;
+
+    while (!rewind_entry(rb, keyframe_index)->keyframe)
+        keyframe_index--;
+
+    for (uint32_t i = keyframe_index; i < rb->entry_count; i++)
+    {
+        struct REWIND_ENTRY *e = rewind_entry(rb, i);
+        rle_decode(rb->arena + e->offset, e->length, rb->head_state, e->keyframe);
+    }
+
+    rb->entries_since_keyframe = rb->entry_count - 1 - keyframe_index;
+    rb->arena_write_offset = entry->offset;
+}
+
+void rewind_buffer_free(struct REWIND_BUFFER *buffer)
+{
+    if (!buffer)
+        return;
+
+    free_ptr((void **)&buffer->head_state);
+    free_ptr((void **)&buffer->capture_state);
+    free_ptr((void **)&buffer->encoded);
+    free_ptr((void **)&buffer->arena);
+    free_ptr((void **)&buffer->entries);
+
+    free(buffer);
+}
+
+// called by the clock whenever it's at an instruction boundary and a frame may have been completed
+void rewind_on_frame()
+{
+    struct REWIND_BUFFER *rb = CTX(rewind_buffer);
+
+    if (rb->last_frame == CTX(ppu_frame_counter))
+        return;
+
+    rb->last_frame = CTX(ppu_frame_counter);
+
+    if (CTX(rewinding))
+    {
+        nsgbe_rewind_step();
+        return;
+    }
+
+    if (++rb->frames_since_capture < rb->frame_interval)
+        return;
+
+    rb->frames_since_capture = 0;
+
+    rewind_capture(rb);
+}
+
+int nsgbe_rewind_enable(size_t budget_bytes, uint32_t frame_interval, uint32_t keyframe_interval)
+{
+    nsgbe_rewind_disable();
+
+    if (budget_bytes == 0)
+        return NSGBE_ERR;
+
+    struct REWIND_BUFFER *rb = calloc(1, sizeof(struct REWIND_BUFFER));
+
+    if (!rb)
+        return NSGBE_ERR;
+
+    // one entry per 512 bytes of budget is plenty, deltas of quiet frames are hardly ever smaller
+    rb->entry_capacity = budget_bytes / 512;
+
+    if (rb->entry_capacity < REWIND_MIN_ENTRIES)
+        rb->entry_capacity = REWIND_MIN_ENTRIES;
+
+    if (rb->entry_capacity > REWIND_MAX_ENTRIES)
+        rb->entry_capacity = REWIND_MAX_ENTRIES;
+
+    rb->arena_size = budget_bytes;
+    rb->arena = malloc(budget_bytes);
+    rb->entries = malloc(rb->entry_capacity * sizeof(struct REWIND_ENTRY));
+    rb->frame_interval = (frame_interval ? frame_interval : 1);
+    rb->keyframe_interval = (keyframe_interval ? keyframe_interval : 1);
+    rb->last_frame = CTX(ppu_frame_counter);
+
+    if (!rb->arena || !rb->entries)
+    {
+        rewind_buffer_free(rb);
+        return NSGBE_ERR;
+    }
+
+    CTX(rewind_buffer) = rb;
+
+    return NSGBE_OK;
+}
+
+void nsgbe_rewind_disable()
+{
+    rewind_buffer_free(CTX(rewind_buffer));
+    CTX(rewind_buffer) = NULL;
+}
+
+int nsgbe_rewind_step()
+{
+    struct REWIND_BUFFER *rb = CTX(rewind_buffer);
+
+    if (!rb || rb->entry_count == 0 || rb->state_size != nsgbe_state_size())
+        return NSGBE_ERR;
+
+    if (!nsgbe_state_load(rb->head_state, rb->state_size))
+        return NSGBE_ERR;
+
+    rewind_drop_newest(rb);
+
+    rb->last_frame = CTX(ppu_frame_counter);
+    rb->frames_since_capture = 0;
+
+    return NSGBE_OK;
+}
+
+uint32_t nsgbe_rewind_length()
+{
+    return (CTX(rewind_buffer) ? CTX(rewind_buffer)->entry_count : 0);
+}
+
+void system_set_rewinding(_Bool enable)
+{
+    CTX(rewinding) = enable;
+}
@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// handing data from the emulation thread over to a background writer
+
+// the producer copies into a preallocated slot and moves on, it never waits: if the ring is full, the data is dropped
+// (and counted). the consumer, a thread of the tracer or the video capture, drains the ring every few milliseconds
+// and hands each slot back as soon as it's done with it
+
+#include "env.h"
+#include <string.h>
+#include <unistd.h>
+
+_Bool ring_init(struct RING *r, size_t slot_size, uint32_t slot_count)
+{
+    memset(r, 0, sizeof(struct RING));
+
+    r->slots = malloc(slot_count * slot_size);
+
+    if (!r->slots)
+        return 0;
+
+    // touch the slots now, so the emulation thread doesn't take the page faults
+    memset(r->slots, 0, slot_count * slot_size);
+
+    r->slot_size = slot_size;
+    r->slot_count = slot_count;
+
+    return 1;
+}
+
+void ring_free(struct RING *r)
+{
+    free_ptr((void **)&r->slots);
+}
+
+uint32_t ring_drain(struct RING *r, void (* consume)(void *slot, void *user), void *user)
+{
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = r->tail;
+    uint32_t count = head - tail;
+
+    for (; tail != head; tail++)
+    {
+        consume(r->slots + (tail & (r->slot_count - 1)) * r->slot_size, user);
+        __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
+
+void ring_drain_until_stopped(struct RING *r, uint32_t (* drain)(void *user), void *user, uint32_t interval_usec)
+{
+    for (;;)
+    {
+        // look at the flag first, so whatever was pushed before it was raised is all drained below
+        _Bool stopping = __atomic_load_n(&r->stopping, __ATOMIC_ACQUIRE);
+
+        if (drain(user) == 0)
+        {
+            if (stopping)
+                break;
+
+            usleep(interval_usec);
+        }
+    }
+}
+
+void ring_stop(struct RING *r)
+{
+    __atomic_store_n(&r->stopping, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t ring_dropped(struct RING *r)
+{
+    return __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,548 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// pixel art scaling for frontends
+
+// nsgbe_scale() works row by row: for every row of the output, the row of the k times scaled image it samples is built
+// from three rows of the frame (k being 1 for nearest neighbour, 2 or 3 for the filters), then stretched to the output
+// width by nearest neighbour. consecutive output rows sampling the same scaled row are copies of the first. the filters
+// look at a pixel and its eight neighbours and work on four pixels at once through the compiler's vector extensions,
+// which become sse / neon / wasm simd instructions where the host has them.
+// the output can be split into row bands for up to SCALE_THREADS_MAX threads, the calling thread being one of them
+
+#include "env.h"
+#include <string.h>
+
+#define SCALE_THREADS_MAX 4
+#define SCALE_LANES       4
+#define SCALE_FACTOR_MAX  3
+#define SCALE_ROW_MAX     (GB_FRAMEBUFFER_WIDTH * SCALE_FACTOR_MAX)
+
+#define SCALE_FILTER_MASK 0xFF
+
+typedef uint32_t scale_vec __attribute__((vector_size(SCALE_LANES * sizeof(uint32_t))));
+
+struct SCALE_JOB {
+    const uint32_t *frame;
+    byte *output;
+    uint32_t width;
+    uint32_t height;
+    size_t pitch;
+    uint32_t filter;
+    uint32_t factor;
+    _Bool swap_rb;
+    const uint16_t *columns; // which pixel of a scaled row each output column samples
+    _Bool stretch;           // output width differs from the scaled row's
+};
+
+struct SCALE_POOL {
+    uint32_t threads; // including the calling thread
+
+#ifndef EMSCRIPTEN
+    pthread_t workers[SCALE_THREADS_MAX];
+    pthread_mutex_t mutex;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+#endif
+    uint64_t generation;
+    uint32_t busy;
+    _Bool stopping;
+
+    struct SCALE_JOB job;
+    uint16_t *columns;
+    uint32_t columns_capacity;
+};
+
+static struct SCALE_POOL scale_pool;
+static uint32_t scale_requested_threads = 1;
+
+#ifndef EMSCRIPTEN
+static pthread_mutex_t scale_call_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*-------------------VECTORS------------------*/
+
+__always_inline static scale_vec scale_load(const uint32_t *pixels)
+{
+    scale_vec v;
+    memcpy(&v, pixels, sizeof(v));
+
+    return v;
+}
+
+__always_inline static scale_vec scale_select(scale_vec mask, scale_vec a, scale_vec b)
+{
+    return (mask & a) | (~mask & b);
+}
+
+__always_inline static scale_vec scale_equal(scale_vec a, scale_vec b)
+{
+    return (scale_vec)(a == b);
+}
+
+__always_inline static scale_vec scale_differ(scale_vec a, scale_vec b)
+{
+    return (scale_vec)(a != b);
+}
+
+// per channel, rounding down
+__always_inline static scale_vec scale_average(scale_vec a, scale_vec b)
+{
+    return (a & b) + (((a ^ b) & 0xFEFEFEFE) >> 1);
+}
+
+// how different two colors look: per channel absolute differences, green weighing the most
+__always_inline static scale_vec scale_distance(scale_vec a, scale_vec b)
+{
+    scale_vec distance = { 0 };
+    const uint32_t weights[3] = { 2, 3, 1 };
+
+    for (uint32_t channel = 0; channel < 3; channel++)
+    {
+        scale_vec x = (a >> (channel * 8)) & 0xFF;
+        scale_vec y = (b >> (channel * 8)) & 0xFF;
+
+        distance += scale_select((scale_vec)(x > y), x - y, y - x) * weights[channel];
+    }
+
+    return distance;
+}
+
+/*-------------------FILTERS------------------*/
+
+// the 3x3 neighbourhood of four pixels:
+// a b c
+// d e f
+// g h i
+struct SCALE_NEIGHBOURS {
+    scale_vec a, b, c, d, e, f, g, h, i;
+};
+
+// rows are padded by a pixel on either side
+__always_inline static void scale_neighbours(struct SCALE_NEIGHBOURS *n, const uint32_t *up, const uint32_t *mid,
+    const uint32_t *down, uint32_t x)
+{
+    n->a = scale_load(up + x - 1);
+    n->b = scale_load(up + x);
+    n->c = scale_load(up + x + 1);
+    n->d = scale_load(mid + x - 1);
+    n->e = scale_load(mid + x);
+    n->f = scale_load(mid + x + 1);
+    n->g = scale_load(down + x - 1);
+    n->h = scale_load(down + x);
+    n->i = scale_load(down + x + 1);
+}
+
+__always_inline static void scale_store(uint32_t *row, uint32_t x, uint32_t factor, uint32_t sub_column, scale_vec v)
+{
+    for (uint32_t lane = 0; lane < SCALE_LANES; lane++)
+        row[(x + lane) * factor + sub_column] = v[lane];
+}
+
+// scale2x / scale3x, see https://www.scale2x.it/algorithm
+static void scale_epx_row(uint32_t *row, const uint32_t *up, const uint32_t *mid, const uint32_t *down, uint32_t factor,
+    uint32_t sub_row)
+{
+    struct SCALE_NEIGHBOURS n;
+
+    for (uint32_t x = 0; x < GB_FRAMEBUFFER_WIDTH; x += SCALE_LANES)
+    {
+        scale_neighbours(&n, up, mid, down, x);
+
+        scale_vec active = scale_differ(n.b, n.h) & scale_differ(n.d, n.f);
+
+        if (factor == 2)
+        {
+            // top: d==b -> d, b==f -> f; bottom: d==h -> d, h==f -> f
+            scale_vec side = (sub_row == 0 ? n.b : n.h);
+
+            scale_store(row, x, 2, 0, scale_select(active & scale_equal(n.d, side), n.d, n.e));
+            scale_store(row, x, 2, 1, scale_select(active & scale_equal(side, n.f), n.f, n.e));
+            continue;
+        }
+
+        scale_vec db = scale_equal(n.d, n.b);
+        scale_vec bf = scale_equal(n.b, n.f);
+        scale_vec dh = scale_equal(n.d, n.h);
+        scale_vec hf = scale_equal(n.h, n.f);
+
+        if (sub_row == 0)
+        {
+            scale_vec top = (db & scale_differ(n.e, n.c)) | (bf & scale_differ(n.e, n.a));
+
+            scale_store(row, x, 3, 0, scale_select(active & db, n.d, n.e));
+            scale_store(row, x, 3, 1, scale_select(active & top, n.b, n.e));
+            scale_store(row, x, 3, 2, scale_select(active & bf, n.f, n.e));
+        }
+        else if (sub_row == 1)
+        {
+            scale_vec left = (db & scale_differ(n.e, n.g)) | (dh & scale_differ(n.e, n.a));
+            scale_vec right = (bf & scale_differ(n.e, n.i)) | (hf & scale_differ(n.e, n.c));
+
+            scale_store(row, x, 3, 0, scale_select(active & left, n.d, n.e));
+            scale_store(row, x, 3, 1, n.e);
+            scale_store(row, x, 3, 2, scale_select(active & right, n.f, n.e));
+        }
+        else
+        {
+            scale_vec bottom = (dh & scale_differ(n.e, n.i)) | (hf & scale_differ(n.e, n.g));
+
+            scale_store(row, x, 3, 0, scale_select(active & dh, n.d, n.e));
+            scale_store(row, x, 3, 1, scale_select(active & bottom, n.h, n.e));
+            scale_store(row, x, 3, 2, scale_select(active & hf, n.f, n.e));
+        }
+    }
+}
+
+// a corner of e borders on side_1 and side_2 and, across it, on diagonal. if the sides are more alike than e and the
+// diagonal, an edge runs through the corner, and it's blended with the side closer to e
+__always_inline static scale_vec scale_xbr_corner(scale_vec e, scale_vec side_1, scale_vec side_2, scale_vec diagonal)
+{
+    scale_vec edge = (scale_vec)(scale_distance(side_1, side_2) * 2 < scale_distance(e, diagonal))
+        & scale_differ(e, side_1) & scale_differ(e, side_2);
+    scale_vec closer = scale_select((scale_vec)(scale_distance(e, side_1) <= scale_distance(e, side_2)), side_1, side_2);
+
+    return scale_select(edge, scale_average(e, closer), e);
+}
+
+// xbr-lite: xbr's edge detection cut down to the 3x3 neighbourhood, only the corners get blended
+static void scale_xbr_row(uint32_t *row, const uint32_t *up, const uint32_t *mid, const uint32_t *down, uint32_t factor,
+    uint32_t sub_row)
+{
+    struct SCALE_NEIGHBOURS n;
+    _Bool top = (sub_row == 0);
+    _Bool bottom = (sub_row == factor - 1);
+
+    for (uint32_t x = 0; x < GB_FRAMEBUFFER_WIDTH; x += SCALE_LANES)
+    {
+        scale_neighbours(&n, up, mid, down, x);
+
+        scale_vec left = n.e;
+        scale_vec right = n.e;
+
+        if (top)
+        {
+            left = scale_xbr_corner(n.e, n.d, n.b, n.a);
+            right = scale_xbr_corner(n.e, n.b, n.f, n.c);
+        }
+        else if (bottom)
+        {
+            left = scale_xbr_corner(n.e, n.d, n.h, n.g);
+            right = scale_xbr_corner(n.e, n.h, n.f, n.i);
+        }
+
+        scale_store(row, x, factor, 0, left);
+
+        if (factor == 3)
+            scale_store(row, x, 3, 1, n.e);
+
+        scale_store(row, x, factor, factor - 1, right);
+    }
+}
+
+/*-------------------ROWS------------------*/
+
+__always_inline static void scale_pad_row(uint32_t *padded, const uint32_t *row)
+{
+    padded[0] = row[0];
+    memcpy(padded + 1, row, GB_FRAMEBUFFER_WIDTH * sizeof(uint32_t));
+    padded[GB_FRAMEBUFFER_WIDTH + 1] = row[GB_FRAMEBUFFER_WIDTH - 1];
+}
+
+// the sub_row-th row of the scaled image for frame row source_y, built in row unless the frame is used unscaled
+static const uint32_t *scale_build_row(const struct SCALE_JOB *job, uint32_t *row, uint32_t source_y, uint32_t sub_row)
+{
+    const uint32_t *frame = job->frame;
+
+    if (job->factor == 1)
+        return frame + source_y * GB_FRAMEBUFFER_WIDTH;
+
+    // the rows above and below, repeating the edges of the frame
+    uint32_t padded[3][GB_FRAMEBUFFER_WIDTH + 2 + SCALE_LANES];
+
+    scale_pad_row(padded[0], frame + (source_y > 0 ? source_y - 1 : 0) * GB_FRAMEBUFFER_WIDTH);
+    scale_pad_row(padded[1], frame + source_y * GB_FRAMEBUFFER_WIDTH);
+    scale_pad_row(padded[2], frame + (source_y < GB_FRAMEBUFFER_HEIGHT - 1 ? source_y + 1 : source_y) * GB_FRAMEBUFFER_WIDTH);
+
+    if (job->filter == NSGBE_SCALE_EPX)
+        scale_epx_row(row, padded[0] + 1, padded[1] + 1, padded[2] + 1, job->factor, sub_row);
+    else
+        scale_xbr_row(row, padded[0] + 1, padded[1] + 1, padded[2] + 1, job->factor, sub_row);
+
+    return row;
+}
+
+__always_inline static uint32_t scale_swap_rb(uint32_t pixel)
+{
+    return (pixel & 0xFF00FF00) | ((pixel & 0xFF) << 16) | ((pixel >> 16) & 0xFF);
+}
+
+static void scale_band(const struct SCALE_JOB *job, uint32_t first_y, uint32_t end_y)
+{
+    uint32_t scaled_height = GB_FRAMEBUFFER_HEIGHT * job->factor;
+    uint32_t scaled_width = GB_FRAMEBUFFER_WIDTH * job->factor;
+    uint32_t buffer[SCALE_ROW_MAX];
+    const uint32_t *previous = NULL;
+    uint32_t previous_y = UINT32_MAX;
+
+    for (uint32_t y = first_y; y < end_y; y++)
+    {
+        uint32_t scaled_y = (uint32_t)((uint64_t)y * scaled_height / job->height);
+        uint32_t *output = (uint32_t *)(job->output + y * job->pitch);
+
+        // a row repeated to fill the height is copied over from the output row before it
+        if (scaled_y == previous_y)
+        {
+            memcpy(output, previous, job->width * sizeof(uint32_t));
+            continue;
+        }
+
+        const uint32_t *row = scale_build_row(job, buffer, scaled_y / job->factor, scaled_y % job->factor);
+
+        previous = output;
+        previous_y = scaled_y;
+
+        if (!job->stretch && !job->swap_rb)
+            memcpy(output, row, scaled_width * sizeof(uint32_t));
+        else if (!job->stretch)
+            for (uint32_t x = 0; x < scaled_width; x++)
+                output[x] = scale_swap_rb(row[x]);
+        else if (!job->swap_rb)
+            for (uint32_t x = 0; x < job->width; x++)
+                output[x] = row[job->columns[x]];
+        else
+            for (uint32_t x = 0; x < job->width; x++)
+                output[x] = scale_swap_rb(row[job->columns[x]]);
+    }
+}
+
+__always_inline static void scale_work(uint32_t thread)
+{
+    struct SCALE_POOL *pool = &scale_pool;
+    struct SCALE_JOB *job = &pool->job;
+
+    scale_band(job, job->height * thread / pool->threads, job->height * (thread + 1) / pool->threads);
+}
+
+/*-------------------POOL------------------*/
+
+#ifndef EMSCRIPTEN
+
+static void *scale_worker_thread(void *arg)
+{
+    struct SCALE_POOL *pool = &scale_pool;
+    uint32_t thread = (uint32_t)(uintptr_t)arg;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;)
+    {
+        while (pool->generation == generation && !pool->stopping)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+
+        if (pool->stopping)
+            break;
+
+        generation = pool->generation;
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        scale_work(thread);
+
+        pthread_mutex_lock(&pool->mutex);
+
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+static void scale_pool_stop()
+{
+    struct SCALE_POOL *pool = &scale_pool;
+
+    if (pool->threads > 1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pool->stopping = 1;
+        pthread_cond_broadcast(&pool->start_cond);
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (uint32_t i = 1; i < pool->threads; i++)
+            pthread_join(pool->workers[i], NULL);
+
+        pthread_cond_destroy(&pool->start_cond);
+        pthread_cond_destroy(&pool->done_cond);
+        pthread_mutex_destroy(&pool->mutex);
+    }
+
+    pool->threads = 0;
+    pool->generation = 0;
+    pool->stopping = 0;
+}
+
+static void scale_pool_start()
+{
+    struct SCALE_POOL *pool = &scale_pool;
+
+    pool->threads = 1;
+
+    if (scale_requested_threads <= 1)
+        return;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    // a pool short of threads still works, just with fewer of them
+    for (uint32_t i = 1; i < scale_requested_threads; i++)
+    {
+        if (pthread_create(&pool->workers[i], NULL, scale_worker_thread, (void *)(uintptr_t)i) != 0)
+            break;
+
+        pool->threads++;
+    }
+}
+
+static void scale_run()
+{
+    struct SCALE_POOL *pool = &scale_pool;
+
+    if (pool->threads > 1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        pool->busy = pool->threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->start_cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    scale_work(0);
+
+    if (pool->threads > 1)
+    {
+        pthread_mutex_lock(&pool->mutex);
+
+        while (pool->busy)
+            pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+#else
+
+static void scale_pool_stop()
+{
+    scale_pool.threads = 0;
+}
+
+static void scale_pool_start()
+{
+    scale_pool.threads = 1;
+}
+
+static void scale_run()
+{
+    scale_work(0);
+}
+
+#endif
+
+/*-------------------API------------------*/
+
+void nsgbe_scale_set_threads(uint32_t threads)
+{
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&scale_call_mtx);
+#endif
+
+    scale_requested_threads = (threads < 1 ? 1 : (threads > SCALE_THREADS_MAX ? SCALE_THREADS_MAX : threads));
+    scale_pool_stop();
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_unlock(&scale_call_mtx);
+#endif
+}
+
+static int scale_prepare(const uint32_t *frame, uint32_t *output, uint32_t width, uint32_t height, size_t pitch,
+    uint32_t mode)
+{
+    struct SCALE_POOL *pool = &scale_pool;
+    struct SCALE_JOB *job = &pool->job;
+    uint32_t filter = mode & SCALE_FILTER_MASK;
+
+    if (!frame || !output || width == 0 || height == 0 || pitch < width * sizeof(uint32_t) || filter > NSGBE_SCALE_XBR)
+        return NSGBE_ERR;
+
+    // the filters work at 2x or 3x, whichever divides the output's integer scale; below 2x they'd only be sampled away
+    uint32_t scale = (width / GB_FRAMEBUFFER_WIDTH < height / GB_FRAMEBUFFER_HEIGHT ? width / GB_FRAMEBUFFER_WIDTH
+        : height / GB_FRAMEBUFFER_HEIGHT);
+    uint32_t factor = 1;
+
+    if (filter != NSGBE_SCALE_NEAREST && scale >= 2)
+        factor = (scale % 3 == 0 ? 3 : 2);
+
+    uint32_t scaled_width = GB_FRAMEBUFFER_WIDTH * factor;
+
+    *job = (struct SCALE_JOB) {
+        .frame = frame,
+        .output = (byte *)output,
+        .width = width,
+        .height = height,
+        .pitch = pitch,
+        .filter = filter,
+        .factor = factor,
+        .swap_rb = (mode & NSGBE_SCALE_SWAP_RB) != 0,
+        .stretch = (width != scaled_width)
+    };
+
+    if (job->stretch)
+    {
+        if (pool->columns_capacity < width)
+        {
+            uint16_t *grown = realloc(pool->columns, width * sizeof(uint16_t));
+
+            if (!grown)
+                return NSGBE_ERR;
+
+            pool->columns = grown;
+            pool->columns_capacity = width;
+        }
+
+        for (uint32_t x = 0; x < width; x++)
+            pool->columns[x] = (uint16_t)((uint64_t)x * scaled_width / width);
+
+        job->columns = pool->columns;
+    }
+
+    return NSGBE_OK;
+}
+
+int nsgbe_scale(const uint32_t *frame, uint32_t *output, uint32_t width, uint32_t height, size_t pitch, uint32_t mode)
+{
+#ifndef EMSCRIPTEN
+    pthread_mutex_lock(&scale_call_mtx);
+#endif
+
+    int result = scale_prepare(frame, output, width, height, pitch, mode);
+
+    if (result)
+    {
+        if (scale_pool.threads == 0)
+            scale_pool_start();
+
+        scale_run();
+    }
+
+#ifndef EMSCRIPTEN
+    pthread_mutex_unlock(&scale_call_mtx);
+#endif
+
+    return result;
+}
@@ -0,0 +1,262 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// save states
+
+#include "env.h"
+#include <string.h>
+
+#define STATE_MAGIC   "NSST"
+#define STATE_VERSION 3
+
+// the state is a header followed by the fields listed below (in order, host byte order, no padding),
+// the writable half of the address space (0x8000 - 0xFFFF), the cgb vram/wram banks and all ext ram banks;
+// bump STATE_VERSION whenever any of this changes
+struct __attribute__((packed)) STATE_HEADER {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t size; // including header
+    // identifies the rom the state belongs to
+    uint8_t cartridge_type;
+    uint8_t header_checksum;
+    uint8_t global_checksum[2];
+    uint16_t rom_banks_total;
+    uint16_t ext_ram_banks_total;
+};
+
+// machine state outside of memory; host settings (speed, pacing) and framebuffers aren't part of it
+#define STATE_FIELDS \
+    /* system */ \
+    STATE_FIELD(CTX(gb_mode)) \
+    /* clock */ \
+    STATE_FIELD(CTX(cpu_clock_cycles_behind)) \
+    STATE_FIELD(CTX(ppu_clock_cycles_behind)) \
+    /* cpu */ \
+    STATE_FIELD(CTX(cpu_regs)) \
+    STATE_FIELD(CTX(cpu_alive)) \
+    STATE_FIELD(CTX(cpu_int_halt)) \
+    STATE_FIELD(CTX(cpu_dma_halt)) \
+    STATE_FIELD(CTX(interrupt_master_enable)) \
+    STATE_FIELD(CTX(clock_cycle_counter)) \
+    STATE_FIELD(CTX(global_cycle_counter)) \
+    /* memory */ \
+    STATE_FIELD(CTX(enable_bootrom)) \
+    /* io */ \
+    STATE_FIELD(CTX(unencoded_button_state)) \
+    STATE_FIELD(CTX(dma_byte)) \
+    STATE_FIELD(CTX(oam_dma_timer)) \
+    STATE_FIELD(CTX(divider_counter)) \
+    STATE_FIELD(CTX(timer_counter)) \
+    STATE_FIELD(CTX(vram_dma_timer)) \
+    STATE_FIELD(CTX(vram_dma_length)) \
+    STATE_FIELD(CTX(active_dma_is_hblank)) \
+    STATE_FIELD(CTX(vram_dma_hblank_timer)) \
+    STATE_FIELD(CTX(did_transfer_during_current_hblank)) \
+    STATE_FIELD(CTX(cgb_dma_source)) \
+    STATE_FIELD(CTX(cgb_dma_destination)) \
+    STATE_FIELD(CTX(emulated_cycles)) \
+    /* ext_chip */ \
+    STATE_FIELD(CTX(active_rom_bank)) \
+    STATE_FIELD(CTX(active_ext_ram_bank)) \
+    STATE_FIELD(CTX(ext_ram_enabled)) \
+    /* mbc3 */ \
+    STATE_FIELD(CTX(rtc_dh)) \
+    STATE_FIELD(CTX(rtc_reg_selected)) \
+    STATE_FIELD(CTX(selected_rtc_reg)) \
+    STATE_FIELD(CTX(latching)) \
+    STATE_FIELD(CTX(initial_tv_seconds)) \
+    STATE_FIELD(CTX(time_elapsed)) \
+    /* display/ppu */ \
+    STATE_FIELD(CTX(ppu_alive)) \
+    STATE_FIELD(CTX(ppu_clock_cycle_counter)) \
+    STATE_FIELD(CTX(ppu_exec_cycle_counter)) \
+    STATE_FIELD(CTX(ppu_frame_counter)) \
+    STATE_FIELD(CTX(window_internal_line_counter)) \
+    STATE_FIELD(CTX(rgb_bg_color_palettes)) \
+    STATE_FIELD(CTX(rgb_obj_color_palettes)) \
+    STATE_FIELD(CTX(adjusted_bg_color_palettes_r)) \
+    STATE_FIELD(CTX(adjusted_bg_color_palettes_g)) \
+    STATE_FIELD(CTX(adjusted_bg_color_palettes_b)) \
+    STATE_FIELD(CTX(adjusted_obj_color_palettes_r)) \
+    STATE_FIELD(CTX(adjusted_obj_color_palettes_g)) \
+    STATE_FIELD(CTX(adjusted_obj_color_palettes_b))
+
+#define STATE_FIELD(field) + sizeof(field)
+#define STATE_FIELDS_SIZE (0 STATE_FIELDS)
+
+#define STATE_MEM_OFFSET 0x8000
+#define STATE_MEM_SIZE   (sizeof(CTX(mem).raw) - STATE_MEM_OFFSET)
+
+__always_inline static byte *state_put(byte *cursor, const void *src, size_t size)
+{
+    memcpy(cursor, src, size);
+    return cursor + size;
+}
+
+__always_inline static const byte *state_get(const byte *cursor, void *dst, size_t size)
+{
+    memcpy(dst, cursor, size);
+    return cursor + size;
+}
+
+static void state_fill_header(struct STATE_HEADER *header)
+{
+    memcpy(header->magic, STATE_MAGIC, sizeof(header->magic));
+    header->version = STATE_VERSION;
+    header->header_size = sizeof(struct STATE_HEADER);
+    header->size = nsgbe_state_size();
+    header->cartridge_type = CTX(rom_header)->cartridge_type;
+    header->header_checksum = CTX(rom_header)->header_checksum;
+    header->global_checksum[0] = CTX(rom_header)->global_checksum[0];
+    header->global_checksum[1] = CTX(rom_header)->global_checksum[1];
+    header->rom_banks_total = CTX(rom_bank_count);
+    header->ext_ram_banks_total = CTX(ext_ram_bank_count);
+}
+
+size_t nsgbe_state_size()
+{
+    if (!CTX(rom_header) || !CTX(ext_ram))
+        return 0;
+
+    return sizeof(struct STATE_HEADER)
+        + STATE_FIELDS_SIZE
+        + STATE_MEM_SIZE
+        + sizeof(CTX(cgb_extra_vram_bank))
+        + sizeof(CTX(cgb_extra_wram_banks))
+        + (size_t)CTX(ext_ram_bank_count) * 0x2000;
+}
+
+size_t nsgbe_state_save(uint8_t *buffer, size_t size)
+{
+    size_t state_size = nsgbe_state_size();
+
+    if (!buffer || state_size == 0 || size < state_size)
+        return 0;
+
+    struct STATE_HEADER header;
+    state_fill_header(&header);
+
+    byte *cursor = state_put(buffer, &header, sizeof(header));
+
+#undef STATE_FIELD
+#define STATE_FIELD(field) cursor = state_put(cursor, &(field), sizeof(field));
+    STATE_FIELDS
+
+    cursor = state_put(cursor, CTX(mem).raw + STATE_MEM_OFFSET, STATE_MEM_SIZE);
+    cursor = state_put(cursor, CTX(cgb_extra_vram_bank), sizeof(CTX(cgb_extra_vram_bank)));
+
+    // bank by bank, some of them may be shared with forks (see fork.c)
+    for (uint16_t i = 0; i < 8; i++)
+        cursor = state_put(cursor, CTX(wram_banks)[i], 0x1000);
+
+    for (uint16_t i = 0; i < CTX(ext_ram_bank_count); i++)
+        cursor = state_put(cursor, CTX(ext_ram_banks)[i], 0x2000);
+
+    return state_size;
+}
+
+static int state_load(const uint8_t *buffer, size_t size, _Bool with_ext_ram)
+{
+    size_t state_size = nsgbe_state_size();
+
+    if (!buffer || state_size == 0 || size < state_size)
+        return NSGBE_ERR;
+
+    struct STATE_HEADER header, expected_header;
+    memcpy(&header, buffer, sizeof(header));
+    state_fill_header(&expected_header);
+
+    // refuse states of other versions or roms
+    if (memcmp(&header, &expected_header, sizeof(header)) != 0)
+        return NSGBE_ERR;
+
+    const byte *cursor = buffer + sizeof(header);
+
+    cow_unshare_all(nsgbe_ctx_current);
+
+#undef STATE_FIELD
+#define STATE_FIELD(field) cursor = state_get(cursor, &(field), sizeof(field));
+    STATE_FIELDS
+
+    cursor = state_get(cursor, CTX(mem).raw + STATE_MEM_OFFSET, STATE_MEM_SIZE);
+    cursor = state_get(cursor, CTX(cgb_extra_vram_bank), sizeof(CTX(cgb_extra_vram_bank)));
+    cursor = state_get(cursor, CTX(cgb_extra_wram_banks), sizeof(CTX(cgb_extra_wram_banks)));
+
+    if (with_ext_ram)
+    {
+        cursor = state_get(cursor, CTX(ext_ram), (size_t)CTX(ext_ram_bank_count) * 0x2000);
+        CTX(ext_ram_dirty) = 1;
+    }
+
+    if (CTX(movie))
+        movie_on_state_loaded();
+
+    return NSGBE_OK;
+}
+
+int nsgbe_state_load(const uint8_t *buffer, size_t size)
+{
+    return state_load(buffer, size, 1);
+}
+
+// for rolling back frames that left cart ram untouched, see clock_run_ahead()
+int state_load_machine(const uint8_t *buffer, size_t size)
+{
+    return state_load(buffer, size, 0);
+}
+
+int nsgbe_state_save_file(const char *path)
+{
+    size_t state_size = nsgbe_state_size();
+
+    if (!path || state_size == 0)
+        return NSGBE_ERR;
+
+    uint8_t *buffer = malloc(state_size);
+
+    if (!buffer)
+        return NSGBE_ERR;
+
+    int result = NSGBE_ERR;
+    FILE *file = NULL;
+
+    if (nsgbe_state_save(buffer, state_size) == state_size && (file = fopen(path, "wb")))
+    {
+        if (fwrite(buffer, 1, state_size, file) == state_size)
+            result = NSGBE_OK;
+
+        if (fclose(file) != 0)
+            result = NSGBE_ERR;
+    }
+
+    free(buffer);
+
+    return result;
+}
+
+int nsgbe_state_load_file(const char *path)
+{
+    size_t state_size = nsgbe_state_size();
+
+    if (!path || state_size == 0)
+        return NSGBE_ERR;
+
+    FILE *file = fopen(path, "rb");
+
+    if (!file)
+        return NSGBE_ERR;
+
+    uint8_t *buffer = malloc(state_size);
+    int result = NSGBE_ERR;
+
+    // read one byte more than expected to catch oversized files
+    if (buffer && fread(buffer, 1, state_size, file) == state_size && fgetc(file) == EOF)
+        result = nsgbe_state_load(buffer, state_size);
+
+    free(buffer);
+    fclose(file);
+
+    return result;
+}
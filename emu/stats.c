@@ -0,0 +1,114 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// live statistics
+
+// the emulation thread publishes its numbers through a sequence lock: it makes stats_sequence odd, updates the fields
+// and makes it even again; readers copy the fields and retry if the sequence was odd or has changed in the meantime.
+// the presentation counters are bumped by whichever thread fetches frames, so they're plain atomics instead.
+// the reading side is nsgbe_ctx_stats() in context.c
+
+#include "env.h"
+
+#define STATS_WINDOW_NSEC 500000000ULL // rates are averaged over (at least) this long
+
+static const uint64_t stats_overshoot_bounds_nsec[NSGBE_STATS_OVERSHOOT_BUCKETS - 1] = {
+    50000, 100000, 250000, 500000, 1000000, 2000000, 5000000
+};
+
+__always_inline static void stats_write_begin()
+{
+    __atomic_store_n(&CTX(stats_sequence), CTX(stats_sequence) + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+__always_inline static void stats_write_end()
+{
+    __atomic_store_n(&CTX(stats_sequence), CTX(stats_sequence) + 1, __ATOMIC_RELEASE);
+}
+
+void stats_on_frame()
+{
+    uint64_t now = host_nsec();
+
+    stats_write_begin();
+
+    CTX(stats_published).frames_emulated++;
+
+    if (CTX(stats_last_frame_nsec))
+    {
+        float frame_usec = (now - CTX(stats_last_frame_nsec)) / 1000.f;
+
+        CTX(stats_published).frame_host_usec = frame_usec;
+        CTX(stats_window_frame_usec_sum) += frame_usec;
+
+        if (frame_usec > CTX(stats_window_frame_usec_max))
+            CTX(stats_window_frame_usec_max) = frame_usec;
+    }
+
+    CTX(stats_last_frame_nsec) = now;
+
+    if (CTX(stats_window_start_nsec) == 0)
+    {
+        CTX(stats_window_start_nsec) = now;
+        CTX(stats_window_frames) = CTX(stats_published).frames_emulated;
+        CTX(stats_window_presented) = __atomic_load_n(&CTX(stats_frames_presented), __ATOMIC_RELAXED);
+        CTX(stats_window_instructions) = CTX(instruction_counter);
+        CTX(stats_window_frame_usec_sum) = 0;
+        CTX(stats_window_frame_usec_max) = 0;
+    }
+    else if (now - CTX(stats_window_start_nsec) >= STATS_WINDOW_NSEC)
+    {
+        double seconds = (now - CTX(stats_window_start_nsec)) / 1e9;
+        uint64_t frames = CTX(stats_published).frames_emulated - CTX(stats_window_frames);
+        uint64_t presented = __atomic_load_n(&CTX(stats_frames_presented), __ATOMIC_RELAXED);
+
+        CTX(stats_published).emulated_fps = frames / seconds;
+        CTX(stats_published).presented_fps = (presented - CTX(stats_window_presented)) / seconds;
+        CTX(stats_published).instructions_per_second = (CTX(instruction_counter) - CTX(stats_window_instructions)) / seconds;
+        CTX(stats_published).frame_host_usec_avg = CTX(stats_window_frame_usec_sum) / frames;
+        CTX(stats_published).frame_host_usec_max = CTX(stats_window_frame_usec_max);
+
+        CTX(stats_window_start_nsec) = now;
+        CTX(stats_window_frames) = CTX(stats_published).frames_emulated;
+        CTX(stats_window_presented) = presented;
+        CTX(stats_window_instructions) = CTX(instruction_counter);
+        CTX(stats_window_frame_usec_sum) = 0;
+        CTX(stats_window_frame_usec_max) = 0;
+    }
+
+    stats_write_end();
+}
+
+void stats_on_frame_dropped()
+{
+    stats_write_begin();
+    CTX(stats_published).frames_dropped++;
+    stats_write_end();
+}
+
+void stats_on_sleep(uint64_t overshoot_nsec)
+{
+    uint32_t bucket = 0;
+
+    while (bucket < NSGBE_STATS_OVERSHOOT_BUCKETS - 1 && overshoot_nsec >= stats_overshoot_bounds_nsec[bucket])
+        bucket++;
+
+    stats_write_begin();
+    CTX(stats_published).sleep_overshoot[bucket]++;
+    stats_write_end();
+}
+
+void stats_on_present(_Bool new_frame)
+{
+    __atomic_fetch_add(&CTX(stats_frames_presented), 1, __ATOMIC_RELAXED);
+
+    if (!new_frame)
+        __atomic_fetch_add(&CTX(stats_frames_duplicated), 1, __ATOMIC_RELAXED);
+}
+
+void nsgbe_stats(struct NSGBE_STATS *stats)
+{
+    nsgbe_ctx_stats(nsgbe_ctx_current, stats);
+}
@@ -0,0 +1,292 @@
+// SPDX-FileCopyrightText: 2021 Noeliel <noelieldev@gmail.com>
+//
+// SPDX-License-Identifier: LGPL-2.0-only
+
+// timeline tracing in the chrome trace event format (chrome://tracing, ui.perfetto.dev)
+
+// the emulation thread stamps events into a ring (see ring.c), which a background thread drains every few
+// milliseconds, turning the events into json and writing them out. the file uses the json array format, which the viewers accept even if the closing bracket is missing,
+// so a trace stays readable if the program gets killed
+
+#include "env.h"
+
+#define TRACE_RING_SIZE           0x10000 // events, power of two
+#define TRACE_FLUSH_INTERVAL_USEC 10000
+
+// one track (thread, in trace event terms) per kind of activity
+enum TRACE_TRACK {
+    TRACE_TRACK_FRAMES = 1,
+    TRACE_TRACK_PPU,
+    TRACE_TRACK_CPU,
+    TRACE_TRACK_OAM_DMA,
+    TRACE_TRACK_VRAM_DMA,
+    TRACE_TRACK_MBC,
+    TRACE_TRACK_HOST
+};
+
+struct TRACE_EVENT {
+    uint64_t nsec;      // host time
+    uint64_t cycle;     // emulated_cycles
+    uint32_t type;      // enum TRACE_EVENT_TYPE
+    uint32_t arg;
+};
+
+struct TRACE {
+    struct RING ring;   // of struct TRACE_EVENT
+    FILE *file;
+
+#ifndef EMSCRIPTEN
+    pthread_t thread;
+#endif
+
+    // flush thread state
+    uint64_t start_nsec;
+    uint64_t dropped_reported;
+    _Bool frame_started;
+    struct TRACE_EVENT frame_start;
+    _Bool mode_started;
+    struct TRACE_EVENT mode_start;
+};
+
+#ifndef EMSCRIPTEN
+
+static const char *trace_mode_names[4] = { "hblank", "vblank", "oam scan", "drawing" };
+static const char *trace_dma_names[3] = { "oam dma", "vram dma", "hblank dma" };
+
+void trace_event(enum TRACE_EVENT_TYPE type, uint32_t arg)
+{
+    // frames run ahead get rolled back, emulated_cycles along with them
+    if (CTX(running_ahead))
+        return;
+
+    struct RING *ring = &CTX(trace)->ring;
+    struct TRACE_EVENT *e = ring_slot(ring);
+
+    if (!e)
+        return;
+
+    e->nsec = host_nsec();
+    e->cycle = CTX(emulated_cycles);
+    e->type = type;
+    e->arg = arg;
+
+    ring_push(ring);
+}
+
+/*-------------------FLUSH THREAD------------------*/
+
+__always_inline static double trace_usec(const struct TRACE *t, uint64_t nsec)
+{
+    return (nsec > t->start_nsec ? (nsec - t->start_nsec) / 1000.0 : 0.0);
+}
+
+static void trace_write_span(struct TRACE *t, enum TRACE_TRACK track, const char *name, const struct TRACE_EVENT *start,
+                             const struct TRACE_EVENT *end, const char *args)
+{
+    fprintf(t->file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{%s}},\n",
+            name, track, trace_usec(t, start->nsec), (end->nsec - start->nsec) / 1000.0, args);
+}
+
+static void trace_write_event(void *slot, void *user)
+{
+    struct TRACE *t = user;
+    const struct TRACE_EVENT *e = slot;
+    char args[96];
+    double ts = trace_usec(t, e->nsec);
+
+    switch (e->type)
+    {
+        case TRACE_FRAME:
+            if (t->frame_started)
+            {
+                snprintf(args, sizeof(args), "\"frame\":%u,\"cycles\":%llu", t->frame_start.arg,
+                         (unsigned long long)(e->cycle - t->frame_start.cycle));
+                trace_write_span(t, TRACE_TRACK_FRAMES, "frame", &t->frame_start, e, args);
+            }
+
+            t->frame_start = *e;
+            t->frame_started = 1;
+            break;
+
+        case TRACE_PPU_MODE:
+            if (t->mode_started)
+            {
+                snprintf(args, sizeof(args), "\"cycles\":%llu", (unsigned long long)(e->cycle - t->mode_start.cycle));
+                trace_write_span(t, TRACE_TRACK_PPU, trace_mode_names[t->mode_start.arg & 3], &t->mode_start, e, args);
+            }
+
+            t->mode_start = *e;
+            t->mode_started = 1;
+            break;
+
+        case TRACE_INTERRUPT:
+            fprintf(t->file, "{\"name\":\"interrupt $%04X\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                    "\"args\":{\"cycle\":%llu}},\n", e->arg, TRACE_TRACK_CPU, ts, (unsigned long long)e->cycle);
+            break;
+
+        case TRACE_DMA_BEGIN:
+        case TRACE_DMA_END:
+            fprintf(t->file, "{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f},\n",
+                    trace_dma_names[e->arg % 3], (e->type == TRACE_DMA_BEGIN ? 'B' : 'E'),
+                    (e->arg == TRACE_DMA_OAM ? TRACE_TRACK_OAM_DMA : TRACE_TRACK_VRAM_DMA), ts);
+            break;
+
+        case TRACE_ROM_BANK:
+        case TRACE_RAM_BANK:
+            fprintf(t->file, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"bank\":%u}},\n",
+                    (e->type == TRACE_ROM_BANK ? "rom bank" : "ram bank"), TRACE_TRACK_MBC, ts, e->arg);
+            break;
+
+        case TRACE_SLEEP_BEGIN:
+        case TRACE_SLEEP_END:
+            fprintf(t->file, "{\"name\":\"sleep\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f},\n",
+                    (e->type == TRACE_SLEEP_BEGIN ? 'B' : 'E'), TRACE_TRACK_HOST, ts);
+            break;
+    }
+}
+
+static void trace_write_header(struct TRACE *t)
+{
+    static const char *track_names[] = { NULL, "frames", "ppu", "cpu", "oam dma", "vram dma", "mbc", "host" };
+
+    fprintf(t->file, "[\n");
+    fprintf(t->file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"nsgbe\"}},\n");
+
+    for (uint32_t i = TRACE_TRACK_FRAMES; i <= TRACE_TRACK_HOST; i++)
+    {
+        fprintf(t->file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n", i, track_names[i]);
+        fprintf(t->file, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"sort_index\":%u}},\n", i, i);
+    }
+}
+
+// returns the number of events written
+static uint32_t trace_drain(void *user)
+{
+    struct TRACE *t = user;
+    uint32_t count = ring_drain(&t->ring, trace_write_event, t);
+    uint64_t dropped = ring_dropped(&t->ring);
+
+    if (dropped != t->dropped_reported)
+    {
+        fprintf(t->file, "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                "\"args\":{\"total\":%llu}},\n", TRACE_TRACK_HOST, trace_usec(t, host_nsec()), (unsigned long long)dropped);
+        t->dropped_reported = dropped;
+    }
+
+    if (count)
+        fflush(t->file);
+
+    return count;
+}
+
+static void *trace_flush_thread(void *arg)
+{
+    ring_drain_until_stopped(&((struct TRACE *)arg)->ring, trace_drain, arg, TRACE_FLUSH_INTERVAL_USEC);
+
+    return NULL;
+}
+
+void trace_free(struct TRACE *t)
+{
+    if (!t)
+        return;
+
+    if (t->file)
+    {
+        ring_stop(&t->ring);
+        pthread_join(t->thread, NULL);
+
+        // the last metadata event has no trailing comma, closing the array
+        fprintf(t->file, "{\"name\":\"trace_end\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                "\"args\":{\"dropped\":%llu}}\n]\n", TRACE_TRACK_HOST, trace_usec(t, host_nsec()),
+                (unsigned long long)ring_dropped(&t->ring));
+        fclose(t->file);
+    }
+
+    ring_free(&t->ring);
+    free(t);
+}
+
+int nsgbe_trace_start(const char *path)
+{
+    nsgbe_trace_stop();
+
+    if (!path)
+        return NSGBE_ERR;
+
+    struct TRACE *t = calloc(1, sizeof(struct TRACE));
+
+    if (!t)
+        return NSGBE_ERR;
+
+    if (!ring_init(&t->ring, sizeof(struct TRACE_EVENT), TRACE_RING_SIZE))
+    {
+        trace_free(t);
+        return NSGBE_ERR;
+    }
+
+    t->file = fopen(path, "w");
+
+    if (!t->file)
+    {
+        trace_free(t);
+        return NSGBE_ERR;
+    }
+
+    t->start_nsec = host_nsec();
+    trace_write_header(t);
+
+    if (pthread_create(&t->thread, NULL, trace_flush_thread, t) != 0)
+    {
+        fclose(t->file);
+        t->file = NULL;
+        trace_free(t);
+        return NSGBE_ERR;
+    }
+
+    CTX(trace) = t;
+
+    return NSGBE_OK;
+}
+
+void nsgbe_trace_stop()
+{
+    struct TRACE *t = CTX(trace);
+
+    CTX(trace) = NULL;
+    trace_free(t);
+}
+
+uint64_t nsgbe_trace_dropped()
+{
+    return (CTX(trace) ? ring_dropped(&CTX(trace)->ring) : 0);
+}
+
+#else
+
+void trace_event(enum TRACE_EVENT_TYPE type, uint32_t arg)
+{
+
+}
+
+void trace_free(struct TRACE *t)
+{
+
+}
+
+int nsgbe_trace_start(const char *path)
+{
+    return NSGBE_ERR;
+}
+
+void nsgbe_trace_stop()
+{
+
+}
+
+uint64_t nsgbe_trace_dropped()
+{
+    return 0;
+}
+
+#endif